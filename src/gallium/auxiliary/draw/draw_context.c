@@ -206,6 +206,19 @@ void draw_flush( struct draw_context *draw )
 }
 
 
+/**
+ * Wait until the vertex shaders which proved hot so far run their
+ * optimized code.  Used by benchmarks, so as not to time the compilation.
+ */
+void draw_finish_shader_compiles( struct draw_context *draw )
+{
+#ifdef HAVE_LLVM
+   if (draw->llvm)
+      draw_llvm_finish_compiles( draw->llvm );
+#endif
+}
+
+
 /**
  * Specify the Minimum Resolvable Depth factor for polygon offset.
  * This factor potentially depends on the number of Z buffer bits,
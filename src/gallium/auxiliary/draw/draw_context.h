@@ -49,6 +49,12 @@ struct draw_geometry_shader;
 struct draw_fragment_shader;
 struct tgsi_sampler;
 
+/**
+ * Default for DRAW_HOT_VERTICES, the number of vertices an LLVM vertex
+ * shader variant shades before its optimized code is compiled.
+ */
+#define DRAW_DEFAULT_HOT_VERTICES (16 * 1024)
+
 /*
  * structure to contain driver internal information 
  * for stream out support. mapping stores the pointer
@@ -70,6 +76,8 @@ void draw_destroy( struct draw_context *draw );
 
 void draw_flush(struct draw_context *draw);
 
+void draw_finish_shader_compiles(struct draw_context *draw);
+
 void draw_set_viewport_state( struct draw_context *draw,
                               const struct pipe_viewport_state *viewport );
 
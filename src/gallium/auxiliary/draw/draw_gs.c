@@ -29,6 +29,9 @@
 
 #include "draw_private.h"
 #include "draw_context.h"
+#ifdef HAVE_LLVM
+#include "draw_llvm.h"
+#endif
 
 #include "tgsi/tgsi_parse.h"
 #include "tgsi/tgsi_exec.h"
@@ -82,88 +85,11 @@ draw_gs_set_constants(struct draw_context *draw,
 }
 
 
-struct draw_geometry_shader *
-draw_create_geometry_shader(struct draw_context *draw,
-                            const struct pipe_shader_state *state)
-{
-   struct draw_geometry_shader *gs;
-   int i;
-
-   gs = CALLOC_STRUCT(draw_geometry_shader);
-
-   if (!gs)
-      return NULL;
-
-   gs->draw = draw;
-   gs->state = *state;
-   gs->state.tokens = tgsi_dup_tokens(state->tokens);
-   if (!gs->state.tokens) {
-      FREE(gs);
-      return NULL;
-   }
-
-   tgsi_scan_shader(state->tokens, &gs->info);
-
-   /* setup the defaults */
-   gs->input_primitive = PIPE_PRIM_TRIANGLES;
-   gs->output_primitive = PIPE_PRIM_TRIANGLE_STRIP;
-   gs->max_output_vertices = 32;
-
-   for (i = 0; i < gs->info.num_properties; ++i) {
-      if (gs->info.properties[i].name ==
-          TGSI_PROPERTY_GS_INPUT_PRIM)
-         gs->input_primitive = gs->info.properties[i].data[0];
-      else if (gs->info.properties[i].name ==
-               TGSI_PROPERTY_GS_OUTPUT_PRIM)
-         gs->output_primitive = gs->info.properties[i].data[0];
-      else if (gs->info.properties[i].name ==
-               TGSI_PROPERTY_GS_MAX_OUTPUT_VERTICES)
-         gs->max_output_vertices = gs->info.properties[i].data[0];
-   }
-
-   gs->machine = draw->gs.tgsi.machine;
-
-   if (gs)
-   {
-      uint i;
-      for (i = 0; i < gs->info.num_outputs; i++) {
-         if (gs->info.output_semantic_name[i] == TGSI_SEMANTIC_POSITION &&
-             gs->info.output_semantic_index[i] == 0)
-            gs->position_output = i;
-      }
-   }
-
-   return gs;
-}
-
-void draw_bind_geometry_shader(struct draw_context *draw,
-                               struct draw_geometry_shader *dgs)
-{
-   draw_do_flush(draw, DRAW_FLUSH_STATE_CHANGE);
-
-   if (dgs) {
-      draw->gs.geometry_shader = dgs;
-      draw->gs.num_gs_outputs = dgs->info.num_outputs;
-      draw->gs.position_output = dgs->position_output;
-      draw_geometry_shader_prepare(dgs, draw);
-   }
-   else {
-      draw->gs.geometry_shader = NULL;
-      draw->gs.num_gs_outputs = 0;
-   }
-}
-
-void draw_delete_geometry_shader(struct draw_context *draw,
-                                 struct draw_geometry_shader *dgs)
-{
-   FREE(dgs);
-}
-
 /*#define DEBUG_OUTPUTS 1*/
 static INLINE void
-draw_geometry_fetch_outputs(struct draw_geometry_shader *shader,
-                            int num_primitives,
-                            float (**p_output)[4])
+tgsi_fetch_gs_outputs(struct draw_geometry_shader *shader,
+                      int num_primitives,
+                      float (**p_output)[4])
 {
    struct tgsi_exec_machine *machine = shader->machine;
    unsigned prim_idx, j, slot;
@@ -207,7 +133,7 @@ draw_geometry_fetch_outputs(struct draw_geometry_shader *shader,
 }
 
 /*#define DEBUG_INPUTS 1*/
-static void draw_fetch_gs_input(struct draw_geometry_shader *shader,
+static void tgsi_fetch_gs_input(struct draw_geometry_shader *shader,
                                 unsigned *indices,
                                 unsigned num_vertices,
                                 unsigned prim_idx)
@@ -266,8 +192,8 @@ static void draw_fetch_gs_input(struct draw_geometry_shader *shader,
    }
 }
 
-static void gs_flush(struct draw_geometry_shader *shader,
-                     unsigned input_primitives)
+static void tgsi_gs_run(struct draw_geometry_shader *shader,
+                        unsigned input_primitives)
 {
    unsigned out_prim_count;
    struct tgsi_exec_machine *machine = shader->machine;
@@ -292,8 +218,193 @@ static void gs_flush(struct draw_geometry_shader *shader,
                 shader->emitted_primitives, shader->emitted_vertices,
                 out_prim_count);
 #endif
-   draw_geometry_fetch_outputs(shader, out_prim_count,
-                               &shader->tmp_output);
+   tgsi_fetch_gs_outputs(shader, out_prim_count,
+                         &shader->tmp_output);
+}
+
+
+#ifdef HAVE_LLVM
+
+/**
+ * Transpose the vertices of one input primitive into lane prim_idx of the
+ * SoA input buffer of the JIT-compiled shader.
+ */
+static void
+llvm_fetch_gs_input(struct draw_geometry_shader *shader,
+                    unsigned *indices,
+                    unsigned num_vertices,
+                    unsigned prim_idx)
+{
+   const unsigned num_inputs = shader->info.num_inputs;
+   const unsigned length = shader->vector_length;
+   unsigned input_vertex_stride = shader->input_vertex_stride;
+   unsigned slot, vs_slot, i, chan;
+
+   for (i = 0; i < num_vertices; ++i) {
+      const float (*input)[4] = (const float (*)[4])(
+         (const char *)shader->input + (indices[i] * input_vertex_stride));
+      for (slot = 0, vs_slot = 0; slot < num_inputs; ++slot) {
+         float *dst = shader->llvm_input +
+                      (i * num_inputs + slot) * TGSI_NUM_CHANNELS * length +
+                      prim_idx;
+         if (shader->info.input_semantic_name[slot] == TGSI_SEMANTIC_PRIMID) {
+            for (chan = 0; chan < TGSI_NUM_CHANNELS; ++chan)
+               dst[chan * length] = (float)shader->in_prim_idx;
+         } else {
+            for (chan = 0; chan < TGSI_NUM_CHANNELS; ++chan)
+               dst[chan * length] = input[vs_slot][chan];
+            ++vs_slot;
+         }
+      }
+   }
+}
+
+/**
+ * Run the JIT-compiled shader on the fetched primitives and append what
+ * each of them emitted to the output buffers, in input order.
+ */
+static void
+llvm_gs_run(struct draw_geometry_shader *shader,
+            unsigned input_primitives)
+{
+   const unsigned slots_per_lane = shader->max_output_vertices + 1;
+   const unsigned output_size =
+      shader->info.num_outputs * TGSI_NUM_CHANNELS * sizeof(float);
+   float (*output)[4] = shader->tmp_output;
+   unsigned lane, i;
+
+   shader->llvm_variant->jit_func(&shader->draw->llvm->jit_context,
+                                  shader->llvm_input,
+                                  shader->llvm_output,
+                                  shader->llvm_prim_lengths,
+                                  shader->llvm_emitted_vertices,
+                                  shader->llvm_emitted_prims);
+
+   for (lane = 0; lane < input_primitives; ++lane) {
+      const unsigned first = lane * slots_per_lane;
+      const unsigned num_verts = shader->llvm_emitted_vertices[lane];
+      const unsigned num_prims = shader->llvm_emitted_prims[lane];
+
+      debug_assert(num_verts <= shader->max_output_vertices);
+
+      for (i = 0; i < num_prims; ++i) {
+         shader->primitive_lengths[shader->emitted_primitives + i] =
+            shader->llvm_prim_lengths[first + i];
+      }
+      shader->emitted_primitives += num_prims;
+
+      for (i = 0; i < num_verts; ++i) {
+         const struct vertex_header *vert = (const struct vertex_header *)
+            ((const char *)shader->llvm_output +
+             (first + i) * shader->llvm_output_vertex_size);
+         memcpy(output, vert->data, output_size);
+         output = (float (*)[4])((char *)output + shader->vertex_size);
+      }
+      shader->emitted_vertices += num_verts;
+   }
+
+   shader->tmp_output = output;
+}
+
+/**
+ * The JIT path doesn't support sampling, system values nor indirect
+ * addressing of the inputs and outputs; such shaders are interpreted.
+ */
+static boolean
+llvm_gs_supported(const struct draw_geometry_shader *gs)
+{
+   const struct tgsi_shader_info *info = &gs->info;
+   const unsigned indirect_io = (1 << TGSI_FILE_INPUT) |
+                                (1 << TGSI_FILE_OUTPUT);
+
+   return info->file_max[TGSI_FILE_SAMPLER] < 0 &&
+          info->file_max[TGSI_FILE_SYSTEM_VALUE] < 0 &&
+          !(info->indirect_files & indirect_io);
+}
+
+static void
+llvm_gs_destroy(struct draw_geometry_shader *gs)
+{
+   if (gs->llvm_variant)
+      draw_gs_llvm_destroy_variant(gs->llvm_variant);
+   align_free(gs->llvm_input);
+   FREE(gs->llvm_output);
+   FREE(gs->llvm_prim_lengths);
+   FREE(gs->llvm_emitted_vertices);
+   FREE(gs->llvm_emitted_prims);
+
+   gs->llvm_variant = NULL;
+   gs->llvm_input = NULL;
+   gs->llvm_output = NULL;
+   gs->llvm_prim_lengths = NULL;
+   gs->llvm_emitted_vertices = NULL;
+   gs->llvm_emitted_prims = NULL;
+}
+
+static boolean
+llvm_gs_init(struct draw_geometry_shader *gs)
+{
+   struct draw_context *draw = gs->draw;
+   unsigned length, slots;
+
+   gs->llvm_variant = draw_gs_llvm_create_variant(draw->llvm, gs);
+   if (!gs->llvm_variant)
+      return FALSE;
+
+   length = gs->llvm_variant->vector_length;
+   slots = length * (gs->max_output_vertices + 1);
+
+   gs->llvm_output_vertex_size = sizeof(struct vertex_header) +
+      gs->info.num_outputs * TGSI_NUM_CHANNELS * sizeof(float);
+
+   gs->llvm_input = align_malloc(DRAW_GS_MAX_INPUT_VERTICES *
+                                 MAX2(gs->info.num_inputs, 1) *
+                                 TGSI_NUM_CHANNELS * length * sizeof(float),
+                                 32);
+   gs->llvm_output = MALLOC(slots * gs->llvm_output_vertex_size);
+   gs->llvm_prim_lengths = MALLOC(slots * sizeof(unsigned));
+   gs->llvm_emitted_vertices = MALLOC(length * sizeof(unsigned));
+   gs->llvm_emitted_prims = MALLOC(length * sizeof(unsigned));
+
+   if (!gs->llvm_input || !gs->llvm_output || !gs->llvm_prim_lengths ||
+       !gs->llvm_emitted_vertices || !gs->llvm_emitted_prims) {
+      llvm_gs_destroy(gs);
+      return FALSE;
+   }
+
+   gs->vector_length = length;
+   gs->fetch_inputs = llvm_fetch_gs_input;
+   gs->run = llvm_gs_run;
+
+   return TRUE;
+}
+
+#endif /* HAVE_LLVM */
+
+
+/**
+ * Run the shader on the primitives fetched so far.
+ */
+static void gs_flush(struct draw_geometry_shader *shader)
+{
+   debug_assert(shader->fetched_prim_count > 0 &&
+                shader->fetched_prim_count <= shader->vector_length);
+
+   shader->run(shader, shader->fetched_prim_count);
+   shader->fetched_prim_count = 0;
+}
+
+static void gs_fetch(struct draw_geometry_shader *shader,
+                     unsigned *indices,
+                     unsigned num_vertices)
+{
+   shader->fetch_inputs(shader, indices, num_vertices,
+                        shader->fetched_prim_count);
+   ++shader->in_prim_idx;
+   ++shader->fetched_prim_count;
+
+   if (shader->fetched_prim_count == shader->vector_length)
+      gs_flush(shader);
 }
 
 static void gs_point(struct draw_geometry_shader *shader,
@@ -303,10 +414,7 @@ static void gs_point(struct draw_geometry_shader *shader,
 
    indices[0] = idx;
 
-   draw_fetch_gs_input(shader, indices, 1, 0);
-   ++shader->in_prim_idx;
-
-   gs_flush(shader, 1);
+   gs_fetch(shader, indices, 1);
 }
 
 static void gs_line(struct draw_geometry_shader *shader,
@@ -317,10 +425,7 @@ static void gs_line(struct draw_geometry_shader *shader,
    indices[0] = i0;
    indices[1] = i1;
 
-   draw_fetch_gs_input(shader, indices, 2, 0);
-   ++shader->in_prim_idx;
-
-   gs_flush(shader, 1);
+   gs_fetch(shader, indices, 2);
 }
 
 static void gs_line_adj(struct draw_geometry_shader *shader,
@@ -333,10 +438,7 @@ static void gs_line_adj(struct draw_geometry_shader *shader,
    indices[2] = i2;
    indices[3] = i3;
 
-   draw_fetch_gs_input(shader, indices, 4, 0);
-   ++shader->in_prim_idx;
-
-   gs_flush(shader, 1);
+   gs_fetch(shader, indices, 4);
 }
 
 static void gs_tri(struct draw_geometry_shader *shader,
@@ -348,10 +450,7 @@ static void gs_tri(struct draw_geometry_shader *shader,
    indices[1] = i1;
    indices[2] = i2;
 
-   draw_fetch_gs_input(shader, indices, 3, 0);
-   ++shader->in_prim_idx;
-
-   gs_flush(shader, 1);
+   gs_fetch(shader, indices, 3);
 }
 
 static void gs_tri_adj(struct draw_geometry_shader *shader,
@@ -367,12 +466,99 @@ static void gs_tri_adj(struct draw_geometry_shader *shader,
    indices[4] = i4;
    indices[5] = i5;
 
-   draw_fetch_gs_input(shader, indices, 6, 0);
-   ++shader->in_prim_idx;
+   gs_fetch(shader, indices, 6);
+}
+
+struct draw_geometry_shader *
+draw_create_geometry_shader(struct draw_context *draw,
+                            const struct pipe_shader_state *state)
+{
+   struct draw_geometry_shader *gs;
+   int i;
+
+   gs = CALLOC_STRUCT(draw_geometry_shader);
+
+   if (!gs)
+      return NULL;
+
+   gs->draw = draw;
+   gs->state = *state;
+   gs->state.tokens = tgsi_dup_tokens(state->tokens);
+   if (!gs->state.tokens) {
+      FREE(gs);
+      return NULL;
+   }
+
+   tgsi_scan_shader(state->tokens, &gs->info);
+
+   /* setup the defaults */
+   gs->input_primitive = PIPE_PRIM_TRIANGLES;
+   gs->output_primitive = PIPE_PRIM_TRIANGLE_STRIP;
+   gs->max_output_vertices = 32;
+
+   for (i = 0; i < gs->info.num_properties; ++i) {
+      if (gs->info.properties[i].name ==
+          TGSI_PROPERTY_GS_INPUT_PRIM)
+         gs->input_primitive = gs->info.properties[i].data[0];
+      else if (gs->info.properties[i].name ==
+               TGSI_PROPERTY_GS_OUTPUT_PRIM)
+         gs->output_primitive = gs->info.properties[i].data[0];
+      else if (gs->info.properties[i].name ==
+               TGSI_PROPERTY_GS_MAX_OUTPUT_VERTICES)
+         gs->max_output_vertices = gs->info.properties[i].data[0];
+   }
+
+   gs->machine = draw->gs.tgsi.machine;
 
-   gs_flush(shader, 1);
+   gs->vector_length = 1;
+   gs->fetch_inputs = tgsi_fetch_gs_input;
+   gs->run = tgsi_gs_run;
+
+#ifdef HAVE_LLVM
+   if (draw->llvm && llvm_gs_supported(gs))
+      llvm_gs_init(gs);
+#endif
+
+   if (gs)
+   {
+      uint i;
+      for (i = 0; i < gs->info.num_outputs; i++) {
+         if (gs->info.output_semantic_name[i] == TGSI_SEMANTIC_POSITION &&
+             gs->info.output_semantic_index[i] == 0)
+            gs->position_output = i;
+      }
+   }
+
+   return gs;
 }
 
+void draw_bind_geometry_shader(struct draw_context *draw,
+                               struct draw_geometry_shader *dgs)
+{
+   draw_do_flush(draw, DRAW_FLUSH_STATE_CHANGE);
+
+   if (dgs) {
+      draw->gs.geometry_shader = dgs;
+      draw->gs.num_gs_outputs = dgs->info.num_outputs;
+      draw->gs.position_output = dgs->position_output;
+      draw_geometry_shader_prepare(dgs, draw);
+   }
+   else {
+      draw->gs.geometry_shader = NULL;
+      draw->gs.num_gs_outputs = 0;
+   }
+}
+
+void draw_delete_geometry_shader(struct draw_context *draw,
+                                 struct draw_geometry_shader *dgs)
+{
+#ifdef HAVE_LLVM
+   llvm_gs_destroy(dgs);
+#endif
+   FREE(dgs);
+}
+
+
 #define FUNC         gs_run
 #define GET_ELT(idx) (idx)
 #include "draw_gs_tmp.h"
@@ -433,13 +619,21 @@ int draw_geometry_shader_run(struct draw_geometry_shader *shader,
    shader->vertex_size = vertex_size;
    shader->tmp_output = (float (*)[4])output_verts->verts->data;
    shader->in_prim_idx = 0;
+   shader->fetched_prim_count = 0;
    shader->input_vertex_stride = input_stride;
    shader->input = input;
    FREE(shader->primitive_lengths);
    shader->primitive_lengths = MALLOC(max_out_prims * sizeof(unsigned));
 
-   tgsi_exec_set_constant_buffers(machine, PIPE_MAX_CONSTANT_BUFFERS,
-                                  constants, constants_size);
+#ifdef HAVE_LLVM
+   if (shader->llvm_variant) {
+      shader->draw->llvm->jit_context.gs_constants = constants[0];
+   } else
+#endif
+   {
+      tgsi_exec_set_constant_buffers(machine, PIPE_MAX_CONSTANT_BUFFERS,
+                                     constants, constants_size);
+   }
 
    if (input_prim->linear)
       gs_run(shader, input_prim, input_verts,
@@ -448,6 +642,10 @@ int draw_geometry_shader_run(struct draw_geometry_shader *shader,
       gs_run_elts(shader, input_prim, input_verts,
                   output_prims, output_verts);
 
+   /* run the last, partial batch of primitives */
+   if (shader->fetched_prim_count)
+      gs_flush(shader);
+
    /* Update prim_info:
     */
    output_prims->linear = TRUE;
@@ -471,6 +669,9 @@ int draw_geometry_shader_run(struct draw_geometry_shader *shader,
 
 void draw_geometry_shader_delete(struct draw_geometry_shader *shader)
 {
+#ifdef HAVE_LLVM
+   llvm_gs_destroy(shader);
+#endif
    FREE((void*) shader->state.tokens);
    FREE(shader);
 }
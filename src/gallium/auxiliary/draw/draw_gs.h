@@ -34,7 +34,11 @@
 
 #define MAX_TGSI_PRIMITIVES 4
 
+/* the largest input primitive, PIPE_PRIM_TRIANGLES_ADJACENCY */
+#define DRAW_GS_MAX_INPUT_VERTICES 6
+
 struct draw_context;
+struct draw_gs_llvm_variant;
 
 /**
  * Private version of the compiled geometry shader
@@ -64,6 +68,28 @@ struct draw_geometry_shader {
    unsigned in_prim_idx;
    unsigned input_vertex_stride;
    const float (*input)[4];
+
+   /* number of input primitives run per invocation, and how many of them
+    * have been fetched so far */
+   unsigned vector_length;
+   unsigned fetched_prim_count;
+
+   void (*fetch_inputs)(struct draw_geometry_shader *shader,
+                        unsigned *indices,
+                        unsigned num_vertices,
+                        unsigned prim_idx);
+   void (*run)(struct draw_geometry_shader *shader,
+               unsigned input_primitives);
+
+#ifdef HAVE_LLVM
+   struct draw_gs_llvm_variant *llvm_variant;
+   float *llvm_input;
+   struct vertex_header *llvm_output;
+   unsigned llvm_output_vertex_size;
+   unsigned *llvm_prim_lengths;
+   unsigned *llvm_emitted_vertices;
+   unsigned *llvm_emitted_prims;
+#endif
 };
 
 /*
@@ -29,6 +29,8 @@
 
 #include "draw_context.h"
 #include "draw_vs.h"
+#include "draw_gs.h"
+#include "draw_vertex.h"
 
 #include "gallivm/lp_bld_arit.h"
 #include "gallivm/lp_bld_logic.h"
@@ -45,12 +47,15 @@
 #include "gallivm/lp_bld_type.h"
 #include "gallivm/lp_bld_pack.h"
 #include "gallivm/lp_bld_format.h"
+#include "gallivm/lp_bld_compile_queue.h"
 
 #include "tgsi/tgsi_exec.h"
 #include "tgsi/tgsi_dump.h"
 
+#include "util/u_debug.h"
 #include "util/u_math.h"
 #include "util/u_pointer.h"
+#include "util/u_prim.h"
 #include "util/u_string.h"
 #include "util/u_simple_list.h"
 
@@ -58,9 +63,18 @@
 #define DEBUG_STORE 0
 
 
+/**
+ * Number of vertices a vertex shader variant shades with quickly compiled
+ * code before it is recompiled with full optimization.  Zero optimizes
+ * every variant right away.
+ */
+DEBUG_GET_ONCE_NUM_OPTION(draw_hot_vertices, "DRAW_HOT_VERTICES",
+                          DRAW_DEFAULT_HOT_VERTICES)
+
+
 static void
-draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *var,
-                   boolean elts);
+draw_llvm_generate(struct draw_llvm_variant *var,
+                   boolean elts, boolean emit);
 
 
 /**
@@ -356,6 +370,10 @@ draw_llvm_create(struct draw_context *draw)
    llvm->nr_variants = 0;
    make_empty_list(&llvm->vs_variants_list);
 
+   /* Without a compile thread every variant is optimized right away. */
+   if (debug_get_option_draw_hot_vertices())
+      llvm->compile_queue = lp_compile_queue_create(1, 1);
+
    return llvm;
 }
 
@@ -366,13 +384,221 @@ draw_llvm_create(struct draw_context *draw)
 void
 draw_llvm_destroy(struct draw_llvm *llvm)
 {
+   lp_compile_queue_destroy(llvm->compile_queue);
+
    /* XXX free other draw_llvm data? */
    FREE(llvm);
 }
 
 
+/**
+ * Build the variant's functions into its module, and compile it.
+ */
+static void
+draw_llvm_compile_variant(struct draw_llvm_variant *variant)
+{
+   LLVMTypeRef vertex_header;
+
+   variant->function_emit = NULL;
+   variant->function_elts_emit = NULL;
+   variant->jit_func_emit = NULL;
+   variant->jit_func_elts_emit = NULL;
+
+   create_jit_types(variant);
+
+   vertex_header = create_jit_vertex_header(variant->gallivm,
+                                            variant->num_inputs);
+
+   variant->vertex_header_ptr_type = LLVMPointerType(vertex_header, 0);
+
+   draw_llvm_generate(variant, FALSE, FALSE);  /* linear */
+   draw_llvm_generate(variant, TRUE, FALSE);   /* elts */
+
+   if (variant->key.nr_emit_attribs) {
+      draw_llvm_generate(variant, FALSE, TRUE);
+      draw_llvm_generate(variant, TRUE, TRUE);
+   }
+
+   gallivm_compile_module(variant->gallivm);
+
+   variant->jit_func = (draw_jit_vert_func)
+         gallivm_jit_function(variant->gallivm, variant->function);
+
+   variant->jit_func_elts = (draw_jit_vert_func_elts)
+         gallivm_jit_function(variant->gallivm, variant->function_elts);
+
+   if (variant->key.nr_emit_attribs) {
+      variant->jit_func_emit = (draw_jit_vert_func)
+            gallivm_jit_function(variant->gallivm, variant->function_emit);
+
+      variant->jit_func_elts_emit = (draw_jit_vert_func_elts)
+            gallivm_jit_function(variant->gallivm, variant->function_elts_emit);
+   }
+}
+
+
+/**
+ * Free the variant's functions along with their module.
+ */
+static void
+draw_llvm_free_variant_code(struct draw_llvm_variant *variant)
+{
+   if (variant->function_elts) {
+      gallivm_free_function(variant->gallivm,
+                            variant->function_elts, variant->jit_func_elts);
+   }
+
+   if (variant->function) {
+      gallivm_free_function(variant->gallivm,
+                            variant->function, variant->jit_func);
+   }
+
+   if (variant->function_elts_emit) {
+      gallivm_free_function(variant->gallivm,
+                            variant->function_elts_emit,
+                            variant->jit_func_elts_emit);
+   }
+
+   if (variant->function_emit) {
+      gallivm_free_function(variant->gallivm,
+                            variant->function_emit, variant->jit_func_emit);
+   }
+
+   gallivm_destroy(variant->gallivm);
+   variant->gallivm = NULL;
+}
+
+
+/**
+ * Background compilation of a variant's optimized code.
+ */
+struct draw_llvm_async_job
+{
+   struct lp_compile_job base;
+
+   /** The variant whose functions are replaced on completion */
+   struct draw_llvm_variant *variant;
+
+   /** Holds the worker's module, types and functions; must be last */
+   struct draw_llvm_variant optimized;
+};
+
+
+/**
+ * Compile the optimized code in the worker's context and swap it in.
+ */
+static void
+vs_async_compile(struct lp_compile_job *base, LLVMContextRef context)
+{
+   struct draw_llvm_async_job *job = (struct draw_llvm_async_job *) base;
+   struct draw_llvm_variant *variant = job->variant;
+   struct draw_llvm_variant *optimized = &job->optimized;
+
+   optimized->gallivm = gallivm_create_ext(context, 0);
+   if (!optimized->gallivm)
+      return;
+
+   draw_llvm_compile_variant(optimized);
+
+   /*
+    * Swap the code in.  The vertex shader threads may be running the
+    * unoptimized code right now, which is fine as it stays around until
+    * the variant is destroyed; each pointer store is atomic, and either
+    * function is correct for any run.
+    */
+   variant->jit_func = optimized->jit_func;
+   variant->jit_func_elts = optimized->jit_func_elts;
+   variant->jit_func_emit = optimized->jit_func_emit;
+   variant->jit_func_elts_emit = optimized->jit_func_elts_emit;
+}
+
+
+/**
+ * Free the optimized code.  Must run on the worker which compiled it.
+ */
+static void
+vs_async_destroy(struct lp_compile_job *base, LLVMContextRef context)
+{
+   struct draw_llvm_async_job *job = (struct draw_llvm_async_job *) base;
+
+   (void) context;
+
+   draw_llvm_free_variant_code(&job->optimized);
+}
+
+
+/**
+ * Queue the optimized compilation of a variant which currently runs
+ * unoptimized code.
+ */
+static void
+submit_async_compile(struct draw_llvm *llvm,
+                     struct draw_llvm_variant *variant)
+{
+   struct draw_llvm_async_job *job;
+
+   job = CALLOC(1, sizeof *job +
+                variant->shader->variant_key_size -
+                sizeof job->optimized.key);
+   if (!job)
+      return;
+
+   job->base.execute = vs_async_compile;
+   job->base.worker = -1;
+   job->variant = variant;
+
+   job->optimized.llvm = llvm;
+   job->optimized.shader = variant->shader;
+   job->optimized.num_inputs = variant->num_inputs;
+   job->optimized.position_output = variant->position_output;
+   job->optimized.clipvertex_output = variant->clipvertex_output;
+   job->optimized.clipdistance_output[0] = variant->clipdistance_output[0];
+   job->optimized.clipdistance_output[1] = variant->clipdistance_output[1];
+   job->optimized.optimized = TRUE;
+   memcpy(&job->optimized.key, &variant->key,
+          variant->shader->variant_key_size);
+
+   variant->async = job;
+
+   lp_compile_queue_submit(llvm->compile_queue, &job->base);
+}
+
+
+/**
+ * Stop or wait for the background compilation of a variant which is
+ * about to be destroyed, and free the optimized code.
+ */
+static void
+finish_async_compile(struct draw_llvm *llvm,
+                     struct draw_llvm_variant *variant)
+{
+   struct draw_llvm_async_job *job = variant->async;
+
+   if (!lp_compile_queue_cancel(llvm->compile_queue, &job->base))
+      lp_compile_queue_wait(llvm->compile_queue, &job->base);
+
+   variant->async = NULL;
+
+   if (!job->optimized.gallivm) {
+      FREE(job);
+      return;
+   }
+
+   /* The module belongs to the worker's context; free it there. */
+   job->base.execute = vs_async_destroy;
+   job->base.detached = TRUE;
+   lp_compile_queue_submit(llvm->compile_queue, &job->base);
+}
+
+
 /**
  * Create LLVM-generated code for a vertex shader.
+ *
+ * Unless DRAW_HOT_VERTICES is zero or there is no compile thread, the code
+ * is compiled quickly, without optimizations.  Once the variant has shaded
+ * enough vertices draw_llvm_shade_count() queues the optimized compilation,
+ * which replaces the code when done.  Shaders which only serve the odd
+ * blit thus don't pay for the full optimization.
  */
 struct draw_llvm_variant *
 draw_llvm_create_variant(struct draw_llvm *llvm,
@@ -380,9 +606,9 @@ draw_llvm_create_variant(struct draw_llvm *llvm,
 			 const struct draw_llvm_variant_key *key)
 {
    struct draw_llvm_variant *variant;
+   struct draw_context *draw = llvm->draw;
    struct llvm_vertex_shader *shader =
-      llvm_vertex_shader(llvm->draw->vs.vertex_shader);
-   LLVMTypeRef vertex_header;
+      llvm_vertex_shader(draw->vs.vertex_shader);
 
    variant = MALLOC(sizeof *variant +
 		    shader->variant_key_size -
@@ -391,29 +617,28 @@ draw_llvm_create_variant(struct draw_llvm *llvm,
       return NULL;
 
    variant->llvm = llvm;
-
-   variant->gallivm = gallivm_create();
-
-   create_jit_types(variant);
+   variant->shader = shader;
+   variant->num_inputs = num_inputs;
+   variant->position_output = draw_current_shader_position_output(draw);
+   variant->clipvertex_output = draw_current_shader_clipvertex_output(draw);
+   variant->clipdistance_output[0] =
+      draw_current_shader_clipdistance_output(draw, 0);
+   variant->clipdistance_output[1] =
+      draw_current_shader_clipdistance_output(draw, 1);
+   variant->num_vertices = 0;
+   variant->async = NULL;
 
    memcpy(&variant->key, key, shader->variant_key_size);
 
-   vertex_header = create_jit_vertex_header(variant->gallivm, num_inputs);
+   variant->gallivm = NULL;
+   if (llvm->compile_queue)
+      variant->gallivm = gallivm_create_ext(NULL, GALLIVM_CREATE_NO_OPT);
+   variant->optimized = variant->gallivm == NULL;
+   if (!variant->gallivm)
+      variant->gallivm = gallivm_create();
 
-   variant->vertex_header_ptr_type = LLVMPointerType(vertex_header, 0);
-
-   draw_llvm_generate(llvm, variant, FALSE);  /* linear */
-   draw_llvm_generate(llvm, variant, TRUE);   /* elts */
-
-   gallivm_compile_module(variant->gallivm);
-
-   variant->jit_func = (draw_jit_vert_func)
-         gallivm_jit_function(variant->gallivm, variant->function);
-
-   variant->jit_func_elts = (draw_jit_vert_func_elts)
-         gallivm_jit_function(variant->gallivm, variant->function_elts);
+   draw_llvm_compile_variant(variant);
 
-   variant->shader = shader;
    variant->list_item_global.base = variant;
    variant->list_item_local.base = variant;
    /*variant->no = */shader->variants_created++;
@@ -423,6 +648,38 @@ draw_llvm_create_variant(struct draw_llvm *llvm,
 }
 
 
+/**
+ * Account for vertices about to be shaded with the variant, and queue its
+ * optimized compilation once it has proven hot.
+ */
+void
+draw_llvm_shade_count(struct draw_llvm_variant *variant,
+                      unsigned count)
+{
+   if (variant->optimized || variant->async)
+      return;
+
+   variant->num_vertices += count;
+   if (variant->num_vertices >= debug_get_option_draw_hot_vertices())
+      submit_async_compile(variant->llvm, variant);
+}
+
+
+/**
+ * Wait until the optimized code of all variants queued so far is in use.
+ */
+void
+draw_llvm_finish_compiles(struct draw_llvm *llvm)
+{
+   struct draw_llvm_variant_list_item *li;
+
+   foreach(li, &llvm->vs_variants_list) {
+      if (li->base->async)
+         lp_compile_queue_wait(llvm->compile_queue, &li->base->async->base);
+   }
+}
+
+
 static void
 generate_vs(struct draw_llvm_variant *variant,
             LLVMBuilderRef builder,
@@ -434,8 +691,7 @@ generate_vs(struct draw_llvm_variant *variant,
             struct lp_build_sampler_soa *draw_sampler,
             boolean clamp_vertex_color)
 {
-   struct draw_llvm *llvm = variant->llvm;
-   const struct tgsi_token *tokens = llvm->draw->vs.vertex_shader->state.tokens;
+   const struct tgsi_token *tokens = variant->shader->base.state.tokens;
    LLVMValueRef consts_ptr = draw_jit_context_vs_constants(variant->gallivm, context_ptr);
    struct lp_build_sampler_soa *sampler = 0;
 
@@ -443,7 +699,7 @@ generate_vs(struct draw_llvm_variant *variant,
       tgsi_dump(tokens, 0);
    }
 
-   if (llvm->draw->num_sampler_views && llvm->draw->num_samplers)
+   if (variant->key.nr_samplers)
       sampler = draw_sampler;
 
    lp_build_tgsi_soa(variant->gallivm,
@@ -456,13 +712,14 @@ generate_vs(struct draw_llvm_variant *variant,
                      inputs,
                      outputs,
                      sampler,
-                     &llvm->draw->vs.vertex_shader->info);
+                     &variant->shader->base.info,
+                     NULL);
 
    {
       LLVMValueRef out;
       unsigned chan, attrib;
       struct lp_build_context bld;
-      struct tgsi_shader_info* info = &llvm->draw->vs.vertex_shader->info;
+      struct tgsi_shader_info* info = &variant->shader->base.info;
       lp_build_context_init(&bld, variant->gallivm, vs_type);
 
       for (attrib = 0; attrib < info->num_outputs; ++attrib) {
@@ -606,6 +863,7 @@ static void
 store_aos_array(struct gallivm_state *gallivm,
                 struct lp_type soa_type,
                 LLVMValueRef io_ptr,
+                LLVMValueRef *indices,
                 LLVMValueRef* aos,
                 int attrib,
                 int num_outputs,
@@ -623,7 +881,11 @@ store_aos_array(struct gallivm_state *gallivm,
 
    for (i = 0; i < vector_length; i++) {
       inds[i] = lp_build_const_int32(gallivm, i);
-      io_ptrs[i] = LLVMBuildGEP(builder, io_ptr, &inds[i], 1, "");
+      if (indices) {
+         io_ptrs[i] = LLVMBuildGEP(builder, io_ptr, &indices[i], 1, "");
+      } else {
+         io_ptrs[i] = LLVMBuildGEP(builder, io_ptr, &inds[i], 1, "");
+      }
    }
 
    if (attrib == 0) {
@@ -660,60 +922,84 @@ store_aos_array(struct gallivm_state *gallivm,
 }
 
 
+/**
+ * Load output attrib and transpose it into one xyzw vector per vertex.
+ */
+static void
+transpose_output(struct gallivm_state *gallivm,
+                 LLVMValueRef (*outputs)[TGSI_NUM_CHANNELS],
+                 unsigned attrib,
+                 struct lp_type soa_type,
+                 LLVMValueRef *aos)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMValueRef soa[TGSI_NUM_CHANNELS];
+   unsigned chan, i;
+
+   for (chan = 0; chan < TGSI_NUM_CHANNELS; ++chan) {
+      if (outputs[attrib][chan]) {
+         LLVMValueRef out = LLVMBuildLoad(builder, outputs[attrib][chan], "");
+         lp_build_name(out, "output%u.%c", attrib, "xyzw"[chan]);
+#if DEBUG_STORE
+         lp_build_printf(gallivm, "output %d : %d ",
+                         LLVMConstInt(LLVMInt32TypeInContext(gallivm->context),
+                                      attrib, 0),
+                         LLVMConstInt(LLVMInt32TypeInContext(gallivm->context),
+                                      chan, 0));
+         lp_build_print_value(gallivm, "val = ", out);
+#endif
+         soa[chan] = out;
+      }
+      else {
+         soa[chan] = 0;
+      }
+   }
+
+
+   if (soa_type.length == TGSI_NUM_CHANNELS) {
+      lp_build_transpose_aos(gallivm, soa_type, soa, aos);
+   } else {
+      lp_build_transpose_aos(gallivm, soa_type, soa, soa);
+
+      for (i = 0; i < soa_type.length; ++i) {
+         aos[i] = lp_build_extract_range(gallivm,
+                                         soa[i % TGSI_NUM_CHANNELS],
+                                         (i / TGSI_NUM_CHANNELS) * TGSI_NUM_CHANNELS,
+                                         TGSI_NUM_CHANNELS);
+      }
+   }
+}
+
+
+/**
+ * Transpose the SoA outputs and store them in the vertex buffer.
+ *
+ * The vertices are consecutive starting at io, unless indices is given, in
+ * which case lane i is stored at io[indices[i]].
+ */
 static void
 convert_to_aos(struct gallivm_state *gallivm,
                LLVMValueRef io,
+               LLVMValueRef *indices,
                LLVMValueRef (*outputs)[TGSI_NUM_CHANNELS],
                LLVMValueRef clipmask,
                int num_outputs,
                struct lp_type soa_type,
                boolean have_clipdist)
 {
-   LLVMBuilderRef builder = gallivm->builder;
-   unsigned chan, attrib, i;
+   unsigned attrib;
 
 #if DEBUG_STORE
    lp_build_printf(gallivm, "   # storing begin\n");
 #endif
    for (attrib = 0; attrib < num_outputs; ++attrib) {
-      LLVMValueRef soa[TGSI_NUM_CHANNELS];
       LLVMValueRef aos[LP_MAX_VECTOR_WIDTH / 32];
-      for (chan = 0; chan < TGSI_NUM_CHANNELS; ++chan) {
-         if (outputs[attrib][chan]) {
-            LLVMValueRef out = LLVMBuildLoad(builder, outputs[attrib][chan], "");
-            lp_build_name(out, "output%u.%c", attrib, "xyzw"[chan]);
-#if DEBUG_STORE
-            lp_build_printf(gallivm, "output %d : %d ",
-                            LLVMConstInt(LLVMInt32TypeInContext(gallivm->context),
-                                         attrib, 0),
-                            LLVMConstInt(LLVMInt32TypeInContext(gallivm->context),
-                                         chan, 0));
-            lp_build_print_value(gallivm, "val = ", out);
-#endif
-            soa[chan] = out;
-         }
-         else {
-            soa[chan] = 0;
-         }
-      }
-
 
-      if (soa_type.length == TGSI_NUM_CHANNELS) {
-         lp_build_transpose_aos(gallivm, soa_type, soa, aos);
-      } else {
-         lp_build_transpose_aos(gallivm, soa_type, soa, soa);
-
-         for (i = 0; i < soa_type.length; ++i) {
-            aos[i] = lp_build_extract_range(gallivm,
-                                            soa[i % TGSI_NUM_CHANNELS],
-                                            (i / TGSI_NUM_CHANNELS) * TGSI_NUM_CHANNELS,
-                                            TGSI_NUM_CHANNELS);
-         }
-      }
+      transpose_output(gallivm, outputs, attrib, soa_type, aos);
 
       store_aos_array(gallivm,
                       soa_type,
-                      io,
+                      io, indices,
                       aos,
                       attrib,
                       num_outputs,
@@ -725,6 +1011,79 @@ convert_to_aos(struct gallivm_state *gallivm,
 }
 
 
+/**
+ * Store the outputs straight into the hardware vertex layout of the key,
+ * for the fused fetch/shade/emit functions.
+ *
+ * Vertex index + i of hw_ptr receives lane i.  Lanes past max_index are
+ * copies of the last vertex (the fetch indices are clamped the same way),
+ * so they rewrite it instead of overrunning the buffer.
+ */
+static void
+store_emit(struct gallivm_state *gallivm,
+           const struct draw_llvm_variant_key *key,
+           LLVMValueRef hw_ptr,
+           LLVMValueRef index,
+           LLVMValueRef max_index,
+           LLVMValueRef (*outputs)[TGSI_NUM_CHANNELS],
+           struct lp_type soa_type)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef float_ptr_type =
+      LLVMPointerType(LLVMFloatTypeInContext(gallivm->context), 0);
+   LLVMTypeRef vec4_ptr_type =
+      LLVMPointerType(lp_build_vec_type(gallivm, lp_float32_vec4_type()), 0);
+   LLVMValueRef vert_ptrs[LP_MAX_VECTOR_WIDTH / 32];
+   struct lp_build_context bld;
+   unsigned i, j, chan;
+   unsigned offset = 0;
+
+   lp_build_context_init(&bld, gallivm, lp_type_int(32));
+
+   for (i = 0; i < soa_type.length; ++i) {
+      LLVMValueRef vert = LLVMBuildAdd(builder, index,
+                                       lp_build_const_int32(gallivm, i), "");
+      vert = lp_build_min(&bld, vert, max_index);
+      vert = LLVMBuildMul(builder, vert,
+                          lp_build_const_int32(gallivm, key->emit_stride), "");
+      vert_ptrs[i] = LLVMBuildGEP(builder, hw_ptr, &vert, 1, "");
+   }
+
+   for (j = 0; j < key->nr_emit_attribs; ++j) {
+      const unsigned nr_components = key->emit_attrib[j].nr_components;
+      LLVMValueRef attr_offset = lp_build_const_int32(gallivm, offset);
+      LLVMValueRef aos[LP_MAX_VECTOR_WIDTH / 32];
+
+      transpose_output(gallivm, outputs, key->emit_attrib[j].src_index,
+                       soa_type, aos);
+
+      for (i = 0; i < soa_type.length; ++i) {
+         LLVMValueRef ptr = LLVMBuildGEP(builder, vert_ptrs[i],
+                                         &attr_offset, 1, "");
+
+         if (nr_components == TGSI_NUM_CHANNELS) {
+            ptr = LLVMBuildPointerCast(builder, ptr, vec4_ptr_type, "");
+            lp_set_store_alignment(LLVMBuildStore(builder, aos[i], ptr),
+                                   sizeof(float));
+         }
+         else {
+            ptr = LLVMBuildPointerCast(builder, ptr, float_ptr_type, "");
+            for (chan = 0; chan < nr_components; ++chan) {
+               LLVMValueRef chan_index = lp_build_const_int32(gallivm, chan);
+               LLVMValueRef chan_ptr = LLVMBuildGEP(builder, ptr,
+                                                    &chan_index, 1, "");
+               LLVMValueRef val = LLVMBuildExtractElement(builder, aos[i],
+                                                          chan_index, "");
+               LLVMBuildStore(builder, val, chan_ptr);
+            }
+         }
+      }
+
+      offset += nr_components * sizeof(float);
+   }
+}
+
+
 /**
  * Stores original vertex positions in clip coordinates
  */
@@ -848,7 +1207,7 @@ generate_viewport(struct draw_llvm_variant *variant,
  * Returns clipmask as nxi32 bitmask for the n vertices
  */
 static LLVMValueRef 
-generate_clipmask(struct draw_llvm *llvm,
+generate_clipmask(struct draw_llvm_variant *variant,
                   struct gallivm_state *gallivm,
                   struct lp_type vs_type,
                   LLVMValueRef (*outputs)[TGSI_NUM_CHANNELS],
@@ -856,6 +1215,7 @@ generate_clipmask(struct draw_llvm *llvm,
                   boolean clip_z,
                   boolean clip_user,
                   boolean clip_halfz,
+                  boolean guard_band_xy,
                   unsigned ucp_enable,
                   LLVMValueRef context_ptr,
                   boolean *have_clipdist)
@@ -869,14 +1229,14 @@ generate_clipmask(struct draw_llvm *llvm,
    LLVMValueRef plane1, planes, plane_ptr, sum;
    struct lp_type f32_type = vs_type;
    struct lp_type i32_type = lp_int_type(vs_type);
-   const unsigned pos = draw_current_shader_position_output(llvm->draw);
-   const unsigned cv = draw_current_shader_clipvertex_output(llvm->draw);
-   int num_written_clipdistance = llvm->draw->vs.vertex_shader->info.num_written_clipdistance;
+   const unsigned pos = variant->position_output;
+   const unsigned cv = variant->clipvertex_output;
+   int num_written_clipdistance = variant->shader->base.info.num_written_clipdistance;
    bool have_cd = false;
    unsigned cd[2];
 
-   cd[0] = draw_current_shader_clipdistance_output(llvm->draw, 0);
-   cd[1] = draw_current_shader_clipdistance_output(llvm->draw, 1);
+   cd[0] = variant->clipdistance_output[0];
+   cd[1] = variant->clipdistance_output[1];
   
    if (cd[0] != pos || cd[1] != pos)
       have_cd = true;
@@ -909,6 +1269,15 @@ generate_clipmask(struct draw_llvm *llvm,
 
    /* Cliptest, for hardwired planes */
    if (clip_xy) {
+      if (guard_band_xy) {
+         /* Test against a guard band twice the size of the viewport, the
+          * rasterizer takes care of anything inside it.
+          */
+         LLVMValueRef half = lp_build_const_vec(gallivm, f32_type, 0.5);
+         pos_x = LLVMBuildFMul(builder, pos_x, half, "");
+         pos_y = LLVMBuildFMul(builder, pos_y, half, "");
+      }
+
       /* plane 1 */
       test = lp_build_compare(gallivm, f32_type, PIPE_FUNC_GREATER, pos_x , pos_w);
       temp = shift;
@@ -1055,9 +1424,16 @@ clipmask_booli32(struct gallivm_state *gallivm,
 }
 
 
+/**
+ * Generate the vertex fetch/shade function.
+ *
+ * With elts the vertices are fetched through an index list.  With emit the
+ * function writes the hardware vertex layout of the key instead of vertex
+ * headers, for runs which turn out not to need clipping.
+ */
 static void
-draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant,
-                   boolean elts)
+draw_llvm_generate(struct draw_llvm_variant *variant,
+                   boolean elts, boolean emit)
 {
    struct gallivm_state *gallivm = variant->gallivm;
    LLVMContextRef context = gallivm->context;
@@ -1074,14 +1450,13 @@ draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant,
    LLVMValueRef io_ptr, vbuffers_ptr, vb_ptr;
    LLVMValueRef zero = lp_build_const_int32(gallivm, 0);
    LLVMValueRef one = lp_build_const_int32(gallivm, 1);
-   struct draw_context *draw = llvm->draw;
-   const struct tgsi_shader_info *vs_info = &draw->vs.vertex_shader->info;
+   const struct tgsi_shader_info *vs_info = &variant->shader->base.info;
    unsigned i, j;
    struct lp_build_context bld;
    struct lp_build_loop_state lp_loop;
    const int vector_length = lp_native_vector_width / 32;
    LLVMValueRef outputs[PIPE_MAX_SHADER_OUTPUTS][TGSI_NUM_CHANNELS];
-   LLVMValueRef fetch_max;
+   LLVMValueRef fetch_max, io_max = NULL, hw_ptr = NULL;
    struct lp_build_sampler_soa *sampler = 0;
    LLVMValueRef ret, clipmask_bool_ptr;
    const boolean bypass_viewport = variant->key.bypass_viewport;
@@ -1089,8 +1464,8 @@ draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant,
                                    variant->key.clip_z  ||
                                    variant->key.clip_user;
    LLVMValueRef variant_func;
-   const unsigned pos = draw_current_shader_position_output(llvm->draw);
-   const unsigned cv = draw_current_shader_clipvertex_output(llvm->draw);
+   const unsigned pos = variant->position_output;
+   const unsigned cv = variant->clipvertex_output;
    boolean have_clipdist = FALSE;
    struct lp_bld_tgsi_system_values system_values;
 
@@ -1110,14 +1485,26 @@ draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant,
 
    func_type = LLVMFunctionType(int32_type, arg_types, Elements(arg_types), 0);
 
-   variant_func = LLVMAddFunction(gallivm->module,
-                                  elts ? "draw_llvm_shader_elts" : "draw_llvm_shader",
-                                  func_type);
-
-   if (elts)
-      variant->function_elts = variant_func;
-   else
-      variant->function = variant_func;
+   if (emit) {
+      variant_func = LLVMAddFunction(gallivm->module,
+                                     elts ? "draw_llvm_shader_elts_emit" :
+                                            "draw_llvm_shader_emit",
+                                     func_type);
+      if (elts)
+         variant->function_elts_emit = variant_func;
+      else
+         variant->function_emit = variant_func;
+   }
+   else {
+      variant_func = LLVMAddFunction(gallivm->module,
+                                     elts ? "draw_llvm_shader_elts" :
+                                            "draw_llvm_shader",
+                                     func_type);
+      if (elts)
+         variant->function_elts = variant_func;
+      else
+         variant->function = variant_func;
+   }
 
    LLVMSetFunctionCallConv(variant_func, LLVMCCallConv);
    for (i = 0; i < Elements(arg_types); ++i)
@@ -1192,6 +1579,13 @@ draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant,
 
    fetch_max = LLVMBuildSub(builder, end, one, "fetch_max");
 
+   if (emit) {
+      LLVMTypeRef byte_ptr_type =
+         LLVMPointerType(LLVMInt8TypeInContext(context), 0);
+      hw_ptr = LLVMBuildBitCast(builder, io_ptr, byte_ptr_type, "hw_verts");
+      io_max = LLVMBuildSub(builder, fetch_max, start, "io_max");
+   }
+
    lp_build_loop_begin(&lp_loop, gallivm, start);
    {
       LLVMValueRef inputs[PIPE_MAX_SHADER_INPUTS][TGSI_NUM_CHANNELS];
@@ -1205,7 +1599,7 @@ draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant,
       else
          io_itr = LLVMBuildSub(builder, lp_loop.counter, start, "");
 
-      io = LLVMBuildGEP(builder, io_ptr, &io_itr, 1, "");
+      io = emit ? NULL : LLVMBuildGEP(builder, io_ptr, &io_itr, 1, "");
 #if DEBUG_STORE
       lp_build_printf(gallivm, " --- io %d = %p, loop counter %d\n",
                       io_itr, io, lp_loop.counter);
@@ -1232,8 +1626,8 @@ draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant,
          system_values.vertex_id = LLVMBuildInsertElement(gallivm->builder,
                                                           system_values.vertex_id, true_index,
                                                           lp_build_const_int32(gallivm, i), "");
-         for (j = 0; j < draw->pt.nr_vertex_elements; ++j) {
-            struct pipe_vertex_element *velem = &draw->pt.vertex_element[j];
+         for (j = 0; j < variant->key.nr_vertex_elements; ++j) {
+            struct pipe_vertex_element *velem = &variant->key.vertex_element[j];
             LLVMValueRef vb_index =
                lp_build_const_int32(gallivm, velem->vertex_buffer_index);
             LLVMValueRef vb = LLVMBuildGEP(builder, vb_ptr, &vb_index, 1, "");
@@ -1243,7 +1637,7 @@ draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant,
          }
       }
       convert_to_soa(gallivm, aos_attribs, inputs,
-                     draw->pt.nr_vertex_elements, vs_type);
+                     variant->key.nr_vertex_elements, vs_type);
 
       ptr_aos = (const LLVMValueRef (*)[TGSI_NUM_CHANNELS]) inputs;
       generate_vs(variant,
@@ -1257,14 +1651,16 @@ draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant,
                   variant->key.clamp_vertex_color);
 
       /* store original positions in clip before further manipulation */
-      store_clip(gallivm, vs_type, io, outputs, 0, cv);
-      store_clip(gallivm, vs_type, io, outputs, 1, pos);
+      if (!emit) {
+         store_clip(gallivm, vs_type, io, outputs, 0, cv);
+         store_clip(gallivm, vs_type, io, outputs, 1, pos);
+      }
 
       /* do cliptest */
       if (enable_cliptest) {
          LLVMValueRef temp = LLVMBuildLoad(builder, clipmask_bool_ptr, "");
          /* allocate clipmask, assign it integer type */
-         clipmask = generate_clipmask(llvm,
+         clipmask = generate_clipmask(variant,
                                       gallivm,
                                       vs_type,
                                       outputs,
@@ -1272,6 +1668,7 @@ draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant,
                                       variant->key.clip_z, 
                                       variant->key.clip_user,
                                       variant->key.clip_halfz,
+                                      variant->key.guard_band_xy,
                                       variant->key.ucp_enable,
                                       context_ptr, &have_clipdist);
          temp = LLVMBuildOr(builder, clipmask, temp, "");
@@ -1287,13 +1684,22 @@ draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant,
          generate_viewport(variant, builder, vs_type, outputs, context_ptr);
       }
 
-      /* store clipmask in vertex header, 
-       * original positions in clip 
-       * and transformed positions in data 
-       */   
-      convert_to_aos(gallivm, io, outputs, clipmask,
-                     vs_info->num_outputs, vs_type,
-                     have_clipdist);
+      if (emit) {
+         /* write the final vertices, the caller discards them if any
+          * vertex turns out to need clipping
+          */
+         store_emit(gallivm, &variant->key, hw_ptr, io_itr, io_max,
+                    outputs, vs_type);
+      }
+      else {
+         /* store clipmask in vertex header, 
+          * original positions in clip 
+          * and transformed positions in data 
+          */   
+         convert_to_aos(gallivm, io, NULL, outputs, clipmask,
+                        vs_info->num_outputs, vs_type,
+                        have_clipdist);
+      }
    }
 
    lp_build_loop_end_cond(&lp_loop, end, step, LLVMIntUGE);
@@ -1309,8 +1715,14 @@ draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant,
 }
 
 
+/**
+ * Build the variant key for the current state.  If emit_vinfo is given, the
+ * fused fetch/shade/emit functions are requested for that hardware vertex
+ * layout, provided it only has plain float attributes.
+ */
 struct draw_llvm_variant_key *
-draw_llvm_make_variant_key(struct draw_llvm *llvm, char *store)
+draw_llvm_make_variant_key(struct draw_llvm *llvm, char *store,
+                           const struct vertex_info *emit_vinfo)
 {
    unsigned i;
    struct draw_llvm_variant_key *key;
@@ -1331,10 +1743,52 @@ draw_llvm_make_variant_key(struct draw_llvm *llvm, char *store)
    key->clip_user = llvm->draw->clip_user;
    key->bypass_viewport = llvm->draw->identity_viewport;
    key->clip_halfz = !llvm->draw->rasterizer->gl_rasterization_rules;
+   /* like draw_pt_post_vs_prepare(), no guard band with GL clip space */
+   key->guard_band_xy = (llvm->draw->guard_band_xy &&
+                         !llvm->draw->rasterizer->gl_rasterization_rules);
    key->need_edgeflags = (llvm->draw->vs.edgeflag_output ? TRUE : FALSE);
    key->ucp_enable = llvm->draw->rasterizer->clip_plane_enable;
    key->pad = 0;
 
+   key->nr_emit_attribs = 0;
+   key->emit_stride = 0;
+   key->pad2 = 0;
+   memset(key->emit_attrib, 0, sizeof key->emit_attrib);
+
+   if (emit_vinfo) {
+      const unsigned num_outputs = llvm->draw->vs.vertex_shader->info.num_outputs;
+      unsigned size = 0;
+
+      for (i = 0; i < emit_vinfo->num_attribs; i++) {
+         unsigned nr;
+
+         switch (emit_vinfo->attrib[i].emit) {
+         case EMIT_1F: nr = 1; break;
+         case EMIT_2F: nr = 2; break;
+         case EMIT_3F: nr = 3; break;
+         case EMIT_4F: nr = 4; break;
+         default:      nr = 0; break;
+         }
+
+         if (!nr ||
+             emit_vinfo->attrib[i].src_index >= num_outputs ||
+             i >= Elements(key->emit_attrib))
+            break;
+
+         key->emit_attrib[i].src_index = emit_vinfo->attrib[i].src_index;
+         key->emit_attrib[i].nr_components = nr;
+         size += nr;
+      }
+
+      if (i == emit_vinfo->num_attribs && i && size == emit_vinfo->size) {
+         key->nr_emit_attribs = i;
+         key->emit_stride = emit_vinfo->size * 4;
+      }
+      else {
+         memset(key->emit_attrib, 0, sizeof key->emit_attrib);
+      }
+   }
+
    /* All variants of this shader will have the same value for
     * nr_samplers.  Not yet trying to compact away holes in the
     * sampler array.
@@ -1414,11 +1868,375 @@ draw_llvm_destroy_variant(struct draw_llvm_variant *variant)
 {
    struct draw_llvm *llvm = variant->llvm;
 
-   if (variant->function_elts) {
-      gallivm_free_function(variant->gallivm,
-                            variant->function_elts, variant->jit_func_elts);
+   if (variant->async)
+      finish_async_compile(llvm, variant);
+
+   draw_llvm_free_variant_code(variant);
+
+   remove_from_list(&variant->list_item_local);
+   variant->shader->variants_cached--;
+   remove_from_list(&variant->list_item_global);
+   llvm->nr_variants--;
+   FREE(variant);
+}
+
+
+/**
+ * Geometry shader interface handed to the TGSI translator.
+ */
+struct draw_gs_llvm_iface
+{
+   struct lp_build_tgsi_gs_iface base;
+
+   LLVMValueRef input;
+   LLVMValueRef io;
+   LLVMValueRef prim_lengths;
+   LLVMValueRef emitted_vertices;
+   LLVMValueRef emitted_prims;
+
+   unsigned num_inputs;
+   unsigned num_outputs;
+   unsigned vertices_per_prim;
+};
+
+
+static INLINE const struct draw_gs_llvm_iface *
+draw_gs_llvm_iface(const struct lp_build_tgsi_gs_iface *iface)
+{
+   return (const struct draw_gs_llvm_iface *)iface;
+}
+
+
+static LLVMValueRef
+draw_gs_llvm_fetch_input(const struct lp_build_tgsi_gs_iface *gs_iface,
+                         struct lp_build_tgsi_context *bld_base,
+                         boolean is_vindex_indirect,
+                         LLVMValueRef vertex_index,
+                         unsigned attrib_index,
+                         unsigned swizzle)
+{
+   const struct draw_gs_llvm_iface *gs = draw_gs_llvm_iface(gs_iface);
+   struct gallivm_state *gallivm = bld_base->base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_build_context *uint_bld = &bld_base->uint_bld;
+   const unsigned length = bld_base->base.type.length;
+   LLVMValueRef res;
+
+   if (is_vindex_indirect) {
+      LLVMValueRef max_index =
+         lp_build_const_int_vec(gallivm, uint_bld->type,
+                                gs->vertices_per_prim - 1);
+      LLVMValueRef lanes[LP_MAX_VECTOR_LENGTH];
+      LLVMValueRef index_vec;
+      unsigned i;
+
+      for (i = 0; i < length; i++) {
+         lanes[i] = lp_build_const_int32(gallivm, i);
+      }
+
+      /*
+       * Each lane reads its own primitive's vertex:
+       * index_vec = ((vertex * num_inputs + attrib) * 4 + swizzle) * length + lane
+       */
+      index_vec = lp_build_min(uint_bld, vertex_index, max_index);
+      index_vec = lp_build_mul_imm(uint_bld, index_vec, gs->num_inputs);
+      index_vec = lp_build_add(uint_bld, index_vec,
+                               lp_build_const_int_vec(gallivm, uint_bld->type,
+                                                      attrib_index * 4 + swizzle));
+      index_vec = lp_build_mul_imm(uint_bld, index_vec, length);
+      index_vec = lp_build_add(uint_bld, index_vec,
+                               LLVMConstVector(lanes, length));
+
+      res = bld_base->base.undef;
+      for (i = 0; i < length; i++) {
+         LLVMValueRef index = LLVMBuildExtractElement(builder, index_vec,
+                                                      lanes[i], "");
+         LLVMValueRef ptr = LLVMBuildGEP(builder, gs->input, &index, 1, "");
+         LLVMValueRef val = LLVMBuildLoad(builder, ptr, "");
+         res = LLVMBuildInsertElement(builder, res, val, lanes[i], "");
+      }
+   }
+   else {
+      LLVMTypeRef vec_ptr_type = LLVMPointerType(bld_base->base.vec_type, 0);
+      LLVMValueRef vertex = LLVMBuildExtractElement(builder, vertex_index,
+                                                    lp_build_const_int32(gallivm, 0),
+                                                    "");
+      LLVMValueRef index, ptr;
+
+      index = LLVMBuildMul(builder, vertex,
+                           lp_build_const_int32(gallivm, gs->num_inputs * 4), "");
+      index = LLVMBuildAdd(builder, index,
+                           lp_build_const_int32(gallivm, attrib_index * 4 + swizzle),
+                           "");
+
+      ptr = LLVMBuildBitCast(builder, gs->input, vec_ptr_type, "");
+      ptr = LLVMBuildGEP(builder, ptr, &index, 1, "");
+      res = LLVMBuildLoad(builder, ptr, "");
+   }
+
+   return res;
+}
+
+
+/**
+ * Compute the io / prim_lengths index of each lane's slot number count_vec,
+ * sending the masked-off lanes to their scratch slot.
+ */
+static LLVMValueRef
+draw_gs_llvm_slot_indices(const struct draw_gs_llvm_iface *gs,
+                          struct lp_build_tgsi_context *bld_base,
+                          LLVMValueRef count_vec,
+                          LLVMValueRef mask)
+{
+   struct gallivm_state *gallivm = bld_base->base.gallivm;
+   struct lp_build_context *uint_bld = &bld_base->uint_bld;
+   const unsigned length = bld_base->base.type.length;
+   const unsigned slots_per_lane = gs->base.max_output_vertices + 1;
+   LLVMValueRef lane_base[LP_MAX_VECTOR_LENGTH];
+   LLVMValueRef slot;
+   unsigned i;
+
+   for (i = 0; i < length; i++) {
+      lane_base[i] = lp_build_const_int32(gallivm, i * slots_per_lane);
+   }
+
+   slot = lp_build_select(uint_bld, mask, count_vec,
+                          lp_build_const_int_vec(gallivm, uint_bld->type,
+                                                 gs->base.max_output_vertices));
+
+   return lp_build_add(uint_bld, LLVMConstVector(lane_base, length), slot);
+}
+
+
+static void
+draw_gs_llvm_emit_vertex(const struct lp_build_tgsi_gs_iface *gs_iface,
+                         struct lp_build_tgsi_context *bld_base,
+                         LLVMValueRef (*outputs)[4],
+                         LLVMValueRef emitted_vertices_vec,
+                         LLVMValueRef mask)
+{
+   const struct draw_gs_llvm_iface *gs = draw_gs_llvm_iface(gs_iface);
+   struct gallivm_state *gallivm = bld_base->base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_type gs_type = bld_base->base.type;
+   LLVMValueRef indices[LP_MAX_VECTOR_LENGTH];
+   LLVMValueRef index_vec, clipmask;
+   unsigned i;
+
+   index_vec = draw_gs_llvm_slot_indices(gs, bld_base,
+                                         emitted_vertices_vec, mask);
+   for (i = 0; i < gs_type.length; i++) {
+      indices[i] = LLVMBuildExtractElement(builder, index_vec,
+                                           lp_build_const_int32(gallivm, i), "");
    }
 
+   /* clipping and viewport are done by the post-GS stages */
+   clipmask = lp_build_const_int_vec(gallivm, lp_int_type(gs_type), 0);
+
+   convert_to_aos(gallivm, gs->io, indices, outputs, clipmask,
+                  gs->num_outputs, gs_type, FALSE);
+}
+
+
+static void
+draw_gs_llvm_end_primitive(const struct lp_build_tgsi_gs_iface *gs_iface,
+                           struct lp_build_tgsi_context *bld_base,
+                           LLVMValueRef verts_per_prim_vec,
+                           LLVMValueRef emitted_prims_vec,
+                           LLVMValueRef mask)
+{
+   const struct draw_gs_llvm_iface *gs = draw_gs_llvm_iface(gs_iface);
+   struct gallivm_state *gallivm = bld_base->base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMValueRef index_vec;
+   unsigned i;
+
+   index_vec = draw_gs_llvm_slot_indices(gs, bld_base,
+                                         emitted_prims_vec, mask);
+
+   for (i = 0; i < bld_base->base.type.length; i++) {
+      LLVMValueRef lane = lp_build_const_int32(gallivm, i);
+      LLVMValueRef index = LLVMBuildExtractElement(builder, index_vec,
+                                                   lane, "");
+      LLVMValueRef ptr = LLVMBuildGEP(builder, gs->prim_lengths,
+                                      &index, 1, "");
+      LLVMValueRef val = LLVMBuildExtractElement(builder, verts_per_prim_vec,
+                                                 lane, "");
+      LLVMBuildStore(builder, val, ptr);
+   }
+}
+
+
+static void
+draw_gs_llvm_epilogue(const struct lp_build_tgsi_gs_iface *gs_iface,
+                      struct lp_build_tgsi_context *bld_base,
+                      LLVMValueRef total_emitted_vertices_vec,
+                      LLVMValueRef emitted_prims_vec)
+{
+   const struct draw_gs_llvm_iface *gs = draw_gs_llvm_iface(gs_iface);
+   struct gallivm_state *gallivm = bld_base->base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef vec_ptr_type = LLVMPointerType(bld_base->uint_bld.vec_type, 0);
+   LLVMValueRef ptr;
+
+   ptr = LLVMBuildBitCast(builder, gs->emitted_vertices, vec_ptr_type, "");
+   lp_set_store_alignment(LLVMBuildStore(builder, total_emitted_vertices_vec,
+                                         ptr), sizeof(unsigned));
+
+   ptr = LLVMBuildBitCast(builder, gs->emitted_prims, vec_ptr_type, "");
+   lp_set_store_alignment(LLVMBuildStore(builder, emitted_prims_vec, ptr),
+                          sizeof(unsigned));
+}
+
+
+static void
+draw_gs_llvm_generate(struct draw_llvm *llvm,
+                      struct draw_gs_llvm_variant *variant,
+                      const struct draw_geometry_shader *shader)
+{
+   struct gallivm_state *gallivm = variant->gallivm;
+   LLVMContextRef context = gallivm->context;
+   LLVMTypeRef int32_type = LLVMInt32TypeInContext(context);
+   LLVMTypeRef arg_types[6];
+   LLVMTypeRef func_type;
+   LLVMValueRef variant_func;
+   LLVMValueRef context_ptr, consts_ptr;
+   LLVMBasicBlockRef block;
+   LLVMBuilderRef builder;
+   struct lp_type gs_type;
+   struct draw_gs_llvm_iface gs_iface;
+   struct lp_bld_tgsi_system_values system_values;
+   LLVMValueRef outputs[PIPE_MAX_SHADER_OUTPUTS][TGSI_NUM_CHANNELS];
+   unsigned i;
+
+   memset(&system_values, 0, sizeof(system_values));
+   memset(outputs, 0, sizeof(outputs));
+
+   arg_types[0] = variant->context_ptr_type;              /* context */
+   arg_types[1] = LLVMPointerType(LLVMFloatTypeInContext(context), 0);
+                                                          /* input */
+   arg_types[2] = variant->vertex_header_ptr_type;        /* io */
+   arg_types[3] = LLVMPointerType(int32_type, 0);         /* prim_lengths */
+   arg_types[4] = LLVMPointerType(int32_type, 0);         /* emitted_vertices */
+   arg_types[5] = LLVMPointerType(int32_type, 0);         /* emitted_prims */
+
+   func_type = LLVMFunctionType(LLVMVoidTypeInContext(context),
+                                arg_types, Elements(arg_types), 0);
+
+   variant_func = LLVMAddFunction(gallivm->module, "draw_gs_llvm_shader",
+                                  func_type);
+   variant->function = variant_func;
+
+   LLVMSetFunctionCallConv(variant_func, LLVMCCallConv);
+   for (i = 0; i < Elements(arg_types); ++i)
+      if (LLVMGetTypeKind(arg_types[i]) == LLVMPointerTypeKind)
+         LLVMAddAttribute(LLVMGetParam(variant_func, i),
+                          LLVMNoAliasAttribute);
+
+   memset(&gs_iface, 0, sizeof gs_iface);
+   gs_iface.base.max_output_vertices = shader->max_output_vertices;
+   gs_iface.base.fetch_input = draw_gs_llvm_fetch_input;
+   gs_iface.base.emit_vertex = draw_gs_llvm_emit_vertex;
+   gs_iface.base.end_primitive = draw_gs_llvm_end_primitive;
+   gs_iface.base.gs_epilogue = draw_gs_llvm_epilogue;
+   gs_iface.num_inputs = shader->info.num_inputs;
+   gs_iface.num_outputs = shader->info.num_outputs;
+   gs_iface.vertices_per_prim = u_vertices_per_prim(shader->input_primitive);
+
+   context_ptr                = LLVMGetParam(variant_func, 0);
+   gs_iface.input             = LLVMGetParam(variant_func, 1);
+   gs_iface.io                = LLVMGetParam(variant_func, 2);
+   gs_iface.prim_lengths      = LLVMGetParam(variant_func, 3);
+   gs_iface.emitted_vertices  = LLVMGetParam(variant_func, 4);
+   gs_iface.emitted_prims     = LLVMGetParam(variant_func, 5);
+
+   lp_build_name(context_ptr, "context");
+   lp_build_name(gs_iface.input, "input");
+   lp_build_name(gs_iface.io, "io");
+   lp_build_name(gs_iface.prim_lengths, "prim_lengths");
+   lp_build_name(gs_iface.emitted_vertices, "emitted_vertices");
+   lp_build_name(gs_iface.emitted_prims, "emitted_prims");
+
+   /*
+    * Function body
+    */
+
+   block = LLVMAppendBasicBlockInContext(gallivm->context, variant_func, "entry");
+   builder = gallivm->builder;
+   LLVMPositionBuilderAtEnd(builder, block);
+
+   memset(&gs_type, 0, sizeof gs_type);
+   gs_type.floating = TRUE; /* floating point values */
+   gs_type.sign = TRUE;     /* values are signed */
+   gs_type.norm = FALSE;    /* values are not limited to [0,1] or [-1,1] */
+   gs_type.width = 32;      /* 32-bit float */
+   gs_type.length = variant->vector_length;
+
+   consts_ptr = draw_jit_context_gs_constants(gallivm, context_ptr);
+
+   if (gallivm_debug & GALLIVM_DEBUG_IR) {
+      tgsi_dump(shader->state.tokens, 0);
+   }
+
+   lp_build_tgsi_soa(gallivm,
+                     shader->state.tokens,
+                     gs_type,
+                     NULL /*struct lp_build_mask_context *mask*/,
+                     consts_ptr,
+                     &system_values,
+                     NULL /*pos*/,
+                     NULL /*inputs*/,
+                     outputs,
+                     NULL /*sampler*/,
+                     &shader->info,
+                     &gs_iface.base);
+
+   LLVMBuildRetVoid(builder);
+
+   gallivm_verify_function(gallivm, variant_func);
+}
+
+
+/**
+ * Create LLVM-generated code for a geometry shader.
+ */
+struct draw_gs_llvm_variant *
+draw_gs_llvm_create_variant(struct draw_llvm *llvm,
+                            const struct draw_geometry_shader *shader)
+{
+   struct draw_gs_llvm_variant *variant;
+   LLVMTypeRef texture_type, context_type, vertex_header;
+
+   variant = CALLOC_STRUCT(draw_gs_llvm_variant);
+   if (variant == NULL)
+      return NULL;
+
+   variant->gallivm = gallivm_create();
+   variant->vector_length = lp_native_vector_width / 32;
+
+   texture_type = create_jit_texture_type(variant->gallivm, "texture");
+   context_type = create_jit_context_type(variant->gallivm, texture_type,
+                                          "draw_jit_context");
+   variant->context_ptr_type = LLVMPointerType(context_type, 0);
+
+   vertex_header = create_jit_vertex_header(variant->gallivm,
+                                            shader->info.num_outputs);
+   variant->vertex_header_ptr_type = LLVMPointerType(vertex_header, 0);
+
+   draw_gs_llvm_generate(llvm, variant, shader);
+
+   gallivm_compile_module(variant->gallivm);
+
+   variant->jit_func = (draw_gs_jit_func)
+         gallivm_jit_function(variant->gallivm, variant->function);
+
+   return variant;
+}
+
+
+void
+draw_gs_llvm_destroy_variant(struct draw_gs_llvm_variant *variant)
+{
    if (variant->function) {
       gallivm_free_function(variant->gallivm,
                             variant->function, variant->jit_func);
@@ -1426,9 +2244,5 @@ draw_llvm_destroy_variant(struct draw_llvm_variant *variant)
 
    gallivm_destroy(variant->gallivm);
 
-   remove_from_list(&variant->list_item_local);
-   variant->shader->variants_cached--;
-   remove_from_list(&variant->list_item_global);
-   llvm->nr_variants--;
    FREE(variant);
 }
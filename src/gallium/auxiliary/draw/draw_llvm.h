@@ -39,6 +39,10 @@
 
 struct draw_llvm;
 struct llvm_vertex_shader;
+struct draw_geometry_shader;
+struct vertex_info;
+struct draw_llvm_async_job;
+struct lp_compile_queue;
 
 struct draw_jit_texture
 {
@@ -138,6 +142,11 @@ struct draw_jit_context
    lp_build_struct_get(_gallivm, _ptr, 1, "buffer_offset")
 
 
+/*
+ * The vertex shader entry points.  The _emit variants store straight into
+ * the hardware vertex layout of the key instead, with io pointing at the
+ * mapped vbuf vertices.
+ */
 typedef int
 (*draw_jit_vert_func)(struct draw_jit_context *context,
                       struct vertex_header *io,
@@ -159,6 +168,28 @@ typedef int
                            struct pipe_vertex_buffer *vertex_buffers,
                            unsigned instance_id);
 
+/**
+ * Geometry shader entry point.  Each vector lane runs one input primitive;
+ * see struct draw_gs_llvm_variant for the buffer layouts.
+ */
+typedef void
+(*draw_gs_jit_func)(struct draw_jit_context *context,
+                    const float *input,
+                    struct vertex_header *io,
+                    unsigned *prim_lengths,
+                    unsigned *emitted_vertices,
+                    unsigned *emitted_prims);
+
+
+/**
+ * One attribute of the hardware vertex, EMIT_1F..EMIT_4F of an output.
+ */
+struct draw_llvm_emit_attrib
+{
+   ubyte src_index;
+   ubyte nr_components;
+};
+
 struct draw_llvm_variant_key
 {
    unsigned nr_vertex_elements:8;
@@ -173,6 +204,17 @@ struct draw_llvm_variant_key
    unsigned ucp_enable:PIPE_MAX_CLIP_PLANES;
    unsigned pad:9-PIPE_MAX_CLIP_PLANES;
 
+   /* Only clip x/y against the guard band, see DO_CLIP_XY_GUARD_BAND */
+   unsigned guard_band_xy:1;
+   unsigned pad2:7;
+
+   /* Hardware vertex layout for the fused fetch/shade/emit functions,
+    * nr_emit_attribs is zero if they aren't generated.
+    */
+   unsigned nr_emit_attribs:8;
+   unsigned emit_stride:16;
+   struct draw_llvm_emit_attrib emit_attrib[PIPE_MAX_SHADER_OUTPUTS];
+
    /* Variable number of vertex elements:
     */
    struct pipe_vertex_element vertex_element[1];
@@ -225,8 +267,32 @@ struct draw_llvm_variant
 
    LLVMValueRef function;
    LLVMValueRef function_elts;
+   LLVMValueRef function_emit;
+   LLVMValueRef function_elts_emit;
    draw_jit_vert_func jit_func;
    draw_jit_vert_func_elts jit_func_elts;
+   draw_jit_vert_func jit_func_emit;
+   draw_jit_vert_func_elts jit_func_elts_emit;
+
+   /** Number of attributes in the vertex header */
+   unsigned num_inputs;
+
+   /**
+    * Shader output locations, as they were when the variant was created.
+    * The optimized code is generated from these on a compile thread,
+    * which must not look at the draw context.
+    */
+   unsigned position_output;
+   unsigned clipvertex_output;
+   unsigned clipdistance_output[2];
+
+   /**
+    * Set if the code is fully optimized; otherwise the number of vertices
+    * shaded so far decides when to queue the optimized compilation.
+    */
+   boolean optimized;
+   unsigned num_vertices;
+   struct draw_llvm_async_job *async;
 
    struct llvm_vertex_shader *shader;
 
@@ -238,6 +304,30 @@ struct draw_llvm_variant
    struct draw_llvm_variant_key key;
 };
 
+/**
+ * A geometry shader compiled with gallivm.
+ *
+ * The inputs are SoA, input[vertex][attrib][chan][lane].  Lane i stores its
+ * n-th emitted vertex at io[i * (max_output_vertices + 1) + n] and the length
+ * of its n-th primitive at prim_lengths[i * (max_output_vertices + 1) + n];
+ * the extra slot of each lane absorbs the stores of masked-off lanes.  The
+ * per-lane totals are returned in emitted_vertices[] and emitted_prims[].
+ */
+struct draw_gs_llvm_variant
+{
+   struct gallivm_state *gallivm;
+
+   /* LLVM JIT builder types */
+   LLVMTypeRef context_ptr_type;
+   LLVMTypeRef vertex_header_ptr_type;
+
+   LLVMValueRef function;
+   draw_gs_jit_func jit_func;
+
+   /* number of primitives processed per call */
+   unsigned vector_length;
+};
+
 struct llvm_vertex_shader {
    struct draw_vertex_shader base;
 
@@ -250,6 +340,9 @@ struct llvm_vertex_shader {
 struct draw_llvm {
    struct draw_context *draw;
 
+   /** Compiles the optimized code of hot variants, or NULL */
+   struct lp_compile_queue *compile_queue;
+
    struct draw_jit_context jit_context;
 
    struct draw_llvm_variant_list_item vs_variants_list;
@@ -278,8 +371,23 @@ draw_llvm_create_variant(struct draw_llvm *llvm,
 void
 draw_llvm_destroy_variant(struct draw_llvm_variant *variant);
 
+void
+draw_llvm_shade_count(struct draw_llvm_variant *variant,
+                      unsigned count);
+
+void
+draw_llvm_finish_compiles(struct draw_llvm *llvm);
+
 struct draw_llvm_variant_key *
-draw_llvm_make_variant_key(struct draw_llvm *llvm, char *store);
+draw_llvm_make_variant_key(struct draw_llvm *llvm, char *store,
+                           const struct vertex_info *emit_vinfo);
+
+struct draw_gs_llvm_variant *
+draw_gs_llvm_create_variant(struct draw_llvm *llvm,
+                            const struct draw_geometry_shader *shader);
+
+void
+draw_gs_llvm_destroy_variant(struct draw_gs_llvm_variant *variant);
 
 struct lp_build_sampler_soa *
 draw_llvm_sampler_soa_create(const struct lp_sampler_static_state *static_state,
@@ -34,6 +34,7 @@
 
 #include "util/u_memory.h"
 #include "util/u_math.h"
+#include "util/u_sse.h"
 
 #include "pipe/p_shader_tokens.h"
 
@@ -64,6 +65,14 @@ struct clip_stage {
    /* Mask of attributes in noperspective mode */
    boolean noperspective_attribs[PIPE_MAX_SHADER_OUTPUTS];
 
+   /* Attributes interp() handles generically, split by interpolation
+    * mode.  Position and clip vertex are not included.
+    */
+   uint num_persp_attribs;
+   uint persp_attribs[PIPE_MAX_SHADER_OUTPUTS];
+   uint num_nopersp_attribs;
+   uint nopersp_attribs[PIPE_MAX_SHADER_OUTPUTS];
+
    float (*plane)[4];
 };
 
@@ -80,15 +89,23 @@ static INLINE struct clip_stage *clip_stage( struct draw_stage *stage )
 
 /* All attributes are float[4], so this is easy:
  */
-static void interp_attr( float dst[4],
-			 float t,
-			 const float in[4],
-			 const float out[4] )
+static INLINE void interp_attr( float dst[4],
+                                float t,
+                                const float in[4],
+                                const float out[4] )
 {  
+#if defined(PIPE_ARCH_SSE)
+   /* vertex_header data is only guaranteed 4-byte aligned */
+   const __m128 vout = _mm_loadu_ps(out);
+   const __m128 vin = _mm_loadu_ps(in);
+   const __m128 vt = _mm_set1_ps(t);
+   _mm_storeu_ps(dst, _mm_add_ps(vout, _mm_mul_ps(vt, _mm_sub_ps(vin, vout))));
+#else
    dst[0] = LINTERP( t, out[0], in[0] );
    dst[1] = LINTERP( t, out[1], in[1] );
    dst[2] = LINTERP( t, out[2], in[2] );
    dst[3] = LINTERP( t, out[3], in[3] );
+#endif
 }
 
 
@@ -117,9 +134,7 @@ static void interp( const struct clip_stage *clip,
 		    const struct vertex_header *out, 
 		    const struct vertex_header *in )
 {
-   const unsigned nr_attrs = draw_current_shader_outputs(clip->stage.draw);
    const unsigned pos_attr = draw_current_shader_position_output(clip->stage.draw);
-   const unsigned clip_attr = draw_current_shader_clipvertex_output(clip->stage.draw);
    unsigned j;
    float t_nopersp;
 
@@ -160,7 +175,7 @@ static void interp( const struct clip_stage *clip,
     * pick whatever value (the interpolated point won't be in front
     * anyway), so just use the 3d t.
     */
-   {
+   if (clip->num_nopersp_attribs) {
       int k;
       t_nopersp = t;
       for (k = 0; k < 2; k++)
@@ -169,17 +184,18 @@ static void interp( const struct clip_stage *clip,
                (in->data[pos_attr][k] - out->data[pos_attr][k]);
             break;
          }
+
+      for (j = 0; j < clip->num_nopersp_attribs; j++) {
+         const unsigned attr = clip->nopersp_attribs[j];
+         interp_attr(dst->data[attr], t_nopersp, in->data[attr], out->data[attr]);
+      }
    }
 
    /* Other attributes
     */
-   for (j = 0; j < nr_attrs; j++) {
-      if (j != pos_attr && j != clip_attr) {
-         if (clip->noperspective_attribs[j])
-            interp_attr(dst->data[j], t_nopersp, in->data[j], out->data[j]);
-         else
-            interp_attr(dst->data[j], t, in->data[j], out->data[j]);
-      }
+   for (j = 0; j < clip->num_persp_attribs; j++) {
+      const unsigned attr = clip->persp_attribs[j];
+      interp_attr(dst->data[attr], t, in->data[attr], out->data[attr]);
    }
 }
 
@@ -652,6 +668,22 @@ clip_init_state( struct draw_stage *stage )
       } else
          clipper->noperspective_attribs[i] = interp == TGSI_INTERPOLATE_LINEAR;
    }
+
+   /* Precompute the attribute lists interp() walks for every new vertex,
+    * so that its inner loops are free of per-attribute tests.
+    */
+   clipper->num_persp_attribs = 0;
+   clipper->num_nopersp_attribs = 0;
+   for (i = 0; i < draw_current_shader_outputs(stage->draw); i++) {
+      if (i == draw_current_shader_position_output(stage->draw) ||
+          i == draw_current_shader_clipvertex_output(stage->draw))
+         continue;
+
+      if (clipper->noperspective_attribs[i])
+         clipper->nopersp_attribs[clipper->num_nopersp_attribs++] = i;
+      else
+         clipper->persp_attribs[clipper->num_persp_attribs++] = i;
+   }
    
    stage->tri = clip_tri;
    stage->line = clip_line;
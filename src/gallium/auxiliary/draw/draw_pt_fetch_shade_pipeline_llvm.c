@@ -27,6 +27,7 @@
 
 #include "util/u_math.h"
 #include "util/u_memory.h"
+#include "util/u_cpu_detect.h"
 #include "draw/draw_context.h"
 #include "draw/draw_gs.h"
 #include "draw/draw_vbuf.h"
@@ -34,9 +35,48 @@
 #include "draw/draw_pt.h"
 #include "draw/draw_vs.h"
 #include "draw/draw_llvm.h"
+#include "draw/draw_vs_threads.h"
 #include "gallivm/lp_bld_init.h"
 
 
+/**
+ * Don't bother splitting vertex shading into runs shorter than this.
+ */
+#define MIN_VERTICES_PER_THREAD 256
+
+
+static unsigned
+draw_get_option_vs_threads(void)
+{
+   static boolean first = TRUE;
+   static unsigned value;
+   if (first) {
+      first = FALSE;
+      util_cpu_detect();
+      value = util_cpu_caps.nr_cpus > 1 ? MIN2(util_cpu_caps.nr_cpus - 1, 4) : 0;
+      value = debug_get_num_option("DRAW_VS_THREADS", value);
+   }
+   return value;
+}
+
+
+/**
+ * Whether runs which need no clipping may be shaded straight into the
+ * render's vertex buffer.
+ */
+static boolean
+draw_get_option_fused_emit(void)
+{
+   static boolean first = TRUE;
+   static boolean value;
+   if (first) {
+      first = FALSE;
+      value = debug_get_bool_option("DRAW_FUSED_EMIT", TRUE);
+   }
+   return value;
+}
+
+
 struct llvm_middle_end {
    struct draw_pt_middle_end base;
    struct draw_context *draw;
@@ -54,6 +94,28 @@ struct llvm_middle_end {
 
    struct draw_llvm *llvm;
    struct draw_llvm_variant *current_variant;
+
+   /** Set once a fused run had to be redone for clipping */
+   boolean fused_emit_failed;
+
+   /** Vertex shading helper threads, created on first use */
+   unsigned num_threads;
+   struct draw_vs_threads *threads;
+};
+
+
+/**
+ * A vertex run split into chunks which are shaded concurrently.
+ */
+struct llvm_vs_job
+{
+   struct llvm_middle_end *fpme;
+   const struct draw_fetch_info *fetch_info;
+   struct vertex_header *verts;
+   unsigned vertex_stride;
+   boolean emit;
+   unsigned chunk_size;
+   unsigned clipped[DRAW_MAX_VS_THREADS + 1];
 };
 
 
@@ -69,6 +131,7 @@ llvm_middle_end_prepare( struct draw_pt_middle_end *middle,
       llvm_vertex_shader(draw->vs.vertex_shader);
    char store[DRAW_LLVM_MAX_VARIANT_KEY_SIZE];
    struct draw_llvm_variant_key *key;
+   const struct vertex_info *emit_vinfo = NULL;
    struct draw_llvm_variant *variant = NULL;
    struct draw_llvm_variant_list_item *li;
    const unsigned out_prim = (draw->gs.geometry_shader ? 
@@ -110,6 +173,14 @@ llvm_middle_end_prepare( struct draw_pt_middle_end *middle,
 			    out_prim,
                             max_vertices );
 
+      /* Without a GS or stream output the shaded vertices go straight to
+       * the render, so they can be written in its layout right away.
+       */
+      if (draw_get_option_fused_emit() &&
+          !draw->gs.geometry_shader &&
+          !draw->vs.vertex_shader->state.stream_output.num_outputs)
+         emit_vinfo = draw->render->get_vertex_info(draw->render);
+
       *max_vertices = MAX2( *max_vertices, 4096 );
    }
    else {
@@ -120,7 +191,7 @@ llvm_middle_end_prepare( struct draw_pt_middle_end *middle,
    /* return even number */
    *max_vertices = *max_vertices & ~1;
    
-   key = draw_llvm_make_variant_key(fpme->llvm, store);
+   key = draw_llvm_make_variant_key(fpme->llvm, store, emit_vinfo);
 
    /* Search shader's list of variants for the key */
    li = first_elem(&shader->variants);
@@ -170,6 +241,7 @@ llvm_middle_end_prepare( struct draw_pt_middle_end *middle,
    }
 
    fpme->current_variant = variant;
+   fpme->fused_emit_failed = FALSE;
 
    /*XXX we only support one constant buffer */
    fpme->llvm->jit_context.vs_constants =
@@ -210,6 +282,208 @@ static void emit(struct pt_emit *emit,
    }
 }
 
+/**
+ * Fetch and shade vertices [first, first + count) of the fetch info into
+ * verts, which points at vertex 'first' of the output.  With emit, verts
+ * is the render's vertex buffer and gets the final hardware vertices.
+ */
+static unsigned
+llvm_fetch_shade_range(struct llvm_middle_end *fpme,
+                       const struct draw_fetch_info *fetch_info,
+                       struct vertex_header *verts,
+                       unsigned first,
+                       unsigned count,
+                       boolean emit)
+{
+   struct draw_context *draw = fpme->draw;
+   struct draw_llvm_variant *variant = fpme->current_variant;
+
+   if (emit) {
+      if (fetch_info->linear)
+         return variant->jit_func_emit( &fpme->llvm->jit_context,
+                                        verts,
+                                        (const char **)draw->pt.user.vbuffer,
+                                        fetch_info->start + first,
+                                        count,
+                                        fpme->vertex_size,
+                                        draw->pt.vertex_buffer,
+                                        draw->instance_id);
+      else
+         return variant->jit_func_elts_emit( &fpme->llvm->jit_context,
+                                             verts,
+                                             (const char **)draw->pt.user.vbuffer,
+                                             fetch_info->elts + first,
+                                             count,
+                                             fpme->vertex_size,
+                                             draw->pt.vertex_buffer,
+                                             draw->instance_id);
+   }
+
+   if (fetch_info->linear)
+      return fpme->current_variant->jit_func( &fpme->llvm->jit_context,
+                                       verts,
+                                       (const char **)draw->pt.user.vbuffer,
+                                       fetch_info->start + first,
+                                       count,
+                                       fpme->vertex_size,
+                                       draw->pt.vertex_buffer,
+                                       draw->instance_id);
+   else
+      return fpme->current_variant->jit_func_elts( &fpme->llvm->jit_context,
+                                            verts,
+                                            (const char **)draw->pt.user.vbuffer,
+                                            fetch_info->elts + first,
+                                            count,
+                                            fpme->vertex_size,
+                                            draw->pt.vertex_buffer,
+                                            draw->instance_id);
+}
+
+
+static void
+llvm_fetch_shade_task(void *data, unsigned task)
+{
+   struct llvm_vs_job *job = (struct llvm_vs_job *) data;
+   const struct draw_fetch_info *fetch_info = job->fetch_info;
+   unsigned first = task * job->chunk_size;
+   unsigned count = MIN2(job->chunk_size, fetch_info->count - first);
+   struct vertex_header *verts = (struct vertex_header *)
+      ((char *) job->verts + first * job->vertex_stride);
+
+   job->clipped[task] = llvm_fetch_shade_range(job->fpme, fetch_info,
+                                               verts, first, count,
+                                               job->emit);
+}
+
+
+/**
+ * Fetch and shade all vertices of the fetch info, spreading large runs
+ * over the helper threads.  Returns non-zero if any vertex was clipped.
+ */
+static unsigned
+llvm_fetch_shade(struct llvm_middle_end *fpme,
+                 const struct draw_fetch_info *fetch_info,
+                 struct vertex_header *verts,
+                 boolean emit)
+{
+   const unsigned vector_length = lp_native_vector_width / 32;
+   struct llvm_vs_job job;
+   unsigned num_tasks;
+   unsigned clipped = 0;
+   unsigned i;
+
+   /* May queue the compilation of optimized code. */
+   draw_llvm_shade_count(fpme->current_variant, fetch_info->count);
+
+   num_tasks = MIN2(fpme->num_threads + 1,
+                    fetch_info->count / MIN_VERTICES_PER_THREAD);
+
+   if (num_tasks > 1 && !fpme->threads) {
+      fpme->threads = draw_vs_threads_create(fpme->num_threads);
+      fpme->num_threads = draw_vs_threads_count(fpme->threads);
+      num_tasks = MIN2(num_tasks, fpme->num_threads + 1);
+   }
+
+   if (num_tasks <= 1) {
+      return llvm_fetch_shade_range(fpme, fetch_info, verts,
+                                    0, fetch_info->count, emit);
+   }
+
+   /*
+    * Keep all chunks but the last a multiple of the vector length, as
+    * the shader writes whole vectors of vertices.
+    */
+   job.fpme = fpme;
+   job.fetch_info = fetch_info;
+   job.verts = verts;
+   job.vertex_stride = emit ? fpme->current_variant->key.emit_stride :
+                              fpme->vertex_size;
+   job.emit = emit;
+   job.chunk_size = align((fetch_info->count + num_tasks - 1) / num_tasks,
+                          vector_length);
+   num_tasks = (fetch_info->count + job.chunk_size - 1) / job.chunk_size;
+
+   draw_vs_threads_run(fpme->threads, num_tasks,
+                       llvm_fetch_shade_task, &job);
+
+   for (i = 0; i < num_tasks; i++)
+      clipped |= job.clipped[i];
+
+   return clipped;
+}
+
+
+/**
+ * Fetch and shade the vertices straight into the render's vertex buffer
+ * and draw them, skipping the intermediate vertex headers and the emit
+ * pass.
+ *
+ * Returns FALSE, without drawing anything, if some vertex needs clipping
+ * or the vertex buffer can't be had; the caller then takes the regular
+ * path.
+ */
+static boolean
+llvm_fused_emit(struct llvm_middle_end *fpme,
+                const struct draw_fetch_info *fetch_info,
+                const struct draw_prim_info *prim_info)
+{
+   struct draw_context *draw = fpme->draw;
+   struct vbuf_render *render = draw->render;
+   const unsigned stride = fpme->current_variant->key.emit_stride;
+   const unsigned count = fetch_info->count;
+   unsigned clipped, start, i;
+   void *hw_verts;
+
+   if (count == 0)
+      return FALSE;
+
+   /* XXX: need to flush to get prim_vbuf.c to release its allocation??
+    */
+   draw_do_flush( draw, DRAW_FLUSH_BACKEND );
+
+   render->set_primitive(render, prim_info->prim);
+
+   if (!render->allocate_vertices(render, (ushort)stride, (ushort)count))
+      return FALSE;
+
+   hw_verts = render->map_vertices(render);
+   if (!hw_verts) {
+      render->release_vertices(render);
+      return FALSE;
+   }
+
+   clipped = llvm_fetch_shade(fpme, fetch_info,
+                              (struct vertex_header *)hw_verts, TRUE);
+
+   render->unmap_vertices(render, 0, count - 1);
+
+   if (clipped) {
+      /* Don't keep shading twice for the rest of this draw */
+      render->release_vertices(render);
+      fpme->fused_emit_failed = TRUE;
+      return FALSE;
+   }
+
+   for (start = i = 0;
+        i < prim_info->primitive_count;
+        start += prim_info->primitive_lengths[i], i++)
+   {
+      if (prim_info->linear)
+         render->draw_arrays(render,
+                             start,
+                             prim_info->primitive_lengths[i]);
+      else
+         render->draw_elements(render,
+                               prim_info->elts + start,
+                               prim_info->primitive_lengths[i]);
+   }
+
+   render->release_vertices(render);
+
+   return TRUE;
+}
+
+
 static void
 llvm_pipeline_generic( struct draw_pt_middle_end *middle,
                        const struct draw_fetch_info *fetch_info,
@@ -225,6 +499,11 @@ llvm_pipeline_generic( struct draw_pt_middle_end *middle,
    unsigned opt = fpme->opt;
    unsigned clipped = 0;
 
+   if (fpme->current_variant->jit_func_emit &&
+       !fpme->fused_emit_failed &&
+       llvm_fused_emit(fpme, fetch_info, prim_info))
+      return;
+
    llvm_vert_info.count = fetch_info->count;
    llvm_vert_info.vertex_size = fpme->vertex_size;
    llvm_vert_info.stride = fpme->vertex_size;
@@ -236,24 +515,7 @@ llvm_pipeline_generic( struct draw_pt_middle_end *middle,
       return;
    }
 
-   if (fetch_info->linear)
-      clipped = fpme->current_variant->jit_func( &fpme->llvm->jit_context,
-                                       llvm_vert_info.verts,
-                                       (const char **)draw->pt.user.vbuffer,
-                                       fetch_info->start,
-                                       fetch_info->count,
-                                       fpme->vertex_size,
-                                       draw->pt.vertex_buffer,
-                                       draw->instance_id);
-   else
-      clipped = fpme->current_variant->jit_func_elts( &fpme->llvm->jit_context,
-                                            llvm_vert_info.verts,
-                                            (const char **)draw->pt.user.vbuffer,
-                                            fetch_info->elts,
-                                            fetch_info->count,
-                                            fpme->vertex_size,
-                                            draw->pt.vertex_buffer,
-                                            draw->instance_id);
+   clipped = llvm_fetch_shade(fpme, fetch_info, llvm_vert_info.verts, FALSE);
 
    /* Finished with fetch and vs:
     */
@@ -414,6 +676,8 @@ static void llvm_middle_end_destroy( struct draw_pt_middle_end *middle )
    if (fpme->post_vs)
       draw_pt_post_vs_destroy( fpme->post_vs );
 
+   draw_vs_threads_destroy( fpme->threads );
+
    FREE(middle);
 }
 
@@ -461,6 +725,8 @@ draw_pt_fetch_pipeline_or_emit_llvm(struct draw_context *draw)
 
    fpme->current_variant = NULL;
 
+   fpme->num_threads = draw_get_option_vs_threads();
+
    return &fpme->base;
 
  fail:
@@ -24,6 +24,8 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include "util/u_bitmask.h"
+#include "util/u_debug.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
 
@@ -31,8 +33,35 @@
 #include "draw/draw_private.h"
 #include "draw/draw_pt.h"
 
-#define SEGMENT_SIZE 1024
-#define MAP_SIZE     256
+/* Large enough for the llvm middle end to split a segment's vertex
+ * shading across threads (see draw_pt_fetch_shade_pipeline_llvm.c).
+ */
+#define SEGMENT_SIZE 4096
+
+#define VCACHE_HASH_SIZE (2 * SEGMENT_SIZE)
+#define VCACHE_NIL       0xffff
+
+/* Number of shaded vertices the post-transform cache remembers.  Zero
+ * (the default) keeps every vertex of the segment, ie. each fetch
+ * element is shaded at most once per segment.
+ */
+DEBUG_GET_ONCE_NUM_OPTION(draw_vcache_size, "DRAW_VCACHE_SIZE", 0)
+/* Replace the least recently used vertex instead of the oldest one. */
+DEBUG_GET_ONCE_BOOL_OPTION(draw_vcache_lru, "DRAW_VCACHE_LRU", FALSE)
+/* Print vertex shader invocations against unique indices per draw. */
+DEBUG_GET_ONCE_BOOL_OPTION(draw_vcache_stats, "DRAW_VCACHE_STATS", FALSE)
+
+
+/**
+ * A vertex in the post-transform cache.
+ */
+struct vsplit_vcache_entry {
+   unsigned fetch;   /**< fetch element */
+   ushort draw;      /**< draw element of the shaded vertex */
+   ushort next;      /**< next entry in the same hash bucket */
+   ushort prev_use;  /**< replacement order, only used when bounded */
+   ushort next_use;
+};
 
 struct vsplit_frontend {
    struct draw_pt_front_end base;
@@ -50,23 +79,67 @@ struct vsplit_frontend {
    ushort draw_elts[SEGMENT_SIZE];
    ushort identity_draw_elts[SEGMENT_SIZE];
 
+   /**
+    * Post-transform vertex cache: maps a fetch element to the draw
+    * element its vertex was shaded into within the current segment.
+    *
+    * Buckets are tagged with the segment's stamp so that starting a
+    * new segment does not have to clear the table.  When the cache is
+    * bounded, entries are kept on a list ordered by insertion (FIFO) or
+    * by last use (LRU) and the tail is recycled once the cache is full.
+    */
    struct {
-      /* map a fetch element to a draw element */
-      unsigned fetches[MAP_SIZE];
-      ushort draws[MAP_SIZE];
-      boolean has_max_fetch;
+      struct vsplit_vcache_entry entries[SEGMENT_SIZE];
+      ushort buckets[VCACHE_HASH_SIZE];
+      unsigned bucket_stamp[VCACHE_HASH_SIZE];
+      unsigned stamp;
+
+      ushort num_entries;
+      ushort head, tail;  /**< most and least recently inserted/used */
+
+      ushort size;        /**< DRAW_VCACHE_SIZE, zero for unbounded */
+      boolean lru;        /**< DRAW_VCACHE_LRU */
+      ushort capacity;    /**< effective capacity for this prepare */
+      boolean bounded;    /**< capacity is below the segment size */
 
       ushort num_fetch_elts;
       ushort num_draw_elts;
    } cache;
+
+   /* DRAW_VCACHE_STATS; seen is only allocated while a draw is counted */
+   struct {
+      boolean enabled;
+      /** run function of the index type, wrapped by vsplit_run_stats */
+      void (*run)(struct draw_pt_front_end *, unsigned start, unsigned count);
+      struct util_bitmask *seen;
+      unsigned indices;
+      unsigned invocations;
+      unsigned unique;
+   } stats;
 };
 
 
+static INLINE void
+vsplit_stats_mark(struct vsplit_frontend *vsplit, unsigned fetch)
+{
+   if (!util_bitmask_get(vsplit->stats.seen, fetch)) {
+      util_bitmask_set(vsplit->stats.seen, fetch);
+      vsplit->stats.unique++;
+   }
+}
+
+
 static void
 vsplit_clear_cache(struct vsplit_frontend *vsplit)
 {
-   memset(vsplit->cache.fetches, 0xff, sizeof(vsplit->cache.fetches));
-   vsplit->cache.has_max_fetch = FALSE;
+   if (++vsplit->cache.stamp == 0) {
+      memset(vsplit->cache.bucket_stamp, 0,
+             sizeof(vsplit->cache.bucket_stamp));
+      vsplit->cache.stamp = 1;
+   }
+   vsplit->cache.num_entries = 0;
+   vsplit->cache.head = VCACHE_NIL;
+   vsplit->cache.tail = VCACHE_NIL;
    vsplit->cache.num_fetch_elts = 0;
    vsplit->cache.num_draw_elts = 0;
 }
@@ -74,11 +147,66 @@ vsplit_clear_cache(struct vsplit_frontend *vsplit)
 static void
 vsplit_flush_cache(struct vsplit_frontend *vsplit, unsigned flags)
 {
+   if (vsplit->stats.seen) {
+      vsplit->stats.indices += vsplit->cache.num_draw_elts;
+      vsplit->stats.invocations += vsplit->cache.num_fetch_elts;
+   }
+
    vsplit->middle->run(vsplit->middle,
          vsplit->fetch_elts, vsplit->cache.num_fetch_elts,
          vsplit->draw_elts, vsplit->cache.num_draw_elts, flags);
 }
 
+
+static INLINE void
+vsplit_vcache_unlink_use(struct vsplit_frontend *vsplit, ushort e)
+{
+   struct vsplit_vcache_entry *entry = &vsplit->cache.entries[e];
+
+   if (entry->prev_use != VCACHE_NIL)
+      vsplit->cache.entries[entry->prev_use].next_use = entry->next_use;
+   else
+      vsplit->cache.head = entry->next_use;
+
+   if (entry->next_use != VCACHE_NIL)
+      vsplit->cache.entries[entry->next_use].prev_use = entry->prev_use;
+   else
+      vsplit->cache.tail = entry->prev_use;
+}
+
+static INLINE void
+vsplit_vcache_push_use(struct vsplit_frontend *vsplit, ushort e)
+{
+   struct vsplit_vcache_entry *entry = &vsplit->cache.entries[e];
+
+   entry->prev_use = VCACHE_NIL;
+   entry->next_use = vsplit->cache.head;
+   if (vsplit->cache.head != VCACHE_NIL)
+      vsplit->cache.entries[vsplit->cache.head].prev_use = e;
+   else
+      vsplit->cache.tail = e;
+   vsplit->cache.head = e;
+}
+
+/**
+ * Take the least recently inserted (or used) entry out of the cache.
+ */
+static ushort
+vsplit_vcache_evict(struct vsplit_frontend *vsplit)
+{
+   ushort e = vsplit->cache.tail;
+   unsigned hash = vsplit->cache.entries[e].fetch % VCACHE_HASH_SIZE;
+   ushort *link = &vsplit->cache.buckets[hash];
+
+   vsplit_vcache_unlink_use(vsplit, e);
+
+   while (*link != e)
+      link = &vsplit->cache.entries[*link].next;
+   *link = vsplit->cache.entries[e].next;
+
+   return e;
+}
+
 /**
  * Add a fetch element and add it to the draw elements.
  */
@@ -86,41 +214,53 @@ static INLINE void
 vsplit_add_cache(struct vsplit_frontend *vsplit, unsigned fetch)
 {
    struct draw_context *draw = vsplit->draw;
+   struct vsplit_vcache_entry *entries = vsplit->cache.entries;
    unsigned hash;
+   ushort e = VCACHE_NIL;
 
    fetch = MIN2(fetch, draw->pt.max_index);
 
-   hash = fetch % MAP_SIZE;
+   hash = fetch % VCACHE_HASH_SIZE;
 
-   if (vsplit->cache.fetches[hash] != fetch) {
+   if (vsplit->cache.bucket_stamp[hash] == vsplit->cache.stamp) {
+      e = vsplit->cache.buckets[hash];
+      while (e != VCACHE_NIL && entries[e].fetch != fetch)
+         e = entries[e].next;
+   }
+   else {
+      vsplit->cache.bucket_stamp[hash] = vsplit->cache.stamp;
+      vsplit->cache.buckets[hash] = VCACHE_NIL;
+   }
+
+   if (e == VCACHE_NIL) {
       /* update cache */
-      vsplit->cache.fetches[hash] = fetch;
-      vsplit->cache.draws[hash] = vsplit->cache.num_fetch_elts;
+      if (vsplit->cache.num_entries < vsplit->cache.capacity)
+         e = vsplit->cache.num_entries++;
+      else
+         e = vsplit_vcache_evict(vsplit);
+
+      entries[e].fetch = fetch;
+      entries[e].draw = vsplit->cache.num_fetch_elts;
+      entries[e].next = vsplit->cache.buckets[hash];
+      vsplit->cache.buckets[hash] = e;
+
+      if (vsplit->cache.bounded)
+         vsplit_vcache_push_use(vsplit, e);
 
       /* add fetch */
       assert(vsplit->cache.num_fetch_elts < vsplit->segment_size);
       vsplit->fetch_elts[vsplit->cache.num_fetch_elts++] = fetch;
-   }
-
-   vsplit->draw_elts[vsplit->cache.num_draw_elts++] = vsplit->cache.draws[hash];
-}
-
 
-/**
- * Add a fetch element and add it to the draw elements.  The fetch element is
- * in full range (uint).
- */
-static INLINE void
-vsplit_add_cache_uint(struct vsplit_frontend *vsplit, unsigned fetch)
-{
-   /* special care for 0xffffffff */
-   if (fetch == 0xffffffff && !vsplit->cache.has_max_fetch) {
-      unsigned hash = fetch % MAP_SIZE;
-      vsplit->cache.fetches[hash] = fetch - 1; /* force update */
-      vsplit->cache.has_max_fetch = TRUE;
+      if (vsplit->stats.seen)
+         vsplit_stats_mark(vsplit, fetch);
+   }
+   else if (vsplit->cache.bounded && vsplit->cache.lru &&
+            vsplit->cache.head != e) {
+      vsplit_vcache_unlink_use(vsplit, e);
+      vsplit_vcache_push_use(vsplit, e);
    }
 
-   vsplit_add_cache(vsplit, fetch);
+   vsplit->draw_elts[vsplit->cache.num_draw_elts++] = entries[e].draw;
 }
 
 
@@ -139,10 +279,42 @@ vsplit_add_cache_uint(struct vsplit_frontend *vsplit, unsigned fetch)
 
 #define FUNC vsplit_run_uint
 #define ELT_TYPE uint
-#define ADD_CACHE(vsplit, fetch) vsplit_add_cache_uint(vsplit, fetch)
+#define ADD_CACHE(vsplit, fetch) vsplit_add_cache(vsplit, fetch)
 #include "draw_pt_vsplit_tmp.h"
 
 
+/**
+ * Wraps the indexed run functions to report how many vertices were
+ * shaded against how many distinct indices the draw references.
+ */
+static void
+vsplit_run_stats(struct draw_pt_front_end *frontend,
+                 unsigned start, unsigned count)
+{
+   struct vsplit_frontend *vsplit = (struct vsplit_frontend *) frontend;
+
+   vsplit->stats.indices = 0;
+   vsplit->stats.invocations = 0;
+   vsplit->stats.unique = 0;
+   vsplit->stats.seen = util_bitmask_create();
+
+   vsplit->stats.run(frontend, start, count);
+
+   if (vsplit->stats.seen) {
+      debug_printf("draw: %u indices, %u unique, %u vs invocations "
+                   "(%.2f per unique index)\n",
+                   vsplit->stats.indices, vsplit->stats.unique,
+                   vsplit->stats.invocations,
+                   vsplit->stats.unique ?
+                   (double) vsplit->stats.invocations / vsplit->stats.unique :
+                   0.0);
+
+      util_bitmask_destroy(vsplit->stats.seen);
+      vsplit->stats.seen = NULL;
+   }
+}
+
+
 static void vsplit_prepare(struct draw_pt_front_end *frontend,
                            unsigned in_prim,
                            struct draw_pt_middle_end *middle,
@@ -175,6 +347,19 @@ static void vsplit_prepare(struct draw_pt_front_end *frontend,
    middle->prepare(middle, vsplit->prim, opt, &vsplit->max_vertices);
 
    vsplit->segment_size = MIN2(SEGMENT_SIZE, vsplit->max_vertices);
+
+   /* A segment never references more vertices than its size, so larger
+    * caches behave as unbounded ones.
+    */
+   vsplit->cache.bounded = (vsplit->cache.size &&
+                            vsplit->cache.size < vsplit->segment_size);
+   vsplit->cache.capacity = vsplit->cache.bounded ?
+      vsplit->cache.size : vsplit->segment_size;
+
+   if (vsplit->stats.enabled && vsplit->draw->pt.user.eltSize) {
+      vsplit->stats.run = vsplit->base.run;
+      vsplit->base.run = vsplit_run_stats;
+   }
 }
 
 
@@ -209,6 +394,11 @@ struct draw_pt_front_end *draw_pt_vsplit(struct draw_context *draw)
    vsplit->base.destroy = vsplit_destroy;
    vsplit->draw = draw;
 
+   vsplit->cache.size = CLAMP(debug_get_option_draw_vcache_size(),
+                              0, SEGMENT_SIZE);
+   vsplit->cache.lru = debug_get_option_draw_vcache_lru();
+   vsplit->stats.enabled = debug_get_option_draw_vcache_stats();
+
    for (i = 0; i < SEGMENT_SIZE; i++)
       vsplit->identity_draw_elts[i] = i;
 
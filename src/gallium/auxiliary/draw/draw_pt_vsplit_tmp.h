@@ -108,6 +108,13 @@ CONCAT(vsplit_primitive_, ELT_TYPE)(struct vsplit_frontend *vsplit,
       draw_elts = vsplit->draw_elts;
    }
 
+   if (vsplit->stats.seen) {
+      vsplit->stats.indices += icount;
+      vsplit->stats.invocations += fetch_count;
+      for (i = 0; i < icount; i++)
+         vsplit_stats_mark(vsplit, (unsigned) ((int) ib[i] + elt_bias));
+   }
+
    return vsplit->middle->run_linear_elts(vsplit->middle,
                                           fetch_start, fetch_count,
                                           draw_elts, icount, 0x0);
@@ -0,0 +1,203 @@
+/**************************************************************************
+ *
+ * Copyright 2012 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Helper threads for vertex shading.
+ *
+ * draw_vs_threads_run() hands out tasks to the helper threads and to the
+ * calling thread alike, and returns once all of them have completed.
+ * Only the vertex fetch/shade stage is run this way; everything after it
+ * (clipping, primitive assembly, the vbuf backend) stays on the calling
+ * thread, so primitives reach the driver in API order.
+ */
+
+#include "os/os_thread.h"
+#include "util/u_memory.h"
+#include "util/u_math.h"
+#include "draw_vs_threads.h"
+
+
+struct draw_vs_threads
+{
+   unsigned num_threads;
+   pipe_thread threads[DRAW_MAX_VS_THREADS];
+
+   pipe_mutex mutex;
+   pipe_condvar work;     /**< signalled on new work and on exit */
+   pipe_condvar done;     /**< signalled when the last task completes */
+
+   /** Incremented for each draw_vs_threads_run() call */
+   unsigned generation;
+   boolean exit_flag;
+
+   draw_vs_task_func func;
+   void *data;
+   unsigned num_tasks;
+   unsigned next_task;
+   unsigned tasks_done;
+};
+
+
+/**
+ * Run tasks of the current batch until none are left.
+ * Called with the mutex held.
+ */
+static void
+run_tasks(struct draw_vs_threads *pool)
+{
+   while (pool->next_task < pool->num_tasks) {
+      unsigned task = pool->next_task++;
+
+      pipe_mutex_unlock(pool->mutex);
+      pool->func(pool->data, task);
+      pipe_mutex_lock(pool->mutex);
+
+      if (++pool->tasks_done == pool->num_tasks)
+         pipe_condvar_broadcast(pool->done);
+   }
+}
+
+
+static PIPE_THREAD_ROUTINE( vs_thread_function, init_data )
+{
+   struct draw_vs_threads *pool = (struct draw_vs_threads *) init_data;
+   unsigned generation;
+
+   pipe_mutex_lock(pool->mutex);
+
+   generation = pool->generation;
+
+   while (1) {
+      while (generation == pool->generation && !pool->exit_flag)
+         pipe_condvar_wait(pool->work, pool->mutex);
+
+      if (pool->exit_flag)
+         break;
+
+      generation = pool->generation;
+      run_tasks(pool);
+   }
+
+   pipe_mutex_unlock(pool->mutex);
+
+   return NULL;
+}
+
+
+/**
+ * Create a pool with the given number of helper threads.
+ * Returns NULL if num_threads is zero.
+ */
+struct draw_vs_threads *
+draw_vs_threads_create(unsigned num_threads)
+{
+   struct draw_vs_threads *pool;
+   unsigned i;
+
+   num_threads = MIN2(num_threads, DRAW_MAX_VS_THREADS);
+   if (num_threads == 0)
+      return NULL;
+
+   pool = CALLOC_STRUCT(draw_vs_threads);
+   if (!pool)
+      return NULL;
+
+   pipe_mutex_init(pool->mutex);
+   pipe_condvar_init(pool->work);
+   pipe_condvar_init(pool->done);
+
+   pool->num_threads = num_threads;
+
+   for (i = 0; i < num_threads; i++) {
+      pool->threads[i] = pipe_thread_create(vs_thread_function,
+                                            (void *) pool);
+   }
+
+   return pool;
+}
+
+
+void
+draw_vs_threads_destroy(struct draw_vs_threads *pool)
+{
+   unsigned i;
+
+   if (!pool)
+      return;
+
+   pipe_mutex_lock(pool->mutex);
+   pool->exit_flag = TRUE;
+   pipe_condvar_broadcast(pool->work);
+   pipe_mutex_unlock(pool->mutex);
+
+   for (i = 0; i < pool->num_threads; i++) {
+      pipe_thread_wait(pool->threads[i]);
+   }
+
+   pipe_condvar_destroy(pool->done);
+   pipe_condvar_destroy(pool->work);
+   pipe_mutex_destroy(pool->mutex);
+
+   FREE(pool);
+}
+
+
+unsigned
+draw_vs_threads_count(const struct draw_vs_threads *pool)
+{
+   return pool ? pool->num_threads : 0;
+}
+
+
+/**
+ * Call func(data, task) for each task in [0, num_tasks), spread over the
+ * helper threads and the calling thread.  Blocks until all are done.
+ */
+void
+draw_vs_threads_run(struct draw_vs_threads *pool,
+                    unsigned num_tasks,
+                    draw_vs_task_func func,
+                    void *data)
+{
+   pipe_mutex_lock(pool->mutex);
+
+   pool->func = func;
+   pool->data = data;
+   pool->num_tasks = num_tasks;
+   pool->next_task = 0;
+   pool->tasks_done = 0;
+   pool->generation++;
+
+   pipe_condvar_broadcast(pool->work);
+
+   run_tasks(pool);
+
+   while (pool->tasks_done < pool->num_tasks)
+      pipe_condvar_wait(pool->done, pool->mutex);
+
+   pipe_mutex_unlock(pool->mutex);
+}
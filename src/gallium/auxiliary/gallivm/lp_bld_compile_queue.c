@@ -0,0 +1,350 @@
+/**************************************************************************
+ *
+ * Copyright 2012 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Background shader compilation threads.
+ */
+
+#include "os/os_thread.h"
+#include "util/u_debug.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "lp_bld_init.h"
+#include "lp_bld_compile_queue.h"
+
+
+struct lp_compile_worker
+{
+   struct lp_compile_queue *queue;
+   unsigned index;
+   pipe_thread thread;
+
+   /** Pending jobs, in submission order */
+   struct lp_compile_job *head, *tail;
+   unsigned num_pending;
+};
+
+
+struct lp_compile_queue
+{
+   pipe_mutex mutex;
+   pipe_condvar change;   /**< signalled on submit, completion and exit */
+   boolean exit_flag;
+
+   unsigned num_threads;
+   struct lp_compile_worker *workers;
+
+   /** Max number of jobs built into one module */
+   unsigned max_batch;
+};
+
+
+/**
+ * Build a list of batchable jobs into one module, compile it and let each
+ * job pick up its code.
+ */
+static void
+compile_batch(struct lp_compile_job *jobs, LLVMContextRef context)
+{
+   struct gallivm_state *gallivm;
+   struct lp_compile_job *job;
+
+   gallivm = gallivm_create_ext(context, 0);
+   if (!gallivm) {
+      for (job = jobs; job; job = job->next)
+         job->execute(job, context);
+      return;
+   }
+
+   for (job = jobs; job; job = job->next)
+      job->build(job, gallivm);
+
+   gallivm_compile_module(gallivm);
+
+   for (job = jobs; job; job = job->next)
+      job->finish(job, gallivm);
+
+   /* The jobs hold their own references to the module now. */
+   gallivm_destroy(gallivm);
+}
+
+
+static PIPE_THREAD_ROUTINE( compile_thread_function, init_data )
+{
+   struct lp_compile_worker *worker = (struct lp_compile_worker *) init_data;
+   struct lp_compile_queue *queue = worker->queue;
+   LLVMContextRef context;
+
+   /* Like the shared gallivm context, this is never freed. */
+   context = LLVMContextCreate();
+
+   pipe_mutex_lock(queue->mutex);
+
+   while (1) {
+      struct lp_compile_job *job, *last, *next;
+      unsigned num_jobs = 1;
+
+      /* Drain the pending jobs before exiting, as they may free code
+       * which lives in this worker's context.
+       */
+      while (!worker->head && !queue->exit_flag)
+         pipe_condvar_wait(queue->change, queue->mutex);
+
+      job = worker->head;
+      if (!job)
+         break;
+
+      /* Take the batchable jobs following this one along with it.
+       * Detached jobs are never batched, as they are typically resubmitted
+       * to run a different execute() than the one they were built for.
+       */
+      last = job;
+      if (job->build && !job->detached) {
+         while (num_jobs < queue->max_batch &&
+                last->next && last->next->build && !last->next->detached) {
+            last = last->next;
+            num_jobs++;
+         }
+      }
+
+      worker->head = last->next;
+      if (!worker->head)
+         worker->tail = NULL;
+      last->next = NULL;
+
+      pipe_mutex_unlock(queue->mutex);
+
+      if (job->build && !job->detached)
+         compile_batch(job, context);
+      else
+         job->execute(job, context);
+
+      pipe_mutex_lock(queue->mutex);
+
+      worker->num_pending -= num_jobs;
+
+      for (; job; job = next) {
+         next = job->next;
+         job->next = NULL;
+         if (job->detached) {
+            FREE(job);
+         }
+         else {
+            job->done = TRUE;
+         }
+      }
+      pipe_condvar_broadcast(queue->change);
+   }
+
+   pipe_mutex_unlock(queue->mutex);
+
+   return NULL;
+}
+
+
+/**
+ * Create the compile threads.
+ * Returns NULL if num_threads is zero or LLVM can't be used from
+ * several threads, in which case shaders must be compiled synchronously.
+ * \param max_batch  max number of queued jobs compiled in one module
+ */
+struct lp_compile_queue *
+lp_compile_queue_create(unsigned num_threads, unsigned max_batch)
+{
+   struct lp_compile_queue *queue;
+   unsigned i;
+
+   if (num_threads == 0)
+      return NULL;
+
+   if (!lp_build_start_multithreaded()) {
+      debug_printf("gallivm: LLVM lacks thread support, "
+                   "compiling shaders synchronously\n");
+      return NULL;
+   }
+
+   queue = CALLOC_STRUCT(lp_compile_queue);
+   if (!queue)
+      goto no_queue;
+
+   queue->workers = CALLOC(num_threads, sizeof queue->workers[0]);
+   if (!queue->workers)
+      goto no_workers;
+
+   pipe_mutex_init(queue->mutex);
+   pipe_condvar_init(queue->change);
+
+   queue->num_threads = num_threads;
+   queue->max_batch = MAX2(max_batch, 1);
+
+   for (i = 0; i < num_threads; i++) {
+      struct lp_compile_worker *worker = &queue->workers[i];
+      worker->queue = queue;
+      worker->index = i;
+      worker->thread = pipe_thread_create(compile_thread_function,
+                                          (void *) worker);
+      if (!worker->thread) {
+         /* Stop the threads started so far; no job can be queued yet. */
+         debug_printf("gallivm: failed to create compile threads, "
+                      "compiling shaders synchronously\n");
+         queue->num_threads = i;
+         lp_compile_queue_destroy(queue);
+         return NULL;
+      }
+   }
+
+   return queue;
+
+no_workers:
+   FREE(queue);
+no_queue:
+   return NULL;
+}
+
+
+/**
+ * Run all pending jobs, then stop and free the threads.
+ */
+void
+lp_compile_queue_destroy(struct lp_compile_queue *queue)
+{
+   unsigned i;
+
+   if (!queue)
+      return;
+
+   pipe_mutex_lock(queue->mutex);
+   queue->exit_flag = TRUE;
+   pipe_condvar_broadcast(queue->change);
+   pipe_mutex_unlock(queue->mutex);
+
+   for (i = 0; i < queue->num_threads; i++) {
+      pipe_thread_wait(queue->workers[i].thread);
+   }
+
+   pipe_condvar_destroy(queue->change);
+   pipe_mutex_destroy(queue->mutex);
+
+   FREE(queue->workers);
+   FREE(queue);
+}
+
+
+/**
+ * Queue a job.  If job->worker is negative the least busy worker is
+ * chosen and recorded in job->worker.
+ */
+void
+lp_compile_queue_submit(struct lp_compile_queue *queue,
+                        struct lp_compile_job *job)
+{
+   struct lp_compile_worker *worker;
+
+   pipe_mutex_lock(queue->mutex);
+
+   if (job->worker < 0) {
+      unsigned i, best = 0;
+      for (i = 1; i < queue->num_threads; i++) {
+         if (queue->workers[i].num_pending < queue->workers[best].num_pending)
+            best = i;
+      }
+      job->worker = best;
+   }
+
+   assert(job->worker < (int) queue->num_threads);
+   worker = &queue->workers[job->worker];
+
+   job->next = NULL;
+   job->done = FALSE;
+
+   if (worker->tail)
+      worker->tail->next = job;
+   else
+      worker->head = job;
+   worker->tail = job;
+   worker->num_pending++;
+
+   pipe_condvar_broadcast(queue->change);
+
+   pipe_mutex_unlock(queue->mutex);
+}
+
+
+/**
+ * Remove a job which hasn't started yet.
+ * \return TRUE if the job was removed, FALSE if it is running or done.
+ */
+boolean
+lp_compile_queue_cancel(struct lp_compile_queue *queue,
+                        struct lp_compile_job *job)
+{
+   struct lp_compile_worker *worker;
+   struct lp_compile_job *prev = NULL, *iter;
+   boolean found = FALSE;
+
+   if (job->worker < 0)
+      return FALSE;
+
+   pipe_mutex_lock(queue->mutex);
+
+   worker = &queue->workers[job->worker];
+
+   for (iter = worker->head; iter; prev = iter, iter = iter->next) {
+      if (iter == job) {
+         if (prev)
+            prev->next = job->next;
+         else
+            worker->head = job->next;
+         if (worker->tail == job)
+            worker->tail = prev;
+         worker->num_pending--;
+         job->next = NULL;
+         found = TRUE;
+         break;
+      }
+   }
+
+   pipe_mutex_unlock(queue->mutex);
+
+   return found;
+}
+
+
+/**
+ * Wait for a submitted, non-detached job to complete.
+ */
+void
+lp_compile_queue_wait(struct lp_compile_queue *queue,
+                      struct lp_compile_job *job)
+{
+   assert(!job->detached);
+
+   pipe_mutex_lock(queue->mutex);
+   while (!job->done)
+      pipe_condvar_wait(queue->change, queue->mutex);
+   pipe_mutex_unlock(queue->mutex);
+}
@@ -0,0 +1,100 @@
+/**************************************************************************
+ *
+ * Copyright 2012 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * A pool of threads which compile shader code off the critical path.
+ *
+ * Each worker owns a private LLVM context.  Everything built in a context
+ * must also be freed in it, so jobs can be submitted to a specific worker
+ * (e.g. to free code which that worker compiled earlier).
+ *
+ * Jobs which provide build() and finish() can be batched: a worker takes
+ * all such jobs at the head of its queue, builds them into one module and
+ * compiles it once, which amortizes the per-module LLVM overhead over
+ * bursts of new shaders.
+ */
+
+#ifndef LP_BLD_COMPILE_QUEUE_H
+#define LP_BLD_COMPILE_QUEUE_H
+
+#include "pipe/p_compiler.h"
+#include "lp_bld.h"
+
+
+struct lp_compile_queue;
+struct gallivm_state;
+
+
+/**
+ * Base class for compile jobs.  Embed it first in the job's struct.
+ */
+struct lp_compile_job
+{
+   struct lp_compile_job *next;
+
+   /** Called by the worker thread with the worker's LLVM context */
+   void (*execute)(struct lp_compile_job *job, LLVMContextRef context);
+
+   /**
+    * Optional batched form of execute().  build() adds the job's functions
+    * to a module shared with other jobs, taking a reference to it with
+    * gallivm_reference(); finish() is called once the module is compiled.
+    */
+   void (*build)(struct lp_compile_job *job, struct gallivm_state *gallivm);
+   void (*finish)(struct lp_compile_job *job, struct gallivm_state *gallivm);
+
+   /** Worker which runs/ran the job, or -1 to pick any */
+   int worker;
+
+   /** If set, the worker FREEs the job after execute() returns */
+   boolean detached;
+
+   /** Set by the worker once execute() has returned */
+   volatile boolean done;
+};
+
+
+struct lp_compile_queue *
+lp_compile_queue_create(unsigned num_threads, unsigned max_batch);
+
+void
+lp_compile_queue_destroy(struct lp_compile_queue *queue);
+
+void
+lp_compile_queue_submit(struct lp_compile_queue *queue,
+                        struct lp_compile_job *job);
+
+boolean
+lp_compile_queue_cancel(struct lp_compile_queue *queue,
+                        struct lp_compile_job *job);
+
+void
+lp_compile_queue_wait(struct lp_compile_queue *queue,
+                      struct lp_compile_job *job);
+
+
+#endif /* LP_BLD_COMPILE_QUEUE_H */
@@ -43,6 +43,7 @@
 #define GALLIVM_DEBUG_PERF          (1 << 4)
 #define GALLIVM_DEBUG_NO_BRILINEAR  (1 << 5)
 #define GALLIVM_DEBUG_GC            (1 << 6)
+#define GALLIVM_DEBUG_TIMING        (1 << 7)
 
 
 #ifdef __cplusplus
@@ -0,0 +1,337 @@
+/**************************************************************************
+ *
+ * Copyright 2012 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * @file
+ * Persistent on-disk cache of optimized LLVM modules.
+ *
+ * Each entry is a pair of files named after the 64-bit FNV-1a hash of the
+ * key: "<hash>.key" holds the full key bytes, and "<hash>.bc" the module
+ * bitcode.  A lookup only succeeds if the stored key matches exactly.
+ *
+ * The key always starts with the identity of the code generator: a format
+ * version, the LLVM version, the pointer size, the host CPU features and
+ * the native vector width.  Callers append whatever else the generated
+ * code depends on (shader tokens, variant keys, etc).
+ *
+ * Only the IR building and optimization passes are skipped on a hit;
+ * the JIT still generates machine code for the loaded module.
+ */
+
+
+#include <stdio.h>
+
+#include "pipe/p_config.h"
+
+#if defined(PIPE_OS_WINDOWS)
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "util/u_cpu_detect.h"
+#include "util/u_debug.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "util/u_string.h"
+
+#include "lp_bld_debug.h"
+#include "lp_bld_init.h"
+#include "lp_bld_type.h"
+#include "lp_bld_disk_cache.h"
+
+
+/** Bump whenever the cache file layout or key identity changes */
+#define LP_DISK_CACHE_VERSION 2
+
+
+static const char *
+get_cache_dir(void)
+{
+   static boolean first = TRUE;
+   static const char *dir = NULL;
+
+   if (first) {
+      first = FALSE;
+      dir = debug_get_option("GALLIVM_CACHE_DIR", NULL);
+      if (dir && !dir[0])
+         dir = NULL;
+   }
+
+   return dir;
+}
+
+
+boolean
+lp_disk_cache_enabled(void)
+{
+   return get_cache_dir() != NULL;
+}
+
+
+/**
+ * Initialize the key with the code generator identity.
+ */
+void
+lp_disk_cache_key_init(struct lp_disk_cache_key *key)
+{
+   struct util_cpu_caps caps;
+   unsigned identity[5];
+
+   memset(key, 0, sizeof *key);
+   key->hash = 0xcbf29ce484222325ULL;  /* FNV-1a 64-bit offset basis */
+
+   lp_build_init();
+
+   identity[0] = LP_DISK_CACHE_VERSION;
+   identity[1] = HAVE_LLVM;
+   identity[2] = sizeof(void *);
+   identity[3] = lp_native_vector_width;
+   identity[4] = gallivm_debug;
+   lp_disk_cache_key_add(key, identity, sizeof identity);
+
+   /* The number of CPUs doesn't affect the generated code */
+   memcpy(&caps, &util_cpu_caps, sizeof caps);
+   caps.nr_cpus = 0;
+   lp_disk_cache_key_add(key, &caps, sizeof caps);
+}
+
+
+void
+lp_disk_cache_key_add(struct lp_disk_cache_key *key,
+                      const void *data,
+                      unsigned size)
+{
+   const uint8_t *bytes = (const uint8_t *) data;
+   unsigned i;
+
+   if (key->size + size > key->max_size) {
+      unsigned new_size = MAX2(key->size + size, 2 * key->max_size);
+      new_size = MAX2(new_size, 256);
+      key->data = REALLOC(key->data, key->max_size, new_size);
+      key->max_size = new_size;
+      if (!key->data) {
+         key->size = key->max_size = 0;
+         return;
+      }
+   }
+
+   memcpy(key->data + key->size, bytes, size);
+   key->size += size;
+
+   for (i = 0; i < size; i++) {
+      key->hash ^= bytes[i];
+      key->hash *= 0x100000001b3ULL;  /* FNV-1a 64-bit prime */
+   }
+}
+
+
+void
+lp_disk_cache_key_cleanup(struct lp_disk_cache_key *key)
+{
+   FREE(key->data);
+   memset(key, 0, sizeof *key);
+}
+
+
+static void
+get_filename(char *filename, size_t size,
+             const struct lp_disk_cache_key *key,
+             const char *suffix)
+{
+   util_snprintf(filename, size, "%s/%08x%08x%s",
+                 get_cache_dir(),
+                 (unsigned) (key->hash >> 32),
+                 (unsigned) (key->hash & 0xffffffff),
+                 suffix);
+}
+
+
+/**
+ * Check that the stored key matches exactly.
+ */
+static boolean
+key_matches(const struct lp_disk_cache_key *key)
+{
+   char filename[1024];
+   boolean match = FALSE;
+   uint8_t *data;
+   FILE *f;
+
+   get_filename(filename, sizeof filename, key, ".key");
+
+   f = fopen(filename, "rb");
+   if (!f)
+      return FALSE;
+
+   data = MALLOC(key->size + 1);
+   if (data) {
+      /* read one more byte than expected to detect longer keys */
+      if (fread(data, 1, key->size + 1, f) == key->size &&
+          memcmp(data, key->data, key->size) == 0) {
+         match = TRUE;
+      }
+      FREE(data);
+   }
+
+   fclose(f);
+   return match;
+}
+
+
+/**
+ * Look up a module in the cache.
+ * \return a new gallivm_state holding the cached module, or NULL on a miss.
+ */
+struct gallivm_state *
+lp_disk_cache_load(const struct lp_disk_cache_key *key)
+{
+   char filename[1024];
+   struct gallivm_state *gallivm;
+
+   if (!lp_disk_cache_enabled() || !key->data)
+      return NULL;
+
+   if (!key_matches(key))
+      return NULL;
+
+   get_filename(filename, sizeof filename, key, ".bc");
+
+   gallivm = gallivm_create_from_bitcode(filename);
+
+   if (gallivm_debug & GALLIVM_DEBUG_PERF) {
+      debug_printf("%s: %s %s\n", __FUNCTION__,
+                   gallivm ? "hit" : "bad entry", filename);
+   }
+
+   return gallivm;
+}
+
+
+/**
+ * Create an empty temporary file next to \c filename, with a name no
+ * other process or thread is using.
+ */
+static boolean
+make_temp_file(const char *filename, char *tmpname, size_t size)
+{
+#if defined(PIPE_OS_WINDOWS)
+   util_snprintf(tmpname, size, "%s.%d.tmp", filename, _getpid());
+   return TRUE;
+#else
+   int fd;
+
+   util_snprintf(tmpname, size, "%s.XXXXXX", filename);
+
+   fd = mkstemp(tmpname);
+   if (fd < 0)
+      return FALSE;
+
+   close(fd);
+   return TRUE;
+#endif
+}
+
+
+/**
+ * Write a file atomically, by writing a temporary file and renaming it.
+ * Concurrent processes may be storing the same entry; each writes its own
+ * temporary file, and the last rename wins.
+ */
+static boolean
+write_key_file(const char *filename, const struct lp_disk_cache_key *key)
+{
+   char tmpname[1024];
+   boolean ok;
+   FILE *f;
+
+   if (!make_temp_file(filename, tmpname, sizeof tmpname))
+      return FALSE;
+
+   f = fopen(tmpname, "wb");
+   if (!f) {
+      remove(tmpname);
+      return FALSE;
+   }
+
+   ok = fwrite(key->data, 1, key->size, f) == key->size;
+   ok = (fclose(f) == 0) && ok;
+
+   if (ok)
+      ok = rename(tmpname, filename) == 0;
+
+   if (!ok)
+      remove(tmpname);
+
+   return ok;
+}
+
+
+/**
+ * Store the module of the given gallivm_state in the cache.  Must be
+ * called after optimization and before the functions are JIT'd.
+ */
+boolean
+lp_disk_cache_store(const struct lp_disk_cache_key *key,
+                    struct gallivm_state *gallivm)
+{
+   char filename[1024];
+   char tmpname[1024];
+   boolean ok;
+
+   if (!lp_disk_cache_enabled() || !key->data)
+      return FALSE;
+
+   /* Remove any key file first, as it may belong to a different key with
+    * the same hash, then write the bitcode, so that a key file always
+    * refers to complete bitcode for that key.
+    */
+   get_filename(filename, sizeof filename, key, ".key");
+   remove(filename);
+
+   get_filename(filename, sizeof filename, key, ".bc");
+   ok = make_temp_file(filename, tmpname, sizeof tmpname);
+   if (ok) {
+      ok = gallivm_write_bitcode(gallivm, tmpname);
+      if (ok)
+         ok = rename(tmpname, filename) == 0;
+      if (!ok)
+         remove(tmpname);
+   }
+   if (ok) {
+      get_filename(filename, sizeof filename, key, ".key");
+      ok = write_key_file(filename, key);
+   }
+
+   if (gallivm_debug & GALLIVM_DEBUG_PERF) {
+      debug_printf("%s: %s %s\n", __FUNCTION__,
+                   ok ? "stored" : "failed to store", filename);
+   }
+
+   return ok;
+}
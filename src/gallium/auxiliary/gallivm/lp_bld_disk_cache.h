@@ -0,0 +1,82 @@
+/**************************************************************************
+ *
+ * Copyright 2012 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * @file
+ * Persistent on-disk cache of optimized LLVM modules.
+ *
+ * Modules are stored as bitcode in the directory named by the
+ * GALLIVM_CACHE_DIR environment variable.  The cache is disabled when the
+ * variable is not set.
+ */
+
+#ifndef LP_BLD_DISK_CACHE_H
+#define LP_BLD_DISK_CACHE_H
+
+
+#include "pipe/p_compiler.h"
+
+
+struct gallivm_state;
+
+
+/**
+ * Cache lookup key.  Holds the raw bytes of everything the generated code
+ * depends on, so that a hash collision can never return the wrong module.
+ */
+struct lp_disk_cache_key
+{
+   uint64_t hash;
+   unsigned size;
+   unsigned max_size;
+   uint8_t *data;
+};
+
+
+boolean
+lp_disk_cache_enabled(void);
+
+void
+lp_disk_cache_key_init(struct lp_disk_cache_key *key);
+
+void
+lp_disk_cache_key_add(struct lp_disk_cache_key *key,
+                      const void *data,
+                      unsigned size);
+
+void
+lp_disk_cache_key_cleanup(struct lp_disk_cache_key *key);
+
+struct gallivm_state *
+lp_disk_cache_load(const struct lp_disk_cache_key *key);
+
+boolean
+lp_disk_cache_store(const struct lp_disk_cache_key *key,
+                    struct gallivm_state *gallivm);
+
+
+#endif /* !LP_BLD_DISK_CACHE_H */
@@ -28,6 +28,8 @@
 
 #include "pipe/p_config.h"
 #include "pipe/p_compiler.h"
+#include "os/os_time.h"
+#include "util/u_atomic.h"
 #include "util/u_cpu_detect.h"
 #include "util/u_debug.h"
 #include "util/u_memory.h"
@@ -39,6 +41,7 @@
 
 #include <llvm-c/Analysis.h>
 #include <llvm-c/Transforms/Scalar.h>
+#include <llvm-c/BitReader.h>
 #include <llvm-c/BitWriter.h>
 
 
@@ -77,6 +80,7 @@ static const struct debug_named_value lp_bld_debug_flags[] = {
    { "perf",   GALLIVM_DEBUG_PERF, NULL },
    { "no_brilinear", GALLIVM_DEBUG_NO_BRILINEAR, NULL },
    { "gc",     GALLIVM_DEBUG_GC, NULL },
+   { "timing", GALLIVM_DEBUG_TIMING, NULL },
    DEBUG_NAMED_VALUE_END
 };
 
@@ -138,7 +142,8 @@ create_pass_manager(struct gallivm_state *gallivm)
 
    LLVMAddTargetData(gallivm->target, gallivm->passmgr);
 
-   if ((gallivm_debug & GALLIVM_DEBUG_NO_OPT) == 0) {
+   if ((gallivm_debug & GALLIVM_DEBUG_NO_OPT) == 0 &&
+       (gallivm->flags & GALLIVM_CREATE_NO_OPT) == 0) {
       /* These are the passes currently listed in llvm-c/Transforms/Scalar.h,
        * but there are more on SVN.
        * TODO: Add more passes.
@@ -248,7 +253,8 @@ init_gallivm_engine(struct gallivm_state *gallivm)
       char *error = NULL;
       int ret;
 
-      if (gallivm_debug & GALLIVM_DEBUG_NO_OPT) {
+      if ((gallivm_debug & GALLIVM_DEBUG_NO_OPT) ||
+          (gallivm->flags & GALLIVM_CREATE_NO_OPT)) {
          optlevel = None;
       }
       else {
@@ -326,10 +332,14 @@ static LLVMContextRef gallivm_context = NULL;
 
 /**
  * Allocate gallivm LLVM objects.
+ * \param context  LLVM context to use, or NULL for the shared one
+ * \param module  existing module to JIT, or NULL to create an empty one
  * \return  TRUE for success, FALSE for failure
  */
 static boolean
-init_gallivm_state(struct gallivm_state *gallivm)
+init_gallivm_state(struct gallivm_state *gallivm,
+                   LLVMContextRef context,
+                   LLVMModuleRef module)
 {
    assert(!gallivm->context);
    assert(!gallivm->module);
@@ -337,15 +347,23 @@ init_gallivm_state(struct gallivm_state *gallivm)
 
    lp_build_init();
 
-   if (!gallivm_context) {
-      gallivm_context = LLVMContextCreate();
+   if (!context) {
+      if (!gallivm_context) {
+         gallivm_context = LLVMContextCreate();
+      }
+      context = gallivm_context;
    }
-   gallivm->context = gallivm_context;
+   gallivm->context = context;
    if (!gallivm->context)
       goto fail;
 
-   gallivm->module = LLVMModuleCreateWithNameInContext("gallivm",
-                                                       gallivm->context);
+   if (module) {
+      gallivm->module = module;
+   }
+   else {
+      gallivm->module = LLVMModuleCreateWithNameInContext("gallivm",
+                                                          gallivm->context);
+   }
    if (!gallivm->module)
       goto fail;
 
@@ -406,6 +424,10 @@ init_gallivm_state(struct gallivm_state *gallivm)
    if (!create_pass_manager(gallivm))
       goto fail;
 
+   gallivm->refcount = 1;
+   if (gallivm_debug & GALLIVM_DEBUG_TIMING)
+      gallivm->timing.phase_start = os_time_get();
+
    return TRUE;
 
 fail:
@@ -437,13 +459,14 @@ lp_build_init(void)
    /* AMD Bulldozer AVX's throughput is the same as SSE2; and because using
     * 8-wide vector needs more floating ops than 4-wide (due to padding), it is
     * actually more efficient to use 4-wide vectors on this processor.
+    * Later AMD cores, which are the ones with AVX2, don't have this problem.
     *
     * See also:
     * - http://www.anandtech.com/show/4955/the-bulldozer-review-amd-fx8150-tested/2
     */
    if (HAVE_AVX &&
        util_cpu_caps.has_avx &&
-       util_cpu_caps.has_intel) {
+       (util_cpu_caps.has_intel || util_cpu_caps.has_avx2)) {
       lp_native_vector_width = 256;
    } else {
       /* Leave it at 128, even when no SIMD extensions are available.
@@ -484,7 +507,7 @@ gallivm_create(void)
 
    gallivm = CALLOC_STRUCT(gallivm_state);
    if (gallivm) {
-      if (!init_gallivm_state(gallivm)) {
+      if (!init_gallivm_state(gallivm, NULL, NULL)) {
          FREE(gallivm);
          gallivm = NULL;
       }
@@ -499,7 +522,165 @@ gallivm_create(void)
 
 
 /**
- * Destroy a gallivm_state object.
+ * Create a new gallivm_state object with a private LLVM context and/or
+ * non-default compilation flags.
+ *
+ * A gallivm_state with its own context may be used from a thread other
+ * than the one which uses the shared context, provided
+ * lp_build_start_multithreaded() succeeded.  All gallivm_states of a
+ * context must be used and destroyed from the same thread.
+ *
+ * \param context  LLVM context to use, or NULL for the shared one
+ * \param flags  bitmask of GALLIVM_CREATE_x flags
+ */
+struct gallivm_state *
+gallivm_create_ext(LLVMContextRef context, unsigned flags)
+{
+#if HAVE_LLVM <= 0x206
+   /* Only the singleton is supported */
+   (void) context;
+   (void) flags;
+   return NULL;
+#else
+   struct gallivm_state *gallivm;
+
+   gallivm = CALLOC_STRUCT(gallivm_state);
+   if (gallivm) {
+      gallivm->flags = flags;
+      if (!init_gallivm_state(gallivm, context, NULL)) {
+         FREE(gallivm);
+         gallivm = NULL;
+      }
+   }
+
+   return gallivm;
+#endif
+}
+
+
+/**
+ * Enable LLVM's thread safety, so that gallivm_states with private
+ * contexts can be used from several threads.
+ * \return FALSE if LLVM was built without thread support.
+ */
+boolean
+lp_build_start_multithreaded(void)
+{
+   lp_build_init();
+
+   return lp_start_multithreaded();
+}
+
+
+/**
+ * Add a user to a gallivm_state, which then takes one more
+ * gallivm_destroy() to free.  This lets several shader variants be built
+ * into one module and compiled together, saving the per-module setup and
+ * code generation overhead, while each variant is still destroyed on its
+ * own.
+ */
+struct gallivm_state *
+gallivm_reference(struct gallivm_state *gallivm)
+{
+   p_atomic_inc(&gallivm->refcount);
+   return gallivm;
+}
+
+
+/**
+ * Create a new gallivm_state object for a module previously written with
+ * gallivm_write_bitcode().  The module's functions are already optimized
+ * and only need to be compiled.
+ * Returns NULL if the file can't be read or parsed.
+ */
+struct gallivm_state *
+gallivm_create_from_bitcode(const char *filename)
+{
+#if HAVE_LLVM <= 0x0206
+   /* Can't have more than one module with the singleton */
+   (void) filename;
+   return NULL;
+#else
+   struct gallivm_state *gallivm;
+   LLVMMemoryBufferRef buffer;
+   LLVMModuleRef module;
+   char *error = NULL;
+
+   lp_build_init();
+
+   if (!gallivm_context) {
+      gallivm_context = LLVMContextCreate();
+      if (!gallivm_context)
+         return NULL;
+   }
+
+   if (LLVMCreateMemoryBufferWithContentsOfFile(filename, &buffer, &error)) {
+      LLVMDisposeMessage(error);
+      return NULL;
+   }
+
+   if (LLVMParseBitcodeInContext(gallivm_context, buffer, &module, &error)) {
+      if (gallivm_debug & GALLIVM_DEBUG_PERF)
+         debug_printf("%s: %s: %s\n", __FUNCTION__, filename, error);
+      LLVMDisposeMessage(error);
+      LLVMDisposeMemoryBuffer(buffer);
+      return NULL;
+   }
+
+   LLVMDisposeMemoryBuffer(buffer);
+
+   gallivm = CALLOC_STRUCT(gallivm_state);
+   if (!gallivm) {
+      LLVMDisposeModule(module);
+      return NULL;
+   }
+
+   if (!init_gallivm_state(gallivm, NULL, module)) {
+      FREE(gallivm);
+      return NULL;
+   }
+
+   return gallivm;
+#endif
+}
+
+
+/**
+ * Write the gallivm_state's module to a bitcode file.  Must be called after
+ * the functions have been verified/optimized but before they are JIT'd,
+ * as gallivm_jit_function() frees the function bodies.
+ * Returns FALSE if the module embeds host pointers (which are only valid
+ * in this process) or if the file can't be written.
+ */
+boolean
+gallivm_write_bitcode(struct gallivm_state *gallivm,
+                      const char *filename)
+{
+   if (gallivm->has_host_pointers)
+      return FALSE;
+
+   return LLVMWriteBitcodeToFile(gallivm->module, filename) == 0;
+}
+
+
+/**
+ * Charge the time since the end of the previous phase to *phase, or just
+ * start a new phase if phase is NULL.
+ */
+static INLINE void
+gallivm_time_phase(struct gallivm_state *gallivm, int64_t *phase)
+{
+   if (gallivm_debug & GALLIVM_DEBUG_TIMING) {
+      int64_t now = os_time_get();
+      if (phase)
+         *phase += now - gallivm->timing.phase_start;
+      gallivm->timing.phase_start = now;
+   }
+}
+
+
+/**
+ * Drop a reference to a gallivm_state object, destroying it with the last.
  */
 void
 gallivm_destroy(struct gallivm_state *gallivm)
@@ -508,6 +689,18 @@ gallivm_destroy(struct gallivm_state *gallivm)
    /* No-op: don't destroy the singleton */
    (void) gallivm;
 #else
+   if (!p_atomic_dec_zero(&gallivm->refcount))
+      return;
+
+   if ((gallivm_debug & GALLIVM_DEBUG_TIMING) && gallivm->compiled) {
+      debug_printf("gallivm: %u functions: ir %.3f ms, optimize %.3f ms, "
+                   "codegen %.3f ms\n",
+                   gallivm->timing.num_functions,
+                   gallivm->timing.ir / 1000.0,
+                   gallivm->timing.optimize / 1000.0,
+                   gallivm->timing.codegen / 1000.0);
+   }
+
    free_gallivm_state(gallivm);
    FREE(gallivm);
 #endif
@@ -556,7 +749,10 @@ gallivm_verify_function(struct gallivm_state *gallivm,
    }
 #endif
 
+   gallivm_time_phase(gallivm, &gallivm->timing.ir);
    gallivm_optimize_function(gallivm, func);
+   gallivm_time_phase(gallivm, &gallivm->timing.optimize);
+   gallivm->timing.num_functions++;
 
    if (gallivm_debug & GALLIVM_DEBUG_IR) {
       /* Print the LLVM IR to stderr */
@@ -573,6 +769,8 @@ gallivm_compile_module(struct gallivm_state *gallivm)
    assert(!gallivm->compiled);
 #endif
 
+   gallivm_time_phase(gallivm, &gallivm->timing.ir);
+
    /* Dump byte code to a file */
    if (0) {
       LLVMWriteBitcodeToFile(gallivm->module, "llvmpipe.bc");
@@ -588,6 +786,8 @@ gallivm_compile_module(struct gallivm_state *gallivm)
 #endif
    assert(gallivm->engine);
 
+   gallivm_time_phase(gallivm, &gallivm->timing.codegen);
+
    ++gallivm->compiled;
 }
 
@@ -602,7 +802,10 @@ gallivm_jit_function(struct gallivm_state *gallivm,
    assert(gallivm->compiled);
    assert(gallivm->engine);
 
+   /* The JIT emits machine code lazily, on the first lookup. */
+   gallivm_time_phase(gallivm, NULL);
    code = LLVMGetPointerToGlobal(gallivm->engine, func);
+   gallivm_time_phase(gallivm, &gallivm->timing.codegen);
    assert(code);
    jit_func = pointer_to_func(code);
 
@@ -36,6 +36,10 @@
 #include <llvm-c/ExecutionEngine.h>
 
 
+/** gallivm_create_ext() flags */
+#define GALLIVM_CREATE_NO_OPT  (1 << 0)  /**< skip IR and codegen optimizations */
+
+
 struct gallivm_state
 {
    LLVMModuleRef module;
@@ -46,6 +50,29 @@ struct gallivm_state
    LLVMContextRef context;
    LLVMBuilderRef builder;
    unsigned compiled;
+   unsigned flags;  /**< GALLIVM_CREATE_x */
+
+   /**
+    * Set when the generated code embeds addresses of this process, so that
+    * the module must not be written to a persistent cache.
+    */
+   boolean has_host_pointers;
+
+   /**
+    * Number of users of the module.  Several shader variants may share a
+    * module so that they are compiled together; the last gallivm_destroy()
+    * frees it.
+    */
+   int32_t refcount;
+
+   /** Per-phase compilation times in usecs, kept for GALLIVM_DEBUG=timing */
+   struct {
+      int64_t phase_start;  /**< end of the last timed phase */
+      int64_t ir;           /**< building IR, i.e. untimed time before codegen */
+      int64_t optimize;     /**< IR optimization passes */
+      int64_t codegen;      /**< engine creation and machine code emission */
+      unsigned num_functions;
+   } timing;
 };
 
 
@@ -56,6 +83,22 @@ lp_build_init(void);
 struct gallivm_state *
 gallivm_create(void);
 
+struct gallivm_state *
+gallivm_create_ext(LLVMContextRef context, unsigned flags);
+
+struct gallivm_state *
+gallivm_create_from_bitcode(const char *filename);
+
+boolean
+lp_build_start_multithreaded(void);
+
+struct gallivm_state *
+gallivm_reference(struct gallivm_state *gallivm);
+
+boolean
+gallivm_write_bitcode(struct gallivm_state *gallivm,
+                      const char *filename);
+
 void
 gallivm_destroy(struct gallivm_state *gallivm);
 
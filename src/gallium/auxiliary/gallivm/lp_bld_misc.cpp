@@ -53,6 +53,7 @@
 #endif
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Support/PrettyStackTrace.h>
+#include <llvm/Support/Threading.h>
 
 #if HAVE_LLVM >= 0x0300
 #include <llvm/Support/TargetSelect.h>
@@ -203,6 +204,17 @@ lp_func_delete_body(LLVMValueRef FF)
 }
 
 
+/**
+ * Turn on LLVM's internal locking.  Returns false if LLVM was built
+ * without thread support.
+ */
+extern "C" int
+lp_start_multithreaded(void)
+{
+   return llvm::llvm_start_multithreaded();
+}
+
+
 extern "C"
 LLVMValueRef
 lp_build_load_volatile(LLVMBuilderRef B, LLVMValueRef PointerVal,
@@ -51,6 +51,10 @@ extern void
 lp_func_delete_body(LLVMValueRef func);
 
 
+extern int
+lp_start_multithreaded(void);
+
+
 extern LLVMValueRef
 lp_build_load_volatile(LLVMBuilderRef B, LLVMValueRef PointerVal,
                        const char *Name);
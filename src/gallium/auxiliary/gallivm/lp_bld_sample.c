@@ -723,6 +723,133 @@ lp_build_linear_mip_levels(struct lp_build_sample_context *bld,
 }
 
 
+struct lp_build_sample_counters lp_build_sample_count;
+
+
+/**
+ * Add inc to one of the lp_build_sample_count counters at runtime.
+ *
+ * The increment isn't atomic, so counts from several threads are only
+ * approximate, which is good enough for judging the fast paths.
+ */
+static void
+lp_build_sample_counter_add(struct gallivm_state *gallivm,
+                            uint64_t *counter,
+                            LLVMValueRef inc)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef i64t = LLVMInt64TypeInContext(gallivm->context);
+   LLVMValueRef ptr, value;
+
+   ptr = lp_build_const_int_pointer(gallivm, counter);
+   ptr = LLVMBuildBitCast(builder, ptr, LLVMPointerType(i64t, 0), "");
+   value = LLVMBuildLoad(builder, ptr, "");
+   value = LLVMBuildAdd(builder, value, LLVMBuildZExt(builder, inc, i64t, ""), "");
+   LLVMBuildStore(builder, value, ptr);
+}
+
+
+/**
+ * For PIPE_TEX_MIPFILTER_LINEAR, decide at runtime whether both mipmap
+ * levels really need to be sampled.
+ *
+ * When the mip weight of every quad is zero, only the first level
+ * contributes, and when it is one for every quad, only the second level
+ * does, so in either case a single level is sampled.
+ *
+ * Unless exact is set, weights below 1/256 and at or above 255/256 count
+ * as zero and one.  These are lost in the 8-bit precision of the fixed
+ * point AoS filter anyway (and brilinear filtering produces plenty of
+ * them), but would change the results of the float SoA filter.
+ *
+ * \param lod_fpart  per-quad float mip weight
+ * \param exact  only skip a level whose weight is exactly zero
+ * \param level_out  the level to sample first (scalar, like ilevel0)
+ * \param need_lerp_out  whether the second level must be sampled too (i1)
+ */
+void
+lp_build_mip_level_early_out(struct lp_build_sample_context *bld,
+                             LLVMValueRef lod_fpart,
+                             LLVMValueRef ilevel0,
+                             LLVMValueRef ilevel1,
+                             boolean exact,
+                             LLVMValueRef *level_out,
+                             LLVMValueRef *need_lerp_out)
+{
+   struct gallivm_state *gallivm = bld->gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_build_context *perquadf_bld = &bld->perquadf_bld;
+   LLVMValueRef lo, hi;
+   unsigned num_quads = bld->coord_bld.type.length / 4;
+   LLVMValueRef any_level0, any_level1, use_level1, need_lerp;
+
+   if (exact) {
+      lo = perquadf_bld->zero;
+      hi = perquadf_bld->one;
+   }
+   else {
+      lo = lp_build_const_vec(gallivm, perquadf_bld->type, 1.0/256.0);
+      hi = lp_build_const_vec(gallivm, perquadf_bld->type, 255.0/256.0);
+   }
+
+   if (num_quads == 1) {
+      /* NaN weights sample both levels */
+      any_level0 = LLVMBuildFCmp(builder, LLVMRealULT, lod_fpart, hi, "");
+      any_level1 = LLVMBuildFCmp(builder, exact ? LLVMRealUGT : LLVMRealUGE,
+                                 lod_fpart, lo, "");
+   }
+   else {
+      any_level0 = lp_build_compare(gallivm, perquadf_bld->type,
+                                    PIPE_FUNC_LESS, lod_fpart, hi);
+      any_level0 = lp_build_any_true_range(&bld->perquadi_bld, num_quads,
+                                           any_level0);
+      any_level1 = lp_build_compare(gallivm, perquadf_bld->type,
+                                    exact ? PIPE_FUNC_GREATER : PIPE_FUNC_GEQUAL,
+                                    lod_fpart, lo);
+      any_level1 = lp_build_any_true_range(&bld->perquadi_bld, num_quads,
+                                           any_level1);
+   }
+
+   use_level1 = LLVMBuildNot(builder, any_level0, "use_level1");
+   need_lerp = LLVMBuildAnd(builder, any_level0, any_level1, "need_lerp");
+
+   *level_out = LLVMBuildSelect(builder, use_level1, ilevel1, ilevel0, "");
+   *need_lerp_out = need_lerp;
+
+   if (gallivm_debug & GALLIVM_DEBUG_PERF) {
+      LLVMTypeRef i32t = LLVMInt32TypeInContext(gallivm->context);
+      LLVMValueRef quads = lp_build_const_int32(gallivm, num_quads);
+
+      lp_build_sample_counter_add(gallivm, &lp_build_sample_count.nr_mip_quads,
+                                  quads);
+      lp_build_sample_counter_add(gallivm,
+                                  &lp_build_sample_count.nr_mip_single_level_quads,
+                                  LLVMBuildSelect(builder, need_lerp,
+                                                  LLVMConstNull(i32t), quads, ""));
+   }
+}
+
+
+/**
+ * Print the lp_build_sample_count counters, if any code gathering them
+ * was generated (GALLIVM_DEBUG=perf).
+ */
+void
+lp_build_sample_print_counters(void)
+{
+   const struct lp_build_sample_counters *count = &lp_build_sample_count;
+
+   if (count->nr_mip_quads) {
+      debug_printf("gallivm: trilinear quads:              %9llu\n",
+                   (unsigned long long) count->nr_mip_quads);
+      debug_printf("gallivm:   single mip level quads:     %9llu (%3.0f%%)\n",
+                   (unsigned long long) count->nr_mip_single_level_quads,
+                   100.0 * count->nr_mip_single_level_quads /
+                   count->nr_mip_quads);
+   }
+}
+
+
 /**
  * Return pointer to a single mipmap level.
  * \param data_array  array of pointers to mipmap levels
@@ -271,6 +271,19 @@ lp_is_simple_wrap_mode(unsigned mode)
 }
 
 
+/**
+ * Return whether the given mode is supported by the 8-bit fixed point
+ * (AoS) filtering path, which besides the simple wrap modes can also
+ * mirror power of two textures.
+ */
+static INLINE boolean
+lp_is_fixed_point_wrap_mode(unsigned mode, boolean is_pot)
+{
+   return lp_is_simple_wrap_mode(mode) ||
+          (mode == PIPE_TEX_WRAP_MIRROR_REPEAT && is_pot);
+}
+
+
 static INLINE void
 apply_sampler_swizzle(struct lp_build_sample_context *bld,
                       LLVMValueRef *texel)
@@ -343,6 +356,15 @@ lp_build_linear_mip_levels(struct lp_build_sample_context *bld,
                            LLVMValueRef *level0_out,
                            LLVMValueRef *level1_out);
 
+void
+lp_build_mip_level_early_out(struct lp_build_sample_context *bld,
+                             LLVMValueRef lod_fpart,
+                             LLVMValueRef ilevel0,
+                             LLVMValueRef ilevel1,
+                             boolean exact,
+                             LLVMValueRef *level_out,
+                             LLVMValueRef *need_lerp_out);
+
 LLVMValueRef
 lp_build_get_mipmap_level(struct lp_build_sample_context *bld,
                           LLVMValueRef level);
@@ -452,4 +474,22 @@ lp_build_minify(struct lp_build_context *bld,
                 LLVMValueRef level);
 
 
+/**
+ * Runtime counters of the sampling fast paths, only gathered by code
+ * generated with GALLIVM_DEBUG=perf.
+ */
+struct lp_build_sample_counters
+{
+   /** Quads sampled with linear mip filtering */
+   uint64_t nr_mip_quads;
+   /** ... of which only needed a single mipmap level */
+   uint64_t nr_mip_single_level_quads;
+};
+
+extern struct lp_build_sample_counters lp_build_sample_count;
+
+void
+lp_build_sample_print_counters(void);
+
+
 #endif /* LP_BLD_SAMPLE_H */
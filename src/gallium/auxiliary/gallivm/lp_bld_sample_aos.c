@@ -59,6 +59,35 @@
 #include "lp_bld_quad.h"
 
 
+/**
+ * Build LLVM code for mirror repeat wrapping of integer texel coordinates,
+ * for power of two textures.
+ *
+ * Texels are mirrored every other period, that is, when the bit of the
+ * coordinate corresponding to the texture size is set, which also holds
+ * for negative coordinates in two's complement.
+ * \param coord  integer texel coordinate
+ * \param length  the texture size along one dimension (a power of two)
+ */
+static LLVMValueRef
+lp_build_coord_mirror_pot_int(struct lp_build_context *int_coord_bld,
+                              LLVMValueRef coord,
+                              LLVMValueRef length)
+{
+   LLVMBuilderRef builder = int_coord_bld->gallivm->builder;
+   LLVMValueRef length_minus_one;
+   LLVMValueRef flip;
+
+   length_minus_one = lp_build_sub(int_coord_bld, length, int_coord_bld->one);
+
+   flip = LLVMBuildAnd(builder, coord, length, "");
+   flip = lp_build_compare(int_coord_bld->gallivm, int_coord_bld->type,
+                           PIPE_FUNC_NOTEQUAL, flip, int_coord_bld->zero);
+   coord = LLVMBuildXor(builder, coord, flip, "");
+   return LLVMBuildAnd(builder, coord, length_minus_one, "");
+}
+
+
 /**
  * Build LLVM code for texture coord wrapping, for nearest filtering,
  * for scaled integer texcoords.
@@ -108,9 +137,13 @@ lp_build_sample_wrap_nearest_int(struct lp_build_sample_context *bld,
       coord = lp_build_min(int_coord_bld, coord, length_minus_one);
       break;
 
+   case PIPE_TEX_WRAP_MIRROR_REPEAT:
+      assert(is_pot);
+      coord = lp_build_coord_mirror_pot_int(int_coord_bld, coord, length);
+      break;
+
    case PIPE_TEX_WRAP_CLAMP:
    case PIPE_TEX_WRAP_CLAMP_TO_BORDER:
-   case PIPE_TEX_WRAP_MIRROR_REPEAT:
    case PIPE_TEX_WRAP_MIRROR_CLAMP:
    case PIPE_TEX_WRAP_MIRROR_CLAMP_TO_EDGE:
    case PIPE_TEX_WRAP_MIRROR_CLAMP_TO_BORDER:
@@ -161,9 +194,16 @@ lp_build_sample_wrap_nearest_float(struct lp_build_sample_context *bld,
       *icoord = lp_build_itrunc(coord_bld, coord);
       break;
 
+   case PIPE_TEX_WRAP_MIRROR_REPEAT:
+      assert(is_pot);
+      coord = lp_build_mul(coord_bld, coord, length);
+      *icoord = lp_build_ifloor(coord_bld, coord);
+      *icoord = lp_build_coord_mirror_pot_int(&bld->int_coord_bld, *icoord,
+                                              lp_build_itrunc(coord_bld, length));
+      break;
+
    case PIPE_TEX_WRAP_CLAMP:
    case PIPE_TEX_WRAP_CLAMP_TO_BORDER:
-   case PIPE_TEX_WRAP_MIRROR_REPEAT:
    case PIPE_TEX_WRAP_MIRROR_CLAMP:
    case PIPE_TEX_WRAP_MIRROR_CLAMP_TO_EDGE:
    case PIPE_TEX_WRAP_MIRROR_CLAMP_TO_BORDER:
@@ -252,9 +292,15 @@ lp_build_sample_wrap_linear_int(struct lp_build_sample_context *bld,
                                 length_minus_one);
          break;
 
+      case PIPE_TEX_WRAP_MIRROR_REPEAT:
+         assert(is_pot);
+         coord1 = lp_build_add(int_coord_bld, coord0, int_coord_bld->one);
+         coord0 = lp_build_coord_mirror_pot_int(int_coord_bld, coord0, length);
+         coord1 = lp_build_coord_mirror_pot_int(int_coord_bld, coord1, length);
+         break;
+
       case PIPE_TEX_WRAP_CLAMP:
       case PIPE_TEX_WRAP_CLAMP_TO_BORDER:
-      case PIPE_TEX_WRAP_MIRROR_REPEAT:
       case PIPE_TEX_WRAP_MIRROR_CLAMP:
       case PIPE_TEX_WRAP_MIRROR_CLAMP_TO_EDGE:
       case PIPE_TEX_WRAP_MIRROR_CLAMP_TO_BORDER:
@@ -320,9 +366,24 @@ lp_build_sample_wrap_linear_int(struct lp_build_sample_context *bld,
                               LLVMBuildAnd(builder, stride, mask, ""));
       break;
 
+   case PIPE_TEX_WRAP_MIRROR_REPEAT:
+      /*
+       * Mirroring doesn't preserve adjacency across the period edges, so
+       * the offsets can't be derived from one another.
+       */
+      {
+         LLVMValueRef coord1;
+         assert(is_pot);
+         coord1 = lp_build_add(int_coord_bld, coord0, int_coord_bld->one);
+         coord0 = lp_build_coord_mirror_pot_int(int_coord_bld, coord0, length);
+         coord1 = lp_build_coord_mirror_pot_int(int_coord_bld, coord1, length);
+         *offset0 = lp_build_mul(int_coord_bld, coord0, stride);
+         *offset1 = lp_build_mul(int_coord_bld, coord1, stride);
+      }
+      break;
+
    case PIPE_TEX_WRAP_CLAMP:
    case PIPE_TEX_WRAP_CLAMP_TO_BORDER:
-   case PIPE_TEX_WRAP_MIRROR_REPEAT:
    case PIPE_TEX_WRAP_MIRROR_CLAMP:
    case PIPE_TEX_WRAP_MIRROR_CLAMP_TO_EDGE:
    case PIPE_TEX_WRAP_MIRROR_CLAMP_TO_BORDER:
@@ -425,6 +486,20 @@ lp_build_sample_wrap_linear_float(struct lp_build_sample_context *bld,
       *coord1 = lp_build_min(coord_bld, *coord1, length_minus_one);
       *coord1 = lp_build_itrunc(coord_bld, *coord1);
       break;
+   case PIPE_TEX_WRAP_MIRROR_REPEAT:
+      assert(is_pot);
+      /* mul by size and subtract 0.5 */
+      coord = lp_build_mul(coord_bld, coord, length);
+      if (!force_nearest)
+         coord = lp_build_sub(coord_bld, coord, half);
+      /* convert to int, compute lerp weight */
+      lp_build_ifloor_fract(coord_bld, coord, coord0, weight);
+      *coord1 = lp_build_add(int_coord_bld, *coord0, int_coord_bld->one);
+      /* mirror wrap */
+      length = lp_build_itrunc(coord_bld, length);
+      *coord0 = lp_build_coord_mirror_pot_int(int_coord_bld, *coord0, length);
+      *coord1 = lp_build_coord_mirror_pot_int(int_coord_bld, *coord1, length);
+      break;
    default:
       assert(0);
       *coord0 = int_coord_bld->zero;
@@ -1332,6 +1407,18 @@ lp_build_sample_mipmap(struct lp_build_sample_context *bld,
    LLVMValueRef data_ptr1;
    LLVMValueRef colors0_lo, colors0_hi;
    LLVMValueRef colors1_lo, colors1_hi;
+   LLVMValueRef need_lerp = NULL;
+
+   if (mip_filter == PIPE_TEX_MIPFILTER_LINEAR) {
+      /*
+       * Sample just one of the levels if that's all the quads need.
+       * Otherwise, if any quad needs both, sample the second level below.
+       * It might be better to split the vectors here and only fetch/filter
+       * quads which need it.
+       */
+      lp_build_mip_level_early_out(bld, lod_fpart, ilevel0, ilevel1, FALSE,
+                                   &ilevel0, &need_lerp);
+   }
 
    /* sample the first mipmap level */
    lp_build_mipmap_level_sizes(bld, ilevel0,
@@ -1382,34 +1469,20 @@ lp_build_sample_mipmap(struct lp_build_sample_context *bld,
                                                      bld->perquadf_bld.type, 256.0);
       LLVMTypeRef i32vec_type = lp_build_vec_type(bld->gallivm, bld->perquadi_bld.type);
       struct lp_build_if_state if_ctx;
-      LLVMValueRef need_lerp;
       unsigned num_quads = bld->coord_bld.type.length / 4;
       unsigned i;
 
       lod_fpart = LLVMBuildFMul(builder, lod_fpart, h16vec_scale, "");
       lod_fpart = LLVMBuildFPToSI(builder, lod_fpart, i32vec_type, "lod_fpart.fixed16");
 
-      /* need_lerp = lod_fpart > 0 */
-      if (num_quads == 1) {
-         need_lerp = LLVMBuildICmp(builder, LLVMIntSGT,
-                                   lod_fpart, bld->perquadi_bld.zero,
-                                   "need_lerp");
-      }
-      else {
-         /*
-          * We'll do mip filtering if any of the quads need it.
-          * It might be better to split the vectors here and only fetch/filter
-          * quads which need it.
-          */
+      if (num_quads > 1) {
          /*
           * We need to clamp lod_fpart here since we can get negative
           * values which would screw up filtering if not all
           * lod_fpart values have same sign.
-          * We can however then skip the greater than comparison.
           */
          lod_fpart = lp_build_max(&bld->perquadi_bld, lod_fpart,
                                   bld->perquadi_bld.zero);
-         need_lerp = lp_build_any_true_range(&bld->perquadi_bld, num_quads, lod_fpart);
       }
 
       lp_build_if(&if_ctx, bld->gallivm, need_lerp);
@@ -1548,11 +1621,14 @@ lp_build_sample_aos(struct lp_build_sample_context *bld,
    struct lp_build_context h16_bld;
 
    /* we only support the common/simple wrap modes at this time */
-   assert(lp_is_simple_wrap_mode(bld->static_state->wrap_s));
+   assert(lp_is_fixed_point_wrap_mode(bld->static_state->wrap_s,
+                                      bld->static_state->pot_width));
    if (dims >= 2)
-      assert(lp_is_simple_wrap_mode(bld->static_state->wrap_t));
+      assert(lp_is_fixed_point_wrap_mode(bld->static_state->wrap_t,
+                                         bld->static_state->pot_height));
    if (dims >= 3)
-      assert(lp_is_simple_wrap_mode(bld->static_state->wrap_r));
+      assert(lp_is_fixed_point_wrap_mode(bld->static_state->wrap_r,
+                                         bld->static_state->pot_depth));
 
 
    /* make 16-bit fixed-pt builder context */
@@ -665,6 +665,84 @@ lp_build_sample_image_nearest(struct lp_build_sample_context *bld,
 }
 
 
+/**
+ * Determine which texel channels actually need to be filtered.
+ *
+ * Formats with fewer than four channels (L8, A8, R16, ...) replicate a
+ * channel or fill the missing ones with 0 or 1 on fetch, so filtering all
+ * four channels just repeats the same lerps, and float lerps of constants
+ * can't be folded away by LLVM.  On return src[chan] is chan if the
+ * channel must be filtered, the earlier channel it duplicates, or -1 if
+ * it is constant.  Border color texels break the pattern, so this only
+ * applies when no wrap mode can sample the border.
+ */
+static void
+lp_build_sample_filter_channels(struct lp_build_sample_context *bld,
+                                int src[4])
+{
+   const struct lp_sampler_static_state *static_state = bld->static_state;
+   const struct util_format_description *format_desc = bld->format_desc;
+   const unsigned dims = bld->dims;
+   unsigned chan, prev;
+
+   for (chan = 0; chan < 4; chan++)
+      src[chan] = chan;
+
+   if (format_desc->colorspace != UTIL_FORMAT_COLORSPACE_RGB &&
+       format_desc->colorspace != UTIL_FORMAT_COLORSPACE_SRGB)
+      return;
+
+   if (lp_sampler_wrap_mode_uses_border_color(static_state->wrap_s,
+                                              static_state->min_img_filter,
+                                              static_state->mag_img_filter) ||
+       (dims >= 2 &&
+        lp_sampler_wrap_mode_uses_border_color(static_state->wrap_t,
+                                               static_state->min_img_filter,
+                                               static_state->mag_img_filter)) ||
+       (dims >= 3 &&
+        lp_sampler_wrap_mode_uses_border_color(static_state->wrap_r,
+                                               static_state->min_img_filter,
+                                               static_state->mag_img_filter)))
+      return;
+
+   for (chan = 0; chan < 4; chan++) {
+      unsigned swizzle = format_desc->swizzle[chan];
+      if (swizzle == UTIL_FORMAT_SWIZZLE_0 ||
+          swizzle == UTIL_FORMAT_SWIZZLE_1) {
+         src[chan] = -1;
+         continue;
+      }
+      for (prev = 0; prev < chan; prev++) {
+         if (format_desc->swizzle[prev] == swizzle) {
+            src[chan] = prev;
+            break;
+         }
+      }
+   }
+}
+
+
+/**
+ * Fill in the channels skipped by filtering, as described by
+ * lp_build_sample_filter_channels().  Constant channels are taken from
+ * the given texel.
+ */
+static void
+lp_build_sample_copy_channels(const int src[4],
+                              const LLVMValueRef texel[4],
+                              LLVMValueRef colors[4])
+{
+   unsigned chan;
+
+   for (chan = 0; chan < 4; chan++) {
+      if (src[chan] < 0)
+         colors[chan] = texel[chan];
+      else if (src[chan] != (int)chan)
+         colors[chan] = colors[src[chan]];
+   }
+}
+
+
 /**
  * Generate code to sample a mipmap level with linear filtering.
  * If sampling a cube texture, r = cube face in [0,5].
@@ -692,8 +770,11 @@ lp_build_sample_image_linear(struct lp_build_sample_context *bld,
    LLVMValueRef x0, y0, z0, x1, y1, z1;
    LLVMValueRef s_fpart, t_fpart, r_fpart;
    LLVMValueRef neighbors[2][2][4];
+   int src[4];
    int chan;
 
+   lp_build_sample_filter_channels(bld, src);
+
    lp_build_extract_image_sizes(bld,
                                 bld->int_size_type,
                                 bld->int_coord_type,
@@ -766,6 +847,8 @@ lp_build_sample_image_linear(struct lp_build_sample_context *bld,
    if (dims == 1) {
       /* Interpolate two samples from 1D image to produce one color */
       for (chan = 0; chan < 4; chan++) {
+         if (src[chan] != chan)
+            continue;
          colors_out[chan] = lp_build_lerp(&bld->texel_bld, s_fpart,
                                           neighbors[0][0][chan],
                                           neighbors[0][1][chan]);
@@ -789,6 +872,8 @@ lp_build_sample_image_linear(struct lp_build_sample_context *bld,
 
       /* Bilinear interpolate the four samples from the 2D image / 3D slice */
       for (chan = 0; chan < 4; chan++) {
+         if (src[chan] != chan)
+            continue;
          colors0[chan] = lp_build_lerp_2d(&bld->texel_bld,
                                           s_fpart, t_fpart,
                                           neighbors[0][0][chan],
@@ -825,6 +910,8 @@ lp_build_sample_image_linear(struct lp_build_sample_context *bld,
 
          /* Bilinear interpolate the four samples from the second Z slice */
          for (chan = 0; chan < 4; chan++) {
+            if (src[chan] != chan)
+               continue;
             colors1[chan] = lp_build_lerp_2d(&bld->texel_bld,
                                              s_fpart, t_fpart,
                                              neighbors1[0][0][chan],
@@ -835,6 +922,8 @@ lp_build_sample_image_linear(struct lp_build_sample_context *bld,
 
          /* Linearly interpolate the two samples from the two 3D slices */
          for (chan = 0; chan < 4; chan++) {
+            if (src[chan] != chan)
+               continue;
             colors_out[chan] = lp_build_lerp(&bld->texel_bld,
                                              r_fpart,
                                              colors0[chan], colors1[chan]);
@@ -843,10 +932,14 @@ lp_build_sample_image_linear(struct lp_build_sample_context *bld,
       else {
          /* 2D tex */
          for (chan = 0; chan < 4; chan++) {
+            if (src[chan] != chan)
+               continue;
             colors_out[chan] = colors0[chan];
          }
       }
    }
+
+   lp_build_sample_copy_channels(src, neighbors[0][0], colors_out);
 }
 
 
@@ -879,8 +972,23 @@ lp_build_sample_mipmap(struct lp_build_sample_context *bld,
    LLVMValueRef data_ptr0 = NULL;
    LLVMValueRef data_ptr1 = NULL;
    LLVMValueRef colors0[4], colors1[4];
+   LLVMValueRef need_lerp = NULL;
+   int src[4];
    unsigned chan;
 
+   lp_build_sample_filter_channels(bld, src);
+
+   if (mip_filter == PIPE_TEX_MIPFILTER_LINEAR) {
+      /*
+       * Sample just one of the levels if that's all the quads need.
+       * Otherwise, if any quad needs both, sample the second level below.
+       * It might be better to split the vectors here and only fetch/filter
+       * quads which need it.
+       */
+      lp_build_mip_level_early_out(bld, lod_fpart, ilevel0, ilevel1, TRUE,
+                                   &ilevel0, &need_lerp);
+   }
+
    /* sample the first mipmap level */
    lp_build_mipmap_level_sizes(bld, ilevel0,
                                &size0,
@@ -909,21 +1017,9 @@ lp_build_sample_mipmap(struct lp_build_sample_context *bld,
 
    if (mip_filter == PIPE_TEX_MIPFILTER_LINEAR) {
       struct lp_build_if_state if_ctx;
-      LLVMValueRef need_lerp;
       unsigned num_quads = bld->coord_bld.type.length / 4;
 
-      /* need_lerp = lod_fpart > 0 */
-      if (num_quads == 1) {
-         need_lerp = LLVMBuildFCmp(builder, LLVMRealUGT,
-                                   lod_fpart, bld->perquadf_bld.zero,
-                                   "need_lerp");
-      }
-      else {
-         /*
-          * We'll do mip filtering if any of the quads need it.
-          * It might be better to split the vectors here and only fetch/filter
-          * quads which need it.
-          */
+      if (num_quads > 1) {
          /*
           * We unfortunately need to clamp lod_fpart here since we can get
           * negative values which would screw up filtering if not all
@@ -931,11 +1027,7 @@ lp_build_sample_mipmap(struct lp_build_sample_context *bld,
           */
          lod_fpart = lp_build_max(&bld->perquadf_bld, lod_fpart,
                                   bld->perquadf_bld.zero);
-         need_lerp = lp_build_compare(bld->gallivm, bld->perquadf_bld.type,
-                                      PIPE_FUNC_GREATER,
-                                      lod_fpart, bld->perquadf_bld.zero);
-         need_lerp = lp_build_any_true_range(&bld->perquadi_bld, num_quads, need_lerp);
-     }
+      }
 
       lp_build_if(&if_ctx, bld->gallivm, need_lerp);
       {
@@ -967,8 +1059,13 @@ lp_build_sample_mipmap(struct lp_build_sample_context *bld,
                                                            lod_fpart);
 
          for (chan = 0; chan < 4; chan++) {
+            if (src[chan] != (int)chan)
+               continue;
             colors0[chan] = lp_build_lerp(&bld->texel_bld, lod_fpart,
                                           colors0[chan], colors1[chan]);
+         }
+         lp_build_sample_copy_channels(src, colors0, colors0);
+         for (chan = 0; chan < 4; chan++) {
             LLVMBuildStore(builder, colors0[chan], colors_out[chan]);
          }
       }
@@ -1336,8 +1433,13 @@ lp_build_sample_soa(struct gallivm_state *gallivm,
       unsigned num_quads = type.length / 4;
       const unsigned mip_filter = bld.static_state->min_mip_filter;
       boolean use_aos = util_format_fits_8unorm(bld.format_desc) &&
-                        lp_is_simple_wrap_mode(static_state->wrap_s) &&
-                        lp_is_simple_wrap_mode(static_state->wrap_t);
+                        lp_is_fixed_point_wrap_mode(static_state->wrap_s,
+                                                    static_state->pot_width) &&
+                        lp_is_fixed_point_wrap_mode(static_state->wrap_t,
+                                                    static_state->pot_height) &&
+                        (dims < 3 ||
+                         lp_is_fixed_point_wrap_mode(static_state->wrap_r,
+                                                     static_state->pot_depth));
 
       if ((gallivm_debug & GALLIVM_DEBUG_PERF) &&
           !use_aos && util_format_fits_8unorm(bld.format_desc)) {
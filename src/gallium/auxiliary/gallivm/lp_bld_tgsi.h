@@ -61,6 +61,7 @@ struct tgsi_shader_info;
 struct lp_build_mask_context;
 struct gallivm_state;
 struct lp_derivatives;
+struct lp_build_tgsi_context;
 
 
 enum lp_build_tex_modifier {
@@ -190,6 +191,65 @@ struct lp_build_sampler_soa
 };
 
 
+/**
+ * Geometry shader code generation interface.
+ *
+ * The SoA translator runs one input primitive per vector lane and keeps
+ * per-lane counts of the emitted vertices and primitives.  Fetching the
+ * per-vertex inputs and storing the emitted vertices is left to the caller,
+ * which knows the layout of its vertex buffers.
+ *
+ * All the callbacks receive a mask of the lanes they are supposed to act
+ * on; inactive lanes must not have any visible effect.
+ */
+struct lp_build_tgsi_gs_iface
+{
+   /** GS_MAX_OUTPUT_VERTICES; lanes stop emitting once they reach it */
+   unsigned max_output_vertices;
+
+   /**
+    * Fetch IN[vertex_index][attrib_index].swizzle.  vertex_index is an
+    * integer vector which may differ per lane when is_vindex_indirect is set.
+    */
+   LLVMValueRef
+   (*fetch_input)(const struct lp_build_tgsi_gs_iface *gs_iface,
+                  struct lp_build_tgsi_context *bld_base,
+                  boolean is_vindex_indirect,
+                  LLVMValueRef vertex_index,
+                  unsigned attrib_index,
+                  unsigned swizzle);
+
+   /**
+    * Store the current OUT[] registers as vertex number
+    * emitted_vertices_vec of each lane's primitive.
+    */
+   void
+   (*emit_vertex)(const struct lp_build_tgsi_gs_iface *gs_iface,
+                  struct lp_build_tgsi_context *bld_base,
+                  LLVMValueRef (*outputs)[4],
+                  LLVMValueRef emitted_vertices_vec,
+                  LLVMValueRef mask);
+
+   /**
+    * Close output primitive number emitted_prims_vec, made of
+    * verts_per_prim_vec vertices.
+    */
+   void
+   (*end_primitive)(const struct lp_build_tgsi_gs_iface *gs_iface,
+                    struct lp_build_tgsi_context *bld_base,
+                    LLVMValueRef verts_per_prim_vec,
+                    LLVMValueRef emitted_prims_vec,
+                    LLVMValueRef mask);
+
+   /** Report the final per-lane vertex and primitive counts. */
+   void
+   (*gs_epilogue)(const struct lp_build_tgsi_gs_iface *gs_iface,
+                  struct lp_build_tgsi_context *bld_base,
+                  LLVMValueRef total_emitted_vertices_vec,
+                  LLVMValueRef emitted_prims_vec);
+};
+
+
 struct lp_build_sampler_aos
 {
    LLVMValueRef
@@ -219,7 +279,8 @@ lp_build_tgsi_soa(struct gallivm_state *gallivm,
                   const LLVMValueRef (*inputs)[4],
                   LLVMValueRef (*outputs)[4],
                   struct lp_build_sampler_soa *sampler,
-                  const struct tgsi_shader_info *info);
+                  const struct tgsi_shader_info *info,
+                  const struct lp_build_tgsi_gs_iface *gs_iface);
 
 
 void
@@ -398,6 +459,13 @@ struct lp_build_tgsi_soa_context
    struct lp_build_mask_context *mask;
    struct lp_exec_mask exec_mask;
 
+   /* Geometry shaders only */
+   const struct lp_build_tgsi_gs_iface *gs_iface;
+   LLVMValueRef emitted_prims_vec_ptr;
+   LLVMValueRef total_emitted_vertices_vec_ptr;
+   LLVMValueRef emitted_vertices_vec_ptr;
+   LLVMValueRef max_output_vertices_vec;
+
    uint num_immediates;
 
 };
@@ -651,6 +651,64 @@ emit_fetch_immediate(
    return res;
 }
 
+/**
+ * Geometry shader inputs are two-dimensional, IN[vertex][attrib], with one
+ * input primitive per lane; the caller's interface knows where they live.
+ */
+static LLVMValueRef
+emit_fetch_gs_input(
+   struct lp_build_tgsi_context * bld_base,
+   const struct tgsi_full_src_register * reg,
+   enum tgsi_opcode_type stype,
+   unsigned swizzle)
+{
+   struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
+   struct gallivm_state *gallivm = bld->bld_base.base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_build_context *uint_bld = &bld_base->uint_bld;
+   LLVMValueRef vertex_index;
+   boolean is_vindex_indirect = FALSE;
+   LLVMValueRef res;
+
+   /* The callers fall back to the interpreter for indirect attributes */
+   assert(!reg->Register.Indirect);
+
+   if (!reg->Register.Dimension) {
+      /* e.g. the primitive id, which is the same for all the vertices */
+      vertex_index = uint_bld->zero;
+   }
+   else if (reg->Dimension.Indirect) {
+      LLVMValueRef rel;
+
+      assert(reg->DimIndirect.SwizzleX < 4);
+      rel = LLVMBuildLoad(builder,
+                          bld->addr[reg->DimIndirect.Index][reg->DimIndirect.SwizzleX],
+                          "load addr reg");
+      vertex_index = lp_build_add(uint_bld,
+                                  lp_build_const_int_vec(gallivm, uint_bld->type,
+                                                         reg->Dimension.Index),
+                                  rel);
+      is_vindex_indirect = TRUE;
+   }
+   else {
+      vertex_index = lp_build_const_int_vec(gallivm, uint_bld->type,
+                                            reg->Dimension.Index);
+   }
+
+   res = bld->gs_iface->fetch_input(bld->gs_iface, bld_base,
+                                    is_vindex_indirect, vertex_index,
+                                    reg->Register.Index, swizzle);
+   assert(res);
+
+   if (stype == TGSI_TYPE_UNSIGNED) {
+      res = LLVMBuildBitCast(builder, res, bld_base->uint_bld.vec_type, "");
+   } else if (stype == TGSI_TYPE_SIGNED) {
+      res = LLVMBuildBitCast(builder, res, bld_base->int_bld.vec_type, "");
+   }
+
+   return res;
+}
+
 static LLVMValueRef
 emit_fetch_input(
    struct lp_build_tgsi_context * bld_base,
@@ -665,6 +723,10 @@ emit_fetch_input(
    LLVMValueRef indirect_index = NULL;
    LLVMValueRef res;
 
+   if (bld->gs_iface) {
+      return emit_fetch_gs_input(bld_base, reg, stype, swizzle);
+   }
+
    if (reg->Register.Indirect) {
       indirect_index = get_indirect_index(bld,
                                           reg->Register.File,
@@ -1973,11 +2035,160 @@ nrm_emit(
    }
 }
 
+/**
+ * Mask of the lanes currently executing.
+ */
+static LLVMValueRef
+mask_vec(struct lp_build_tgsi_context *bld_base)
+{
+   struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
+   struct lp_exec_mask *exec_mask = &bld->exec_mask;
+
+   if (!exec_mask->has_mask) {
+      return lp_build_const_int_vec(bld_base->base.gallivm,
+                                    bld_base->int_bld.type, -1);
+   }
+   return exec_mask->exec_mask;
+}
+
+/**
+ * Add one to the counters of the lanes set in mask (which are ~0).
+ */
+static void
+increment_vec_ptr_by_mask(struct lp_build_tgsi_context * bld_base,
+                          LLVMValueRef ptr,
+                          LLVMValueRef mask)
+{
+   LLVMBuilderRef builder = bld_base->base.gallivm->builder;
+   LLVMValueRef current_vec = LLVMBuildLoad(builder, ptr, "");
+
+   current_vec = LLVMBuildSub(builder, current_vec, mask, "");
+
+   LLVMBuildStore(builder, current_vec, ptr);
+}
+
+static void
+clear_uint_vec_ptr_from_mask(struct lp_build_tgsi_context * bld_base,
+                             LLVMValueRef ptr,
+                             LLVMValueRef mask)
+{
+   LLVMBuilderRef builder = bld_base->base.gallivm->builder;
+   LLVMValueRef current_vec = LLVMBuildLoad(builder, ptr, "");
+
+   current_vec = lp_build_select(&bld_base->uint_bld,
+                                 mask,
+                                 bld_base->uint_bld.zero,
+                                 current_vec);
+
+   LLVMBuildStore(builder, current_vec, ptr);
+}
+
+/**
+ * Drop the lanes which already emitted GS_MAX_OUTPUT_VERTICES vertices.
+ */
+static LLVMValueRef
+clamp_mask_to_max_output_vertices(struct lp_build_tgsi_soa_context * bld,
+                                  LLVMValueRef current_mask_vec,
+                                  LLVMValueRef total_emitted_vertices_vec)
+{
+   LLVMBuilderRef builder = bld->bld_base.base.gallivm->builder;
+   struct lp_build_context *uint_bld = &bld->bld_base.uint_bld;
+   LLVMValueRef max_mask = lp_build_cmp(uint_bld, PIPE_FUNC_LESS,
+                                        total_emitted_vertices_vec,
+                                        bld->max_output_vertices_vec);
+
+   return LLVMBuildAnd(builder, current_mask_vec, max_mask, "");
+}
+
+static void
+emit_vertex(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
+   LLVMBuilderRef builder = bld->bld_base.base.gallivm->builder;
+   LLVMValueRef mask = mask_vec(bld_base);
+   LLVMValueRef total_emitted_vertices_vec =
+      LLVMBuildLoad(builder, bld->total_emitted_vertices_vec_ptr, "");
+
+   mask = clamp_mask_to_max_output_vertices(bld, mask,
+                                            total_emitted_vertices_vec);
+   bld->gs_iface->emit_vertex(bld->gs_iface, &bld->bld_base,
+                              bld->outputs,
+                              total_emitted_vertices_vec,
+                              mask);
+   increment_vec_ptr_by_mask(bld_base, bld->emitted_vertices_vec_ptr, mask);
+   increment_vec_ptr_by_mask(bld_base, bld->total_emitted_vertices_vec_ptr,
+                             mask);
+}
+
+/**
+ * Close the current primitive of the lanes in mask which have emitted at
+ * least one vertex since the last ENDPRIM.
+ */
+static void
+end_primitive_masked(struct lp_build_tgsi_context * bld_base,
+                     LLVMValueRef mask)
+{
+   struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
+   LLVMBuilderRef builder = bld->bld_base.base.gallivm->builder;
+   struct lp_build_context *uint_bld = &bld_base->uint_bld;
+   LLVMValueRef emitted_vertices_vec =
+      LLVMBuildLoad(builder, bld->emitted_vertices_vec_ptr, "");
+   LLVMValueRef emitted_prims_vec =
+      LLVMBuildLoad(builder, bld->emitted_prims_vec_ptr, "");
+   LLVMValueRef pending_mask = lp_build_cmp(uint_bld, PIPE_FUNC_NOTEQUAL,
+                                            emitted_vertices_vec,
+                                            uint_bld->zero);
+
+   mask = LLVMBuildAnd(builder, mask, pending_mask, "");
+
+   bld->gs_iface->end_primitive(bld->gs_iface, &bld->bld_base,
+                                emitted_vertices_vec,
+                                emitted_prims_vec,
+                                mask);
+   increment_vec_ptr_by_mask(bld_base, bld->emitted_prims_vec_ptr, mask);
+   clear_uint_vec_ptr_from_mask(bld_base, bld->emitted_vertices_vec_ptr,
+                                mask);
+}
+
+static void
+end_primitive(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   end_primitive_masked(bld_base, mask_vec(bld_base));
+}
+
 static void emit_prologue(struct lp_build_tgsi_context * bld_base)
 {
    struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
    struct gallivm_state * gallivm = bld_base->base.gallivm;
 
+   if (bld->gs_iface) {
+      struct lp_build_context *uint_bld = &bld_base->uint_bld;
+
+      bld->emitted_prims_vec_ptr =
+         lp_build_alloca(gallivm, uint_bld->vec_type, "emitted_prims_ptr");
+      bld->emitted_vertices_vec_ptr =
+         lp_build_alloca(gallivm, uint_bld->vec_type, "emitted_vertices_ptr");
+      bld->total_emitted_vertices_vec_ptr =
+         lp_build_alloca(gallivm, uint_bld->vec_type,
+                         "total_emitted_vertices_ptr");
+      bld->max_output_vertices_vec =
+         lp_build_const_int_vec(gallivm, uint_bld->type,
+                                bld->gs_iface->max_output_vertices);
+
+      LLVMBuildStore(gallivm->builder, uint_bld->zero,
+                     bld->emitted_prims_vec_ptr);
+      LLVMBuildStore(gallivm->builder, uint_bld->zero,
+                     bld->emitted_vertices_vec_ptr);
+      LLVMBuildStore(gallivm->builder, uint_bld->zero,
+                     bld->total_emitted_vertices_vec_ptr);
+   }
+
    if (bld->indirect_files & (1 << TGSI_FILE_TEMPORARY)) {
       LLVMValueRef array_size =
          lp_build_const_int32(gallivm,
@@ -2046,6 +2257,26 @@ static void emit_epilogue(struct lp_build_tgsi_context * bld_base)
          }
       }
    }
+
+   if (bld->gs_iface) {
+      LLVMBuilderRef builder = bld_base->base.gallivm->builder;
+      LLVMValueRef total_emitted_vertices_vec;
+      LLVMValueRef emitted_prims_vec;
+
+      /* Vertices emitted without a trailing ENDPRIM still form a primitive */
+      end_primitive_masked(bld_base,
+                           lp_build_const_int_vec(bld_base->base.gallivm,
+                                                  bld_base->int_bld.type, -1));
+
+      total_emitted_vertices_vec =
+         LLVMBuildLoad(builder, bld->total_emitted_vertices_vec_ptr, "");
+      emitted_prims_vec =
+         LLVMBuildLoad(builder, bld->emitted_prims_vec_ptr, "");
+
+      bld->gs_iface->gs_epilogue(bld->gs_iface, &bld->bld_base,
+                                 total_emitted_vertices_vec,
+                                 emitted_prims_vec);
+   }
 }
 
 void
@@ -2059,7 +2290,8 @@ lp_build_tgsi_soa(struct gallivm_state *gallivm,
                   const LLVMValueRef (*inputs)[TGSI_NUM_CHANNELS],
                   LLVMValueRef (*outputs)[TGSI_NUM_CHANNELS],
                   struct lp_build_sampler_soa *sampler,
-                  const struct tgsi_shader_info *info)
+                  const struct tgsi_shader_info *info,
+                  const struct lp_build_tgsi_gs_iface *gs_iface)
 {
    struct lp_build_tgsi_soa_context bld;
 
@@ -2127,6 +2359,14 @@ lp_build_tgsi_soa(struct gallivm_state *gallivm,
    bld.bld_base.op_actions[TGSI_OPCODE_TXP].emit = txp_emit;
    bld.bld_base.op_actions[TGSI_OPCODE_TXQ].emit = txq_emit;
 
+   if (gs_iface) {
+      /* inputs are fetched through the interface, never indirectly */
+      assert(!(bld.indirect_files & (1 << TGSI_FILE_INPUT)));
+      bld.gs_iface = gs_iface;
+      bld.bld_base.op_actions[TGSI_OPCODE_EMIT].emit = emit_vertex;
+      bld.bld_base.op_actions[TGSI_OPCODE_ENDPRIM].emit = end_primitive;
+   }
+
    lp_exec_mask_init(&bld.exec_mask, &bld.bld_base.base);
 
    bld.system_values = *system_values;
@@ -58,6 +58,7 @@
 #include "tgsi/tgsi_parse.h"
 #include "tgsi/tgsi_util.h"
 #include "tgsi_exec.h"
+#include "util/u_debug.h"
 #include "util/u_memory.h"
 #include "util/u_math.h"
 
@@ -619,6 +620,10 @@ tgsi_check_soa_dependencies(const struct tgsi_full_instruction *inst)
 }
 
 
+static void
+tgsi_exec_predecode(struct tgsi_exec_machine *mach);
+
+
 /**
  * Initialize machine state by expanding tokens to full instructions,
  * allocating temporary storage, setting up constants, etc.
@@ -661,6 +666,9 @@ tgsi_exec_machine_bind_shader(
       mach->Instructions = NULL;
       mach->NumInstructions = 0;
 
+      FREE(mach->Predecoded);
+      mach->Predecoded = NULL;
+
       return;
    }
 
@@ -807,6 +815,8 @@ tgsi_exec_machine_bind_shader(
    FREE(mach->Instructions);
    mach->Instructions = instructions;
    mach->NumInstructions = numInstructions;
+
+   tgsi_exec_predecode(mach);
 }
 
 
@@ -868,6 +878,7 @@ tgsi_exec_machine_destroy(struct tgsi_exec_machine *mach)
 {
    if (mach) {
       FREE(mach->Instructions);
+      FREE(mach->Predecoded);
       FREE(mach->Declarations);
 
       align_free(mach->Inputs);
@@ -4214,6 +4225,426 @@ exec_instruction(
 }
 
 
+/*
+ * Predecoded instructions.
+ *
+ * Most instructions of typical shaders are plain arithmetic on directly
+ * addressed registers.  When a shader is bound these are translated into
+ * tgsi_exec_predecoded records which hold the (swizzled) register
+ * channels they read and write, so that running them skips the opcode
+ * switch and the generic operand decoding of fetch_source() and
+ * store_dest().  Everything else -- control flow, texturing, indirect or
+ * 2D addressing, predication -- keeps going through exec_instruction().
+ */
+
+enum predecoded_kind {
+   PREDECODED_NONE = 0,
+   PREDECODED_UNARY,
+   PREDECODED_BINARY,
+   PREDECODED_TRINARY,
+   PREDECODED_DP3,
+   PREDECODED_DP4
+};
+
+enum predecoded_file {
+   PREDECODED_FILE_REG,    /**< register channels, resolved at bind time */
+   PREDECODED_FILE_IMM,    /**< immediate, broadcast to the quad */
+   PREDECODED_FILE_CONST   /**< constant, buffers are set after binding */
+};
+
+struct predecoded_src {
+   ubyte file;
+   ubyte absolute;
+   ubyte negate;
+   ubyte buffer;           /**< constant buffer */
+   union {
+      const union tgsi_exec_channel *reg[TGSI_NUM_CHANNELS];
+      const float *imm[TGSI_NUM_CHANNELS];
+      int pos[TGSI_NUM_CHANNELS];   /**< constant index * 4 + swizzle */
+   } u;
+};
+
+struct tgsi_exec_predecoded {
+   ubyte kind;
+   ubyte nr_src;
+   ubyte writemask;
+   ubyte saturate;
+   union {
+      micro_unary_op unary;
+      micro_binary_op binary;
+      micro_trinary_op trinary;
+   } op;
+   union tgsi_exec_channel *dst[TGSI_NUM_CHANNELS];
+   struct predecoded_src src[3];
+};
+
+
+DEBUG_GET_ONCE_BOOL_OPTION(tgsi_no_predecode, "TGSI_NO_PREDECODE", FALSE)
+
+
+static boolean
+predecode_src(struct tgsi_exec_machine *mach,
+              const struct tgsi_full_src_register *reg,
+              struct predecoded_src *src)
+{
+   const uint index = reg->Register.Index;
+   uint chan;
+
+   if (reg->Register.Indirect)
+      return FALSE;
+
+   src->absolute = reg->Register.Absolute;
+   src->negate = reg->Register.Negate;
+   src->buffer = 0;
+
+   switch (reg->Register.File) {
+   case TGSI_FILE_CONSTANT:
+      if (reg->Register.Dimension) {
+         if (reg->Dimension.Indirect ||
+             reg->Dimension.Index >= PIPE_MAX_CONSTANT_BUFFERS)
+            return FALSE;
+         src->buffer = reg->Dimension.Index;
+      }
+      src->file = PREDECODED_FILE_CONST;
+      for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+         src->u.pos[chan] = index * 4 +
+            tgsi_util_get_full_src_register_swizzle(reg, chan);
+      }
+      return TRUE;
+
+   case TGSI_FILE_IMMEDIATE:
+      if (reg->Register.Dimension || index >= mach->ImmLimit)
+         return FALSE;
+      src->file = PREDECODED_FILE_IMM;
+      for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+         src->u.imm[chan] =
+            &mach->Imms[index][tgsi_util_get_full_src_register_swizzle(reg, chan)];
+      }
+      return TRUE;
+
+   case TGSI_FILE_TEMPORARY:
+      if (reg->Register.Dimension || index >= TGSI_EXEC_NUM_TEMPS)
+         return FALSE;
+      src->file = PREDECODED_FILE_REG;
+      for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+         src->u.reg[chan] =
+            &mach->Temps[index].xyzw[tgsi_util_get_full_src_register_swizzle(reg, chan)];
+      }
+      return TRUE;
+
+   case TGSI_FILE_INPUT:
+      if (reg->Register.Dimension || index >= PIPE_MAX_ATTRIBS)
+         return FALSE;
+      src->file = PREDECODED_FILE_REG;
+      for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+         src->u.reg[chan] =
+            &mach->Inputs[index].xyzw[tgsi_util_get_full_src_register_swizzle(reg, chan)];
+      }
+      return TRUE;
+
+   default:
+      return FALSE;
+   }
+}
+
+
+static boolean
+predecode_dst(struct tgsi_exec_machine *mach,
+              const struct tgsi_full_dst_register *reg,
+              struct tgsi_exec_predecoded *pred)
+{
+   const uint index = reg->Register.Index;
+   struct tgsi_exec_vector *vec;
+   uint chan;
+
+   if (reg->Register.Indirect || reg->Register.Dimension)
+      return FALSE;
+
+   switch (reg->Register.File) {
+   case TGSI_FILE_TEMPORARY:
+      if (index >= TGSI_EXEC_NUM_TEMPS)
+         return FALSE;
+      vec = &mach->Temps[index];
+      break;
+
+   case TGSI_FILE_OUTPUT:
+      /* geometry shaders move the output base on every EMIT */
+      if (mach->Processor == TGSI_PROCESSOR_GEOMETRY ||
+          index >= PIPE_MAX_ATTRIBS)
+         return FALSE;
+      vec = &mach->Outputs[index];
+      break;
+
+   default:
+      return FALSE;
+   }
+
+   for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++)
+      pred->dst[chan] = &vec->xyzw[chan];
+
+   pred->writemask = reg->Register.WriteMask;
+   return TRUE;
+}
+
+
+static boolean
+predecode_instruction(struct tgsi_exec_machine *mach,
+                      const struct tgsi_full_instruction *inst,
+                      struct tgsi_exec_predecoded *pred)
+{
+   uint i;
+
+   memset(pred, 0, sizeof *pred);
+
+   switch (inst->Instruction.Opcode) {
+   case TGSI_OPCODE_MOV:
+      pred->kind = PREDECODED_UNARY;
+      pred->op.unary = micro_mov;
+      break;
+   case TGSI_OPCODE_ADD:
+      pred->kind = PREDECODED_BINARY;
+      pred->op.binary = micro_add;
+      break;
+   case TGSI_OPCODE_SUB:
+      pred->kind = PREDECODED_BINARY;
+      pred->op.binary = micro_sub;
+      break;
+   case TGSI_OPCODE_MUL:
+      pred->kind = PREDECODED_BINARY;
+      pred->op.binary = micro_mul;
+      break;
+   case TGSI_OPCODE_MIN:
+      pred->kind = PREDECODED_BINARY;
+      pred->op.binary = micro_min;
+      break;
+   case TGSI_OPCODE_MAX:
+      pred->kind = PREDECODED_BINARY;
+      pred->op.binary = micro_max;
+      break;
+   case TGSI_OPCODE_SLT:
+      pred->kind = PREDECODED_BINARY;
+      pred->op.binary = micro_slt;
+      break;
+   case TGSI_OPCODE_SGE:
+      pred->kind = PREDECODED_BINARY;
+      pred->op.binary = micro_sge;
+      break;
+   case TGSI_OPCODE_MAD:
+      pred->kind = PREDECODED_TRINARY;
+      pred->op.trinary = micro_mad;
+      break;
+   case TGSI_OPCODE_LRP:
+      pred->kind = PREDECODED_TRINARY;
+      pred->op.trinary = micro_lrp;
+      break;
+   case TGSI_OPCODE_DP3:
+      pred->kind = PREDECODED_DP3;
+      break;
+   case TGSI_OPCODE_DP4:
+      pred->kind = PREDECODED_DP4;
+      break;
+   default:
+      return FALSE;
+   }
+
+   if (inst->Instruction.Predicate ||
+       inst->Instruction.NumDstRegs != 1 ||
+       inst->Instruction.NumSrcRegs > Elements(pred->src))
+      return FALSE;
+
+   pred->nr_src = inst->Instruction.NumSrcRegs;
+   pred->saturate = inst->Instruction.Saturate;
+
+   for (i = 0; i < pred->nr_src; i++) {
+      if (!predecode_src(mach, &inst->Src[i], &pred->src[i]))
+         return FALSE;
+   }
+
+   return predecode_dst(mach, &inst->Dst[0], pred);
+}
+
+
+/**
+ * Predecode what can be of the bound shader's instructions, see above.
+ */
+static void
+tgsi_exec_predecode(struct tgsi_exec_machine *mach)
+{
+   uint i;
+
+   FREE(mach->Predecoded);
+   mach->Predecoded = NULL;
+
+   if (!mach->NumInstructions || debug_get_option_tgsi_no_predecode())
+      return;
+
+   mach->Predecoded = (struct tgsi_exec_predecoded *)
+      MALLOC(mach->NumInstructions * sizeof(struct tgsi_exec_predecoded));
+   if (!mach->Predecoded)
+      return;
+
+   for (i = 0; i < mach->NumInstructions; i++) {
+      if (!predecode_instruction(mach, &mach->Instructions[i],
+                                 &mach->Predecoded[i]))
+         mach->Predecoded[i].kind = PREDECODED_NONE;
+   }
+}
+
+
+static INLINE void
+fetch_predecoded(const struct tgsi_exec_machine *mach,
+                 const struct predecoded_src *src,
+                 uint chan,
+                 union tgsi_exec_channel *dst)
+{
+   switch (src->file) {
+   case PREDECODED_FILE_REG:
+      *dst = *src->u.reg[chan];
+      break;
+
+   case PREDECODED_FILE_IMM:
+      dst->f[0] =
+      dst->f[1] =
+      dst->f[2] =
+      dst->f[3] = *src->u.imm[chan];
+      break;
+
+   default:
+      {
+         const int pos = src->u.pos[chan];
+
+         if (pos < mach->ConstsSize[src->buffer]) {
+            const uint *buf = (const uint *)mach->Consts[src->buffer];
+            dst->u[0] =
+            dst->u[1] =
+            dst->u[2] =
+            dst->u[3] = buf[pos];
+         }
+         else {
+            *dst = ZeroVec;
+         }
+      }
+      break;
+   }
+
+   if (src->absolute)
+      micro_abs(dst, dst);
+   if (src->negate)
+      micro_neg(dst, dst);
+}
+
+
+static INLINE void
+store_predecoded(const struct tgsi_exec_machine *mach,
+                 const struct tgsi_exec_predecoded *pred,
+                 const union tgsi_exec_channel *chan,
+                 uint chan_index)
+{
+   union tgsi_exec_channel *dst = pred->dst[chan_index];
+   const uint execmask = mach->ExecMask;
+   uint i;
+
+   if (pred->saturate == TGSI_SAT_NONE) {
+      if (execmask == 0xf) {
+         *dst = *chan;
+      }
+      else {
+         for (i = 0; i < TGSI_QUAD_SIZE; i++)
+            if (execmask & (1 << i))
+               dst->i[i] = chan->i[i];
+      }
+   }
+   else {
+      const float lo = pred->saturate == TGSI_SAT_ZERO_ONE ? 0.0f : -1.0f;
+
+      for (i = 0; i < TGSI_QUAD_SIZE; i++)
+         if (execmask & (1 << i)) {
+            if (chan->f[i] < lo)
+               dst->f[i] = lo;
+            else if (chan->f[i] > 1.0f)
+               dst->f[i] = 1.0f;
+            else
+               dst->i[i] = chan->i[i];
+         }
+   }
+}
+
+
+static void
+exec_predecoded(struct tgsi_exec_machine *mach,
+                const struct tgsi_exec_predecoded *pred)
+{
+   struct tgsi_exec_vector dst;
+   union tgsi_exec_channel src[3];
+   uint chan;
+
+   switch (pred->kind) {
+   case PREDECODED_DP3:
+   case PREDECODED_DP4:
+      {
+         const uint last = pred->kind == PREDECODED_DP3 ?
+            TGSI_CHAN_Z : TGSI_CHAN_W;
+
+         fetch_predecoded(mach, &pred->src[0], TGSI_CHAN_X, &src[0]);
+         fetch_predecoded(mach, &pred->src[1], TGSI_CHAN_X, &src[1]);
+         micro_mul(&src[2], &src[0], &src[1]);
+         for (chan = TGSI_CHAN_Y; chan <= last; chan++) {
+            fetch_predecoded(mach, &pred->src[0], chan, &src[0]);
+            fetch_predecoded(mach, &pred->src[1], chan, &src[1]);
+            micro_mad(&src[2], &src[0], &src[1], &src[2]);
+         }
+         for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+            if (pred->writemask & (1 << chan))
+               store_predecoded(mach, pred, &src[2], chan);
+         }
+      }
+      return;
+
+   case PREDECODED_UNARY:
+      for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+         if (pred->writemask & (1 << chan)) {
+            fetch_predecoded(mach, &pred->src[0], chan, &src[0]);
+            pred->op.unary(&dst.xyzw[chan], &src[0]);
+         }
+      }
+      break;
+
+   case PREDECODED_BINARY:
+      for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+         if (pred->writemask & (1 << chan)) {
+            fetch_predecoded(mach, &pred->src[0], chan, &src[0]);
+            fetch_predecoded(mach, &pred->src[1], chan, &src[1]);
+            pred->op.binary(&dst.xyzw[chan], &src[0], &src[1]);
+         }
+      }
+      break;
+
+   case PREDECODED_TRINARY:
+      for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+         if (pred->writemask & (1 << chan)) {
+            fetch_predecoded(mach, &pred->src[0], chan, &src[0]);
+            fetch_predecoded(mach, &pred->src[1], chan, &src[1]);
+            fetch_predecoded(mach, &pred->src[2], chan, &src[2]);
+            pred->op.trinary(&dst.xyzw[chan], &src[0], &src[1], &src[2]);
+         }
+      }
+      break;
+
+   default:
+      assert(0);
+      return;
+   }
+
+   /* all channels are computed before any is stored, as in
+    * exec_vector_binary() & co, so that MOV T, T.yxwz works
+    */
+   for (chan = 0; chan < TGSI_NUM_CHANNELS; chan++) {
+      if (pred->writemask & (1 << chan))
+         store_predecoded(mach, pred, &dst.xyzw[chan], chan);
+   }
+}
+
+
 #define DEBUG_EXECUTION 0
 
 
@@ -4275,7 +4706,14 @@ tgsi_exec_machine_run( struct tgsi_exec_machine *mach )
 #endif
 
          assert(pc < (int) mach->NumInstructions);
-         exec_instruction(mach, mach->Instructions + pc, &pc);
+         if (mach->Predecoded &&
+             mach->Predecoded[pc].kind != PREDECODED_NONE) {
+            exec_predecoded(mach, &mach->Predecoded[pc]);
+            pc++;
+         }
+         else {
+            exec_instruction(mach, mach->Instructions + pc, &pc);
+         }
 
 #if DEBUG_EXECUTION
          for (i = 0; i < TGSI_EXEC_NUM_TEMPS + TGSI_EXEC_NUM_TEMP_EXTRAS; i++) {
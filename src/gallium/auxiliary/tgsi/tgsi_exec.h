@@ -236,6 +236,8 @@ enum tgsi_break_type {
 #define TGSI_EXEC_MAX_BREAK_STACK (TGSI_EXEC_MAX_LOOP_NESTING + TGSI_EXEC_MAX_SWITCH_NESTING)
 
 
+struct tgsi_exec_predecoded;
+
 /**
  * Run-time virtual machine state for executing TGSI shader.
  */
@@ -328,6 +330,9 @@ struct tgsi_exec_machine
    struct tgsi_full_instruction *Instructions;
    uint NumInstructions;
 
+   /** Fast path form of Instructions, see tgsi_exec_predecode() */
+   struct tgsi_exec_predecoded *Predecoded;
+
    struct tgsi_full_declaration *Declarations;
    uint NumDeclarations;
 
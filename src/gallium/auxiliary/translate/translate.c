@@ -32,8 +32,13 @@
 
 #include "pipe/p_config.h"
 #include "pipe/p_state.h"
+#include "util/u_debug.h"
 #include "translate.h"
 
+#if HAVE_LLVM
+DEBUG_GET_ONCE_BOOL_OPTION(translate_use_llvm, "TRANSLATE_USE_LLVM", TRUE)
+#endif
+
 struct translate *translate_create( const struct translate_key *key )
 {
    struct translate *translate = NULL;
@@ -42,10 +47,21 @@ struct translate *translate_create( const struct translate_key *key )
    translate = translate_sse2_create( key );
    if (translate)
       return translate;
-#else
-   (void)translate;
 #endif
 
+#if HAVE_LLVM
+   /* The SSE emitter is much cheaper to build, so only keys it can't
+    * handle get compiled with LLVM.
+    */
+   if (debug_get_option_translate_use_llvm()) {
+      translate = translate_llvm_create( key );
+      if (translate)
+         return translate;
+   }
+#endif
+
+   (void)translate;
+
    return translate_generic_create( key );
 }
 
@@ -0,0 +1,656 @@
+/**************************************************************************
+ *
+ * Copyright 2013 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * @file
+ * Translate backend generating the fetch/convert code with gallivm.
+ *
+ * Every element is fetched with lp_build_fetch_rgba_aos(), which has
+ * vectorized code paths for most vertex formats, and written out as
+ * floats, as a straight copy, or through util_format's pack function for
+ * the remaining output formats.  This covers the keys translate_sse
+ * can't handle, which would otherwise go through translate_generic's
+ * per-element function pointers.
+ */
+
+
+#include "util/u_memory.h"
+#include "util/u_format.h"
+#include "util/u_pointer.h"
+#include "pipe/p_state.h"
+#include "gallivm/lp_bld_arit.h"
+#include "gallivm/lp_bld_const.h"
+#include "gallivm/lp_bld_debug.h"
+#include "gallivm/lp_bld_flow.h"
+#include "gallivm/lp_bld_format.h"
+#include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_struct.h"
+#include "gallivm/lp_bld_type.h"
+#include "translate.h"
+
+
+struct translate_llvm_buffer {
+   const uint8_t *ptr;
+   unsigned stride;
+   unsigned max_index;
+};
+
+
+typedef void
+(*translate_llvm_elts_func)(const struct translate_llvm_buffer *buffers,
+                            const void *elts,
+                            unsigned count,
+                            unsigned instance_id,
+                            void *output_buffer);
+
+typedef void
+(*translate_llvm_linear_func)(const struct translate_llvm_buffer *buffers,
+                              unsigned start,
+                              unsigned count,
+                              unsigned instance_id,
+                              void *output_buffer);
+
+
+struct translate_llvm {
+   struct translate translate;
+
+   struct translate_llvm_buffer buffers[PIPE_MAX_ATTRIBS];
+
+   struct gallivm_state *gallivm;
+
+   translate_llvm_elts_func elt_func;
+   translate_llvm_elts_func elt16_func;
+   translate_llvm_elts_func elt8_func;
+   translate_llvm_linear_func linear_func;
+};
+
+
+static INLINE struct translate_llvm *
+translate_llvm(struct translate *translate)
+{
+   return (struct translate_llvm *)translate;
+}
+
+
+/**
+ * Create LLVM type for struct translate_llvm_buffer.
+ */
+static LLVMTypeRef
+create_buffer_type(struct gallivm_state *gallivm)
+{
+   LLVMTargetDataRef target = gallivm->target;
+   LLVMTypeRef elem_types[3];
+   LLVMTypeRef buffer_type;
+
+   elem_types[0] = LLVMPointerType(LLVMInt8TypeInContext(gallivm->context), 0);
+   elem_types[1] =
+   elem_types[2] = LLVMInt32TypeInContext(gallivm->context);
+
+   buffer_type = LLVMStructTypeInContext(gallivm->context, elem_types,
+                                         Elements(elem_types), 0);
+#if HAVE_LLVM < 0x0300
+   LLVMAddTypeName(gallivm->module, "translate_llvm_buffer", buffer_type);
+
+   LLVMInvalidateStructLayout(gallivm->target, buffer_type);
+#endif
+
+   LP_CHECK_MEMBER_OFFSET(struct translate_llvm_buffer, ptr,
+                          target, buffer_type, 0);
+   LP_CHECK_MEMBER_OFFSET(struct translate_llvm_buffer, stride,
+                          target, buffer_type, 1);
+   LP_CHECK_MEMBER_OFFSET(struct translate_llvm_buffer, max_index,
+                          target, buffer_type, 2);
+
+   LP_CHECK_STRUCT_SIZE(struct translate_llvm_buffer, target, buffer_type);
+
+   return buffer_type;
+}
+
+
+/**
+ * Whether the element is copied verbatim.
+ */
+static boolean
+element_is_copy(const struct translate_element *element)
+{
+   const struct util_format_description *desc =
+      util_format_description(element->input_format);
+
+   return element->type == TRANSLATE_ELEMENT_NORMAL &&
+          element->input_format == element->output_format &&
+          desc->block.width == 1 &&
+          desc->block.height == 1 &&
+          !(desc->block.bits & 7);
+}
+
+
+/**
+ * Whether the element can be handled by this backend.
+ */
+static boolean
+element_is_supported(const struct translate_element *element)
+{
+   const struct util_format_description *out_desc =
+      util_format_description(element->output_format);
+
+   if (!out_desc)
+      return FALSE;
+
+   if (element->type == TRANSLATE_ELEMENT_NORMAL) {
+      const struct util_format_description *in_desc =
+         util_format_description(element->input_format);
+
+      if (!in_desc || !in_desc->fetch_rgba_float)
+         return FALSE;
+
+      if (element_is_copy(element))
+         return TRUE;
+
+      /* Integers must not go through floats. */
+      if (in_desc->channel[0].pure_integer ||
+          out_desc->channel[0].pure_integer)
+         return FALSE;
+   }
+
+   switch (element->output_format) {
+   case PIPE_FORMAT_R32_FLOAT:
+   case PIPE_FORMAT_R32G32_FLOAT:
+   case PIPE_FORMAT_R32G32B32_FLOAT:
+   case PIPE_FORMAT_R32G32B32A32_FLOAT:
+      return TRUE;
+   case PIPE_FORMAT_R32_USCALED:
+   case PIPE_FORMAT_R32_SSCALED:
+      if (element->type == TRANSLATE_ELEMENT_INSTANCE_ID)
+         return TRUE;
+      break;
+   default:
+      break;
+   }
+
+   return out_desc->pack_rgba_float != NULL &&
+          translate_generic_is_output_format_supported(element->output_format);
+}
+
+
+/**
+ * Write a vec4 of floats in the given output format.
+ */
+static void
+emit_rgba(struct gallivm_state *gallivm,
+          enum pipe_format format,
+          LLVMValueRef rgba,
+          LLVMValueRef tmp_ptr,
+          LLVMValueRef dst_ptr)
+{
+   const struct util_format_description *desc = util_format_description(format);
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef f32t = LLVMFloatTypeInContext(gallivm->context);
+   LLVMTypeRef pf32t = LLVMPointerType(f32t, 0);
+   LLVMTypeRef pi8t = LLVMPointerType(LLVMInt8TypeInContext(gallivm->context), 0);
+   LLVMTypeRef i32t = LLVMInt32TypeInContext(gallivm->context);
+   unsigned i;
+
+   switch (format) {
+   case PIPE_FORMAT_R32G32B32A32_FLOAT:
+      dst_ptr = LLVMBuildBitCast(builder, dst_ptr,
+                                 LLVMPointerType(LLVMTypeOf(rgba), 0), "");
+      lp_set_store_alignment(LLVMBuildStore(builder, rgba, dst_ptr), 4);
+      return;
+
+   case PIPE_FORMAT_R32_FLOAT:
+   case PIPE_FORMAT_R32G32_FLOAT:
+   case PIPE_FORMAT_R32G32B32_FLOAT:
+      dst_ptr = LLVMBuildBitCast(builder, dst_ptr, pf32t, "");
+      for (i = 0; i < desc->nr_channels; ++i) {
+         LLVMValueRef index = lp_build_const_int32(gallivm, i);
+         LLVMValueRef chan = LLVMBuildExtractElement(builder, rgba, index, "");
+         LLVMValueRef chan_ptr = LLVMBuildGEP(builder, dst_ptr, &index, 1, "");
+         LLVMBuildStore(builder, chan, chan_ptr);
+      }
+      return;
+
+   default:
+      break;
+   }
+
+   /*
+    * Fallback to calling util_format_description::pack_rgba_float, which
+    * looks like:
+    *   pack(uint8_t *dst, unsigned dst_stride,
+    *        const float *src, unsigned src_stride,
+    *        unsigned width, unsigned height)
+    */
+   {
+      LLVMTypeRef ret_type = LLVMVoidTypeInContext(gallivm->context);
+      LLVMTypeRef arg_types[6];
+      LLVMValueRef function;
+      LLVMValueRef args[6];
+
+      arg_types[0] = pi8t;
+      arg_types[1] = i32t;
+      arg_types[2] = pf32t;
+      arg_types[3] = i32t;
+      arg_types[4] = i32t;
+      arg_types[5] = i32t;
+
+      function = lp_build_const_func_pointer(gallivm,
+                                             func_to_pointer((func_pointer) desc->pack_rgba_float),
+                                             ret_type,
+                                             arg_types, Elements(arg_types),
+                                             desc->short_name);
+
+      LLVMBuildStore(builder, rgba, tmp_ptr);
+
+      args[0] = dst_ptr;
+      args[1] = lp_build_const_int32(gallivm, 0);
+      args[2] = LLVMBuildBitCast(builder, tmp_ptr, pf32t, "");
+      args[3] = lp_build_const_int32(gallivm, 0);
+      args[4] = lp_build_const_int32(gallivm, 1);
+      args[5] = lp_build_const_int32(gallivm, 1);
+
+      LLVMBuildCall(builder, function, args, Elements(args), "");
+   }
+}
+
+
+/**
+ * Generate the code translating one vertex.
+ *
+ * \param ptrs, strides, max_indices  per input buffer values, loaded
+ *                                    once before the loop
+ */
+static void
+generate_vertex(struct gallivm_state *gallivm,
+                const struct translate_key *key,
+                LLVMValueRef *ptrs,
+                LLVMValueRef *strides,
+                LLVMValueRef *max_indices,
+                LLVMValueRef tmp_ptr,
+                LLVMValueRef elt,
+                LLVMValueRef instance_id,
+                LLVMValueRef vertex_ptr)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef i32t = LLVMInt32TypeInContext(gallivm->context);
+   LLVMValueRef zero = lp_build_const_int32(gallivm, 0);
+   struct lp_build_context bld;
+   unsigned i;
+
+   lp_build_context_init(&bld, gallivm, lp_type_uint(32));
+
+   for (i = 0; i < key->nr_elements; ++i) {
+      const struct translate_element *element = &key->element[i];
+      LLVMValueRef offset = lp_build_const_int32(gallivm, element->output_offset);
+      LLVMValueRef dst_ptr = LLVMBuildGEP(builder, vertex_ptr, &offset, 1, "");
+
+      if (element->type == TRANSLATE_ELEMENT_NORMAL) {
+         const struct util_format_description *in_desc =
+            util_format_description(element->input_format);
+         unsigned buffer = element->input_buffer;
+         LLVMValueRef index;
+         LLVMValueRef src_ptr;
+
+         if (element->instance_divisor) {
+            /* array index = instance_id / instance_divisor */
+            index = LLVMBuildUDiv(builder, instance_id,
+                                  lp_build_const_int32(gallivm, element->instance_divisor),
+                                  "instance_divisor");
+         }
+         else {
+            /* clamp to avoid going out of bounds */
+            index = lp_build_min(&bld, elt, max_indices[buffer]);
+         }
+
+         offset = LLVMBuildMul(builder, index, strides[buffer], "");
+         offset = LLVMBuildAdd(builder, offset,
+                               lp_build_const_int32(gallivm, element->input_offset),
+                               "");
+         src_ptr = LLVMBuildGEP(builder, ptrs[buffer], &offset, 1, "");
+
+         if (element_is_copy(element)) {
+            LLVMTypeRef int_type = LLVMIntTypeInContext(gallivm->context,
+                                                        in_desc->block.bits);
+            LLVMTypeRef int_ptr_type = LLVMPointerType(int_type, 0);
+            LLVMValueRef value;
+
+            src_ptr = LLVMBuildBitCast(builder, src_ptr, int_ptr_type, "");
+            dst_ptr = LLVMBuildBitCast(builder, dst_ptr, int_ptr_type, "");
+            value = LLVMBuildLoad(builder, src_ptr, "");
+            lp_set_load_alignment(value, 1);
+            lp_set_store_alignment(LLVMBuildStore(builder, value, dst_ptr), 1);
+         }
+         else {
+            LLVMValueRef rgba;
+
+            rgba = lp_build_fetch_rgba_aos(gallivm, in_desc,
+                                           lp_float32_vec4_type(),
+                                           src_ptr, zero, zero, zero);
+
+            emit_rgba(gallivm, element->output_format, rgba, tmp_ptr, dst_ptr);
+         }
+      }
+      else {
+         switch (element->output_format) {
+         case PIPE_FORMAT_R32_USCALED:
+         case PIPE_FORMAT_R32_SSCALED:
+            dst_ptr = LLVMBuildBitCast(builder, dst_ptr,
+                                       LLVMPointerType(i32t, 0), "");
+            LLVMBuildStore(builder, instance_id, dst_ptr);
+            break;
+
+         default:
+            {
+               LLVMTypeRef f32t = LLVMFloatTypeInContext(gallivm->context);
+               LLVMValueRef rgba = lp_build_const_vec(gallivm,
+                                                      lp_float32_vec4_type(),
+                                                      0.0);
+               LLVMValueRef id = LLVMBuildUIToFP(builder, instance_id, f32t, "");
+
+               rgba = LLVMBuildInsertElement(builder, rgba, id, zero, "");
+               emit_rgba(gallivm, element->output_format, rgba, tmp_ptr, dst_ptr);
+            }
+            break;
+         }
+      }
+   }
+}
+
+
+/**
+ * Generate one of the run functions.
+ *
+ * \param elt_type  type of the elements, or NULL for the linear function
+ */
+static LLVMValueRef
+generate_run(struct gallivm_state *gallivm,
+             const struct translate_key *key,
+             LLVMTypeRef buffer_type,
+             LLVMTypeRef elt_type,
+             const char *name)
+{
+   LLVMContextRef context = gallivm->context;
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef i32t = LLVMInt32TypeInContext(context);
+   LLVMTypeRef pi8t = LLVMPointerType(LLVMInt8TypeInContext(context), 0);
+   LLVMTypeRef arg_types[5];
+   LLVMTypeRef func_type;
+   LLVMValueRef function;
+   LLVMValueRef buffers_ptr, elts_ptr, start, count, instance_id, output_ptr;
+   LLVMValueRef ptrs[PIPE_MAX_ATTRIBS];
+   LLVMValueRef strides[PIPE_MAX_ATTRIBS];
+   LLVMValueRef max_indices[PIPE_MAX_ATTRIBS];
+   LLVMValueRef tmp_ptr;
+   LLVMBasicBlockRef block;
+   struct lp_build_loop_state loop;
+   unsigned i;
+
+   arg_types[0] = LLVMPointerType(buffer_type, 0);        /* buffers */
+   arg_types[1] = elt_type ? LLVMPointerType(elt_type, 0) /* elts */
+                           : i32t;                        /* start */
+   arg_types[2] = i32t;                                   /* count */
+   arg_types[3] = i32t;                                   /* instance_id */
+   arg_types[4] = pi8t;                                   /* output */
+
+   func_type = LLVMFunctionType(LLVMVoidTypeInContext(context),
+                                arg_types, Elements(arg_types), 0);
+
+   function = LLVMAddFunction(gallivm->module, name, func_type);
+   LLVMSetFunctionCallConv(function, LLVMCCallConv);
+   for (i = 0; i < Elements(arg_types); ++i)
+      if (LLVMGetTypeKind(arg_types[i]) == LLVMPointerTypeKind)
+         LLVMAddAttribute(LLVMGetParam(function, i), LLVMNoAliasAttribute);
+
+   buffers_ptr = LLVMGetParam(function, 0);
+   count       = LLVMGetParam(function, 2);
+   instance_id = LLVMGetParam(function, 3);
+   output_ptr  = LLVMGetParam(function, 4);
+
+   lp_build_name(buffers_ptr, "buffers");
+   lp_build_name(count, "count");
+   lp_build_name(instance_id, "instance_id");
+   lp_build_name(output_ptr, "output");
+
+   if (elt_type) {
+      elts_ptr = LLVMGetParam(function, 1);
+      lp_build_name(elts_ptr, "elts");
+      start = NULL;
+   }
+   else {
+      start = LLVMGetParam(function, 1);
+      lp_build_name(start, "start");
+      elts_ptr = NULL;
+   }
+
+   /*
+    * Function body
+    */
+
+   block = LLVMAppendBasicBlockInContext(context, function, "entry");
+   LLVMPositionBuilderAtEnd(builder, block);
+
+   memset(ptrs, 0, sizeof ptrs);
+   memset(strides, 0, sizeof strides);
+   memset(max_indices, 0, sizeof max_indices);
+
+   for (i = 0; i < key->nr_elements; ++i) {
+      unsigned buffer = key->element[i].input_buffer;
+
+      if (key->element[i].type == TRANSLATE_ELEMENT_NORMAL && !ptrs[buffer]) {
+         LLVMValueRef index = lp_build_const_int32(gallivm, buffer);
+         LLVMValueRef buffer_ptr = LLVMBuildGEP(builder, buffers_ptr,
+                                                &index, 1, "");
+
+         ptrs[buffer] = lp_build_struct_get(gallivm, buffer_ptr, 0, "ptr");
+         strides[buffer] = lp_build_struct_get(gallivm, buffer_ptr, 1, "stride");
+         max_indices[buffer] = lp_build_struct_get(gallivm, buffer_ptr, 2,
+                                                   "max_index");
+      }
+   }
+
+   /* scratch space for util_format pack calls */
+   tmp_ptr = lp_build_alloca(gallivm, lp_build_vec_type(gallivm,
+                                                        lp_float32_vec4_type()),
+                             "");
+
+   /* the caller skips empty runs, so the loop body runs at least once */
+   lp_build_loop_begin(&loop, gallivm, lp_build_const_int32(gallivm, 0));
+   {
+      LLVMValueRef elt, offset, vertex_ptr;
+
+      if (elt_type) {
+         elt = lp_build_pointer_get(builder, elts_ptr, loop.counter);
+         elt = LLVMBuildZExt(builder, elt, i32t, "elt");
+      }
+      else {
+         elt = LLVMBuildAdd(builder, start, loop.counter, "elt");
+      }
+
+      offset = LLVMBuildMul(builder, loop.counter,
+                            lp_build_const_int32(gallivm, key->output_stride),
+                            "");
+      vertex_ptr = LLVMBuildGEP(builder, output_ptr, &offset, 1, "vertex");
+
+      generate_vertex(gallivm, key, ptrs, strides, max_indices, tmp_ptr,
+                      elt, instance_id, vertex_ptr);
+   }
+   lp_build_loop_end(&loop, count, lp_build_const_int32(gallivm, 1));
+
+   LLVMBuildRetVoid(builder);
+
+   gallivm_verify_function(gallivm, function);
+
+   return function;
+}
+
+
+static void PIPE_CDECL
+llvm_run_elts(struct translate *translate,
+              const unsigned *elts,
+              unsigned count,
+              unsigned instance_id,
+              void *output_buffer)
+{
+   struct translate_llvm *p = translate_llvm(translate);
+
+   if (count)
+      p->elt_func(p->buffers, elts, count, instance_id, output_buffer);
+}
+
+
+static void PIPE_CDECL
+llvm_run_elts16(struct translate *translate,
+                const uint16_t *elts,
+                unsigned count,
+                unsigned instance_id,
+                void *output_buffer)
+{
+   struct translate_llvm *p = translate_llvm(translate);
+
+   if (count)
+      p->elt16_func(p->buffers, elts, count, instance_id, output_buffer);
+}
+
+
+static void PIPE_CDECL
+llvm_run_elts8(struct translate *translate,
+               const uint8_t *elts,
+               unsigned count,
+               unsigned instance_id,
+               void *output_buffer)
+{
+   struct translate_llvm *p = translate_llvm(translate);
+
+   if (count)
+      p->elt8_func(p->buffers, elts, count, instance_id, output_buffer);
+}
+
+
+static void PIPE_CDECL
+llvm_run(struct translate *translate,
+         unsigned start,
+         unsigned count,
+         unsigned instance_id,
+         void *output_buffer)
+{
+   struct translate_llvm *p = translate_llvm(translate);
+
+   if (count)
+      p->linear_func(p->buffers, start, count, instance_id, output_buffer);
+}
+
+
+static void
+llvm_set_buffer(struct translate *translate,
+                unsigned buf,
+                const void *ptr,
+                unsigned stride,
+                unsigned max_index)
+{
+   struct translate_llvm *p = translate_llvm(translate);
+
+   if (buf < Elements(p->buffers)) {
+      p->buffers[buf].ptr = ptr;
+      p->buffers[buf].stride = stride;
+      p->buffers[buf].max_index = max_index;
+   }
+}
+
+
+static void
+llvm_release(struct translate *translate)
+{
+   struct translate_llvm *p = translate_llvm(translate);
+
+   gallivm_destroy(p->gallivm);
+   FREE(p);
+}
+
+
+struct translate *
+translate_llvm_create(const struct translate_key *key)
+{
+   struct translate_llvm *p;
+   struct gallivm_state *gallivm;
+   LLVMContextRef context;
+   LLVMTypeRef buffer_type;
+   LLVMValueRef elt_func, elt16_func, elt8_func, linear_func;
+   unsigned i;
+
+   for (i = 0; i < key->nr_elements; ++i) {
+      if (!element_is_supported(&key->element[i]))
+         return NULL;
+   }
+
+   p = CALLOC_STRUCT(translate_llvm);
+   if (!p)
+      return NULL;
+
+   gallivm = gallivm_create();
+   if (!gallivm) {
+      FREE(p);
+      return NULL;
+   }
+
+   context = gallivm->context;
+
+   p->translate.key = *key;
+   p->translate.release = llvm_release;
+   p->translate.set_buffer = llvm_set_buffer;
+   p->translate.run_elts = llvm_run_elts;
+   p->translate.run_elts16 = llvm_run_elts16;
+   p->translate.run_elts8 = llvm_run_elts8;
+   p->translate.run = llvm_run;
+   p->gallivm = gallivm;
+
+   buffer_type = create_buffer_type(gallivm);
+
+   /* build all the run functions in one module, compiled at once */
+   elt_func = generate_run(gallivm, key, buffer_type,
+                           LLVMInt32TypeInContext(context),
+                           "translate_elts");
+   elt16_func = generate_run(gallivm, key, buffer_type,
+                             LLVMInt16TypeInContext(context),
+                             "translate_elts16");
+   elt8_func = generate_run(gallivm, key, buffer_type,
+                            LLVMInt8TypeInContext(context),
+                            "translate_elts8");
+   linear_func = generate_run(gallivm, key, buffer_type, NULL,
+                              "translate_linear");
+
+   gallivm_compile_module(gallivm);
+
+   p->elt_func = (translate_llvm_elts_func)
+      gallivm_jit_function(gallivm, elt_func);
+   p->elt16_func = (translate_llvm_elts_func)
+      gallivm_jit_function(gallivm, elt16_func);
+   p->elt8_func = (translate_llvm_elts_func)
+      gallivm_jit_function(gallivm, elt8_func);
+   p->linear_func = (translate_llvm_linear_func)
+      gallivm_jit_function(gallivm, linear_func);
+
+   return &p->translate;
+}
@@ -37,6 +37,7 @@
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_simple_list.h"
+#include "gallivm/lp_bld_sample.h"
 #include "lp_clear.h"
 #include "lp_context.h"
 #include "lp_flush.h"
@@ -57,6 +58,7 @@ static void llvmpipe_destroy( struct pipe_context *pipe )
    uint i, j;
 
    lp_print_counters();
+   lp_build_sample_print_counters();
 
    /* This will also destroy llvmpipe->setup:
     */
@@ -130,6 +130,9 @@ struct llvmpipe_context {
    unsigned nr_fs_variants;
    unsigned nr_fs_instrs;
 
+   /** Currently bound fragment shader variant */
+   struct lp_fragment_shader_variant *fs_variant;
+
    struct lp_setup_variant_list_item setup_variants_list;
    unsigned nr_setup_variants;
 
@@ -61,6 +61,8 @@ st_print_current(void);
 #define PERF_NO_BLEND       0x20  	/* disable blending */
 #define PERF_NO_DEPTH       0x40  	/* disable depth buffering entirely */
 #define PERF_NO_ALPHATEST   0x80  	/* disable alpha testing */
+#define PERF_NO_LINEAR_CBUF 0x100 	/* render through swizzled tiles always */
+#define PERF_NO_HIZ         0x200 	/* no depth bounds block rejection */
 
 
 extern int LP_PERF;
@@ -38,6 +38,8 @@
 #include "lp_context.h"
 #include "lp_state.h"
 #include "lp_query.h"
+#include "lp_perf.h"
+#include "lp_state_fs.h"
 
 #include "draw/draw_context.h"
 
@@ -63,6 +65,11 @@ llvmpipe_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info)
    if (lp->dirty)
       llvmpipe_update_derived( lp );
 
+   if (lp->fs_variant && lp->fs_variant->fallback) {
+      LP_COUNT(nr_fs_fallback_draws);
+      llvmpipe_fs_variant_draw(lp, lp->fs_variant);
+   }
+
    /*
     * Map vertex buffers
     */
@@ -152,6 +152,7 @@ typedef void
                     const void *dadx,
                     const void *dady,
                     uint8_t **color,
+                    const uint32_t *color_stride,
                     void *depth,
                     uint32_t mask,
                     uint32_t *counter);
@@ -35,8 +35,20 @@
 
 /**
  * Tile size (width and height). This needs to be a power of two.
+ *
+ * Build with -DLP_TILE_ORDER=5 or 7 for 32x32 or 128x128 tiles.  Larger
+ * tiles mean less binning and per-tile overhead for big primitives,
+ * smaller ones better load balance on small render targets.
  */
-#define TILE_ORDER 6
+#ifndef LP_TILE_ORDER
+#define LP_TILE_ORDER 6
+#endif
+
+#if LP_TILE_ORDER < 5 || LP_TILE_ORDER > 7
+#error "LP_TILE_ORDER must be 5, 6 or 7"
+#endif
+
+#define TILE_ORDER LP_TILE_ORDER
 #define TILE_SIZE (1 << TILE_ORDER)
 
 
@@ -59,7 +71,12 @@
 #define LP_MAX_WIDTH  (1 << (LP_MAX_TEXTURE_LEVELS - 1))
 
 
-#define LP_MAX_THREADS 8
+/**
+ * Sanity limit on the number of rasterizer threads.  Per-thread state is
+ * allocated at runtime, so this only guards against silly LP_NUM_THREADS
+ * values.
+ */
+#define LP_MAX_THREADS 256
 
 
 /**
@@ -67,6 +84,34 @@
  */
 #define LP_MAX_SCENE_SIZE (512 * 1024 * 1024)
 
+/**
+ * Default and max number of scenes per context.  While the rasterizer
+ * works on one scene the setup module can bin the next ones.  Each
+ * scene's bin data is clamped to LP_SCENE_MAX_SIZE, so the max number
+ * of scenes keeps the total under LP_MAX_SCENE_SIZE.  Scenes are
+ * created on demand, up to the LP_NUM_SCENES env var.
+ */
+#define LP_DEFAULT_SCENES 4
+#define LP_MAX_SCENES 64
+
+/**
+ * Max number of background shader compilation threads.
+ */
+#define LP_MAX_COMPILE_THREADS 16
+
+/**
+ * Default max number of queued shader variants a compile thread builds
+ * into one module, overridable with the LP_COMPILE_BATCH env var.
+ */
+#define LP_DEFAULT_COMPILE_BATCH 8
+
+/**
+ * Default number of draws a fragment shader variant runs unoptimized code
+ * for before it is optimized in the background, overridable with the
+ * LP_HOT_DRAWS env var.
+ */
+#define LP_DEFAULT_HOT_DRAWS 4
+
 /**
  * Max number of shader variants (for all shaders combined,
  * per context) that will be kept around.
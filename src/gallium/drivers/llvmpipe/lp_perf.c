@@ -98,13 +98,22 @@ lp_print_counters(void)
       debug_printf("llvmpipe:   nr_empty_4x4:               %9u (%3.0f%% of %u)\n", lp_count.nr_empty_4, p1, total_4);
       debug_printf("llvmpipe:   nr_non_empty_4x4:           %9u (%3.0f%% of %u)\n", lp_count.nr_non_empty_4, p4, total_4);
 
+      debug_printf("llvmpipe: nr_hiz_culled_tiles:          %9u\n", lp_count.nr_hiz_culled_tiles);
+      debug_printf("llvmpipe: nr_hiz_culled_16x16:          %9u\n", lp_count.nr_hiz_culled_16);
+
       debug_printf("llvmpipe: nr_color_tile_clear:          %9u\n", lp_count.nr_color_tile_clear);
       debug_printf("llvmpipe: nr_color_tile_load:           %9u\n", lp_count.nr_color_tile_load);
       debug_printf("llvmpipe: nr_color_tile_store:          %9u\n", lp_count.nr_color_tile_store);
 
+      debug_printf("llvmpipe: nr_bin_iter_bins:             %9u\n", lp_count.nr_bin_iter_bins);
+      debug_printf("llvmpipe: nr_bin_iter_retries:          %9u\n", lp_count.nr_bin_iter_retries);
+
       debug_printf("llvmpipe: nr_llvm_compiles:             %u\n", lp_count.nr_llvm_compiles);
       debug_printf("llvmpipe: total LLVM compile time:      %.2f sec\n", lp_count.llvm_compile_time / 1000000.0);
       debug_printf("llvmpipe: average LLVM compile time:    %.2f sec\n", lp_count.llvm_compile_time / 1000000.0 / lp_count.nr_llvm_compiles);
+      debug_printf("llvmpipe: nr_fs_cache_hits:             %u\n", lp_count.nr_fs_cache_hits);
+      debug_printf("llvmpipe: nr_fs_cache_misses:           %u\n", lp_count.nr_fs_cache_misses);
+      debug_printf("llvmpipe: nr_fs_fallback_draws:         %u\n", lp_count.nr_fs_fallback_draws);
 
    }
 }
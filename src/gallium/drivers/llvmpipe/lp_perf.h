@@ -56,12 +56,20 @@ struct lp_counters
    unsigned nr_fully_covered_4;
    unsigned nr_partially_covered_4;
    unsigned nr_non_empty_4;
+   unsigned nr_hiz_culled_tiles;  /**< tile commands rejected by depth bounds */
+   unsigned nr_hiz_culled_16;     /**< 16x16 blocks rejected by depth bounds */
    unsigned nr_llvm_compiles;
    int64_t llvm_compile_time;  /**< total, in microseconds */
+   unsigned nr_fs_cache_hits;    /**< variants loaded from disk cache */
+   unsigned nr_fs_cache_misses;  /**< variants not found in disk cache */
+   unsigned nr_fs_fallback_draws; /**< draws with unoptimized fs code */
 
    unsigned nr_color_tile_clear;
    unsigned nr_color_tile_load;
    unsigned nr_color_tile_store;
+
+   unsigned nr_bin_iter_bins;     /**< bins handed out to rast threads */
+   unsigned nr_bin_iter_retries;  /**< lost races for the bin cursor */
 };
 
 
@@ -33,10 +33,12 @@
 #include "draw/draw_context.h"
 #include "pipe/p_defines.h"
 #include "util/u_memory.h"
+#include "util/u_math.h"
 #include "lp_context.h"
 #include "lp_flush.h"
 #include "lp_fence.h"
 #include "lp_query.h"
+#include "lp_screen.h"
 #include "lp_state.h"
 
 
@@ -49,11 +51,24 @@ static struct pipe_query *
 llvmpipe_create_query(struct pipe_context *pipe, 
                       unsigned type)
 {
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
    struct llvmpipe_query *pq;
 
    assert(type == PIPE_QUERY_OCCLUSION_COUNTER);
 
    pq = CALLOC_STRUCT( llvmpipe_query );
+   if (!pq)
+      return NULL;
+
+   /* One counter per rasterizer thread, or a single one when
+    * rasterizing synchronously.
+    */
+   pq->num_counts = MAX2(1, screen->num_threads);
+   pq->count = CALLOC(pq->num_counts, sizeof pq->count[0]);
+   if (!pq->count) {
+      FREE(pq);
+      return NULL;
+   }
 
    return (struct pipe_query *) pq;
 }
@@ -77,6 +92,7 @@ llvmpipe_destroy_query(struct pipe_context *pipe, struct pipe_query *q)
       lp_fence_reference(&pq->fence, NULL);
    }
 
+   FREE(pq->count);
    FREE(pq);
 }
 
@@ -89,7 +105,7 @@ llvmpipe_get_query_result(struct pipe_context *pipe,
 {
    struct llvmpipe_query *pq = llvmpipe_query(q);
    uint64_t *result = (uint64_t *)vresult;
-   int i;
+   unsigned i;
 
    if (!pq->fence) {
       /* no fence because there was no scene, so results is zero */
@@ -110,7 +126,7 @@ llvmpipe_get_query_result(struct pipe_context *pipe,
    /* Sum the results from each of the threads:
     */
    *result = 0;
-   for (i = 0; i < LP_MAX_THREADS; i++) {
+   for (i = 0; i < pq->num_counts; i++) {
       *result += pq->count[i];
    }
 
@@ -133,7 +149,7 @@ llvmpipe_begin_query(struct pipe_context *pipe, struct pipe_query *q)
    }
 
 
-   memset(pq->count, 0, sizeof(pq->count));
+   memset(pq->count, 0, pq->num_counts * sizeof pq->count[0]);
    lp_setup_begin_query(llvmpipe->setup, pq);
 
    llvmpipe->active_query_count++;
@@ -42,7 +42,8 @@ struct llvmpipe_context;
 
 
 struct llvmpipe_query {
-   uint64_t count[LP_MAX_THREADS];  /**< a counter for each thread */
+   uint64_t *count;             /**< a counter for each thread */
+   unsigned num_counts;         /**< number of counters (threads) */
    struct lp_fence *fence;      /* fence from last scene this was binned in */
 };
 
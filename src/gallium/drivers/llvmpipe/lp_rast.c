@@ -26,6 +26,7 @@
  **************************************************************************/
 
 #include <limits.h>
+#include <float.h>
 #include "util/u_memory.h"
 #include "util/u_math.h"
 #include "util/u_rect.h"
@@ -85,6 +86,178 @@ lp_rast_end( struct lp_rasterizer *rast )
 }
 
 
+/**
+ * Set all depth bounds of the current tile.
+ */
+static void
+hiz_reset(struct lp_rasterizer_task *task, float bound)
+{
+   unsigned i;
+
+   for (i = 0; i < LP_HIZ_BLOCKS_X * LP_HIZ_BLOCKS_X; i++)
+      task->hiz_block[i] = bound;
+   task->hiz_tile = bound;
+}
+
+
+/**
+ * Find the depth channel of a z/stencil format, if depth bounds can be
+ * tracked for it: 32-bit float depth, or unorm depth in a word of at
+ * most 32 bits.
+ */
+static boolean
+hiz_depth_channel(enum pipe_format format,
+                  unsigned *shift, unsigned *size, boolean *is_float)
+{
+   const struct util_format_description *desc = util_format_description(format);
+   unsigned swizzle = desc->swizzle[0];
+   const struct util_format_channel_description *chan;
+   unsigned i;
+
+   if (desc->block.bits > 32 || swizzle > UTIL_FORMAT_SWIZZLE_W)
+      return FALSE;
+
+   chan = &desc->channel[swizzle];
+
+   *shift = 0;
+   for (i = 0; i < swizzle; i++)
+      *shift += desc->channel[i].size;
+   *size = chan->size;
+
+   if (chan->type == UTIL_FORMAT_TYPE_FLOAT && chan->size == 32) {
+      *is_float = TRUE;
+      return TRUE;
+   }
+
+   if (chan->type == UTIL_FORMAT_TYPE_UNSIGNED && chan->normalized) {
+      *is_float = FALSE;
+      return TRUE;
+   }
+
+   return FALSE;
+}
+
+
+/**
+ * Margin to add to depth values to get upper bounds of what is stored
+ * in the depth buffer: one unorm step for the rounding, plus some slack
+ * for the float math of the fragment shader's conversion.
+ */
+static float
+hiz_depth_margin(enum pipe_format format)
+{
+   unsigned shift, size;
+   boolean is_float;
+
+   if (!hiz_depth_channel(format, &shift, &size, &is_float))
+      return FLT_MAX;
+
+   if (is_float)
+      return 4.0f * FLT_EPSILON;
+
+   return (float)(1.0 / (double)((1ULL << size) - 1)) + 4.0f * FLT_EPSILON;
+}
+
+
+/**
+ * Update the depth bounds after a depth/stencil clear.
+ */
+static void
+hiz_clear(struct lp_rasterizer_task *task,
+          uint32_t clear_value, uint32_t clear_mask)
+{
+   enum pipe_format format = task->scene->fb.zsbuf->format;
+   unsigned shift, size;
+   boolean is_float;
+   uint64_t depth_max;
+   uint32_t depth_mask;
+   float depth;
+
+   if (!hiz_depth_channel(format, &shift, &size, &is_float)) {
+      hiz_reset(task, FLT_MAX);
+      return;
+   }
+
+   depth_max = (1ULL << size) - 1;
+   depth_mask = (uint32_t)(depth_max << shift);
+
+   if ((clear_mask & depth_mask) == 0) {
+      /* stencil only */
+      return;
+   }
+
+   if ((clear_mask & depth_mask) != depth_mask) {
+      hiz_reset(task, FLT_MAX);
+      return;
+   }
+
+   if (is_float) {
+      union fi fi;
+      fi.ui = clear_value;
+      depth = fi.f;
+   }
+   else {
+      depth = (float)((double)((clear_value >> shift) & depth_max) /
+                      (double)depth_max);
+   }
+
+   hiz_reset(task, depth + task->hiz_margin);
+}
+
+
+/**
+ * Lower the depth bound of the 16x16 block at x, y (window coords),
+ * after the primitive has been shaded over all of it.
+ */
+void
+lp_rast_hiz_update_block(struct lp_rasterizer_task *task,
+                         const struct lp_rast_shader_inputs *inputs,
+                         unsigned x, unsigned y)
+{
+   unsigned bx = (x - task->x) >> LP_HIZ_BLOCK_ORDER;
+   unsigned by = (y - task->y) >> LP_HIZ_BLOCK_ORDER;
+   float *block = &task->hiz_block[by * LP_HIZ_BLOCKS_X + bx];
+   float bound;
+   unsigned i;
+
+   if (!task->state->variant->hiz_update)
+      return;
+
+   bound = inputs->zmax + task->hiz_margin;
+   if (bound >= *block)
+      return;
+
+   *block = bound;
+
+   task->hiz_tile = task->hiz_block[0];
+   for (i = 1; i < LP_HIZ_BLOCKS_X * LP_HIZ_BLOCKS_X; i++)
+      task->hiz_tile = MAX2(task->hiz_tile, task->hiz_block[i]);
+}
+
+
+/**
+ * Lower the depth bounds of the whole tile, as above.
+ */
+static void
+hiz_update_tile(struct lp_rasterizer_task *task,
+                const struct lp_rast_shader_inputs *inputs)
+{
+   float bound;
+   unsigned i;
+
+   if (!task->state->variant->hiz_update)
+      return;
+
+   bound = inputs->zmax + task->hiz_margin;
+   if (bound >= task->hiz_tile)
+      return;
+
+   for (i = 0; i < LP_HIZ_BLOCKS_X * LP_HIZ_BLOCKS_X; i++)
+      task->hiz_block[i] = MIN2(task->hiz_block[i], bound);
+   task->hiz_tile = bound;
+}
+
+
 /**
  * Begining rasterization of a tile.
  * \param x  window X position of the tile, in pixels
@@ -106,6 +279,9 @@ lp_rast_tile_begin(struct lp_rasterizer_task *task,
    /* reset pointers to color tile(s) */
    memset(task->color_tiles, 0, sizeof(task->color_tiles));
 
+   /* nothing is known about the depth values until cleared or drawn */
+   hiz_reset(task, FLT_MAX);
+
    /* get pointer to depth/stencil tile */
    {
       struct pipe_surface *zsbuf = task->scene->fb.zsbuf;
@@ -142,6 +318,39 @@ lp_rast_tile_begin(struct lp_rasterizer_task *task,
 }
 
 
+/**
+ * Clear the current tile of a color buffer which is rendered to in
+ * linear layout (see llvmpipe_is_linear_render_format()).
+ * Linear images are padded to whole tiles, so no clipping is needed.
+ */
+static void
+clear_linear_color_tile(struct lp_rasterizer_task *task,
+                        unsigned buf,
+                        const uint8_t *clear_color)
+{
+   const struct lp_scene *scene = task->scene;
+   uint8_t *dst = scene->cbufs[buf].map;
+   union util_color uc;
+   unsigned x, y;
+
+   if (!dst)
+      return;
+
+   util_pack_color_ub(clear_color[0], clear_color[1],
+                      clear_color[2], clear_color[3],
+                      scene->fb.cbufs[buf]->format, &uc);
+
+   dst += task->y * scene->cbufs[buf].stride + task->x * 4;
+
+   for (y = 0; y < TILE_SIZE; y++) {
+      uint32_t *row = (uint32_t *)dst;
+      for (x = 0; x < TILE_SIZE; x++)
+         row[x] = uc.ui;
+      dst += scene->cbufs[buf].stride;
+   }
+}
+
+
 /**
  * Clear the rasterizer's current color tile.
  * This is a bin command called during bin processing.
@@ -166,8 +375,14 @@ lp_rast_clear_color(struct lp_rasterizer_task *task,
        clear_color[2] == clear_color[3]) {
       /* clear to grayscale value {x, x, x, x} */
       for (i = 0; i < scene->fb.nr_cbufs; i++) {
-         uint8_t *ptr =
-            lp_rast_get_color_tile_pointer(task, i, LP_TEX_USAGE_WRITE_ALL);
+         uint8_t *ptr;
+
+         if (scene->cbufs[i].linear) {
+            clear_linear_color_tile(task, i, clear_color);
+            continue;
+         }
+
+         ptr = lp_rast_get_color_tile_pointer(task, i, LP_TEX_USAGE_WRITE_ALL);
 	 memset(ptr, clear_color[0], TILE_SIZE * TILE_SIZE * 4);
       }
    }
@@ -179,10 +394,16 @@ lp_rast_clear_color(struct lp_rasterizer_task *task,
        */
       const unsigned chunk = TILE_SIZE / 4;
       for (i = 0; i < scene->fb.nr_cbufs; i++) {
-         uint8_t *c =
-            lp_rast_get_color_tile_pointer(task, i, LP_TEX_USAGE_WRITE_ALL);
+         uint8_t *c;
          unsigned j;
 
+         if (scene->cbufs[i].linear) {
+            clear_linear_color_tile(task, i, clear_color);
+            continue;
+         }
+
+         c = lp_rast_get_color_tile_pointer(task, i, LP_TEX_USAGE_WRITE_ALL);
+
          for (j = 0; j < 4 * TILE_SIZE; j++) {
             memset(c, clear_color[0], chunk);
             c += chunk;
@@ -237,6 +458,8 @@ lp_rast_clear_zstencil(struct lp_rasterizer_task *task,
 
    clear_value &= clear_mask;
 
+   hiz_clear(task, clear_value, clear_mask);
+
    switch (block_size) {
    case 1:
       assert(clear_mask == 0xff);
@@ -354,7 +577,12 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
    }
    variant = state->variant;
 
-   /* render the whole 64x64 tile in 4x4 chunks */
+   if (lp_rast_hiz_cull_tile(task, inputs)) {
+      LP_COUNT(nr_hiz_culled_tiles);
+      return;
+   }
+
+   /* render the whole tile in 4x4 chunks */
    for (y = 0; y < TILE_SIZE; y += 4){
       for (x = 0; x < TILE_SIZE; x += 4) {
          uint8_t *color[PIPE_MAX_COLOR_BUFS];
@@ -378,12 +606,15 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
                                             GET_DADX(inputs),
                                             GET_DADY(inputs),
                                             color,
+                                            scene->color_strides,
                                             depth,
                                             0xffff,
                                             &task->vis_counter);
          END_JIT_CALL();
       }
    }
+
+   hiz_update_tile(task, inputs);
 }
 
 
@@ -408,7 +639,8 @@ lp_rast_shade_tile_opaque(struct lp_rasterizer_task *task,
 
    /* this will prevent converting the layout from tiled to linear */
    for (i = 0; i < scene->fb.nr_cbufs; i++) {
-      (void)lp_rast_get_color_tile_pointer(task, i, LP_TEX_USAGE_WRITE_ALL);
+      if (!scene->cbufs[i].linear)
+         (void)lp_rast_get_color_tile_pointer(task, i, LP_TEX_USAGE_WRITE_ALL);
    }
 
    lp_rast_shade_tile(task, arg);
@@ -466,6 +698,7 @@ lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
                                          GET_DADX(inputs),
                                          GET_DADY(inputs),
                                          color,
+                                         scene->color_strides,
                                          depth,
                                          mask,
                                          &task->vis_counter);
@@ -513,6 +746,9 @@ lp_rast_set_state(struct lp_rasterizer_task *task,
                   const union lp_rast_cmd_arg arg)
 {
    task->state = arg.state;
+
+   if (task->state->variant->hiz_invalidate)
+      hiz_reset(task, FLT_MAX);
 }
 
 
@@ -582,8 +818,13 @@ lp_rast_tile_end(struct lp_rasterizer_task *task)
       unsigned buf;
 
       for (buf = 0; buf < scene->fb.nr_cbufs; buf++) {
-         uint8_t *color = lp_rast_get_color_block_pointer(task, buf,
-                                                          task->x, task->y);
+         uint8_t *color;
+
+         /* the outlines assume the swizzled tile layout */
+         if (scene->cbufs[buf].linear)
+            continue;
+
+         color = lp_rast_get_color_block_pointer(task, buf, task->x, task->y);
 
          if (LP_DEBUG & DEBUG_SHOW_SUBTILES)
             outline_subtiles(color);
@@ -703,6 +944,9 @@ rasterize_scene(struct lp_rasterizer_task *task,
 {
    task->scene = scene;
 
+   task->hiz_margin = scene->fb.zsbuf ?
+      hiz_depth_margin(scene->fb.zsbuf->format) : FLT_MAX;
+
    if (!task->rast->no_rast) {
       /* loop over scene bins, rasterize each */
 #if 0
@@ -728,11 +972,6 @@ rasterize_scene(struct lp_rasterizer_task *task,
 #endif
    }
 
-
-   if (scene->fence) {
-      lp_fence_signal(scene->fence);
-   }
-
    task->scene = NULL;
 }
 
@@ -755,7 +994,9 @@ lp_rast_queue_scene( struct lp_rasterizer *rast,
 
       lp_rast_end( rast );
 
-      rast->curr_scene = NULL;
+      if (scene->fence) {
+         lp_fence_signal(scene->fence);
+      }
    }
    else {
       /* threaded rendering! */
@@ -773,29 +1014,16 @@ lp_rast_queue_scene( struct lp_rasterizer *rast,
 }
 
 
-void
-lp_rast_finish( struct lp_rasterizer *rast )
-{
-   if (rast->num_threads == 0) {
-      /* nothing to do */
-   }
-   else {
-      int i;
-
-      /* wait for work to complete */
-      for (i = 0; i < rast->num_threads; i++) {
-         pipe_semaphore_wait(&rast->tasks[i].work_done);
-      }
-   }
-}
-
-
 /**
  * This is the thread's main entrypoint.
  * It's a simple loop:
  *   1. wait for work
  *   2. do work
- *   3. signal that we're done
+ *   3. signal the scene's fence
+ *
+ * The fence is only signalled once thread[0] has unmapped the
+ * framebuffer, so that the setup module may reuse the scene as soon as
+ * the fence completes.
  */
 static PIPE_THREAD_ROUTINE( thread_function, init_data )
 {
@@ -804,6 +1032,8 @@ static PIPE_THREAD_ROUTINE( thread_function, init_data )
    boolean debug = false;
 
    while (1) {
+      struct lp_scene *scene;
+
       /* wait for work */
       if (debug)
          debug_printf("thread %d waiting for work\n", task->thread_index);
@@ -830,13 +1060,14 @@ static PIPE_THREAD_ROUTINE( thread_function, init_data )
       if (debug)
          debug_printf("thread %d doing work\n", task->thread_index);
 
-      rasterize_scene(task,
-                      rast->curr_scene);
-      
+      scene = rast->curr_scene;
+      rasterize_scene(task, scene);
+
       /* wait for all threads to finish with this scene */
       pipe_barrier_wait( &rast->barrier );
 
-      /* XXX: shouldn't be necessary:
+      /* thread[0] unmaps the framebuffer surfaces.  The fence can't
+       * complete until it has signalled too.
        */
       if (task->thread_index == 0) {
          lp_rast_end( rast );
@@ -846,7 +1077,9 @@ static PIPE_THREAD_ROUTINE( thread_function, init_data )
       if (debug)
          debug_printf("thread %d done working\n", task->thread_index);
 
-      pipe_semaphore_signal(&task->work_done);
+      if (scene->fence) {
+         lp_fence_signal(scene->fence);
+      }
    }
 
    return NULL;
@@ -864,7 +1097,6 @@ create_rast_threads(struct lp_rasterizer *rast)
    /* NOTE: if num_threads is zero, we won't use any threads */
    for (i = 0; i < rast->num_threads; i++) {
       pipe_semaphore_init(&rast->tasks[i].work_ready, 0);
-      pipe_semaphore_init(&rast->tasks[i].work_done, 0);
       rast->threads[i] = pipe_thread_create(thread_function,
                                             (void *) &rast->tasks[i]);
    }
@@ -872,6 +1104,24 @@ create_rast_threads(struct lp_rasterizer *rast)
 
 
 
+/**
+ * Free the per-task swizzled color tiles.
+ */
+static void
+free_swizzled_cbufs(struct lp_rasterizer *rast, unsigned num_tasks)
+{
+   unsigned i, buf;
+
+   for (i = 0; i < num_tasks; i++) {
+      for (buf = 0; buf < PIPE_MAX_COLOR_BUFS; buf++) {
+         if (rast->tasks[i].swizzled_cbuf[buf]) {
+            align_free(rast->tasks[i].swizzled_cbuf[buf]);
+         }
+      }
+   }
+}
+
+
 /**
  * Create new lp_rasterizer.  If num_threads is zero, don't create any
  * new threads, do rendering synchronously.
@@ -881,22 +1131,44 @@ struct lp_rasterizer *
 lp_rast_create( unsigned num_threads )
 {
    struct lp_rasterizer *rast;
-   unsigned i;
+   unsigned num_tasks = MAX2(1, num_threads);
+   unsigned i, buf;
 
    rast = CALLOC_STRUCT(lp_rasterizer);
    if (!rast) {
       goto no_rast;
    }
 
+   rast->tasks = CALLOC(num_tasks, sizeof rast->tasks[0]);
+   if (!rast->tasks) {
+      goto no_tasks;
+   }
+
+   if (num_threads) {
+      rast->threads = CALLOC(num_threads, sizeof rast->threads[0]);
+      if (!rast->threads) {
+         goto no_threads;
+      }
+   }
+
    rast->full_scenes = lp_scene_queue_create();
    if (!rast->full_scenes) {
       goto no_full_scenes;
    }
 
-   for (i = 0; i < Elements(rast->tasks); i++) {
+   for (i = 0; i < num_tasks; i++) {
       struct lp_rasterizer_task *task = &rast->tasks[i];
       task->rast = rast;
       task->thread_index = i;
+
+      for (buf = 0; buf < PIPE_MAX_COLOR_BUFS; buf++) {
+         task->swizzled_cbuf[buf] = align_malloc(TILE_SIZE * TILE_SIZE * 4,
+                                                 LP_MIN_VECTOR_ALIGN);
+         if (!task->swizzled_cbuf[buf]) {
+            goto no_swizzled_cbuf;
+         }
+         memset(task->swizzled_cbuf[buf], 0, TILE_SIZE * TILE_SIZE * 4);
+      }
    }
 
    rast->num_threads = num_threads;
@@ -908,13 +1180,18 @@ lp_rast_create( unsigned num_threads )
    /* for synchronizing rasterization threads */
    pipe_barrier_init( &rast->barrier, rast->num_threads );
 
-   memset(lp_swizzled_cbuf, 0, sizeof lp_swizzled_cbuf);
-
    memset(lp_dummy_tile, 0, sizeof lp_dummy_tile);
 
    return rast;
 
+no_swizzled_cbuf:
+   free_swizzled_cbufs(rast, num_tasks);
+   lp_scene_queue_destroy(rast->full_scenes);
 no_full_scenes:
+   FREE(rast->threads);
+no_threads:
+   FREE(rast->tasks);
+no_tasks:
    FREE(rast);
 no_rast:
    return NULL;
@@ -944,7 +1221,6 @@ void lp_rast_destroy( struct lp_rasterizer *rast )
    /* Clean up per-thread data */
    for (i = 0; i < rast->num_threads; i++) {
       pipe_semaphore_destroy(&rast->tasks[i].work_ready);
-      pipe_semaphore_destroy(&rast->tasks[i].work_done);
    }
 
    /* for synchronizing rasterization threads */
@@ -952,6 +1228,10 @@ void lp_rast_destroy( struct lp_rasterizer *rast )
 
    lp_scene_queue_destroy(rast->full_scenes);
 
+   free_swizzled_cbufs(rast, MAX2(1, rast->num_threads));
+
+   FREE(rast->threads);
+   FREE(rast->tasks);
    FREE(rast);
 }
 
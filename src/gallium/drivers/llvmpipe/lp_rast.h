@@ -83,8 +83,8 @@ struct lp_rast_shader_inputs {
    unsigned opaque:1;           /** Is opaque */
    unsigned pad0:29;            /* wasted space */
    unsigned stride;             /* how much to advance data between a0, dadx, dady */
-   unsigned pad2;               /* wasted space */
-   unsigned pad3;               /* wasted space */
+   float zmin;                  /**< conservative depth range over the */
+   float zmax;                  /**< primitive, see lp_rast_hiz_cull_tile() */
    /* followed by a0, dadx, dady and planes[] */
 };
 
@@ -141,9 +141,6 @@ void
 lp_rast_queue_scene( struct lp_rasterizer *rast,
                      struct lp_scene *scene );
 
-void
-lp_rast_finish( struct lp_rasterizer *rast );
-
 
 union lp_rast_cmd_arg {
    const struct lp_rast_shader_inputs *shade_tile;
@@ -353,12 +353,12 @@ lp_debug_draw_bins_by_coverage( struct lp_scene *scene )
             do_debug_bin(&tile, bin, FALSE);
 
             total += tile.coverage;
-            possible += 64*64;
+            possible += TILE_SIZE*TILE_SIZE;
 
-            if (tile.coverage == 64*64)
+            if (tile.coverage == TILE_SIZE*TILE_SIZE)
                debug_printf("*");
             else if (tile.coverage) {
-               int bit = tile.coverage/(64.0*64.0)*10;
+               int bit = tile.coverage/((double)TILE_SIZE*TILE_SIZE)*10;
                debug_printf("%c", bits[MIN2(bit,10)]);
             }
             else
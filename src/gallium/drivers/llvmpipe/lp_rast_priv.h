@@ -74,6 +74,11 @@ extern const struct lp_rasterizer_task *jit_task;
 struct lp_rasterizer;
 struct cmd_bin;
 
+
+/** Depth bounds are tracked per 16x16 block */
+#define LP_HIZ_BLOCK_ORDER 4
+#define LP_HIZ_BLOCKS_X (TILE_SIZE >> LP_HIZ_BLOCK_ORDER)
+
 /**
  * Per-thread rasterization state
  */
@@ -88,6 +93,24 @@ struct lp_rasterizer_task
    uint8_t *color_tiles[PIPE_MAX_COLOR_BUFS];
    uint8_t *depth_tile;
 
+   /**
+    * Upper bounds of the depth values in each 16x16 block of the current
+    * tile, and their maximum, or FLT_MAX where unknown.  These only live
+    * for the duration of the bin: they start unknown and are set by depth
+    * clears and lowered by fully covered blocks.
+    */
+   float hiz_block[LP_HIZ_BLOCKS_X * LP_HIZ_BLOCKS_X];
+   float hiz_tile;
+
+   /** Precision margin of the scene's depth format, FLT_MAX if untracked */
+   float hiz_margin;
+
+   /**
+    * 32bpp RGBA swizzled tiles, one for each possible colorbuf.
+    * Allocated per thread when the rasterizer is created.
+    */
+   uint8_t *swizzled_cbuf[PIPE_MAX_COLOR_BUFS];
+
    /** "back" pointer */
    struct lp_rasterizer *rast;
 
@@ -99,7 +122,6 @@ struct lp_rasterizer_task
    struct llvmpipe_query *query;
 
    pipe_semaphore work_ready;
-   pipe_semaphore work_done;
 };
 
 
@@ -119,17 +141,26 @@ struct lp_rasterizer
    /** The scene currently being rasterized by the threads */
    struct lp_scene *curr_scene;
 
-   /** A task object for each rasterization thread */
-   struct lp_rasterizer_task tasks[LP_MAX_THREADS];
+   /**
+    * A task object for each rasterization thread.  There is always at
+    * least one task, which is used for synchronous rendering when
+    * num_threads is zero.
+    */
+   struct lp_rasterizer_task *tasks;
 
    unsigned num_threads;
-   pipe_thread threads[LP_MAX_THREADS];
+   pipe_thread *threads;
 
    /** For synchronizing the rasterization threads */
    pipe_barrier barrier;
 };
 
 
+void
+lp_rast_hiz_update_block(struct lp_rasterizer_task *task,
+                         const struct lp_rast_shader_inputs *inputs,
+                         unsigned x, unsigned y);
+
 void
 lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
                          const struct lp_rast_shader_inputs *inputs,
@@ -175,6 +206,70 @@ lp_rast_get_depth_block_pointer(struct lp_rasterizer_task *task,
 }
 
 
+/**
+ * Can the primitive be skipped in the whole tile because all its
+ * fragments are certain to fail the depth test?
+ * Depths are compared as floats: the bounds include a margin for the
+ * precision of the depth buffer, so a strictly greater zmin fails both
+ * PIPE_FUNC_LESS and PIPE_FUNC_LEQUAL.
+ */
+static INLINE boolean
+lp_rast_hiz_cull_tile(const struct lp_rasterizer_task *task,
+                      const struct lp_rast_shader_inputs *inputs)
+{
+   return task->state->variant->hiz_cull && inputs->zmin > task->hiz_tile;
+}
+
+
+/**
+ * As above, for the 16x16 block at x, y (window coords, 16-aligned).
+ */
+static INLINE boolean
+lp_rast_hiz_cull_block(const struct lp_rasterizer_task *task,
+                       const struct lp_rast_shader_inputs *inputs,
+                       unsigned x, unsigned y)
+{
+   unsigned bx = (x - task->x) >> LP_HIZ_BLOCK_ORDER;
+   unsigned by = (y - task->y) >> LP_HIZ_BLOCK_ORDER;
+
+   assert(x % 16 == 0);
+   assert(y % 16 == 0);
+
+   return (task->state->variant->hiz_cull &&
+           inputs->zmin > task->hiz_block[by * LP_HIZ_BLOCKS_X + bx]);
+}
+
+
+/**
+ * As above, for a size x size area at x, y which needn't be aligned to
+ * the 16x16 blocks.
+ */
+static INLINE boolean
+lp_rast_hiz_cull_rect(const struct lp_rasterizer_task *task,
+                      const struct lp_rast_shader_inputs *inputs,
+                      unsigned x, unsigned y, unsigned size)
+{
+   unsigned bx0 = (x - task->x) >> LP_HIZ_BLOCK_ORDER;
+   unsigned by0 = (y - task->y) >> LP_HIZ_BLOCK_ORDER;
+   unsigned bx1 = (x - task->x + size - 1) >> LP_HIZ_BLOCK_ORDER;
+   unsigned by1 = (y - task->y + size - 1) >> LP_HIZ_BLOCK_ORDER;
+   unsigned bx, by;
+
+   if (!task->state->variant->hiz_cull)
+      return FALSE;
+
+   assert(bx1 < LP_HIZ_BLOCKS_X);
+   assert(by1 < LP_HIZ_BLOCKS_X);
+
+   for (by = by0; by <= by1; by++)
+      for (bx = bx0; bx <= bx1; bx++)
+         if (inputs->zmin <= task->hiz_block[by * LP_HIZ_BLOCKS_X + bx])
+            return FALSE;
+
+   return TRUE;
+}
+
+
 /**
  * Get pointer to the swizzled color tile
  */
@@ -189,13 +284,14 @@ lp_rast_get_color_tile_pointer(struct lp_rasterizer_task *task,
    assert(task->x % TILE_SIZE == 0);
    assert(task->y % TILE_SIZE == 0);
    assert(buf < scene->fb.nr_cbufs);
+   assert(!scene->cbufs[buf].linear);
 
    if (!task->color_tiles[buf]) {
       struct pipe_surface *cbuf = scene->fb.cbufs[buf];
       struct llvmpipe_resource *lpt;
       assert(cbuf);
       lpt = llvmpipe_resource(cbuf->texture);
-      task->color_tiles[buf] = lp_swizzled_cbuf[task->thread_index][buf];
+      task->color_tiles[buf] = task->swizzled_cbuf[buf];
 
       if (usage != LP_TEX_USAGE_WRITE_ALL) {
          llvmpipe_swizzle_cbuf_tile(lpt,
@@ -211,24 +307,35 @@ lp_rast_get_color_tile_pointer(struct lp_rasterizer_task *task,
 
 
 /**
- * Get the pointer to a 4x4 color block (within a 64x64 tile).
+ * Get the pointer to a 4x4 color block (within a tile).
  * We'll map the color buffer on demand here.
  * Note that this may be called even when there's no color buffers - return
  * NULL in that case.
+ * For linear color buffers this points at the block's top-left pixel in
+ * the mapped image; otherwise into the task's swizzled tile.
  * \param x, y location of 4x4 block in window coords
  */
 static INLINE uint8_t *
 lp_rast_get_color_block_pointer(struct lp_rasterizer_task *task,
                                 unsigned buf, unsigned x, unsigned y)
 {
+   const struct lp_scene *scene = task->scene;
    unsigned px, py, pixel_offset;
    uint8_t *color;
 
-   assert(x < task->scene->tiles_x * TILE_SIZE);
-   assert(y < task->scene->tiles_y * TILE_SIZE);
+   assert(x < scene->tiles_x * TILE_SIZE);
+   assert(y < scene->tiles_y * TILE_SIZE);
    assert((x % TILE_VECTOR_WIDTH) == 0);
    assert((y % TILE_VECTOR_HEIGHT) == 0);
 
+   if (scene->cbufs[buf].linear) {
+      if (!scene->cbufs[buf].map) {
+         /* out of memory - render into the dummy tile */
+         return lp_dummy_tile;
+      }
+      return scene->cbufs[buf].map + y * scene->cbufs[buf].stride + x * 4;
+   }
+
    color = lp_rast_get_color_tile_pointer(task, buf, LP_TEX_USAGE_READ_WRITE);
    assert(color);
 
@@ -276,6 +383,7 @@ lp_rast_shade_quads_all( struct lp_rasterizer_task *task,
                                       GET_DADX(inputs),
                                       GET_DADY(inputs),
                                       color,
+                                      scene->color_strides,
                                       depth,
                                       0xffff,
                                       &task->vis_counter );
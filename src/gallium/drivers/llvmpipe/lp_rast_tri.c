@@ -279,6 +279,11 @@ lp_rast_triangle_3_16(struct lp_rasterizer_task *task,
    __m128i span_2;                /* 0,dcdx,2dcdx,3dcdx for plane 2 */
    __m128i unused;
    
+   if (lp_rast_hiz_cull_rect(task, &tri->inputs, x, y, 16)) {
+      LP_COUNT(nr_hiz_culled_16);
+      return;
+   }
+
    transpose4_epi32(&p0, &p1, &p2, &zero,
                     &c, &dcdx, &dcdy, &rej4);
 
@@ -388,6 +393,11 @@ lp_rast_triangle_3_4(struct lp_rasterizer_task *task,
    __m128i span_2;                /* 0,dcdx,2dcdx,3dcdx for plane 2 */
    __m128i unused;
 
+   if (lp_rast_hiz_cull_rect(task, &tri->inputs, x, y, 4)) {
+      LP_COUNT(nr_hiz_culled_16);
+      return;
+   }
+
    transpose4_epi32(&p0, &p1, &p2, &zero,
                     &c, &dcdx, &dcdy, &unused);
 
@@ -451,6 +461,16 @@ lp_rast_triangle_3_4(struct lp_rasterizer_task *task,
 #endif
 
 
+/**
+ * Tiles are rasterized in blocks of up to 64x64 pixels, each evaluated as
+ * a 4x4 grid of 16x16 blocks.  With tiles smaller than 64x64 only part of
+ * that grid lies inside the tile; BLOCK_16_MASK has a bit for each 16x16
+ * block which does.
+ */
+#define BLOCK_64_SIZE MIN2(TILE_SIZE, 64)
+#define BLOCKS_16 (BLOCK_64_SIZE / 16)
+#define BLOCK_16_MASK (((1 << BLOCKS_16) - 1) * \
+                       (0x1111 & ((1 << (4 * BLOCKS_16)) - 1)))
 
 
 #define TAG(x) x##_1
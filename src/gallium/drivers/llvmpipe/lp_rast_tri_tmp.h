@@ -148,68 +148,51 @@ TAG(do_block_16)(struct lp_rasterizer_task *task,
 
 
 /**
- * Scan the tile in chunks and figure out which pixels to rasterize
- * for this triangle.
+ * Evaluate a 64x64 block of pixels (or the whole tile, if smaller) to
+ * determine which 16x16 subblocks are in/out of the triangle's bounds.
  */
-void
-TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
-                      const union lp_rast_cmd_arg arg)
+static void
+TAG(do_block_64)(struct lp_rasterizer_task *task,
+                 const struct lp_rast_triangle *tri,
+                 const struct lp_rast_plane *plane,
+                 int x, int y,
+                 const int *c)
 {
-   const struct lp_rast_triangle *tri = arg.triangle.tri;
-   unsigned plane_mask = arg.triangle.plane_mask;
-   const struct lp_rast_plane *tri_plane = GET_PLANES(tri);
-   const int x = task->x, y = task->y;
-   struct lp_rast_plane plane[NR_PLANES];
-   int c[NR_PLANES];
    unsigned outmask, inmask, partmask, partial_mask;
-   unsigned j = 0;
-
-   if (tri->inputs.disable) {
-      /* This triangle was partially binned and has been disabled */
-      return;
-   }
+   unsigned j;
 
    outmask = 0;                 /* outside one or more trivial reject planes */
    partmask = 0;                /* outside one or more trivial accept planes */
 
-   while (plane_mask) {
-      int i = ffs(plane_mask) - 1;
-      plane[j] = tri_plane[i];
-      plane_mask &= ~(1 << i);
-      c[j] = plane[j].c + plane[j].dcdy * y - plane[j].dcdx * x;
-
-      {
-	 const int dcdx = -plane[j].dcdx * 16;
-	 const int dcdy = plane[j].dcdy * 16;
-	 const int cox = plane[j].eo * 16;
-         const int ei = plane[j].dcdy - plane[j].dcdx - plane[j].eo;
-         const int cio = ei * 16 - 1;
-
-	 build_masks(c[j] + cox,
-		     cio - cox,
-		     dcdx, dcdy, 
-		     &outmask,   /* sign bits from c[i][0..15] + cox */
-		     &partmask); /* sign bits from c[i][0..15] + cio */
-      }
+   for (j = 0; j < NR_PLANES; j++) {
+      const int dcdx = -plane[j].dcdx * 16;
+      const int dcdy = plane[j].dcdy * 16;
+      const int cox = plane[j].eo * 16;
+      const int ei = plane[j].dcdy - plane[j].dcdx - plane[j].eo;
+      const int cio = ei * 16 - 1;
 
-      j++;
+      build_masks(c[j] + cox,
+                  cio - cox,
+                  dcdx, dcdy, 
+                  &outmask,   /* sign bits from c[i][0..15] + cox */
+                  &partmask); /* sign bits from c[i][0..15] + cio */
    }
 
-   if (outmask == 0xffff)
+   if ((outmask & BLOCK_16_MASK) == BLOCK_16_MASK)
       return;
 
    /* Mask of sub-blocks which are inside all trivial accept planes:
     */
-   inmask = ~partmask & 0xffff;
+   inmask = ~partmask & BLOCK_16_MASK;
 
    /* Mask of sub-blocks which are inside all trivial reject planes,
     * but outside at least one trivial accept plane:
     */
-   partial_mask = partmask & ~outmask;
+   partial_mask = partmask & ~outmask & BLOCK_16_MASK;
 
    assert((partial_mask & inmask) == 0);
 
-   LP_COUNT_ADD(nr_empty_16, util_bitcount(0xffff & ~(partial_mask | inmask)));
+   LP_COUNT_ADD(nr_empty_16, util_bitcount(BLOCK_16_MASK & ~(partial_mask | inmask)));
 
    /* Iterate over partials:
     */
@@ -221,13 +204,18 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
       int py = y + iy;
       int cx[NR_PLANES];
 
+      partial_mask &= ~(1 << i);
+
+      if (lp_rast_hiz_cull_block(task, &tri->inputs, px, py)) {
+         LP_COUNT(nr_hiz_culled_16);
+         continue;
+      }
+
       for (j = 0; j < NR_PLANES; j++)
          cx[j] = (c[j]
 		  - plane[j].dcdx * ix
 		  + plane[j].dcdy * iy);
 
-      partial_mask &= ~(1 << i);
-
       LP_COUNT(nr_partially_covered_16);
       TAG(do_block_16)(task, tri, plane, px, py, cx);
    }
@@ -243,9 +231,72 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
 
       inmask &= ~(1 << i);
 
+      if (lp_rast_hiz_cull_block(task, &tri->inputs, px, py)) {
+         LP_COUNT(nr_hiz_culled_16);
+         continue;
+      }
+
       LP_COUNT(nr_fully_covered_16);
       block_full_16(task, tri, px, py);
+      lp_rast_hiz_update_block(task, &tri->inputs, px, py);
+   }
+}
+
+
+/**
+ * Scan the tile in chunks and figure out which pixels to rasterize
+ * for this triangle.
+ */
+void
+TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
+                      const union lp_rast_cmd_arg arg)
+{
+   const struct lp_rast_triangle *tri = arg.triangle.tri;
+   unsigned plane_mask = arg.triangle.plane_mask;
+   const struct lp_rast_plane *tri_plane = GET_PLANES(tri);
+   const int x = task->x, y = task->y;
+   struct lp_rast_plane plane[NR_PLANES];
+   int c[NR_PLANES];
+   unsigned j = 0;
+
+   if (tri->inputs.disable) {
+      /* This triangle was partially binned and has been disabled */
+      return;
    }
+
+   if (lp_rast_hiz_cull_tile(task, &tri->inputs)) {
+      LP_COUNT(nr_hiz_culled_tiles);
+      return;
+   }
+
+   while (plane_mask) {
+      int i = ffs(plane_mask) - 1;
+      plane[j] = tri_plane[i];
+      plane_mask &= ~(1 << i);
+      c[j] = plane[j].c + plane[j].dcdy * y - plane[j].dcdx * x;
+      j++;
+   }
+
+#if TILE_SIZE <= 64
+   TAG(do_block_64)(task, tri, plane, x, y, c);
+#else
+   {
+      int ix, iy;
+
+      for (iy = 0; iy < TILE_SIZE; iy += 64) {
+         for (ix = 0; ix < TILE_SIZE; ix += 64) {
+            int cx[NR_PLANES];
+
+            for (j = 0; j < NR_PLANES; j++)
+               cx[j] = (c[j]
+                        - plane[j].dcdx * ix
+                        + plane[j].dcdy * iy);
+
+            TAG(do_block_64)(task, tri, plane, x + ix, y + iy, cx);
+         }
+      }
+   }
+#endif
 }
 
 #if defined(PIPE_ARCH_SSE) && defined(TRI_16)
@@ -272,6 +323,11 @@ TRI_16(struct lp_rasterizer_task *task,
    x += task->x;
    y += task->y;
 
+   if (lp_rast_hiz_cull_rect(task, &tri->inputs, x, y, 16)) {
+      LP_COUNT(nr_hiz_culled_16);
+      return;
+   }
+
    for (j = 0; j < NR_PLANES; j++) {
       const int dcdx = -plane[j].dcdx * 4;
       const int dcdy = plane[j].dcdy * 4;
@@ -337,6 +393,11 @@ TRI_4(struct lp_rasterizer_task *task,
    const int y = task->y + (mask >> 8);
    unsigned j;
 
+   if (lp_rast_hiz_cull_rect(task, &tri->inputs, x, y, 4)) {
+      LP_COUNT(nr_hiz_culled_16);
+      return;
+   }
+
    /* Iterate over partials:
     */
    {
@@ -29,11 +29,13 @@
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_inlines.h"
+#include "util/u_atomic.h"
 #include "util/u_simple_list.h"
 #include "util/u_format.h"
 #include "lp_scene.h"
 #include "lp_fence.h"
 #include "lp_debug.h"
+#include "lp_perf.h"
 
 
 #define RESOURCE_REF_SZ 32
@@ -150,6 +152,9 @@ lp_scene_begin_rasterization(struct lp_scene *scene)
                                                   cbuf->u.tex.first_layer,
                                                   LP_TEX_USAGE_READ_WRITE,
                                                   LP_TEX_LAYOUT_LINEAR);
+
+      scene->cbufs[i].linear = llvmpipe_is_linear_render_format(cbuf->format);
+      scene->color_strides[i] = scene->cbufs[i].map ? scene->cbufs[i].stride : 0;
    }
 
    if (fb->zsbuf) {
@@ -171,12 +176,57 @@ lp_scene_begin_rasterization(struct lp_scene *scene)
 
 
 /**
- * Free all the temporary data in a scene.
+ * Drop the scene's references to the framebuffer surfaces and to the
+ * resources its commands use.
+ */
+static void
+release_references(struct lp_scene *scene)
+{
+   struct resource_ref *ref;
+   int i, j = 0;
+
+   pipe_mutex_lock(scene->mutex);
+
+   for (ref = scene->resources; ref; ref = ref->next) {
+      for (i = 0; i < ref->count; i++) {
+         if (LP_DEBUG & DEBUG_SETUP)
+            debug_printf("resource %d: %p %dx%d sz %d\n",
+                         j,
+                         (void *) ref->resource[i],
+                         ref->resource[i]->width0,
+                         ref->resource[i]->height0,
+                         llvmpipe_resource_size(ref->resource[i]));
+         j++;
+         pipe_resource_reference(&ref->resource[i], NULL);
+      }
+   }
+
+   if (LP_DEBUG & DEBUG_SETUP)
+      debug_printf("scene %d resources, sz %d\n",
+                   j, scene->resource_reference_size);
+
+   /* The reference blocks live in the scene's data blocks, which are
+    * only freed by lp_scene_reset().
+    */
+   scene->resources = NULL;
+   scene->resource_reference_size = 0;
+
+   util_unreference_framebuffer_state( &scene->fb );
+
+   pipe_mutex_unlock(scene->mutex);
+}
+
+
+/**
+ * Unmap the framebuffer surfaces once all threads are done with the
+ * scene, and release everything the scene references, so that idle
+ * scenes don't keep resources alive.  Called by the rasterizer before
+ * the scene's fence is signalled.
  */
 void
 lp_scene_end_rasterization(struct lp_scene *scene )
 {
-   int i, j;
+   int i;
 
    /* Unmap color buffers */
    for (i = 0; i < scene->fb.nr_cbufs; i++) {
@@ -198,6 +248,24 @@ lp_scene_end_rasterization(struct lp_scene *scene )
       scene->zsbuf.map = NULL;
    }
 
+   release_references(scene);
+}
+
+
+/**
+ * Free all the temporary data in a scene so it can be reused for
+ * binning.  Called by the setup module once the scene's fence has
+ * signalled (or when the scene was never queued for rasterization, in
+ * which case it still holds its references).
+ */
+void
+lp_scene_reset(struct lp_scene *scene )
+{
+   int i, j;
+
+   assert(scene->cbufs[0].map == NULL);
+   assert(scene->zsbuf.map == NULL);
+
    /* Reset all command lists:
     */
    for (i = 0; i < scene->tiles_x; i++) {
@@ -214,30 +282,9 @@ lp_scene_end_rasterization(struct lp_scene *scene )
     */
    assert(lp_scene_is_empty(scene));
 
-   /* Decrement texture ref counts
+   /* Decrement texture ref counts, if the rasterizer hasn't already
     */
-   {
-      struct resource_ref *ref;
-      int i, j = 0;
-
-      for (ref = scene->resources; ref; ref = ref->next) {
-         for (i = 0; i < ref->count; i++) {
-            if (LP_DEBUG & DEBUG_SETUP)
-               debug_printf("resource %d: %p %dx%d sz %d\n",
-                            j,
-                            (void *) ref->resource[i],
-                            ref->resource[i]->width0,
-                            ref->resource[i]->height0,
-                            llvmpipe_resource_size(ref->resource[i]));
-            j++;
-            pipe_resource_reference(&ref->resource[i], NULL);
-         }
-      }
-
-      if (LP_DEBUG & DEBUG_SETUP)
-         debug_printf("scene %d resources, sz %d\n",
-                      j, scene->resource_reference_size);
-   }
+   release_references(scene);
 
    /* Free all scene data blocks:
     */
@@ -256,14 +303,10 @@ lp_scene_end_rasterization(struct lp_scene *scene )
 
    lp_fence_reference(&scene->fence, NULL);
 
-   scene->resources = NULL;
    scene->scene_size = 0;
-   scene->resource_reference_size = 0;
 
    scene->has_depthstencil_clear = FALSE;
    scene->alloc_failed = FALSE;
-
-   util_unreference_framebuffer_state( &scene->fb );
 }
 
 
@@ -397,77 +440,101 @@ lp_scene_add_resource_reference(struct lp_scene *scene,
  * Does this scene have a reference to the given resource?
  */
 boolean
-lp_scene_is_resource_referenced(const struct lp_scene *scene,
+lp_scene_is_resource_referenced(struct lp_scene *scene,
                                 const struct pipe_resource *resource)
 {
    const struct resource_ref *ref;
+   boolean referenced = FALSE;
    int i;
 
-   for (ref = scene->resources; ref; ref = ref->next) {
-      for (i = 0; i < ref->count; i++)
-         if (ref->resource[i] == resource)
-            return TRUE;
+   pipe_mutex_lock(scene->mutex);
+
+   for (ref = scene->resources; ref && !referenced; ref = ref->next) {
+      for (i = 0; i < ref->count; i++) {
+         if (ref->resource[i] == resource) {
+            referenced = TRUE;
+            break;
+         }
+      }
    }
 
-   return FALSE;
+   pipe_mutex_unlock(scene->mutex);
+
+   return referenced;
 }
 
 
+/**
+ * Does the scene render into the resource?
+ */
+boolean
+lp_scene_is_render_target(struct lp_scene *scene,
+                          const struct pipe_resource *resource)
+{
+   boolean referenced = FALSE;
+   int i;
 
+   pipe_mutex_lock(scene->mutex);
 
-/** advance curr_x,y to the next bin */
-static boolean
-next_bin(struct lp_scene *scene)
-{
-   scene->curr_x++;
-   if (scene->curr_x >= scene->tiles_x) {
-      scene->curr_x = 0;
-      scene->curr_y++;
-   }
-   if (scene->curr_y >= scene->tiles_y) {
-      /* no more bins */
-      return FALSE;
+   for (i = 0; i < scene->fb.nr_cbufs; i++) {
+      if (scene->fb.cbufs[i]->texture == resource)
+         referenced = TRUE;
    }
-   return TRUE;
+   if (scene->fb.zsbuf && scene->fb.zsbuf->texture == resource)
+      referenced = TRUE;
+
+   pipe_mutex_unlock(scene->mutex);
+
+   return referenced;
 }
 
 
+
+
 void
 lp_scene_bin_iter_begin( struct lp_scene *scene )
 {
-   scene->curr_x = scene->curr_y = -1;
+   p_atomic_set(&scene->curr_bin, -1);
 }
 
 
 /**
  * Return pointer to next bin to be rendered.
- * The lp_scene::curr_x and ::curr_y fields will be advanced.
+ * The lp_scene::curr_bin field will be advanced.
  * Multiple rendering threads will call this function to get a chunk
- * of work (a bin) to work on.
+ * of work (a bin) to work on.  This is lock-free: the bin cursor is
+ * bumped with a compare-and-swap, and a thread that loses the race
+ * simply retries with the updated value.
  */
 struct cmd_bin *
 lp_scene_bin_iter_next( struct lp_scene *scene )
 {
-   struct cmd_bin *bin = NULL;
+   const int32_t num_bins = lp_scene_get_num_bins(scene);
+   int32_t curr, next;
 
-   pipe_mutex_lock(scene->mutex);
+   curr = p_atomic_read(&scene->curr_bin);
+   for (;;) {
+      if (curr + 1 >= num_bins) {
+         /* no more bins left */
+         return NULL;
+      }
 
-   if (scene->curr_x < 0) {
-      /* first bin */
-      scene->curr_x = 0;
-      scene->curr_y = 0;
-   }
-   else if (!next_bin(scene)) {
-      /* no more bins left */
-      goto end;
+      next = p_atomic_cmpxchg(&scene->curr_bin, curr, curr + 1);
+      if (next == curr) {
+         break;
+      }
+
+      /* another thread grabbed this bin first */
+      LP_COUNT(nr_bin_iter_retries);
+      curr = next;
    }
 
-   bin = lp_scene_get_bin(scene, scene->curr_x, scene->curr_y);
+   LP_COUNT(nr_bin_iter_bins);
 
-end:
-   /*printf("return bin %p at %d, %d\n", (void *) bin, *bin_x, *bin_y);*/
-   pipe_mutex_unlock(scene->mutex);
-   return bin;
+   curr++;
+   return lp_scene_get_bin(scene,
+                           curr % scene->tiles_x,
+                           curr / scene->tiles_x);
 }
 
 
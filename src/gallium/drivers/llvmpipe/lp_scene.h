@@ -137,7 +137,11 @@ struct lp_scene {
       uint8_t *map;
       unsigned stride;
       unsigned blocksize;
+      boolean linear;   /**< rendered to in place, not via swizzled tiles */
    } zsbuf, cbufs[PIPE_MAX_COLOR_BUFS];
+
+   /** Row strides of the linear color buffers, as passed to the shaders */
+   uint32_t color_strides[PIPE_MAX_COLOR_BUFS];
    
    /** the framebuffer to render the scene into */
    struct pipe_framebuffer_state fb;
@@ -145,6 +149,12 @@ struct lp_scene {
    /** list of resources referenced by the scene commands */
    struct resource_ref *resources;
 
+   /**
+    * Protects the fb and resources references, which the rasterizer
+    * drops while the setup module may be looking at them.
+    */
+   pipe_mutex mutex;
+
    /** Total memory used by the scene (in bytes).  This sums all the
     * data blocks and counts all bins, state, resource references and
     * other random allocations within the scene.
@@ -165,8 +175,11 @@ struct lp_scene {
     */
    unsigned tiles_x, tiles_y;
 
-   int curr_x, curr_y;  /**< for iterating over bins */
-   pipe_mutex mutex;
+   /**
+    * Linear index of the last bin handed out to a rasterizer thread.
+    * Advanced atomically so that threads can grab bins without locking.
+    */
+   int32_t curr_bin;
 
    struct cmd_bin tile[TILES_X][TILES_Y];
    struct data_block_list data;
@@ -191,9 +204,12 @@ boolean lp_scene_add_resource_reference(struct lp_scene *scene,
                                         struct pipe_resource *resource,
                                         boolean initializing_scene);
 
-boolean lp_scene_is_resource_referenced(const struct lp_scene *scene,
+boolean lp_scene_is_resource_referenced(struct lp_scene *scene,
                                         const struct pipe_resource *resource );
 
+boolean lp_scene_is_render_target(struct lp_scene *scene,
+                                  const struct pipe_resource *resource );
+
 
 /**
  * Allocate space for a command/data in the bin's data buffer.
@@ -396,6 +412,9 @@ lp_scene_begin_rasterization(struct lp_scene *scene);
 void
 lp_scene_end_rasterization(struct lp_scene *scene );
 
+void
+lp_scene_reset(struct lp_scene *scene );
+
 
 
 
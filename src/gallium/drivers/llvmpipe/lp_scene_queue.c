@@ -38,7 +38,10 @@
 
 
 
-#define MAX_SCENE_QUEUE 4
+/* Enough room for every context to have several scenes in flight
+ * without blocking the setup thread on the ring.
+ */
+#define MAX_SCENE_QUEUE 64
 
 struct scene_packet {
    struct util_packet header;
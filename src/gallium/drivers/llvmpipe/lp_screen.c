@@ -46,6 +46,7 @@
 #include "lp_public.h"
 #include "lp_limits.h"
 #include "lp_rast.h"
+#include "gallivm/lp_bld_compile_queue.h"
 
 #include "state_tracker/sw_winsys.h"
 
@@ -81,6 +82,8 @@ static const struct debug_named_value lp_perf_flags[] = {
    { "no_blend",       PERF_NO_BLEND, NULL },
    { "no_depth",       PERF_NO_DEPTH, NULL },
    { "no_alphatest",   PERF_NO_ALPHATEST, NULL },
+   { "no_linear_cbuf", PERF_NO_LINEAR_CBUF, NULL },
+   { "no_hiz",         PERF_NO_HIZ, NULL },
    DEBUG_NAMED_VALUE_END
 };
 
@@ -384,6 +387,8 @@ llvmpipe_destroy_screen( struct pipe_screen *_screen )
    if (screen->rast)
       lp_rast_destroy(screen->rast);
 
+   lp_compile_queue_destroy(screen->compile_queue);
+
    lp_jit_screen_cleanup(screen);
 
    if(winsys->destroy)
@@ -494,6 +499,9 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    screen->num_threads = debug_get_num_option("LP_NUM_THREADS", screen->num_threads);
    screen->num_threads = MIN2(screen->num_threads, LP_MAX_THREADS);
 
+   screen->num_scenes = debug_get_num_option("LP_NUM_SCENES", LP_DEFAULT_SCENES);
+   screen->num_scenes = CLAMP(screen->num_scenes, 2, LP_MAX_SCENES);
+
    screen->rast = lp_rast_create(screen->num_threads);
    if (!screen->rast) {
       lp_jit_screen_cleanup(screen);
@@ -502,6 +510,22 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    }
    pipe_mutex_init(screen->rast_mutex);
 
+   /* Background shader compilation only pays off with a spare cpu. */
+   screen->num_compile_threads = util_cpu_caps.nr_cpus > 1 ? 1 : 0;
+#ifdef PIPE_SUBSYSTEM_EMBEDDED
+   screen->num_compile_threads = 0;
+#endif
+   screen->num_compile_threads = debug_get_num_option("LP_NUM_COMPILE_THREADS",
+                                                      screen->num_compile_threads);
+   screen->num_compile_threads = MIN2(screen->num_compile_threads,
+                                      LP_MAX_COMPILE_THREADS);
+   screen->compile_queue =
+      lp_compile_queue_create(screen->num_compile_threads,
+                              debug_get_num_option("LP_COMPILE_BATCH",
+                                                   LP_DEFAULT_COMPILE_BATCH));
+   screen->hot_draws = debug_get_num_option("LP_HOT_DRAWS",
+                                            LP_DEFAULT_HOT_DRAWS);
+
    util_format_s3tc_init();
 
    return &screen->base;
@@ -41,6 +41,7 @@
 
 
 struct sw_winsys;
+struct lp_compile_queue;
 
 
 struct llvmpipe_screen
@@ -51,12 +52,22 @@ struct llvmpipe_screen
 
    unsigned num_threads;
 
+   /** Max number of scenes each context may have in flight */
+   unsigned num_scenes;
+
    /* Increments whenever textures are modified.  Contexts can track this.
     */
    unsigned timestamp;
 
    struct lp_rasterizer *rast;
    pipe_mutex rast_mutex;
+
+   /** Background shader compilation, NULL if disabled */
+   unsigned num_compile_threads;
+   struct lp_compile_queue *compile_queue;
+
+   /** Draws with unoptimized code before a variant gets optimized */
+   unsigned hot_draws;
 };
 
 
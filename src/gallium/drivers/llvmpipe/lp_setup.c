@@ -62,26 +62,91 @@ static boolean set_scene_state( struct lp_setup_context *, enum setup_state,
 static boolean try_update_scene_state( struct lp_setup_context *setup );
 
 
+/**
+ * Is the scene still queued for, or being processed by, the rasterizer?
+ */
+static INLINE boolean
+scene_is_busy(const struct lp_scene *scene)
+{
+   return scene->fence && !lp_fence_signalled(scene->fence);
+}
+
+
+/**
+ * Wait for the queued scenes which render into the resource.  Scenes are
+ * rasterized in order, so once these are done, no earlier scene can be
+ * reading the resource either.
+ */
+static void
+wait_for_render_target(struct lp_setup_context *setup,
+                       const struct pipe_resource *resource)
+{
+   unsigned i;
+
+   for (i = 0; i < setup->num_scenes; i++) {
+      struct lp_scene *scene = setup->scenes[i];
+
+      if (scene != setup->scene &&
+          scene_is_busy(scene) &&
+          lp_scene_is_render_target(scene, resource)) {
+         if (LP_DEBUG & DEBUG_SETUP)
+            debug_printf("%s: wait for scene %d\n",
+                         __FUNCTION__, scene->fence->id);
+
+         lp_fence_wait(scene->fence);
+      }
+   }
+}
+
+
+/**
+ * Find a scene to bin into.  Prefer an idle scene, then grow the pool
+ * up to max_scenes, and only then wait for the oldest scene to be
+ * rasterized.
+ */
 static void
 lp_setup_get_empty_scene(struct lp_setup_context *setup)
 {
+   struct lp_scene *scene = NULL;
+   unsigned i;
+
    assert(setup->scene == NULL);
 
-   setup->scene_idx++;
-   setup->scene_idx %= Elements(setup->scenes);
+   for (i = 1; i <= setup->num_scenes; i++) {
+      unsigned idx = (setup->scene_idx + i) % setup->num_scenes;
+      if (!scene_is_busy(setup->scenes[idx])) {
+         setup->scene_idx = idx;
+         scene = setup->scenes[idx];
+         break;
+      }
+   }
+
+   if (!scene && setup->num_scenes < setup->max_scenes) {
+      scene = lp_scene_create( setup->pipe );
+      if (scene) {
+         setup->scene_idx = setup->num_scenes++;
+         setup->scenes[setup->scene_idx] = scene;
+      }
+   }
 
-   setup->scene = setup->scenes[setup->scene_idx];
+   if (!scene) {
+      setup->scene_idx++;
+      setup->scene_idx %= setup->num_scenes;
+      scene = setup->scenes[setup->scene_idx];
 
-   if (setup->scene->fence) {
       if (LP_DEBUG & DEBUG_SETUP)
          debug_printf("%s: wait for scene %d\n",
-                      __FUNCTION__, setup->scene->fence->id);
+                      __FUNCTION__, scene->fence->id);
 
-      lp_fence_wait(setup->scene->fence);
+      lp_fence_wait(scene->fence);
    }
 
+   /* Release the data from the last time this scene was rasterized */
+   lp_scene_reset(scene);
+
+   setup->scene = scene;
+
    lp_scene_begin_binning(setup->scene, &setup->fb);
-   
 }
 
 
@@ -155,12 +220,13 @@ lp_setup_rasterize_scene( struct lp_setup_context *setup )
    if (setup->last_fence)
       setup->last_fence->issued = TRUE;
 
+   /* Don't wait for the rasterizer here: the scene is recycled by
+    * lp_setup_get_empty_scene() once its fence has signalled.
+    */
    pipe_mutex_lock(screen->rast_mutex);
    lp_rast_queue_scene(screen->rast, scene);
-   lp_rast_finish(screen->rast);
    pipe_mutex_unlock(screen->rast_mutex);
 
-   lp_scene_end_rasterization(setup->scene);
    lp_setup_reset( setup );
 
    LP_DBG(DEBUG_SETUP, "%s done \n", __FUNCTION__);
@@ -324,7 +390,7 @@ set_scene_state( struct lp_setup_context *setup,
 
 fail:
    if (setup->scene) {
-      lp_scene_end_rasterization(setup->scene);
+      lp_scene_reset(setup->scene);
       setup->scene = NULL;
    }
 
@@ -665,6 +731,13 @@ lp_setup_set_fragment_sampler_views(struct lp_setup_context *setup,
          if (!lp_tex->dt) {
             /* regular texture - setup array of mipmap level pointers */
             int j;
+
+            /* Getting the linear images may convert them from the tiled
+             * layout, which must not race with the rasterizer mapping
+             * the texture as a render target.
+             */
+            wait_for_render_target(setup, tex);
+
             for (j = view->u.tex.first_level; j <= tex->last_level; j++) {
                jit_tex->data[j] =
                   llvmpipe_get_texture_image_all(lp_tex, j, LP_TEX_USAGE_READ,
@@ -758,8 +831,17 @@ lp_setup_is_resource_referenced( const struct lp_setup_context *setup,
       return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
    }
 
-   /* check textures referenced by the scene */
-   for (i = 0; i < Elements(setup->scenes); i++) {
+   /* check scenes which have been queued but not yet fully rasterized.
+    * Idle scenes hold no references: the rasterizer drops them before
+    * signalling the fence.
+    */
+   for (i = 0; i < setup->num_scenes; i++) {
+      if (lp_scene_is_render_target(setup->scenes[i], texture))
+         return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
+   }
+
+   /* check textures referenced by the scenes */
+   for (i = 0; i < setup->num_scenes; i++) {
       if (lp_scene_is_resource_referenced(setup->scenes[i], texture)) {
          return LP_REFERENCED_FOR_READ;
       }
@@ -985,13 +1067,14 @@ lp_setup_destroy( struct lp_setup_context *setup )
 
    pipe_resource_reference(&setup->constants.current, NULL);
 
-   /* free the scenes in the 'empty' queue */
-   for (i = 0; i < Elements(setup->scenes); i++) {
+   /* wait for any scenes still being rasterized, then free them all */
+   for (i = 0; i < setup->num_scenes; i++) {
       struct lp_scene *scene = setup->scenes[i];
 
-      if (scene->fence)
+      if (scene_is_busy(scene))
          lp_fence_wait(scene->fence);
 
+      lp_scene_reset(scene);
       lp_scene_destroy(scene);
    }
 
@@ -1012,7 +1095,6 @@ lp_setup_create( struct pipe_context *pipe,
 {
    struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
    struct lp_setup_context *setup;
-   unsigned i;
 
    setup = CALLOC_STRUCT(lp_setup_context);
    if (!setup) {
@@ -1027,6 +1109,9 @@ lp_setup_create( struct pipe_context *pipe,
 
 
    setup->num_threads = screen->num_threads;
+   setup->max_scenes = screen->num_scenes;
+   assert(setup->max_scenes <= Elements(setup->scenes));
+   assert(LP_MAX_SCENES * LP_SCENE_MAX_SIZE <= LP_MAX_SCENE_SIZE);
    setup->vbuf = draw_vbuf_stage(draw, &setup->base);
    if (!setup->vbuf) {
       goto no_vbuf;
@@ -1035,13 +1120,12 @@ lp_setup_create( struct pipe_context *pipe,
    draw_set_rasterize_stage(draw, setup->vbuf);
    draw_set_render(draw, &setup->base);
 
-   /* create some empty scenes */
-   for (i = 0; i < MAX_SCENES; i++) {
-      setup->scenes[i] = lp_scene_create( pipe );
-      if (!setup->scenes[i]) {
-         goto no_scenes;
-      }
+   /* create the first scene, more are added on demand */
+   setup->scenes[0] = lp_scene_create( pipe );
+   if (!setup->scenes[0]) {
+      goto no_scenes;
    }
+   setup->num_scenes = 1;
 
    setup->triangle = first_triangle;
    setup->line     = first_line;
@@ -1052,12 +1136,6 @@ lp_setup_create( struct pipe_context *pipe,
    return setup;
 
 no_scenes:
-   for (i = 0; i < MAX_SCENES; i++) {
-      if (setup->scenes[i]) {
-         lp_scene_destroy(setup->scenes[i]);
-      }
-   }
-
    setup->vbuf->destroy(setup->vbuf);
 no_vbuf:
    FREE(setup);
@@ -53,9 +53,6 @@
 struct lp_setup_variant;
 
 
-/** Max number of scenes */
-#define MAX_SCENES 2
-
 
 
 /**
@@ -86,8 +83,10 @@ struct lp_setup_context
    struct draw_stage *vbuf;
    unsigned num_threads;
    unsigned scene_idx;
-   struct lp_scene *scenes[MAX_SCENES];  /**< all the scenes */
-   struct lp_scene *scene;               /**< current scene being built */
+   unsigned num_scenes;                     /**< scenes created so far */
+   unsigned max_scenes;                     /**< limit on num_scenes */
+   struct lp_scene *scenes[LP_MAX_SCENES];  /**< all the scenes */
+   struct lp_scene *scene;                  /**< current scene being built */
 
    struct lp_fence *last_fence;
    struct llvmpipe_query *active_query;
@@ -29,6 +29,7 @@
  * Binning code for triangles
  */
 
+#include <float.h>
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_rect.h"
@@ -555,6 +556,38 @@ floor_pot(uint32_t n)
 }
 
 
+/**
+ * Compute a conservative range of the depth values the primitive can
+ * produce inside the given box, for the rasterizer's depth bounds
+ * rejection.  The position z plane is evaluated at the box edges, grown
+ * by a pixel to cover the sample positions, and widened by the rounding
+ * error of evaluating it in single precision.
+ */
+static void
+setup_depth_range(struct lp_rast_triangle *tri,
+                  const struct u_rect *box)
+{
+   const float (*a0)[4] = (const float (*)[4]) GET_A0(&tri->inputs);
+   const float (*dadx)[4] = (const float (*)[4]) GET_DADX(&tri->inputs);
+   const float (*dady)[4] = (const float (*)[4]) GET_DADY(&tri->inputs);
+   const float z0 = a0[0][2];
+   const float zx0 = dadx[0][2] * (float)(box->x0 - 1);
+   const float zx1 = dadx[0][2] * (float)(box->x1 + 2);
+   const float zy0 = dady[0][2] * (float)(box->y0 - 1);
+   const float zy1 = dady[0][2] * (float)(box->y1 + 2);
+   const float err = (fabsf(z0) +
+                      MAX2(fabsf(zx0), fabsf(zx1)) +
+                      MAX2(fabsf(zy0), fabsf(zy1))) * (8.0f * FLT_EPSILON);
+
+   tri->inputs.zmin = z0 + MIN2(zx0, zx1) + MIN2(zy0, zy1) - err;
+   tri->inputs.zmax = z0 + MAX2(zx0, zx1) + MAX2(zy0, zy1) + err;
+
+   /* in case the fragment depth gets clamped */
+   tri->inputs.zmin = MIN2(tri->inputs.zmin, 1.0f);
+   tri->inputs.zmax = MAX2(tri->inputs.zmax, 0.0f);
+}
+
+
 boolean
 lp_setup_bin_triangle( struct lp_setup_context *setup,
                        struct lp_rast_triangle *tri,
@@ -583,14 +616,16 @@ lp_setup_bin_triangle( struct lp_setup_context *setup,
     */
    u_rect_find_intersection(&setup->draw_region, &trimmed_box);
 
+   setup_depth_range(tri, &trimmed_box);
+
    /* Determine which tile(s) intersect the triangle's bounding box
     */
    if (dx < TILE_SIZE)
    {
       int ix0 = bbox->x0 / TILE_SIZE;
       int iy0 = bbox->y0 / TILE_SIZE;
-      unsigned px = bbox->x0 & 63 & ~3;
-      unsigned py = bbox->y0 & 63 & ~3;
+      unsigned px = bbox->x0 & (TILE_SIZE - 1) & ~3;
+      unsigned py = bbox->y0 & (TILE_SIZE - 1) & ~3;
 
       assert(iy0 == bbox->y1 / TILE_SIZE &&
 	     ix0 == bbox->x1 / TILE_SIZE);
@@ -82,6 +82,7 @@
 #include "gallivm/lp_bld_swizzle.h"
 #include "gallivm/lp_bld_flow.h"
 #include "gallivm/lp_bld_debug.h"
+#include "gallivm/lp_bld_disk_cache.h"
 
 #include "lp_bld_alpha.h"
 #include "lp_bld_blend.h"
@@ -95,6 +96,8 @@
 #include "lp_tex_sample.h"
 #include "lp_flush.h"
 #include "lp_state_fs.h"
+#include "lp_screen.h"
+#include "gallivm/lp_bld_compile_queue.h"
 
 
 /** Fragment shader number (for debugging) */
@@ -341,7 +344,7 @@ generate_fs(struct gallivm_state *gallivm,
    lp_build_tgsi_soa(gallivm, tokens, type, &mask,
                      consts_ptr, &system_values,
                      interp->pos, interp->inputs,
-                     outputs, sampler, &shader->info.base);
+                     outputs, sampler, &shader->info.base, NULL);
 
    /* Alpha test */
    if (key->alpha.enabled) {
@@ -580,7 +583,7 @@ generate_fs_loop(struct gallivm_state *gallivm,
    lp_build_tgsi_soa(gallivm, tokens, type, &mask,
                      consts_ptr, &system_values,
                      interp->pos, interp->inputs,
-                     outputs, sampler, &shader->info.base);
+                     outputs, sampler, &shader->info.base, NULL);
 
    /* Alpha test */
    if (key->alpha.enabled) {
@@ -681,6 +684,174 @@ generate_fs_loop(struct gallivm_state *gallivm,
 }
 
 
+/**
+ * Position within a 4x4 block of element i of the SoA color vectors,
+ * matching the tile_offset[] layout of the swizzled tiles.
+ */
+#define BLOCK_ELEM_X(i) (((i) & 1) | (((i) >> 1) & 2))
+#define BLOCK_ELEM_Y(i) ((((i) >> 1) & 1) | (((i) >> 2) & 2))
+
+
+/**
+ * Byte of a linear pixel which holds color component chan (0 = red, etc.),
+ * or -1 if the format has no such component.
+ * See llvmpipe_is_linear_render_format().
+ */
+static int
+linear_component_byte(const struct util_format_description *desc,
+                      unsigned chan)
+{
+   unsigned swizzle = desc->swizzle[chan];
+   unsigned i, bits = 0;
+
+   if (swizzle > UTIL_FORMAT_SWIZZLE_W)
+      return -1;
+
+   for (i = 0; i < swizzle; i++)
+      bits += desc->channel[i].size;
+
+   return bits / 8;
+}
+
+
+/**
+ * Load a 4x4 block of 32bpp pixels from a linear color buffer and
+ * transpose it into the SoA 16 x ubyte layout used for blending.
+ */
+static void
+load_linear_color(struct gallivm_state *gallivm,
+                  enum pipe_format format,
+                  LLVMValueRef block_ptr,
+                  LLVMValueRef stride,
+                  LLVMValueRef dst[4])
+{
+   const struct util_format_description *desc = util_format_description(format);
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef int8_type = LLVMInt8TypeInContext(gallivm->context);
+   LLVMTypeRef row_type = LLVMVectorType(int8_type, 16);
+   LLVMValueRef rows[4];
+   unsigned i, y, chan;
+
+   block_ptr = LLVMBuildBitCast(builder, block_ptr,
+                                LLVMPointerType(int8_type, 0), "");
+
+   for (y = 0; y < 4; y++) {
+      LLVMValueRef offset = LLVMBuildMul(builder, stride,
+                                         lp_build_const_int32(gallivm, y), "");
+      LLVMValueRef row_ptr = LLVMBuildGEP(builder, block_ptr, &offset, 1, "");
+      row_ptr = LLVMBuildBitCast(builder, row_ptr,
+                                 LLVMPointerType(row_type, 0), "");
+      rows[y] = LLVMBuildLoad(builder, row_ptr, "");
+      lp_set_load_alignment(rows[y], 4);
+   }
+
+   for (chan = 0; chan < 4; chan++) {
+      int byte = linear_component_byte(desc, chan);
+      LLVMValueRef shuffles[16];
+      LLVMValueRef top, bottom;
+
+      if (byte < 0) {
+         /* no alpha in the buffer */
+         dst[chan] = LLVMConstAllOnes(row_type);
+         continue;
+      }
+
+      /* elements 0..7 come from rows 0-1, 8..15 from rows 2-3 alike */
+      for (i = 0; i < 8; i++) {
+         unsigned index = (BLOCK_ELEM_Y(i) * 16 +
+                           BLOCK_ELEM_X(i) * 4 + byte);
+         shuffles[i] = lp_build_const_int32(gallivm, index);
+      }
+      top = LLVMBuildShuffleVector(builder, rows[0], rows[1],
+                                   LLVMConstVector(shuffles, 8), "");
+      bottom = LLVMBuildShuffleVector(builder, rows[2], rows[3],
+                                      LLVMConstVector(shuffles, 8), "");
+
+      for (i = 0; i < 16; i++)
+         shuffles[i] = lp_build_const_int32(gallivm, i);
+      dst[chan] = LLVMBuildShuffleVector(builder, top, bottom,
+                                         LLVMConstVector(shuffles, 16), "");
+   }
+}
+
+
+/**
+ * Inverse of load_linear_color().
+ */
+static void
+store_linear_color(struct gallivm_state *gallivm,
+                   enum pipe_format format,
+                   LLVMValueRef block_ptr,
+                   LLVMValueRef stride,
+                   const LLVMValueRef src[4])
+{
+   const struct util_format_description *desc = util_format_description(format);
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef int8_type = LLVMInt8TypeInContext(gallivm->context);
+   LLVMTypeRef row_type = LLVMVectorType(int8_type, 16);
+   LLVMValueRef shuffles[64];
+   LLVMValueRef rg, ba, rgba;
+   unsigned byte_chan[4];
+   unsigned i, y, chan;
+
+   block_ptr = LLVMBuildBitCast(builder, block_ptr,
+                                LLVMPointerType(int8_type, 0), "");
+
+   /*
+    * Concatenate the four components into one 64 x ubyte vector.  Bytes
+    * which hold no component (the X in XRGB) get alpha, which is one.
+    */
+   for (i = 0; i < 4; i++)
+      byte_chan[i] = 3;
+   for (chan = 0; chan < 4; chan++) {
+      int byte = linear_component_byte(desc, chan);
+      if (byte >= 0)
+         byte_chan[byte] = chan;
+   }
+
+   for (i = 0; i < 32; i++)
+      shuffles[i] = lp_build_const_int32(gallivm, i);
+   rg = LLVMBuildShuffleVector(builder, src[0], src[1],
+                               LLVMConstVector(shuffles, 32), "");
+   if (linear_component_byte(desc, 3) < 0)
+      ba = LLVMBuildShuffleVector(builder, src[2], LLVMConstAllOnes(row_type),
+                                  LLVMConstVector(shuffles, 32), "");
+   else
+      ba = LLVMBuildShuffleVector(builder, src[2], src[3],
+                                  LLVMConstVector(shuffles, 32), "");
+   for (i = 32; i < 64; i++)
+      shuffles[i] = lp_build_const_int32(gallivm, i);
+   rgba = LLVMBuildShuffleVector(builder, rg, ba,
+                                 LLVMConstVector(shuffles, 64), "");
+
+   for (y = 0; y < 4; y++) {
+      LLVMValueRef offset = LLVMBuildMul(builder, stride,
+                                         lp_build_const_int32(gallivm, y), "");
+      LLVMValueRef row_ptr = LLVMBuildGEP(builder, block_ptr, &offset, 1, "");
+      LLVMValueRef row;
+      LLVMValueRef store;
+      unsigned x;
+
+      for (x = 0; x < 4; x++) {
+         for (i = 0; i < 4; i++) {
+            unsigned elem = (y & 2) * 4 + (x & 2) * 2 + (y & 1) * 2 + (x & 1);
+            assert(BLOCK_ELEM_X(elem) == x && BLOCK_ELEM_Y(elem) == y);
+            shuffles[x * 4 + i] =
+               lp_build_const_int32(gallivm, byte_chan[i] * 16 + elem);
+         }
+      }
+
+      row = LLVMBuildShuffleVector(builder, rgba, LLVMGetUndef(LLVMTypeOf(rgba)),
+                                   LLVMConstVector(shuffles, 16), "");
+
+      row_ptr = LLVMBuildBitCast(builder, row_ptr,
+                                 LLVMPointerType(row_type, 0), "");
+      store = LLVMBuildStore(builder, row, row_ptr);
+      lp_set_store_alignment(store, 4);
+   }
+}
+
+
 /**
  * Generate color blending and color output.
  * \param rt  the render target index (to index blend, colormask state)
@@ -688,7 +859,10 @@ generate_fs_loop(struct gallivm_state *gallivm,
  * \param context_ptr  pointer to the runtime JIT context
  * \param mask  execution mask (active fragment/pixel mask)
  * \param src  colors from the fragment shader
+ * \param format  color buffer format
  * \param dst_ptr  the destination color buffer pointer
+ * \param dst_stride  row stride of a linear color buffer, or NULL if
+ *                    dst_ptr points into a swizzled tile
  */
 static void
 generate_blend(struct gallivm_state *gallivm,
@@ -699,7 +873,9 @@ generate_blend(struct gallivm_state *gallivm,
                LLVMValueRef context_ptr,
                LLVMValueRef mask,
                LLVMValueRef *src,
+               enum pipe_format format,
                LLVMValueRef dst_ptr,
+               LLVMValueRef dst_stride,
                boolean do_branch)
 {
    struct lp_build_context bld;
@@ -724,11 +900,17 @@ generate_blend(struct gallivm_state *gallivm,
                                 LLVMPointerType(vec_type, 0), "");
 
    /* load constant blend color and colors from the dest color buffer */
+   if (dst_stride) {
+      assert(type.width == 8 && type.length == 16);
+      load_linear_color(gallivm, format, dst_ptr, dst_stride, dst);
+   }
+
    for(chan = 0; chan < 4; ++chan) {
       LLVMValueRef index = lp_build_const_int32(gallivm, chan);
       con[chan] = LLVMBuildLoad(builder, LLVMBuildGEP(builder, const_ptr, &index, 1, ""), "");
 
-      dst[chan] = LLVMBuildLoad(builder, LLVMBuildGEP(builder, dst_ptr, &index, 1, ""), "");
+      if (!dst_stride)
+         dst[chan] = LLVMBuildLoad(builder, LLVMBuildGEP(builder, dst_ptr, &index, 1, ""), "");
 
       lp_build_name(con[chan], "con.%c", "rgba"[chan]);
       lp_build_name(dst[chan], "dst.%c", "rgba"[chan]);
@@ -743,10 +925,17 @@ generate_blend(struct gallivm_state *gallivm,
          LLVMValueRef index = lp_build_const_int32(gallivm, chan);
          lp_build_name(res[chan], "res.%c", "rgba"[chan]);
          res[chan] = lp_build_select(&bld, mask, res[chan], dst[chan]);
-         LLVMBuildStore(builder, res[chan], LLVMBuildGEP(builder, dst_ptr, &index, 1, ""));
+         if (!dst_stride)
+            LLVMBuildStore(builder, res[chan], LLVMBuildGEP(builder, dst_ptr, &index, 1, ""));
+      }
+      else {
+         res[chan] = dst[chan];
       }
    }
 
+   if (dst_stride)
+      store_linear_color(gallivm, format, dst_ptr, dst_stride, res);
+
    lp_build_mask_end(&mask_ctx);
 }
 
@@ -771,7 +960,7 @@ generate_fragment(struct llvmpipe_context *lp,
    struct lp_type blend_type;
    LLVMTypeRef fs_elem_type;
    LLVMTypeRef blend_vec_type;
-   LLVMTypeRef arg_types[11];
+   LLVMTypeRef arg_types[12];
    LLVMTypeRef func_type;
    LLVMTypeRef int32_type = LLVMInt32TypeInContext(gallivm->context);
    LLVMTypeRef int8_type = LLVMInt8TypeInContext(gallivm->context);
@@ -782,6 +971,7 @@ generate_fragment(struct llvmpipe_context *lp,
    LLVMValueRef dadx_ptr;
    LLVMValueRef dady_ptr;
    LLVMValueRef color_ptr_ptr;
+   LLVMValueRef color_stride_ptr;
    LLVMValueRef depth_ptr;
    LLVMValueRef mask_input;
    LLVMValueRef counter = NULL;
@@ -864,9 +1054,10 @@ generate_fragment(struct llvmpipe_context *lp,
    arg_types[5] = LLVMPointerType(fs_elem_type, 0);    /* dadx */
    arg_types[6] = LLVMPointerType(fs_elem_type, 0);    /* dady */
    arg_types[7] = LLVMPointerType(LLVMPointerType(blend_vec_type, 0), 0);  /* color */
-   arg_types[8] = LLVMPointerType(int8_type, 0);       /* depth */
-   arg_types[9] = int32_type;                          /* mask_input */
-   arg_types[10] = LLVMPointerType(int32_type, 0);     /* counter */
+   arg_types[8] = LLVMPointerType(int32_type, 0);      /* color_stride */
+   arg_types[9] = LLVMPointerType(int8_type, 0);       /* depth */
+   arg_types[10] = int32_type;                         /* mask_input */
+   arg_types[11] = LLVMPointerType(int32_type, 0);     /* counter */
 
    func_type = LLVMFunctionType(LLVMVoidTypeInContext(gallivm->context),
                                 arg_types, Elements(arg_types), 0);
@@ -891,8 +1082,9 @@ generate_fragment(struct llvmpipe_context *lp,
    dadx_ptr     = LLVMGetParam(function, 5);
    dady_ptr     = LLVMGetParam(function, 6);
    color_ptr_ptr = LLVMGetParam(function, 7);
-   depth_ptr    = LLVMGetParam(function, 8);
-   mask_input   = LLVMGetParam(function, 9);
+   color_stride_ptr = LLVMGetParam(function, 8);
+   depth_ptr    = LLVMGetParam(function, 9);
+   mask_input   = LLVMGetParam(function, 10);
 
    lp_build_name(context_ptr, "context");
    lp_build_name(x, "x");
@@ -901,11 +1093,12 @@ generate_fragment(struct llvmpipe_context *lp,
    lp_build_name(dadx_ptr, "dadx");
    lp_build_name(dady_ptr, "dady");
    lp_build_name(color_ptr_ptr, "color_ptr_ptr");
+   lp_build_name(color_stride_ptr, "color_stride_ptr");
    lp_build_name(depth_ptr, "depth");
    lp_build_name(mask_input, "mask_input");
 
    if (key->occlusion_count) {
-      counter = LLVMGetParam(function, 10);
+      counter = LLVMGetParam(function, 11);
       lp_build_name(counter, "counter");
    }
 
@@ -1046,6 +1239,7 @@ generate_fragment(struct llvmpipe_context *lp,
     */
    for(cbuf = 0; cbuf < key->nr_cbufs; cbuf++) {
       LLVMValueRef color_ptr;
+      LLVMValueRef color_stride;
       LLVMValueRef index = lp_build_const_int32(gallivm, cbuf);
       LLVMValueRef blend_in_color[TGSI_NUM_CHANNELS];
       unsigned rt;
@@ -1082,6 +1276,17 @@ generate_fragment(struct llvmpipe_context *lp,
                                 "");
       lp_build_name(color_ptr, "color_ptr%d", cbuf);
 
+      if (key->linear_cbufs & (1 << cbuf)) {
+         color_stride = LLVMBuildLoad(builder,
+                                      LLVMBuildGEP(builder, color_stride_ptr,
+                                                   &index, 1, ""),
+                                      "");
+         lp_build_name(color_stride, "color_stride%d", cbuf);
+      }
+      else {
+         color_stride = NULL;
+      }
+
       /* which blend/colormask state to use */
       rt = key->blend.independent_blend_enable ? cbuf : 0;
 
@@ -1103,7 +1308,9 @@ generate_fragment(struct llvmpipe_context *lp,
                         context_ptr,
                         blend_mask,
                         blend_in_color,
+                        key->cbuf_format[cbuf],
                         color_ptr,
+                        color_stride,
                         do_branch);
       }
    }
@@ -1127,7 +1334,8 @@ dump_fs_variant_key(const struct lp_fragment_shader_variant_key *key)
       debug_printf("flatshade = 1\n");
    }
    for (i = 0; i < key->nr_cbufs; ++i) {
-      debug_printf("cbuf_format[%u] = %s\n", i, util_format_name(key->cbuf_format[i]));
+      debug_printf("cbuf_format[%u] = %s%s\n", i, util_format_name(key->cbuf_format[i]),
+                   key->linear_cbufs & (1 << i) ? " (linear)" : "");
    }
    if (key->depth.enabled) {
       debug_printf("depth.format = %s\n", util_format_name(key->zsbuf_format));
@@ -1205,10 +1413,280 @@ lp_debug_fs_variant(const struct lp_fragment_shader_variant *variant)
    tgsi_dump(variant->shader->base.tokens, 0);
    dump_fs_variant_key(&variant->key);
    debug_printf("variant->opaque = %u\n", variant->opaque);
+   debug_printf("variant->hiz_cull = %u\n", variant->hiz_cull);
+   debug_printf("variant->hiz_update = %u\n", variant->hiz_update);
+   debug_printf("variant->hiz_invalidate = %u\n", variant->hiz_invalidate);
    debug_printf("\n");
 }
 
 
+/**
+ * Build the on-disk cache key for a fragment shader variant.
+ */
+static void
+make_cache_key(const struct lp_fragment_shader *shader,
+               const struct lp_fragment_shader_variant_key *key,
+               struct lp_disk_cache_key *cache_key)
+{
+   const struct tgsi_token *tokens = shader->base.tokens;
+
+   lp_disk_cache_key_init(cache_key);
+   lp_disk_cache_key_add(cache_key, tokens,
+                         tgsi_num_tokens(tokens) * sizeof tokens[0]);
+   lp_disk_cache_key_add(cache_key, key, shader->variant_key_size);
+}
+
+
+/**
+ * Find the functions of a variant whose module was loaded from the disk
+ * cache.  They are recognized by the suffix given in generate_fragment().
+ */
+static boolean
+find_cached_functions(struct lp_fragment_shader_variant *variant)
+{
+   LLVMValueRef func;
+
+   for (func = LLVMGetFirstFunction(variant->gallivm->module);
+        func;
+        func = LLVMGetNextFunction(func)) {
+      const char *name = LLVMGetValueName(func);
+      size_t len = strlen(name);
+      unsigned partial_mask;
+
+      if (LLVMIsDeclaration(func))
+         continue;
+
+      if (len > 8 && strcmp(name + len - 8, "_partial") == 0)
+         partial_mask = RAST_EDGE_TEST;
+      else if (len > 6 && strcmp(name + len - 6, "_whole") == 0)
+         partial_mask = RAST_WHOLE;
+      else
+         continue;
+
+      variant->function[partial_mask] = func;
+      variant->nr_instrs += lp_build_count_instructions(func);
+   }
+
+   return variant->function[RAST_EDGE_TEST] != NULL;
+}
+
+
+/**
+ * Optimized compilation of a variant, done by a compile thread.
+ */
+struct lp_fs_async_job
+{
+   struct lp_compile_job base;
+
+   /** The variant whose jit_function[] is replaced on completion */
+   struct lp_fragment_shader_variant *variant;
+
+   /** Holds the worker's module, types and functions */
+   struct lp_fragment_shader_variant optimized;
+
+   boolean use_cache;
+   struct lp_disk_cache_key cache_key;
+};
+
+
+/**
+ * Build the optimized functions into a module, which may be shared with
+ * other jobs.
+ */
+static void
+fs_async_build(struct lp_compile_job *base, struct gallivm_state *gallivm)
+{
+   struct lp_fs_async_job *job = (struct lp_fs_async_job *) base;
+   struct lp_fragment_shader_variant *optimized = &job->optimized;
+
+   optimized->gallivm = gallivm_reference(gallivm);
+
+   lp_jit_init_types(optimized);
+
+   /* generate_fragment() doesn't touch the context, which isn't ours */
+   generate_fragment(NULL, optimized->shader, optimized, RAST_EDGE_TEST);
+   if (optimized->opaque)
+      generate_fragment(NULL, optimized->shader, optimized, RAST_WHOLE);
+}
+
+
+/**
+ * Get the optimized code from the compiled module and swap it in.
+ */
+static void
+fs_async_finish(struct lp_compile_job *base, struct gallivm_state *gallivm)
+{
+   struct lp_fs_async_job *job = (struct lp_fs_async_job *) base;
+   struct lp_fragment_shader_variant *variant = job->variant;
+   struct lp_fragment_shader_variant *optimized = &job->optimized;
+   lp_jit_frag_func jit_edge, jit_whole;
+
+   jit_edge = (lp_jit_frag_func)
+         gallivm_jit_function(gallivm,
+                              optimized->function[RAST_EDGE_TEST]);
+   jit_whole = jit_edge;
+   if (optimized->function[RAST_WHOLE]) {
+      jit_whole = (lp_jit_frag_func)
+            gallivm_jit_function(gallivm,
+                                 optimized->function[RAST_WHOLE]);
+   }
+   optimized->jit_function[RAST_EDGE_TEST] = jit_edge;
+   optimized->jit_function[RAST_WHOLE] = jit_whole;
+
+   /*
+    * Swap the code in.  Rasterizer threads may be running the fallback
+    * code right now, which is fine as it stays around until the variant
+    * is destroyed; each pointer store is atomic, and either function is
+    * correct for any scene.
+    */
+   variant->jit_function[RAST_WHOLE] = jit_whole;
+   variant->jit_function[RAST_EDGE_TEST] = jit_edge;
+   variant->fallback = FALSE;
+}
+
+
+/**
+ * Compile a job in a module of its own.  This is used for jobs which
+ * store their module in the disk cache, and if batching fails.
+ */
+static void
+fs_async_compile(struct lp_compile_job *base, LLVMContextRef context)
+{
+   struct lp_fs_async_job *job = (struct lp_fs_async_job *) base;
+   struct gallivm_state *gallivm;
+
+   gallivm = gallivm_create_ext(context, 0);
+   if (gallivm) {
+      fs_async_build(base, gallivm);
+
+      if (job->use_cache)
+         lp_disk_cache_store(&job->cache_key, gallivm);
+
+      gallivm_compile_module(gallivm);
+      fs_async_finish(base, gallivm);
+      gallivm_destroy(gallivm);
+   }
+
+   if (job->use_cache) {
+      lp_disk_cache_key_cleanup(&job->cache_key);
+      job->use_cache = FALSE;
+   }
+}
+
+
+/**
+ * Free the optimized code.  Must run on the worker which compiled it.
+ */
+static void
+fs_async_destroy(struct lp_compile_job *base, LLVMContextRef context)
+{
+   struct lp_fs_async_job *job = (struct lp_fs_async_job *) base;
+   struct lp_fragment_shader_variant *optimized = &job->optimized;
+   unsigned i;
+
+   (void) context;
+
+   for (i = 0; i < Elements(optimized->function); i++) {
+      if (optimized->function[i]) {
+         gallivm_free_function(optimized->gallivm,
+                               optimized->function[i],
+                               optimized->jit_function[i]);
+      }
+   }
+
+   gallivm_destroy(optimized->gallivm);
+}
+
+
+/**
+ * Queue the optimized compilation of a variant which currently runs
+ * unoptimized code.
+ */
+static void
+submit_async_compile(struct lp_compile_queue *queue,
+                     struct lp_fragment_shader_variant *variant)
+{
+   struct lp_fs_async_job *job = CALLOC_STRUCT(lp_fs_async_job);
+   boolean use_cache = lp_disk_cache_enabled();
+
+   if (!job)
+      return;
+
+   job->base.execute = fs_async_compile;
+   job->base.worker = -1;
+   /* A cached module must hold just this variant's functions. */
+   if (!use_cache) {
+      job->base.build = fs_async_build;
+      job->base.finish = fs_async_finish;
+   }
+   job->variant = variant;
+   job->use_cache = use_cache;
+   if (use_cache)
+      make_cache_key(variant->shader, &variant->key, &job->cache_key);
+
+   job->optimized.shader = variant->shader;
+   job->optimized.no = variant->no;
+   job->optimized.opaque = variant->opaque;
+   memcpy(&job->optimized.key, &variant->key,
+          variant->shader->variant_key_size);
+
+   variant->async = job;
+
+   lp_compile_queue_submit(queue, &job->base);
+}
+
+
+/**
+ * Count a draw with a variant which runs unoptimized code, and queue its
+ * optimized compilation once it has been used for enough draws.  Variants
+ * which only serve the odd blit never pay for the full optimization.
+ */
+void
+llvmpipe_fs_variant_draw(struct llvmpipe_context *lp,
+                         struct lp_fragment_shader_variant *variant)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+
+   if (!variant->fallback || variant->async)
+      return;
+
+   if (++variant->num_draws >= screen->hot_draws)
+      submit_async_compile(screen->compile_queue, variant);
+}
+
+
+/**
+ * Stop or wait for the background compilation of a variant which is
+ * about to be destroyed, and free the optimized code.
+ */
+static void
+finish_async_compile(struct lp_compile_queue *queue,
+                     struct lp_fragment_shader_variant *variant)
+{
+   struct lp_fs_async_job *job = variant->async;
+
+   if (!lp_compile_queue_cancel(queue, &job->base))
+      lp_compile_queue_wait(queue, &job->base);
+
+   if (job->use_cache)
+      lp_disk_cache_key_cleanup(&job->cache_key);
+
+   variant->async = NULL;
+
+   if (!job->optimized.gallivm) {
+      FREE(job);
+      return;
+   }
+
+   /* The module belongs to the worker's context; free it there. */
+   job->base.execute = fs_async_destroy;
+   job->base.build = NULL;
+   job->base.finish = NULL;
+   job->base.detached = TRUE;
+   lp_compile_queue_submit(queue, &job->base);
+}
+
+
 /**
  * Generate a new fragment shader variant from the shader code and
  * other state indicated by the key.
@@ -1221,15 +1699,49 @@ generate_variant(struct llvmpipe_context *lp,
    struct lp_fragment_shader_variant *variant;
    const struct util_format_description *cbuf0_format_desc;
    boolean fullcolormask;
+   struct lp_disk_cache_key cache_key;
+   boolean use_cache = lp_disk_cache_enabled();
+   boolean cached = FALSE;
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+   struct lp_compile_queue *queue = screen->compile_queue;
+   boolean async = FALSE;
 
    variant = CALLOC_STRUCT(lp_fragment_shader_variant);
    if(!variant)
       return NULL;
 
-   variant->gallivm = gallivm_create();
+   if (use_cache) {
+      make_cache_key(shader, key, &cache_key);
+      variant->gallivm = lp_disk_cache_load(&cache_key);
+      if (variant->gallivm) {
+         cached = find_cached_functions(variant);
+         if (!cached) {
+            /* stale or foreign entry */
+            gallivm_destroy(variant->gallivm);
+            memset(variant->function, 0, sizeof variant->function);
+            variant->nr_instrs = 0;
+            variant->gallivm = NULL;
+         }
+      }
+   }
+
+   if (!variant->gallivm && queue) {
+      /*
+       * Quickly build unoptimized code to draw with while the optimized
+       * code is compiled in the background.
+       */
+      variant->gallivm = gallivm_create_ext(NULL, GALLIVM_CREATE_NO_OPT);
+      async = variant->gallivm != NULL;
+   }
+
    if (!variant->gallivm) {
-      FREE(variant);
-      return NULL;
+      variant->gallivm = gallivm_create();
+      if (!variant->gallivm) {
+         if (use_cache)
+            lp_disk_cache_key_cleanup(&cache_key);
+         FREE(variant);
+         return NULL;
+      }
    }
 
    variant->shader = shader;
@@ -1258,23 +1770,67 @@ generate_variant(struct llvmpipe_context *lp,
          !shader->info.base.uses_kill
          ? TRUE : FALSE;
 
+   /*
+    * Rejecting fragments ahead of the depth test is only invisible if
+    * failing it has no side effect (stencil) and the tested depth is the
+    * interpolated one.  Fully covered blocks can lower the bound when
+    * every fragment is guaranteed to reach the depth test and write.
+    */
+   if (key->depth.enabled) {
+      boolean less = (key->depth.func == PIPE_FUNC_LESS ||
+                      key->depth.func == PIPE_FUNC_LEQUAL);
+
+      variant->hiz_cull =
+            less &&
+            !key->stencil[0].enabled &&
+            !shader->info.base.writes_z &&
+            !(LP_PERF & PERF_NO_HIZ);
+
+      variant->hiz_update =
+            variant->hiz_cull &&
+            key->depth.writemask &&
+            !key->alpha.enabled &&
+            !shader->info.base.uses_kill;
+
+      variant->hiz_invalidate =
+            key->depth.writemask &&
+            !less &&
+            key->depth.func != PIPE_FUNC_EQUAL &&
+            key->depth.func != PIPE_FUNC_NEVER;
+   }
+
 
    if ((LP_DEBUG & DEBUG_FS) || (gallivm_debug & GALLIVM_DEBUG_IR)) {
       lp_debug_fs_variant(variant);
    }
 
    lp_jit_init_types(variant);
-   
-   if (variant->jit_function[RAST_EDGE_TEST] == NULL)
-      generate_fragment(lp, shader, variant, RAST_EDGE_TEST);
-
-   if (variant->jit_function[RAST_WHOLE] == NULL) {
-      if (variant->opaque) {
-         /* Specialized shader, which doesn't need to read the color buffer. */
-         generate_fragment(lp, shader, variant, RAST_WHOLE);
+
+   if (cached) {
+      LP_COUNT(nr_fs_cache_hits);
+   }
+   else {
+      if (variant->jit_function[RAST_EDGE_TEST] == NULL)
+         generate_fragment(lp, shader, variant, RAST_EDGE_TEST);
+
+      if (variant->jit_function[RAST_WHOLE] == NULL) {
+         if (variant->opaque) {
+            /* Specialized shader, which doesn't need to read the color buffer. */
+            generate_fragment(lp, shader, variant, RAST_WHOLE);
+         }
+      }
+
+      if (use_cache) {
+         LP_COUNT(nr_fs_cache_misses);
+         /* only optimized code goes to the disk cache */
+         if (!async)
+            lp_disk_cache_store(&cache_key, variant->gallivm);
       }
    }
 
+   if (use_cache)
+      lp_disk_cache_key_cleanup(&cache_key);
+
    /*
     * Compile everything
     */
@@ -1295,6 +1851,16 @@ generate_variant(struct llvmpipe_context *lp,
       variant->jit_function[RAST_WHOLE] = variant->jit_function[RAST_EDGE_TEST];
    }
 
+   /*
+    * Unoptimized code gets replaced once the variant proves hot, see
+    * llvmpipe_fs_variant_draw().
+    */
+   if (async) {
+      variant->fallback = TRUE;
+      if (screen->hot_draws == 0)
+         submit_async_compile(queue, variant);
+   }
+
    return variant;
 }
 
@@ -1431,6 +1997,14 @@ llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
                    lp->nr_fs_variants);
    }
 
+   if (variant->async) {
+      finish_async_compile(llvmpipe_screen(lp->pipe.screen)->compile_queue,
+                           variant);
+   }
+
+   if (lp->fs_variant == variant)
+      lp->fs_variant = NULL;
+
    /* free all the variant's JIT'd functions */
    for (i = 0; i < Elements(variant->function); i++) {
       if (variant->function[i]) {
@@ -1602,6 +2176,9 @@ make_variant_key(struct llvmpipe_context *lp,
 
       key->cbuf_format[i] = format;
 
+      if (llvmpipe_is_linear_render_format(format))
+         key->linear_cbufs |= 1 << i;
+
       format_desc = util_format_description(format);
       assert(format_desc->colorspace == UTIL_FORMAT_COLORSPACE_RGB ||
              format_desc->colorspace == UTIL_FORMAT_COLORSPACE_SRGB);
@@ -1753,6 +2330,7 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
    }
 
    /* Bind this variant */
+   lp->fs_variant = variant;
    lp_setup_set_fs_variant(lp->setup, variant);
 }
 
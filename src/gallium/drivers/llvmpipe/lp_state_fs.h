@@ -62,6 +62,7 @@ struct lp_fragment_shader_variant_key
    unsigned nr_samplers:8;	/* actually derivable from just the shader */
    unsigned flatshade:1;
    unsigned occlusion_count:1;
+   unsigned linear_cbufs:8;  /**< cbufs rendered to in linear layout */
 
    enum pipe_format zsbuf_format;
    enum pipe_format cbuf_format[PIPE_MAX_COLOR_BUFS];
@@ -78,12 +79,35 @@ struct lp_fs_variant_list_item
 };
 
 
+struct lp_fs_async_job;
+
+
 struct lp_fragment_shader_variant
 {
    struct lp_fragment_shader_variant_key key;
 
    boolean opaque;
 
+   /*
+    * Depth bounds ("hi-z") behaviour of the rasterizer for this variant:
+    * may reject blocks whose depth range is behind the tile's bound, may
+    * lower the bound of blocks it fully covers, or may raise depths so
+    * the bounds must be forgotten.
+    */
+   boolean hiz_cull;
+   boolean hiz_update;
+   boolean hiz_invalidate;
+
+   /**
+    * Set while jit_function[] points at unoptimized code, until the
+    * optimized code compiled in the background is swapped in.
+    */
+   volatile boolean fallback;
+   struct lp_fs_async_job *async;
+
+   /** Number of draws with the unoptimized code, before queueing async */
+   unsigned num_draws;
+
    struct gallivm_state *gallivm;
 
    LLVMTypeRef jit_context_ptr_type;
@@ -134,5 +158,9 @@ void
 llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
                                struct lp_fragment_shader_variant *variant);
 
+void
+llvmpipe_fs_variant_draw(struct llvmpipe_context *lp,
+                         struct lp_fragment_shader_variant *variant);
+
 
 #endif /* LP_STATE_FS_H_ */
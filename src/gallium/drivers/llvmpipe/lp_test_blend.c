@@ -729,6 +729,7 @@ blend_funcs[] = {
 const struct lp_type blend_types[] = {
    /* float, fixed,  sign,  norm, width, len */
    {   TRUE, FALSE,  TRUE, FALSE,    32,   4 }, /* f32 x 4 */
+   {   TRUE, FALSE,  TRUE, FALSE,    32,   8 }, /* f32 x 8 (AVX) */
    {  FALSE, FALSE, FALSE,  TRUE,     8,  16 }, /* u8n x 16 */
 };
 
@@ -765,6 +766,10 @@ test_all(unsigned verbose, FILE *fp)
                               *alpha_dst_factor == PIPE_BLENDFACTOR_SRC_ALPHA_SATURATE)
                               continue;
 
+                           /* AoS blending is only used with 128-bit vectors */
+                           if(mode == AoS && lp_type_width(*type) > 128)
+                              continue;
+
                            memset(&blend, 0, sizeof blend);
                            blend.rt[0].blend_enable      = 1;
                            blend.rt[0].rgb_func          = *rgb_func;
@@ -825,6 +830,9 @@ test_some(unsigned verbose, FILE *fp,
 
       type = &blend_types[rand() % num_types];
 
+      if(lp_type_width(*type) > 128)
+         mode = SoA;
+
       memset(&blend, 0, sizeof blend);
       blend.rt[0].blend_enable      = 1;
       blend.rt[0].rgb_func          = *rgb_func;
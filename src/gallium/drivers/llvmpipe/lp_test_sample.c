@@ -0,0 +1,632 @@
+/**************************************************************************
+ *
+ * Copyright 2013 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * @file
+ * Unit tests and throughput benchmark for SoA texture sampling.
+ *
+ * Samples a single level 2D texture for every combination of format, image
+ * filter and wrap mode in the tables below, checks the results against a
+ * reference computed with the util_format fetch functions, and reports
+ * the average number of cycles per pixel.
+ */
+
+
+#include "pipe/p_defines.h"
+#include "util/u_memory.h"
+#include "util/u_format.h"
+
+#include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_type.h"
+#include "gallivm/lp_bld_const.h"
+#include "gallivm/lp_bld_debug.h"
+#include "gallivm/lp_bld_sample.h"
+#include "lp_jit.h"
+#include "lp_test.h"
+
+
+#define TEX_SIZE 64
+
+/** Number of vectors sampled per timed run */
+#define NUM_VECTORS 64
+
+
+typedef void (*sample_test_ptr_t)(const float *s, const float *t, float *rgba);
+
+
+/**
+ * Dynamic sampler state reading the members of a lp_jit_texture through
+ * constant pointers, instead of the jit context.
+ */
+struct sample_test_dynamic_state
+{
+   struct lp_sampler_dynamic_state base;
+
+   const struct lp_jit_texture *texture;
+};
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "cycles_per_pixel\t"
+           "format\t"
+           "filter\t"
+           "wrap\n");
+
+   fflush(fp);
+}
+
+
+static void
+write_tsv_row(FILE *fp,
+              const struct util_format_description *desc,
+              unsigned filter,
+              unsigned wrap,
+              double cycles,
+              boolean success)
+{
+   fprintf(fp, "%s\t", success ? "pass" : "fail");
+
+   fprintf(fp, "%.1f\t", cycles);
+
+   fprintf(fp, "%s\t%s\t%s\n",
+           desc->short_name,
+           util_dump_tex_filter(filter, TRUE),
+           util_dump_tex_wrap(wrap, TRUE));
+
+   fflush(fp);
+}
+
+
+static void
+dump_sample_type(FILE *fp,
+                 const struct util_format_description *desc,
+                 unsigned filter,
+                 unsigned wrap)
+{
+   fprintf(fp, "format=%s filter=%s wrap=%s",
+           desc->short_name,
+           util_dump_tex_filter(filter, TRUE),
+           util_dump_tex_wrap(wrap, TRUE));
+
+   fprintf(fp, " ...\n");
+   fflush(fp);
+}
+
+
+static LLVMValueRef
+sample_texture_member(struct gallivm_state *gallivm,
+                      const void *member,
+                      LLVMTypeRef type,
+                      boolean emit_load)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMValueRef ptr;
+
+   ptr = lp_build_const_int_pointer(gallivm, member);
+   ptr = LLVMBuildBitCast(builder, ptr, LLVMPointerType(type, 0), "");
+
+   return emit_load ? LLVMBuildLoad(builder, ptr, "") : ptr;
+}
+
+
+static LLVMTypeRef
+int32_type(struct gallivm_state *gallivm)
+{
+   return LLVMInt32TypeInContext(gallivm->context);
+}
+
+
+static LLVMTypeRef
+float_type(struct gallivm_state *gallivm)
+{
+   return LLVMFloatTypeInContext(gallivm->context);
+}
+
+
+static LLVMTypeRef
+stride_array_type(struct gallivm_state *gallivm)
+{
+   return LLVMArrayType(int32_type(gallivm), LP_MAX_TEXTURE_LEVELS);
+}
+
+
+static LLVMTypeRef
+data_array_type(struct gallivm_state *gallivm)
+{
+   return LLVMArrayType(LLVMPointerType(LLVMInt8TypeInContext(gallivm->context), 0),
+                        LP_MAX_TEXTURE_LEVELS);
+}
+
+
+static LLVMTypeRef
+border_color_type(struct gallivm_state *gallivm)
+{
+   return LLVMArrayType(float_type(gallivm), 4);
+}
+
+
+#define SAMPLE_TEXTURE_MEMBER(_name, _type, _emit_load)  \
+   static LLVMValueRef \
+   sample_texture_##_name(const struct lp_sampler_dynamic_state *base, \
+                          struct gallivm_state *gallivm, \
+                          unsigned unit) \
+   { \
+      const struct sample_test_dynamic_state *state = \
+         (const struct sample_test_dynamic_state *)base; \
+      return sample_texture_member(gallivm, &state->texture->_name, \
+                                   _type(gallivm), _emit_load); \
+   }
+
+
+SAMPLE_TEXTURE_MEMBER(width,        int32_type, TRUE)
+SAMPLE_TEXTURE_MEMBER(height,       int32_type, TRUE)
+SAMPLE_TEXTURE_MEMBER(depth,        int32_type, TRUE)
+SAMPLE_TEXTURE_MEMBER(first_level,  int32_type, TRUE)
+SAMPLE_TEXTURE_MEMBER(last_level,   int32_type, TRUE)
+SAMPLE_TEXTURE_MEMBER(row_stride,   stride_array_type, FALSE)
+SAMPLE_TEXTURE_MEMBER(img_stride,   stride_array_type, FALSE)
+SAMPLE_TEXTURE_MEMBER(data,         data_array_type, FALSE)
+SAMPLE_TEXTURE_MEMBER(min_lod,      float_type, TRUE)
+SAMPLE_TEXTURE_MEMBER(max_lod,      float_type, TRUE)
+SAMPLE_TEXTURE_MEMBER(lod_bias,     float_type, TRUE)
+SAMPLE_TEXTURE_MEMBER(border_color, border_color_type, FALSE)
+
+
+static void
+init_dynamic_state(struct sample_test_dynamic_state *state,
+                   const struct lp_jit_texture *texture)
+{
+   memset(state, 0, sizeof *state);
+   state->base.width = sample_texture_width;
+   state->base.height = sample_texture_height;
+   state->base.depth = sample_texture_depth;
+   state->base.first_level = sample_texture_first_level;
+   state->base.last_level = sample_texture_last_level;
+   state->base.row_stride = sample_texture_row_stride;
+   state->base.img_stride = sample_texture_img_stride;
+   state->base.data_ptr = sample_texture_data;
+   state->base.min_lod = sample_texture_min_lod;
+   state->base.max_lod = sample_texture_max_lod;
+   state->base.lod_bias = sample_texture_lod_bias;
+   state->base.border_color = sample_texture_border_color;
+   state->texture = texture;
+}
+
+
+static LLVMValueRef
+add_sample_test(struct gallivm_state *gallivm,
+                const struct lp_sampler_static_state *static_state,
+                struct lp_sampler_dynamic_state *dynamic_state,
+                struct lp_type type)
+{
+   LLVMContextRef context = gallivm->context;
+   LLVMModuleRef module = gallivm->module;
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef vec_type = lp_build_vec_type(gallivm, type);
+   LLVMTypeRef args[3];
+   LLVMValueRef func;
+   LLVMValueRef s_ptr, t_ptr, rgba_ptr;
+   LLVMValueRef coords[4];
+   LLVMValueRef texel[4];
+   LLVMBasicBlockRef block;
+   unsigned chan;
+
+   args[0] = args[1] = args[2] = LLVMPointerType(vec_type, 0);
+
+   func = LLVMAddFunction(module, "sample",
+                          LLVMFunctionType(LLVMVoidTypeInContext(context),
+                                           args, Elements(args), 0));
+   LLVMSetFunctionCallConv(func, LLVMCCallConv);
+   s_ptr = LLVMGetParam(func, 0);
+   t_ptr = LLVMGetParam(func, 1);
+   rgba_ptr = LLVMGetParam(func, 2);
+
+   block = LLVMAppendBasicBlockInContext(context, func, "entry");
+   LLVMPositionBuilderAtEnd(builder, block);
+
+   coords[0] = LLVMBuildLoad(builder, s_ptr, "s");
+   coords[1] = LLVMBuildLoad(builder, t_ptr, "t");
+   coords[2] = LLVMConstNull(vec_type);
+   coords[3] = LLVMConstNull(vec_type);
+
+   lp_build_sample_soa(gallivm, static_state, dynamic_state, type,
+                       0, 2, coords, NULL, NULL, NULL, texel);
+
+   for (chan = 0; chan < 4; ++chan) {
+      LLVMValueRef index = lp_build_const_int32(gallivm, chan);
+      LLVMValueRef ptr = LLVMBuildGEP(builder, rgba_ptr, &index, 1, "");
+      LLVMBuildStore(builder, texel[chan], ptr);
+   }
+
+   LLVMBuildRetVoid(builder);
+
+   gallivm_verify_function(gallivm, func);
+
+   return func;
+}
+
+
+static int
+wrap_texel_coord(int i, int size, unsigned wrap)
+{
+   switch (wrap) {
+   case PIPE_TEX_WRAP_REPEAT:
+      i %= size;
+      return i < 0 ? i + size : i;
+   case PIPE_TEX_WRAP_CLAMP_TO_EDGE:
+      return CLAMP(i, 0, size - 1);
+   case PIPE_TEX_WRAP_MIRROR_REPEAT:
+      i %= 2 * size;
+      if (i < 0)
+         i += 2 * size;
+      return i >= size ? 2 * size - 1 - i : i;
+   default:
+      assert(0);
+      return 0;
+   }
+}
+
+
+static void
+fetch_texel_ref(const struct util_format_description *desc,
+                const struct lp_jit_texture *texture,
+                int x, int y,
+                float texel[4])
+{
+   const uint8_t *src = (const uint8_t *)texture->data[0];
+
+   src += y * texture->row_stride[0] + x * (desc->block.bits / 8);
+
+   desc->fetch_rgba_float(texel, src, 0, 0);
+}
+
+
+static void
+sample_ref(const struct util_format_description *desc,
+           const struct lp_jit_texture *texture,
+           unsigned filter, unsigned wrap,
+           float s, float t,
+           float rgba[4])
+{
+   const int width = texture->width;
+   const int height = texture->height;
+   float u = s * width;
+   float v = t * height;
+   unsigned chan;
+
+   if (filter == PIPE_TEX_FILTER_NEAREST) {
+      int x = wrap_texel_coord((int)floorf(u), width, wrap);
+      int y = wrap_texel_coord((int)floorf(v), height, wrap);
+      fetch_texel_ref(desc, texture, x, y, rgba);
+   }
+   else {
+      float texels[2][2][4];
+      float wx, wy;
+      int x0, y0, x[2], y[2];
+      unsigned i, j;
+
+      u -= 0.5f;
+      v -= 0.5f;
+      x0 = (int)floorf(u);
+      y0 = (int)floorf(v);
+      wx = u - x0;
+      wy = v - y0;
+
+      for (i = 0; i < 2; ++i) {
+         x[i] = wrap_texel_coord(x0 + i, width, wrap);
+         y[i] = wrap_texel_coord(y0 + i, height, wrap);
+      }
+
+      for (j = 0; j < 2; ++j)
+         for (i = 0; i < 2; ++i)
+            fetch_texel_ref(desc, texture, x[i], y[j], texels[j][i]);
+
+      for (chan = 0; chan < 4; ++chan) {
+         float top = texels[0][0][chan] +
+                     wx * (texels[0][1][chan] - texels[0][0][chan]);
+         float bottom = texels[1][0][chan] +
+                        wx * (texels[1][1][chan] - texels[1][0][chan]);
+         rgba[chan] = top + wy * (bottom - top);
+      }
+   }
+}
+
+
+/**
+ * Random normalized coordinate, spanning a few texture repetitions on
+ * either side of [0, 1].  The coordinates are kept away from texel
+ * boundaries so that nearest filtering picks the same texel regardless
+ * of the precision of the sampling path.
+ */
+static float
+random_coord(unsigned size)
+{
+   int texel = (int)(random_float() * 4 * size) - 2 * (int)size;
+   return (texel + 0.25f + 0.5f * random_float()) / size;
+}
+
+
+PIPE_ALIGN_STACK
+static boolean
+test_one(unsigned verbose,
+         FILE *fp,
+         const struct util_format_description *desc,
+         unsigned filter,
+         unsigned wrap)
+{
+   struct lp_type type = lp_type_float_vec(32, lp_native_vector_width);
+   const unsigned length = type.length;
+   const unsigned num_pixels = NUM_VECTORS * length;
+   const unsigned stride = desc->block.bits / 8;
+   /* the 8-bit fixed point path quantizes the filter weights */
+   const double eps = 4.0 / 255.0;
+   struct lp_sampler_static_state static_state;
+   struct sample_test_dynamic_state dynamic_state;
+   struct lp_jit_texture texture;
+   struct gallivm_state *gallivm;
+   LLVMValueRef func;
+   sample_test_ptr_t sample_test_ptr;
+   int64_t cycles[LP_TEST_NUM_SAMPLES];
+   double cycles_avg = 0.0;
+   float *texels, *s, *t, *rgba;
+   void *data;
+   boolean success = TRUE;
+   unsigned i, j, chan;
+
+   if (verbose >= 1)
+      dump_sample_type(stdout, desc, filter, wrap);
+
+   /* Random texture image */
+   data = align_malloc(TEX_SIZE * TEX_SIZE * stride, 16);
+   texels = MALLOC(TEX_SIZE * TEX_SIZE * 4 * sizeof *texels);
+   for (i = 0; i < TEX_SIZE * TEX_SIZE * 4; ++i)
+      texels[i] = random_float();
+   util_format_write_4f(desc->format,
+                        texels, TEX_SIZE * 4 * sizeof *texels,
+                        data, TEX_SIZE * stride,
+                        0, 0, TEX_SIZE, TEX_SIZE);
+   FREE(texels);
+
+   memset(&texture, 0, sizeof texture);
+   texture.width = TEX_SIZE;
+   texture.height = TEX_SIZE;
+   texture.depth = 1;
+   texture.row_stride[0] = TEX_SIZE * stride;
+   texture.img_stride[0] = TEX_SIZE * TEX_SIZE * stride;
+   texture.data[0] = data;
+
+   memset(&static_state, 0, sizeof static_state);
+   static_state.format = desc->format;
+   static_state.swizzle_r = PIPE_SWIZZLE_RED;
+   static_state.swizzle_g = PIPE_SWIZZLE_GREEN;
+   static_state.swizzle_b = PIPE_SWIZZLE_BLUE;
+   static_state.swizzle_a = PIPE_SWIZZLE_ALPHA;
+   static_state.target = PIPE_TEXTURE_2D;
+   static_state.pot_width = 1;
+   static_state.pot_height = 1;
+   static_state.pot_depth = 1;
+   static_state.wrap_s = wrap;
+   static_state.wrap_t = wrap;
+   static_state.wrap_r = wrap;
+   static_state.min_img_filter = filter;
+   static_state.mag_img_filter = filter;
+   static_state.min_mip_filter = PIPE_TEX_MIPFILTER_NONE;
+   static_state.normalized_coords = 1;
+
+   init_dynamic_state(&dynamic_state, &texture);
+
+   s = align_malloc(num_pixels * sizeof *s, 32);
+   t = align_malloc(num_pixels * sizeof *t, 32);
+   rgba = align_malloc(num_pixels * 4 * sizeof *rgba, 32);
+   for (i = 0; i < num_pixels; ++i) {
+      s[i] = random_coord(TEX_SIZE);
+      t[i] = random_coord(TEX_SIZE);
+   }
+
+   gallivm = gallivm_create();
+
+   func = add_sample_test(gallivm, &static_state, &dynamic_state.base, type);
+
+   gallivm_compile_module(gallivm);
+
+   sample_test_ptr = (sample_test_ptr_t)gallivm_jit_function(gallivm, func);
+
+   for (i = 0; i < LP_TEST_NUM_SAMPLES; ++i) {
+      int64_t start_counter = 0;
+      int64_t end_counter = 0;
+
+      start_counter = rdtsc();
+      for (j = 0; j < NUM_VECTORS; ++j) {
+         sample_test_ptr(s + j * length, t + j * length,
+                         rgba + j * 4 * length);
+      }
+      end_counter = rdtsc();
+
+      cycles[i] = end_counter - start_counter;
+   }
+
+   for (i = 0; i < num_pixels; ++i) {
+      const float *res = rgba + (i / length) * 4 * length + i % length;
+      float ref[4];
+      boolean match = TRUE;
+
+      sample_ref(desc, &texture, filter, wrap, s[i], t[i], ref);
+
+      for (chan = 0; chan < 4; ++chan) {
+         if (fabs(res[chan * length] - ref[chan]) > eps)
+            match = FALSE;
+      }
+
+      if (!match) {
+         success = FALSE;
+
+         if (verbose < 1)
+            dump_sample_type(stderr, desc, filter, wrap);
+         fprintf(stderr, "MISMATCH\n");
+         fprintf(stderr, "  Coord: %f %f\n", s[i], t[i]);
+         fprintf(stderr, "  Res: %f %f %f %f\n",
+                 res[0], res[length], res[2 * length], res[3 * length]);
+         fprintf(stderr, "  Ref: %f %f %f %f\n",
+                 ref[0], ref[1], ref[2], ref[3]);
+         break;
+      }
+   }
+
+   /*
+    * Unfortunately the output of cycle counter is not very reliable as it comes
+    * -- sometimes we get outliers (due IRQs perhaps?) which are
+    * better removed to avoid random or biased data.
+    */
+   {
+      double sum = 0.0, sum2 = 0.0;
+      double avg, std;
+      unsigned m;
+
+      for (i = 0; i < LP_TEST_NUM_SAMPLES; ++i) {
+         sum += cycles[i];
+         sum2 += cycles[i]*cycles[i];
+      }
+
+      avg = sum/LP_TEST_NUM_SAMPLES;
+      std = sqrtf((sum2 - LP_TEST_NUM_SAMPLES*avg*avg)/LP_TEST_NUM_SAMPLES);
+
+      m = 0;
+      sum = 0.0;
+      for (i = 0; i < LP_TEST_NUM_SAMPLES; ++i) {
+         if (fabs(cycles[i] - avg) <= 4.0*std) {
+            sum += cycles[i];
+            ++m;
+         }
+      }
+
+      cycles_avg = sum/m/num_pixels;
+   }
+
+   if (verbose >= 1)
+      printf("  %.1f cycles/pixel\n", cycles_avg);
+
+   if (fp)
+      write_tsv_row(fp, desc, filter, wrap, cycles_avg, success);
+
+   gallivm_free_function(gallivm, func, sample_test_ptr);
+
+   gallivm_destroy(gallivm);
+
+   align_free(s);
+   align_free(t);
+   align_free(rgba);
+   align_free(data);
+
+   return success;
+}
+
+
+static const enum pipe_format
+sample_formats[] = {
+   PIPE_FORMAT_B8G8R8A8_UNORM,
+   PIPE_FORMAT_R8G8B8A8_UNORM,
+   PIPE_FORMAT_B5G6R5_UNORM,
+   PIPE_FORMAT_L8_UNORM,
+   PIPE_FORMAT_A8_UNORM,
+   PIPE_FORMAT_L8A8_UNORM,
+   PIPE_FORMAT_R16_UNORM,
+   PIPE_FORMAT_R16G16B16A16_UNORM,
+   PIPE_FORMAT_R32_FLOAT,
+   PIPE_FORMAT_R32G32B32A32_FLOAT,
+};
+
+
+static const unsigned
+sample_filters[] = {
+   PIPE_TEX_FILTER_NEAREST,
+   PIPE_TEX_FILTER_LINEAR,
+};
+
+
+static const unsigned
+sample_wraps[] = {
+   PIPE_TEX_WRAP_REPEAT,
+   PIPE_TEX_WRAP_CLAMP_TO_EDGE,
+   PIPE_TEX_WRAP_MIRROR_REPEAT,
+};
+
+
+boolean
+test_all(unsigned verbose, FILE *fp)
+{
+   unsigned i, j, k;
+   boolean success = TRUE;
+
+   for (i = 0; i < Elements(sample_formats); ++i) {
+      const struct util_format_description *desc =
+         util_format_description(sample_formats[i]);
+
+      for (j = 0; j < Elements(sample_filters); ++j)
+         for (k = 0; k < Elements(sample_wraps); ++k)
+            if (!test_one(verbose, fp, desc, sample_filters[j], sample_wraps[k]))
+               success = FALSE;
+   }
+
+   return success;
+}
+
+
+boolean
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   unsigned i;
+   boolean success = TRUE;
+
+   for (i = 0; i < n; ++i) {
+      const struct util_format_description *desc =
+         util_format_description(sample_formats[rand() % Elements(sample_formats)]);
+      unsigned filter = sample_filters[rand() % Elements(sample_filters)];
+      unsigned wrap = sample_wraps[rand() % Elements(sample_wraps)];
+
+      if (!test_one(verbose, fp, desc, filter, wrap))
+         success = FALSE;
+   }
+
+   return success;
+}
+
+
+boolean
+test_single(unsigned verbose, FILE *fp)
+{
+   const struct util_format_description *desc =
+      util_format_description(PIPE_FORMAT_B8G8R8A8_UNORM);
+
+   return test_one(verbose, fp, desc,
+                   PIPE_TEX_FILTER_LINEAR, PIPE_TEX_WRAP_REPEAT);
+}
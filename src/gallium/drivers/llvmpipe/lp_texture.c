@@ -50,6 +50,7 @@
 #include "lp_texture.h"
 #include "lp_setup.h"
 #include "lp_state.h"
+#include "lp_debug.h"
 
 #include "state_tracker/sw_winsys.h"
 
@@ -1374,6 +1375,78 @@ llvmpipe_swizzle_cbuf_tile(struct llvmpipe_resource *lpr,
 }
 
 
+/**
+ * Whether color buffers of the given format are rendered to directly in
+ * their linear image, instead of through swizzled tiles.
+ *
+ * This is the case for 8-bit unorm RGBA/RGBX formats, where the
+ * fragment shader can convert between the pixels and the SoA layout with
+ * byte shuffles alone.
+ */
+boolean
+llvmpipe_is_linear_render_format(enum pipe_format format)
+{
+   const struct util_format_description *desc;
+   unsigned chan;
+
+#ifndef PIPE_ARCH_LITTLE_ENDIAN
+   /* The byte shuffles assume a little endian pixel layout */
+   return FALSE;
+#endif
+
+   if (LP_PERF & PERF_NO_LINEAR_CBUF)
+      return FALSE;
+
+   desc = util_format_description(format);
+   if (!desc ||
+       desc->layout != UTIL_FORMAT_LAYOUT_PLAIN ||
+       desc->colorspace != UTIL_FORMAT_COLORSPACE_RGB ||
+       desc->block.width != 1 ||
+       desc->block.height != 1 ||
+       desc->block.bits != 32 ||
+       desc->nr_channels != 4)
+      return FALSE;
+
+   for (chan = 0; chan < 4; chan++) {
+      const struct util_format_channel_description *channel =
+         &desc->channel[chan];
+
+      if (channel->size != 8)
+         return FALSE;
+
+      if (channel->type == UTIL_FORMAT_TYPE_VOID)
+         continue;
+
+      if (channel->type != UTIL_FORMAT_TYPE_UNSIGNED ||
+          !channel->normalized)
+         return FALSE;
+   }
+
+   /* r, g, b must each come from a distinct byte; alpha from one too,
+    * unless there's none (X formats).
+    */
+   for (chan = 0; chan < 4; chan++) {
+      const unsigned swizzle = desc->swizzle[chan];
+
+      if (swizzle > UTIL_FORMAT_SWIZZLE_W) {
+         if (chan == 3 && swizzle == UTIL_FORMAT_SWIZZLE_1)
+            continue;
+         return FALSE;
+      }
+
+      if (desc->channel[swizzle].type == UTIL_FORMAT_TYPE_VOID)
+         return FALSE;
+   }
+
+   if (desc->swizzle[0] == desc->swizzle[1] ||
+       desc->swizzle[0] == desc->swizzle[2] ||
+       desc->swizzle[1] == desc->swizzle[2])
+      return FALSE;
+
+   return TRUE;
+}
+
+
 /**
  * Return size of resource in bytes
  */
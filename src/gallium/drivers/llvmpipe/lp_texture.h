@@ -233,6 +233,9 @@ llvmpipe_swizzle_cbuf_tile(struct llvmpipe_resource *lpr,
                            unsigned x, unsigned y,
                            uint8_t *tile);
 
+boolean
+llvmpipe_is_linear_render_format(enum pipe_format format);
+
 extern void
 llvmpipe_print_resources(void);
 
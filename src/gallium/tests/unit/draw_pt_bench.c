@@ -0,0 +1,381 @@
+/**************************************************************************
+ *
+ * Copyright 2013 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Microbenchmark for the draw module's vertex pipeline.
+ *
+ * Pushes large batches of triangles through draw_vbo() into a vbuf
+ * backend that only discards the emitted vertices, so that the time
+ * measured is spent in the draw_pt middle ends (fetch, shade, clip,
+ * emit).  Both the LLVM and the interpreted middle ends are timed, and
+ * each is run with all vertices inside the view volume and with part of
+ * them outside, which forces the clipping pipeline.
+ *
+ * DRAW_FUSED_EMIT=0 can be used to compare the fused LLVM emit path
+ * against the separate emit pass.
+ */
+
+
+#include <stdio.h>
+
+#include "pipe/p_context.h"
+#include "pipe/p_screen.h"
+#include "pipe/p_state.h"
+#include "draw/draw_context.h"
+#include "draw/draw_vbuf.h"
+#include "draw/draw_vertex.h"
+#include "tgsi/tgsi_text.h"
+#include "util/u_debug.h"
+#include "util/u_draw.h"
+#include "util/u_inlines.h"
+#include "util/u_memory.h"
+#include "os/os_time.h"
+#include "sw/null/null_sw_winsys.h"
+#include "softpipe/sp_public.h"
+
+
+#define NUM_VERTS (3 * 4096)
+#define NUM_ITERATIONS 200
+
+
+struct bench_vertex {
+   float pos[4];
+   float color[4];
+};
+
+
+/**
+ * vbuf backend that emits into a malloc'ed buffer and never rasterizes.
+ */
+struct bench_render {
+   struct vbuf_render base;
+   struct vertex_info vinfo;
+   void *vertices;
+   unsigned vertex_buffer_size;
+   unsigned num_prims;
+};
+
+
+static INLINE struct bench_render *
+bench_render(struct vbuf_render *vbr)
+{
+   return (struct bench_render *)vbr;
+}
+
+
+static const struct vertex_info *
+bench_get_vertex_info(struct vbuf_render *vbr)
+{
+   return &bench_render(vbr)->vinfo;
+}
+
+
+static boolean
+bench_allocate_vertices(struct vbuf_render *vbr,
+                        ushort vertex_size, ushort nr_vertices)
+{
+   struct bench_render *br = bench_render(vbr);
+   unsigned size = vertex_size * nr_vertices;
+
+   if (size > br->vertex_buffer_size) {
+      align_free(br->vertices);
+      br->vertices = align_malloc(size, 16);
+      br->vertex_buffer_size = br->vertices ? size : 0;
+   }
+
+   return br->vertices != NULL;
+}
+
+
+static void *
+bench_map_vertices(struct vbuf_render *vbr)
+{
+   return bench_render(vbr)->vertices;
+}
+
+
+static void
+bench_unmap_vertices(struct vbuf_render *vbr, ushort min_index, ushort max_index)
+{
+}
+
+
+static void
+bench_set_primitive(struct vbuf_render *vbr, unsigned prim)
+{
+}
+
+
+static void
+bench_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
+{
+   bench_render(vbr)->num_prims += nr / 3;
+}
+
+
+static void
+bench_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
+{
+   bench_render(vbr)->num_prims += nr / 3;
+}
+
+
+static void
+bench_release_vertices(struct vbuf_render *vbr)
+{
+}
+
+
+static void
+bench_destroy(struct vbuf_render *vbr)
+{
+   struct bench_render *br = bench_render(vbr);
+
+   align_free(br->vertices);
+   FREE(br);
+}
+
+
+static struct bench_render *
+bench_render_create(void)
+{
+   struct bench_render *br = CALLOC_STRUCT(bench_render);
+
+   if (!br)
+      return NULL;
+
+   br->base.max_indices = 16 * 1024;
+   br->base.max_vertex_buffer_bytes = 4 * 1024 * 1024;
+   br->base.get_vertex_info = bench_get_vertex_info;
+   br->base.allocate_vertices = bench_allocate_vertices;
+   br->base.map_vertices = bench_map_vertices;
+   br->base.unmap_vertices = bench_unmap_vertices;
+   br->base.set_primitive = bench_set_primitive;
+   br->base.draw_elements = bench_draw_elements;
+   br->base.draw_arrays = bench_draw_arrays;
+   br->base.release_vertices = bench_release_vertices;
+   br->base.destroy = bench_destroy;
+
+   /* Same layout softpipe and llvmpipe use: position followed by color. */
+   draw_emit_vertex_attr(&br->vinfo, EMIT_4F, INTERP_POS, 0);
+   draw_emit_vertex_attr(&br->vinfo, EMIT_4F, INTERP_PERSPECTIVE, 1);
+   draw_compute_vertex_size(&br->vinfo);
+
+   return br;
+}
+
+
+static const char vs_text[] =
+   "VERT\n"
+   "DCL IN[0]\n"
+   "DCL IN[1]\n"
+   "DCL OUT[0], POSITION\n"
+   "DCL OUT[1], COLOR\n"
+   "DCL CONST[0..3]\n"
+   "DCL TEMP[0]\n"
+   "  0: MUL TEMP[0], IN[0].xxxx, CONST[0]\n"
+   "  1: MAD TEMP[0], IN[0].yyyy, CONST[1], TEMP[0]\n"
+   "  2: MAD TEMP[0], IN[0].zzzz, CONST[2], TEMP[0]\n"
+   "  3: MAD OUT[0], IN[0].wwww, CONST[3], TEMP[0]\n"
+   "  4: MOV OUT[1], IN[1]\n"
+   "  5: END\n";
+
+
+static const float identity[16] = {
+   1.0f, 0.0f, 0.0f, 0.0f,
+   0.0f, 1.0f, 0.0f, 0.0f,
+   0.0f, 0.0f, 1.0f, 0.0f,
+   0.0f, 0.0f, 0.0f, 1.0f
+};
+
+
+static void
+init_vertices(struct bench_vertex *verts, boolean clipped)
+{
+   unsigned i;
+
+   for (i = 0; i < NUM_VERTS; ++i) {
+      float x = (float)(i % 64) / 32.0f - 1.0f;
+      float y = (float)((i / 64) % 64) / 32.0f - 1.0f;
+
+      /* Push every fourth triangle partially outside the view volume. */
+      if (clipped && (i / 3) % 4 == 0 && i % 3 == 0)
+         x += 4.0f;
+
+      verts[i].pos[0] = x;
+      verts[i].pos[1] = y;
+      verts[i].pos[2] = 0.5f;
+      verts[i].pos[3] = 1.0f;
+      verts[i].color[0] = 1.0f;
+      verts[i].color[1] = 0.5f;
+      verts[i].color[2] = 0.25f;
+      verts[i].color[3] = 1.0f;
+   }
+}
+
+
+static void
+run_bench(struct pipe_context *pipe, boolean use_llvm, boolean clipped)
+{
+   struct draw_context *draw;
+   struct bench_render *br;
+   struct draw_stage *stage;
+   struct draw_vertex_shader *vs;
+   struct tgsi_token tokens[1024];
+   struct pipe_shader_state vs_state;
+   struct pipe_rasterizer_state rast;
+   struct pipe_viewport_state viewport;
+   struct pipe_vertex_element velems[2];
+   struct pipe_vertex_buffer vbuf;
+   struct pipe_draw_info info;
+   struct bench_vertex *verts;
+   int64_t start, end;
+   unsigned i, warm_up;
+   double secs;
+
+   draw = use_llvm ? draw_create(pipe) : draw_create_no_llvm(pipe);
+   if (!draw) {
+      printf("failed to create draw context\n");
+      return;
+   }
+
+   br = bench_render_create();
+   stage = draw_vbuf_stage(draw, &br->base);
+   draw_set_rasterize_stage(draw, stage);
+   draw_set_render(draw, &br->base);
+
+   if (!tgsi_text_translate(vs_text, tokens, Elements(tokens))) {
+      printf("failed to translate vertex shader\n");
+      return;
+   }
+   memset(&vs_state, 0, sizeof vs_state);
+   vs_state.tokens = tokens;
+   vs = draw_create_vertex_shader(draw, &vs_state);
+   draw_bind_vertex_shader(draw, vs);
+   draw_set_mapped_constant_buffer(draw, PIPE_SHADER_VERTEX, 0,
+                                   identity, sizeof identity);
+
+   memset(&rast, 0, sizeof rast);
+   rast.cull_face = PIPE_FACE_NONE;
+   rast.gl_rasterization_rules = 1;
+   rast.depth_clip = 1;
+   draw_set_rasterizer_state(draw, &rast, &rast);
+
+   viewport.scale[0] = 512.0f;
+   viewport.scale[1] = 512.0f;
+   viewport.scale[2] = 0.5f;
+   viewport.scale[3] = 1.0f;
+   viewport.translate[0] = 512.0f;
+   viewport.translate[1] = 512.0f;
+   viewport.translate[2] = 0.5f;
+   viewport.translate[3] = 0.0f;
+   draw_set_viewport_state(draw, &viewport);
+
+   memset(velems, 0, sizeof velems);
+   velems[0].src_offset = Offset(struct bench_vertex, pos);
+   velems[0].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+   velems[1].src_offset = Offset(struct bench_vertex, color);
+   velems[1].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+   draw_set_vertex_elements(draw, 2, velems);
+
+   verts = align_malloc(NUM_VERTS * sizeof *verts, 16);
+   init_vertices(verts, clipped);
+
+   memset(&vbuf, 0, sizeof vbuf);
+   vbuf.stride = sizeof *verts;
+   vbuf.user_buffer = verts;
+   draw_set_vertex_buffers(draw, 1, &vbuf);
+   draw_set_mapped_vertex_buffer(draw, 0, verts);
+
+   util_draw_init_info(&info);
+   info.mode = PIPE_PRIM_TRIANGLES;
+   info.count = NUM_VERTS;
+
+   /*
+    * Warm up: compiles the shader variants, and draws enough vertices for
+    * them to be recompiled optimized.
+    */
+   warm_up = debug_get_num_option("DRAW_HOT_VERTICES",
+                                  DRAW_DEFAULT_HOT_VERTICES) / NUM_VERTS + 1;
+   for (i = 0; i < warm_up; ++i) {
+      draw_vbo(draw, &info);
+      draw_flush(draw);
+   }
+   draw_finish_shader_compiles(draw);
+   br->num_prims = 0;
+
+   start = os_time_get();
+   for (i = 0; i < NUM_ITERATIONS; ++i) {
+      draw_vbo(draw, &info);
+      draw_flush(draw);
+   }
+   end = os_time_get();
+
+   secs = (end - start) / 1.0e6;
+   printf("%-6s %-9s %10.3f Mverts/s %10.3f Mprims/s\n",
+          use_llvm ? "llvm" : "tgsi",
+          clipped ? "clipped" : "unclipped",
+          NUM_VERTS * (double)NUM_ITERATIONS / secs / 1.0e6,
+          br->num_prims / secs / 1.0e6);
+
+   draw_set_mapped_vertex_buffer(draw, 0, NULL);
+   draw_delete_vertex_shader(draw, vs);
+   draw_destroy(draw);
+   align_free(verts);
+}
+
+
+int main(int argc, char** argv)
+{
+   struct sw_winsys *winsys;
+   struct pipe_screen *screen;
+   struct pipe_context *pipe;
+
+   winsys = null_sw_create();
+   if (!winsys)
+      return 1;
+
+   screen = softpipe_create_screen(winsys);
+   if (!screen)
+      return 1;
+
+   pipe = screen->context_create(screen, NULL);
+   if (!pipe)
+      return 1;
+
+#if HAVE_LLVM
+   run_bench(pipe, TRUE, FALSE);
+   run_bench(pipe, TRUE, TRUE);
+#endif
+   run_bench(pipe, FALSE, FALSE);
+   run_bench(pipe, FALSE, TRUE);
+
+   pipe->destroy(pipe);
+   screen->destroy(screen);
+
+   return 0;
+}
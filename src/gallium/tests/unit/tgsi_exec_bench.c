@@ -0,0 +1,197 @@
+/**************************************************************************
+ *
+ * Copyright 2013 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Microbenchmark for the TGSI interpreter.
+ *
+ * Runs a few representative vertex shaders over many quads and prints
+ * the time taken along with a checksum of the outputs.  Run it once as
+ * is and once with TGSI_NO_PREDECODE=1 to compare the predecoded fast
+ * paths with the generic instruction dispatch; the checksums must match.
+ */
+
+
+#include <stdio.h>
+
+#include "tgsi/tgsi_exec.h"
+#include "tgsi/tgsi_text.h"
+#include "util/u_memory.h"
+#include "os/os_time.h"
+
+
+#define NUM_QUADS (64 * 1024)
+
+
+struct bench_shader {
+   const char *name;
+   const char *text;
+   unsigned num_outputs;
+};
+
+
+static const struct bench_shader shaders[] = {
+   {
+      "transform",
+      "VERT\n"
+      "DCL IN[0]\n"
+      "DCL IN[1]\n"
+      "DCL OUT[0], POSITION\n"
+      "DCL OUT[1], COLOR\n"
+      "DCL CONST[0..7]\n"
+      "  0: DP4 OUT[0].x, IN[0], CONST[0]\n"
+      "  1: DP4 OUT[0].y, IN[0], CONST[1]\n"
+      "  2: DP4 OUT[0].z, IN[0], CONST[2]\n"
+      "  3: DP4 OUT[0].w, IN[0], CONST[3]\n"
+      "  4: MOV OUT[1], IN[1]\n"
+      "  5: END\n",
+      2
+   },
+   {
+      "lighting",
+      "VERT\n"
+      "DCL IN[0]\n"
+      "DCL IN[1]\n"
+      "DCL OUT[0], POSITION\n"
+      "DCL OUT[1], COLOR\n"
+      "DCL CONST[0..7]\n"
+      "DCL TEMP[0..3]\n"
+      "IMM FLT32 { 0.0000, 1.0000, 0.5000, 2.0000 }\n"
+      "  0: MUL TEMP[0], IN[0].xxxx, CONST[0]\n"
+      "  1: MAD TEMP[0], IN[0].yyyy, CONST[1], TEMP[0]\n"
+      "  2: MAD TEMP[0], IN[0].zzzz, CONST[2], TEMP[0]\n"
+      "  3: MAD OUT[0], IN[0].wwww, CONST[3], TEMP[0]\n"
+      "  4: DP3 TEMP[1].x, IN[1], IN[1]\n"
+      "  5: RSQ TEMP[1].x, TEMP[1].xxxx\n"
+      "  6: MUL TEMP[1].xyz, IN[1], TEMP[1].xxxx\n"
+      "  7: DP3 TEMP[2].x, TEMP[1], CONST[4]\n"
+      "  8: MAX TEMP[2].x, TEMP[2].xxxx, IMM[0].xxxx\n"
+      "  9: SUB TEMP[3], CONST[5], -TEMP[1].zyxw\n"
+      " 10: LRP TEMP[3], TEMP[2].xxxx, TEMP[3], CONST[6]\n"
+      " 11: SGE TEMP[2].y, TEMP[2].xxxx, IMM[0].zzzz\n"
+      " 12: MAD_SAT OUT[1], TEMP[3], IMM[0].zzzz, |TEMP[2].yyyy|\n"
+      " 13: MIN OUT[1].w, CONST[7].xxxx, IMM[0].yyyy\n"
+      " 14: END\n",
+      2
+   },
+   {
+      "branchy",
+      "VERT\n"
+      "DCL IN[0]\n"
+      "DCL IN[1]\n"
+      "DCL OUT[0], POSITION\n"
+      "DCL OUT[1], COLOR\n"
+      "DCL CONST[0..7]\n"
+      "DCL TEMP[0..1]\n"
+      "IMM FLT32 { 0.0000, 1.0000, 0.5000, 2.0000 }\n"
+      "  0: DP4 OUT[0].x, IN[0], CONST[0]\n"
+      "  1: DP4 OUT[0].y, IN[0], CONST[1]\n"
+      "  2: DP4 OUT[0].z, IN[0], CONST[2]\n"
+      "  3: DP4 OUT[0].w, IN[0], CONST[3]\n"
+      "  4: SLT TEMP[0].x, IN[1].xxxx, IMM[0].zzzz\n"
+      "  5: IF TEMP[0].xxxx :8\n"
+      "  6:   MUL TEMP[1], IN[1], IMM[0].wwww\n"
+      "  7: ELSE :9\n"
+      "  8:   ADD TEMP[1], IN[1], -IMM[0].zzzz\n"
+      "  9: ENDIF\n"
+      " 10: MOV_SAT OUT[1], TEMP[1].wzyx\n"
+      " 11: END\n",
+      2
+   }
+};
+
+
+static float constants[8 * 4];
+
+
+static void
+run_shader(struct tgsi_exec_machine *mach, const struct bench_shader *shader)
+{
+   struct tgsi_token tokens[1024];
+   const void *bufs[1];
+   unsigned sizes[1];
+   int64_t start, end;
+   double checksum = 0.0;
+   unsigned quad, i, j;
+
+   if (!tgsi_text_translate(shader->text, tokens, Elements(tokens))) {
+      printf("%s: failed to translate shader\n", shader->name);
+      return;
+   }
+
+   bufs[0] = constants;
+   sizes[0] = sizeof constants;
+   tgsi_exec_set_constant_buffers(mach, 1, bufs, sizes);
+   tgsi_exec_machine_bind_shader(mach, tokens, 0, NULL);
+
+   start = os_time_get();
+   for (quad = 0; quad < NUM_QUADS; quad++) {
+      for (i = 0; i < 2; i++) {
+         for (j = 0; j < TGSI_QUAD_SIZE; j++) {
+            float v = (float)((quad * 4 + j) % 97) / 97.0f;
+            mach->Inputs[i].xyzw[0].f[j] = v;
+            mach->Inputs[i].xyzw[1].f[j] = 1.0f - v;
+            mach->Inputs[i].xyzw[2].f[j] = v * 0.5f + (float) i;
+            mach->Inputs[i].xyzw[3].f[j] = 1.0f;
+         }
+      }
+
+      tgsi_exec_machine_run(mach);
+
+      for (i = 0; i < shader->num_outputs; i++)
+         for (j = 0; j < TGSI_NUM_CHANNELS; j++)
+            checksum += mach->Outputs[i].xyzw[j].f[quad % TGSI_QUAD_SIZE];
+   }
+   end = os_time_get();
+
+   printf("%-10s %8.3f Mverts/s  checksum %.6f\n",
+          shader->name,
+          NUM_QUADS * TGSI_QUAD_SIZE / ((end - start) / 1.0e6) / 1.0e6,
+          checksum);
+
+   tgsi_exec_machine_bind_shader(mach, NULL, 0, NULL);
+}
+
+
+int main(int argc, char** argv)
+{
+   struct tgsi_exec_machine *mach;
+   unsigned i;
+
+   for (i = 0; i < Elements(constants); i++)
+      constants[i] = (float)((i * 7) % 11) / 11.0f - 0.25f;
+
+   mach = tgsi_exec_machine_create();
+   if (!mach)
+      return 1;
+
+   for (i = 0; i < Elements(shaders); i++)
+      run_shader(mach, &shaders[i]);
+
+   tgsi_exec_machine_destroy(mach);
+
+   return 0;
+}
@@ -29,6 +29,7 @@
 #include "util/u_format.h"
 #include "util/u_half.h"
 #include "util/u_cpu_detect.h"
+#include "os/os_time.h"
 #include "rtasm/rtasm_cpu.h"
 
 /* don't use this for serious use */
@@ -46,6 +47,142 @@ static double rand_double()
    return v;
 }
 
+
+#define BENCH_VERTS 4096
+#define BENCH_RUNS 256
+
+struct bench_element {
+   enum pipe_format input_format;
+   enum pipe_format output_format;
+};
+
+/* Vertex layouts to measure the translate throughput with. */
+static const struct bench_key {
+   const char *name;
+   unsigned nr_elements;
+   struct bench_element element[4];
+} bench_keys[] = {
+   { "copy f32x3", 1,
+     { { PIPE_FORMAT_R32G32B32_FLOAT, PIPE_FORMAT_R32G32B32_FLOAT } } },
+   { "unorm8x4", 1,
+     { { PIPE_FORMAT_R8G8B8A8_UNORM, PIPE_FORMAT_R32G32B32A32_FLOAT } } },
+   { "snorm16x3", 1,
+     { { PIPE_FORMAT_R16G16B16_SNORM, PIPE_FORMAT_R32G32B32_FLOAT } } },
+   { "half16x2", 1,
+     { { PIPE_FORMAT_R16G16_FLOAT, PIPE_FORMAT_R32G32_FLOAT } } },
+   { "double64x3", 1,
+     { { PIPE_FORMAT_R64G64B64_FLOAT, PIPE_FORMAT_R32G32B32_FLOAT } } },
+   { "unorm10x3", 1,
+     { { PIPE_FORMAT_R10G10B10A2_UNORM, PIPE_FORMAT_R32G32B32A32_FLOAT } } },
+   { "pack unorm8x4", 1,
+     { { PIPE_FORMAT_R32G32B32A32_FLOAT, PIPE_FORMAT_R8G8B8A8_UNORM } } },
+   { "mixed", 4,
+     { { PIPE_FORMAT_R32G32B32_FLOAT, PIPE_FORMAT_R32G32B32_FLOAT },
+       { PIPE_FORMAT_R8G8B8_SNORM, PIPE_FORMAT_R32G32B32_FLOAT },
+       { PIPE_FORMAT_B8G8R8A8_UNORM, PIPE_FORMAT_R32G32B32A32_FLOAT },
+       { PIPE_FORMAT_R16G16_UNORM, PIPE_FORMAT_R32G32_FLOAT } } }
+};
+
+
+/**
+ * Translate the same vertices over and over with every bench key and
+ * print the vertex rate, along with translate_generic's for reference.
+ */
+static int
+benchmark(struct translate *(*create_fn)(const struct translate_key *key),
+          const char *name)
+{
+   unsigned *elts;
+   uint8_t *inputs[4];
+   uint8_t *output;
+   unsigned i, j, k;
+
+   elts = align_malloc(BENCH_VERTS * sizeof *elts, 16);
+   output = align_malloc(BENCH_VERTS * 4 * 4 * sizeof(float), 16);
+   for (i = 0; i < Elements(inputs); ++i)
+      inputs[i] = align_malloc(BENCH_VERTS * 4 * sizeof(double), 16);
+
+   /* indices jumping around a bit, as they would in a mesh */
+   for (i = 0; i < BENCH_VERTS; ++i)
+      elts[i] = (i * 37) % BENCH_VERTS;
+
+   for (i = 0; i < Elements(bench_keys); ++i) {
+      const struct bench_key *bench = &bench_keys[i];
+      struct translate_key key;
+      struct translate *translate[2];
+      double rate[2];
+      unsigned offset = 0;
+
+      memset(&key, 0, sizeof key);
+      key.nr_elements = bench->nr_elements;
+
+      for (j = 0; j < bench->nr_elements; ++j) {
+         const struct util_format_description *input_desc =
+            util_format_description(bench->element[j].input_format);
+         unsigned input_size =
+            util_format_get_stride(bench->element[j].input_format, 1);
+
+         key.element[j].type = TRANSLATE_ELEMENT_NORMAL;
+         key.element[j].input_format = bench->element[j].input_format;
+         key.element[j].output_format = bench->element[j].output_format;
+         key.element[j].input_buffer = j;
+         key.element[j].output_offset = offset;
+         offset += util_format_get_stride(bench->element[j].output_format, 1);
+
+         for (k = 0; k < BENCH_VERTS; ++k) {
+            float v = (float)(k % 97) / 97.0f;
+            float rgba[4];
+            rgba[0] = v;
+            rgba[1] = 1.0f - v;
+            rgba[2] = 0.5f * v;
+            rgba[3] = 1.0f;
+            input_desc->pack_rgba_float(inputs[j] + k * input_size, 0,
+                                        rgba, 0, 1, 1);
+         }
+      }
+      key.output_stride = offset;
+
+      translate[0] = create_fn(&key);
+      translate[1] = translate_generic_create(&key);
+
+      for (j = 0; j < 2; ++j) {
+         int64_t start, end;
+
+         rate[j] = 0.0;
+         if (!translate[j])
+            continue;
+
+         for (k = 0; k < bench->nr_elements; ++k)
+            translate[j]->set_buffer(translate[j], k, inputs[k],
+                                     util_format_get_stride(key.element[k].input_format, 1),
+                                     BENCH_VERTS - 1);
+
+         start = os_time_get();
+         for (k = 0; k < BENCH_RUNS; ++k)
+            translate[j]->run_elts(translate[j], elts, BENCH_VERTS, 0, output);
+         end = os_time_get();
+
+         rate[j] = BENCH_VERTS * BENCH_RUNS / ((end - start) / 1.0e6) / 1.0e6;
+
+         translate[j]->release(translate[j]);
+      }
+
+      if (translate[0])
+         printf("%-14s %8.2f Mverts/s  (generic %8.2f Mverts/s)\n",
+                bench->name, rate[0], rate[1]);
+      else
+         printf("%-14s unsupported by translate_%s\n", bench->name, name);
+   }
+
+   for (i = 0; i < Elements(inputs); ++i)
+      align_free(inputs[i]);
+   align_free(output);
+   align_free(elts);
+
+   return 0;
+}
+
+
 int main(int argc, char** argv)
 {
    struct translate *(*create_fn)(const struct translate_key *key) = 0;
@@ -126,13 +263,20 @@ int main(int argc, char** argv)
       }
       create_fn = translate_sse2_create;
    }
+#if HAVE_LLVM
+   else if (!strcmp(argv[1], "llvm"))
+      create_fn = translate_llvm_create;
+#endif
 
    if (!create_fn)
    {
-      printf("Usage: ./translate_test [generic|x86|nosse|sse|sse2|sse3|sse4.1]\n");
+      printf("Usage: ./translate_test [generic|x86|nosse|sse|sse2|sse3|sse4.1|llvm] [bench]\n");
       return 2;
    }
 
+   if (argc > 2 && !strcmp(argv[2], "bench"))
+      return benchmark(create_fn, argv[1]);
+
    for (i = 1; i < Elements(buffer); ++i)
       buffer[i] = align_malloc(buffer_size, 4096);
 
@@ -318,6 +318,7 @@ match_function_by_name(const char *name,
    ir_function *f = state->symbols->get_function(name);
    ir_function_signature *local_sig = NULL;
    ir_function_signature *sig = NULL;
+   gl_shader *builtin_shader = NULL;
 
    /* Is the function hidden by a record type constructor? */
    if (state->symbols->get_type(name))
@@ -361,6 +362,7 @@ match_function_by_name(const char *name,
       /* If the built-in signature is exact, we can stop. */
       if (is_exact) {
 	 sig = builtin_sig;
+	 builtin_shader = state->builtins_to_link[i];
 	 goto done;
       }
 
@@ -369,6 +371,7 @@ match_function_by_name(const char *name,
 	  * we should keep searching for an exact match.
 	  */
 	 sig = builtin_sig;
+	 builtin_shader = state->builtins_to_link[i];
       }
    }
 
@@ -376,6 +379,11 @@ done:
    if (sig != NULL) {
       /* If the match is from a linked built-in shader, import the prototype. */
       if (sig != local_sig) {
+	 /* The body is needed from here on, for constant folding and
+	  * inlining of the call and eventually for linking.
+	  */
+	 _mesa_glsl_load_builtin_function(builtin_shader, name);
+
 	 if (f == NULL) {
 	    f = new(ctx) ir_function(name);
 	    state->symbols->add_global_function(f);
@@ -37,3 +37,10 @@ _mesa_glsl_initialize_functions(_mesa_glsl_parse_state *state)
 {
    (void) state;
 }
+
+void
+_mesa_glsl_load_builtin_function(struct gl_shader *sh, const char *name)
+{
+   (void) sh;
+   (void) name;
+}
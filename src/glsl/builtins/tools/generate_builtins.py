@@ -4,6 +4,7 @@
 from __future__ import with_statement
 
 import re
+import struct
 import sys
 from glob import glob
 from os import path
@@ -48,27 +49,145 @@ def get_builtin_definitions():
     read_glsl_files(fs)
     return fs
 
-def stringify(s):
-    # Work around MSVC's 65535 byte limit by outputting an array of characters
-    # rather than actual string literals.
-    if len(s) >= 65535:
-        #t = "/* Warning: length " + repr(len(s)) + " too large */\n"
-        t = ""
-        for c in re.sub('\s\s+', ' ', s):
-            if c == '\n':
-                t += '\n'
-            else:
-                t += "'" + c + "',"
-        return '{' + t[:-1] + '}'
-
-    t = s.replace('\\', '\\\\').replace('"', '\\"').replace('\n', '\\n"\n   "')
-    return '   "' + t + '"\n'
-
-def write_function_definitions():
-    fs = get_builtin_definitions()
+# Built-in IR is shipped pre-tokenized, see sx_binary_tag in s_expression.h,
+# which saves the compiler from scanning text and converting numbers.
+SX_BINARY_OPEN = 0
+SX_BINARY_CLOSE = 1
+SX_BINARY_INT = 2
+SX_BINARY_FLOAT = 3
+SX_BINARY_SYMBOL = 4
+
+token_re = re.compile(r'[ \v\t\r\n]+|;[^\n]*|\(|\)|[^() \v\t\r\n;]+')
+
+# Prefixes strtod() and strtol() accept, to tell numbers from symbols the
+# same way s_expression.cpp's read_atom() does.
+float_prefix_re = re.compile(r'[+-]?(?:(?:[0-9]+\.?[0-9]*|\.[0-9]+)'
+                             r'(?:[eE][+-]?[0-9]+)?|inf(?:inity)?|nan)',
+                             re.IGNORECASE)
+int_prefix_re = re.compile(r'[+-]?[0-9]+')
+
+class Symbol(str):
+    pass
+
+def parse_atom(atom):
+    if atom == '+INF':
+        return float('inf')
+    f = float_prefix_re.match(atom)
+    if f is None:
+        return Symbol(atom)
+    i = int_prefix_re.match(atom)
+    if i is not None and i.end() == f.end():
+        value = int(i.group(0))
+        assert -2**31 <= value < 2**31
+        return value
+    return float(f.group(0))
+
+def parse_sexp(s):
+    """Parse the first S-Expression in s into nested lists of ints, floats
+    and Symbols.
+    """
+    stack = [[]]
+    for m in token_re.finditer(s):
+        token = m.group(0)
+        if token[0] in ' \v\t\r\n;':
+            continue
+        if token == '(':
+            stack.append([])
+        elif token == ')':
+            l = stack.pop()
+            stack[-1].append(l)
+            if len(stack) == 1:
+                break
+        else:
+            stack[-1].append(parse_atom(token))
+            if len(stack) == 1:
+                break
+    assert len(stack) == 1 and len(stack[0]) == 1, 'unbalanced S-Expression'
+    return stack[0][0]
+
+def count_symbols(expr, counts):
+    if isinstance(expr, list):
+        for e in expr:
+            count_symbols(e, counts)
+    elif isinstance(expr, Symbol):
+        counts[expr] = counts.get(expr, 0) + 1
+
+def find_calls(expr, calls):
+    """Collect the names of the functions called in expr."""
+    if isinstance(expr, list):
+        if len(expr) >= 2 and isinstance(expr[0], Symbol) and \
+           expr[0] == 'call':
+            calls.add(str(expr[1]))
+        for e in expr:
+            find_calls(e, calls)
+
+def varint(value):
+    out = []
+    while True:
+        byte = value & 0x7f
+        value >>= 7
+        if value == 0:
+            out.append(byte)
+            return out
+        out.append(byte | 0x80)
+
+def encode(expr, symbol_index, out):
+    if isinstance(expr, list):
+        out.append(SX_BINARY_OPEN)
+        for e in expr:
+            encode(e, symbol_index, out)
+        out.append(SX_BINARY_CLOSE)
+    elif isinstance(expr, Symbol):
+        out.extend(varint(SX_BINARY_SYMBOL + symbol_index[expr]))
+    elif isinstance(expr, float):
+        out.append(SX_BINARY_FLOAT)
+        try:
+            bits = struct.pack('<f', expr)
+        except OverflowError:
+            bits = struct.pack('<f', float('inf') if expr > 0 else -float('inf'))
+        out.extend(ord(b) for b in bits)
+    else:
+        out.append(SX_BINARY_INT)
+        out.extend(varint(expr * 2 if expr >= 0 else -expr * 2 - 1))
+
+def encode_ir(expr, symbol_index):
+    out = []
+    encode(expr, symbol_index, out)
+    return out
+
+def print_bytes(name, data):
+    print 'static const unsigned char ' + name + '[] = {'
+    line = '  '
+    for byte in data:
+        if len(line) > 72:
+            print line
+            line = '  '
+        line += ' %d,' % byte
+    print line
+    print '};'
+
+def print_symbols(symbols):
+    print 'static const char *const builtin_symbols[] = {'
+    for sym in symbols:
+        print '   "' + sym.replace('\\', '\\\\').replace('"', '\\"') + '",'
+    print '};'
+
+def write_function_definitions(fs, symbol_index):
     for k, v in sorted(fs.iteritems()):
-        print 'static const char builtin_' + k + '[] ='
-        print stringify(v), ';'
+        print_bytes('builtin_' + k + '_ir', encode_ir(v, symbol_index))
+
+        calls = set()
+        find_calls(v, calls)
+        calls.discard(k)
+        print 'static const char *const builtin_' + k + '_calls[] = {'
+        for call in sorted(calls):
+            print '   "' + call + '",'
+        print '   NULL'
+        print '};'
+
+        print 'static const struct builtin_function builtin_' + k + ' = {'
+        print '   "' + k + '", builtin_' + k + '_ir, builtin_' + k + '_calls'
+        print '};'
 
 def run_compiler(args):
     command = [compiler, '--dump-hir'] + args
@@ -96,33 +215,36 @@ def run_compiler(args):
 
     return (output, p.returncode)
 
-def write_profile(filename, profile):
+def read_profile(filename):
+    """Return the prototypes of a profile, or None if they don't compile."""
     (proto_ir, returncode) = run_compiler([filename])
 
     if returncode != 0:
+        return None
+
+    return parse_sexp(proto_ir)
+
+def write_profile(profile, protos, symbol_index):
+    if protos is None:
         print '#error builtins profile', profile, 'failed to compile'
         return
 
-    print 'static const char prototypes_for_' + profile + '[] ='
-    print stringify(proto_ir), ';'
+    print_bytes('prototypes_for_' + profile, encode_ir(protos, symbol_index))
 
-    # Print a table of all the functions (not signatures) referenced.
-    # This is done so we can avoid bothering with a hash table in the C++ code.
+    # Print a table of all the functions (not signatures) referenced, sorted
+    # by name so the C++ code can binary search it when loading bodies.
 
     function_names = set()
-    for func in re.finditer(r'\(function (.+)\n', proto_ir):
-        function_names.add(func.group(1))
+    for func in protos:
+        if isinstance(func, list) and func[0] == 'function':
+            function_names.add(str(func[1]))
 
-    print 'static const char *functions_for_' + profile + ' [] = {'
+    print 'static const struct builtin_function *const functions_for_' + \
+          profile + '[] = {'
     for func in sorted(function_names):
-        print '   builtin_' + func + ','
+        print '   &builtin_' + func + ','
     print '};'
 
-def write_profiles():
-    profiles = get_profile_list()
-    for (filename, profile) in profiles:
-        write_profile(filename, profile)
-
 def get_profile_list():
     profile_files = []
     for extension in ['glsl', 'frag', 'vert']:
@@ -135,6 +257,19 @@ def get_profile_list():
     return profiles
 
 if __name__ == "__main__":
+    fs = dict((k, parse_sexp(v))
+              for k, v in get_builtin_definitions().iteritems())
+
+    profiles = get_profile_list()
+    protos = [read_profile(filename) for (filename, profile) in profiles]
+
+    # Give the most frequent symbols the shortest indices.
+    counts = {}
+    for v in fs.values() + protos:
+        count_symbols(v, counts)
+    symbols = sorted(counts, key=lambda sym: (-counts[sym], sym))
+    symbol_index = dict((sym, i) for i, sym in enumerate(symbols))
+
     print """/* DO NOT MODIFY - automatically generated by generate_builtins.py */
 /*
  * Copyright © 2010 Intel Corporation
@@ -165,12 +300,65 @@ if __name__ == "__main__":
 #include "ir_reader.h"
 #include "program.h"
 #include "ast.h"
+#include "s_expression.h"
+
+/**
+ * A built-in function, with all of its overloads.
+ */
+struct builtin_function {
+   const char *name;
+
+   /** Definition of the function, as a pre-tokenized S-Expression */
+   const unsigned char *ir;
+
+   /** NULL terminated list of the functions the definition calls */
+   const char *const *calls;
+};
+"""
+
+    print_symbols(symbols)
+    write_function_definitions(fs, symbol_index)
+    for ((filename, profile), p) in zip(profiles, protos):
+        write_profile(profile, p, symbol_index)
 
+    print """
 extern "C" struct gl_shader *
 _mesa_new_shader(struct gl_context *ctx, GLuint name, GLenum type);
 
-gl_shader *
-read_builtins(GLenum target, const char *protos, const char **functions, unsigned count)
+/**
+ * A built-in profile, read into a shader holding the prototypes of all of
+ * its functions.  Function bodies are only read the first time a function
+ * is used, see _mesa_glsl_load_builtin_function().
+ */
+struct builtin_profile {
+   gl_shader *sh;
+
+   /** Parse state the bodies are read with, owned by sh */
+   _mesa_glsl_parse_state *st;
+
+   const struct builtin_function *const *functions;
+   unsigned count;
+
+   /** Whether functions[i]'s body has been read yet, owned by sh */
+   bool *loaded;
+};
+"""
+
+    print 'static struct builtin_profile builtin_profiles[%d];' % len(profiles)
+
+    print """
+void *builtin_mem_ctx = NULL;
+
+/* Protects builtin_profiles, and the parse states bodies are read with.
+ * Readers of the built-in shaders don't take it: only bodies of functions
+ * nobody has used yet are filled in while they may be looking.
+ */
+_glthread_DECLARE_STATIC_MUTEX(builtins_lock);
+
+static bool
+read_builtins(struct builtin_profile *profile, GLenum target,
+              const unsigned char *protos,
+              const struct builtin_function *const *functions, unsigned count)
 {
    struct gl_context fakeCtx;
    fakeCtx.API = API_OPENGL;
@@ -190,42 +378,104 @@ read_builtins(GLenum target, const char *protos, const char **functions, unsigne
    _mesa_glsl_initialize_types(st);
 
    sh->ir = new(sh) exec_list;
-   sh->symbols = st->symbols;
 
-   /* Read the IR containing the prototypes */
-   _mesa_glsl_read_ir(st, sh->ir, protos, true);
+   /* Read the IR containing the prototypes.  The IR reader will skip any
+    * function body that does not match one of them when the bodies are read
+    * later on.
+    */
+   _mesa_glsl_read_ir(st, sh->ir, protos, builtin_symbols, true);
 
-   /* Read ALL the function bodies, telling the IR reader not to scan for
-    * prototypes (we've already created them).  The IR reader will skip any
-    * signature that does not already exist as a prototype.
+   if (st->error) {
+      printf("error reading builtin prototypes\\n");
+      printf("Info log:\\n%s\\n", st->info_log);
+      ralloc_free(sh);
+      return false;
+   }
+
+   /* The compiler and the linker look functions up in sh->symbols without
+    * taking builtins_lock, so sh gets a table of its own which never changes
+    * after this.  Reading bodies pushes scopes and variables on st->symbols,
+    * which only the loader uses.
     */
-   for (unsigned i = 0; i < count; i++) {
-      _mesa_glsl_read_ir(st, sh->ir, functions[i], false);
-
-      if (st->error) {
-         printf("error reading builtin: %.35s ...\\n", functions[i]);
-         printf("Info log:\\n%s\\n", st->info_log);
-         ralloc_free(sh);
-         return NULL;
-      }
+   sh->symbols = new(sh) glsl_symbol_table;
+   sh->symbols->language_version = 140;
+   foreach_list(node, sh->ir) {
+      ir_function *f = ((ir_instruction *) node)->as_function();
+      if (f != NULL)
+         sh->symbols->add_function(f);
    }
 
-   reparent_ir(sh->ir, sh);
-   delete st;
+   /* st is kept around to read the bodies with, but fakeCtx goes away.
+    * Errors in built-ins then only go to st's info log.
+    */
+   st->ctx = NULL;
+
+   profile->sh = sh;
+   profile->st = st;
+   profile->functions = functions;
+   profile->count = count;
+   profile->loaded = rzalloc_array(sh, bool, count);
 
-   return sh;
+   return true;
 }
-"""
 
-    write_function_definitions()
-    write_profiles()
+static int
+compare_builtin_function(const void *key, const void *elem)
+{
+   return strcmp((const char *) key,
+                 (*(const struct builtin_function *const *) elem)->name);
+}
 
-    profiles = get_profile_list()
+static void
+load_builtin_function(struct builtin_profile *profile, const char *name)
+{
+   const struct builtin_function *const *f =
+      (const struct builtin_function *const *)
+      bsearch(name, profile->functions, profile->count,
+              sizeof(profile->functions[0]), compare_builtin_function);
 
-    print 'static gl_shader *builtin_profiles[%d];' % len(profiles)
+   if (f == NULL)
+      return;
 
-    print """
-void *builtin_mem_ctx = NULL;
+   const unsigned i = f - profile->functions;
+   if (profile->loaded[i])
+      return;
+   profile->loaded[i] = true;
+
+   /* The bodies are read into the existing prototypes.  Global variables
+    * they use, like ftransform()'s gl_Vertex, are kept out of sh->ir, which
+    * other threads may be walking; the linker gets to them through the
+    * references in the bodies.
+    */
+   exec_list globals;
+   _mesa_glsl_read_ir(profile->st, &globals, (*f)->ir, builtin_symbols,
+                      false);
+
+   if (profile->st->error) {
+      printf("error reading builtin: %s\\n", name);
+      printf("Info log:\\n%s\\n", profile->st->info_log);
+      return;
+   }
+
+   /* Linking clones the bodies of the callees, too. */
+   for (const char *const *call = (*f)->calls; *call != NULL; call++)
+      load_builtin_function(profile, *call);
+}
+
+void
+_mesa_glsl_load_builtin_function(struct gl_shader *sh, const char *name)
+{
+   _glthread_LOCK_MUTEX(builtins_lock);
+
+   for (unsigned i = 0; i < Elements(builtin_profiles); i++) {
+      if (builtin_profiles[i].sh == sh) {
+         load_builtin_function(&builtin_profiles[i], name);
+         break;
+      }
+   }
+
+   _glthread_UNLOCK_MUTEX(builtins_lock);
+}
 
 void
 _mesa_glsl_release_functions(void)
@@ -238,19 +488,20 @@ _mesa_glsl_release_functions(void)
 static void
 _mesa_read_profile(struct _mesa_glsl_parse_state *state,
                    int profile_index,
-		   const char *prototypes,
-		   const char **functions,
+                   const unsigned char *prototypes,
+                   const struct builtin_function *const *functions,
                    int count)
 {
-   gl_shader *sh = builtin_profiles[profile_index];
+   struct builtin_profile *profile = &builtin_profiles[profile_index];
 
-   if (sh == NULL) {
-      sh = read_builtins(GL_VERTEX_SHADER, prototypes, functions, count);
-      ralloc_steal(builtin_mem_ctx, sh);
-      builtin_profiles[profile_index] = sh;
+   if (profile->sh == NULL) {
+      if (!read_builtins(profile, GL_VERTEX_SHADER, prototypes, functions,
+                         count))
+         return;
+      ralloc_steal(builtin_mem_ctx, profile->sh);
    }
 
-   state->builtins_to_link[state->num_builtins_to_link] = sh;
+   state->builtins_to_link[state->num_builtins_to_link] = profile->sh;
    state->num_builtins_to_link++;
 }
 
@@ -261,12 +512,13 @@ _mesa_glsl_initialize_functions(struct _mesa_glsl_parse_state *state)
    if (state->num_builtins_to_link > 0)
       return;
 
+   _glthread_LOCK_MUTEX(builtins_lock);
+
    if (builtin_mem_ctx == NULL) {
       builtin_mem_ctx = ralloc_context(NULL); // "GLSL built-in functions"
       memset(&builtin_profiles, 0, sizeof(builtin_profiles));
    }
 """
-
     i = 0
     for (filename, profile) in profiles:
         if profile.endswith('_vert'):
@@ -290,5 +542,6 @@ _mesa_glsl_initialize_functions(struct _mesa_glsl_parse_state *state)
         print '   }'
         print
         i = i + 1
+    print '   _glthread_UNLOCK_MUTEX(builtins_lock);'
     print '}'
 
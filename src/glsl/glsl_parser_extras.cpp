@@ -36,6 +36,7 @@ extern "C" {
 #include "glsl_parser.h"
 #include "ir_optimization.h"
 #include "loop_analysis.h"
+#include "opt_pass_manager.h"
 
 _mesa_glsl_parse_state::_mesa_glsl_parse_state(struct gl_context *_ctx,
 					       GLenum target, void *mem_ctx)
@@ -150,8 +151,10 @@ _mesa_glsl_msg(const YYLTYPE *locp, _mesa_glsl_parse_state *state,
 
    const char *const msg = &state->info_log[msg_offset];
    struct gl_context *ctx = state->ctx;
-   /* Report the error via GL_ARB_debug_output. */
-   if (error)
+   /* Report the error via GL_ARB_debug_output.  Built-in functions are
+    * read without a context.
+    */
+   if (error && ctx != NULL)
       _mesa_shader_debug(ctx, type, id, msg, strlen(msg));
 
    ralloc_strcat(&state->info_log, "\n");
@@ -1007,9 +1010,239 @@ ast_struct_specifier::ast_struct_specifier(const char *identifier,
    this->declarations.push_degenerate_list_at_head(&declarator_list->link);
 }
 
+/* Wrappers giving the common optimization passes a uniform signature */
+
+static bool
+opt_lower_sub(exec_list *ir, const struct opt_pass_params *params)
+{
+   return lower_instructions(ir, SUB_TO_ADD_NEG);
+}
+
+static bool
+opt_function_inlining(exec_list *ir, const struct opt_pass_params *params)
+{
+   return params->linked && do_function_inlining(ir);
+}
+
+static bool
+opt_dead_functions(exec_list *ir, const struct opt_pass_params *params)
+{
+   return params->linked && do_dead_functions(ir);
+}
+
+static bool
+opt_structure_splitting(exec_list *ir, const struct opt_pass_params *params)
+{
+   return params->linked && do_structure_splitting(ir);
+}
+
+static bool
+opt_if_simplification(exec_list *ir, const struct opt_pass_params *params)
+{
+   return do_if_simplification(ir);
+}
+
+static bool
+opt_copy_propagation(exec_list *ir, const struct opt_pass_params *params)
+{
+   return do_copy_propagation(ir);
+}
+
+static bool
+opt_copy_propagation_elements(exec_list *ir,
+                              const struct opt_pass_params *params)
+{
+   return do_copy_propagation_elements(ir);
+}
+
+static bool
+opt_dead_code(exec_list *ir, const struct opt_pass_params *params)
+{
+   if (params->linked)
+      return do_dead_code(ir, params->uniform_locations_assigned);
+   else
+      return do_dead_code_unlinked(ir);
+}
+
+static bool
+opt_dead_code_local(exec_list *ir, const struct opt_pass_params *params)
+{
+   return do_dead_code_local(ir);
+}
+
+static bool
+opt_tree_grafting(exec_list *ir, const struct opt_pass_params *params)
+{
+   return do_tree_grafting(ir);
+}
+
+static bool
+opt_constant_propagation(exec_list *ir, const struct opt_pass_params *params)
+{
+   return do_constant_propagation(ir);
+}
+
+static bool
+opt_constant_variable(exec_list *ir, const struct opt_pass_params *params)
+{
+   if (params->linked)
+      return do_constant_variable(ir);
+   else
+      return do_constant_variable_unlinked(ir);
+}
+
+static bool
+opt_constant_folding(exec_list *ir, const struct opt_pass_params *params)
+{
+   return do_constant_folding(ir);
+}
+
+static bool
+opt_cse(exec_list *ir, const struct opt_pass_params *params)
+{
+   return do_cse(ir);
+}
+
+static bool
+opt_algebraic(exec_list *ir, const struct opt_pass_params *params)
+{
+   return do_algebraic(ir);
+}
+
+static bool
+opt_lower_jumps(exec_list *ir, const struct opt_pass_params *params)
+{
+   return do_lower_jumps(ir);
+}
+
+static bool
+opt_vec_index_to_swizzle(exec_list *ir, const struct opt_pass_params *params)
+{
+   return do_vec_index_to_swizzle(ir);
+}
+
+static bool
+opt_swizzle_swizzle(exec_list *ir, const struct opt_pass_params *params)
+{
+   return do_swizzle_swizzle(ir);
+}
+
+static bool
+opt_noop_swizzle(exec_list *ir, const struct opt_pass_params *params)
+{
+   return do_noop_swizzle(ir);
+}
+
+static bool
+opt_split_arrays(exec_list *ir, const struct opt_pass_params *params)
+{
+   return optimize_split_arrays(ir, params->linked);
+}
+
+static bool
+opt_redundant_jumps(exec_list *ir, const struct opt_pass_params *params)
+{
+   return optimize_redundant_jumps(ir);
+}
+
+static bool
+opt_unroll_loops(exec_list *ir, const struct opt_pass_params *params)
+{
+   bool progress = false;
+
+   loop_state *ls = analyze_loop_variables(ir);
+   if (ls->loop_found) {
+      progress = set_loop_controls(ir, ls) || progress;
+      progress = unroll_loops(ir, ls, params->max_unroll_iterations) || progress;
+   }
+   delete ls;
+
+   return progress;
+}
+
+/** Indices of the common optimization passes, in the order they run */
+enum {
+   OPT_LOWER_SUB,
+   OPT_FUNCTION_INLINING,
+   OPT_DEAD_FUNCTIONS,
+   OPT_STRUCTURE_SPLITTING,
+   OPT_IF_SIMPLIFICATION,
+   OPT_COPY_PROPAGATION,
+   OPT_COPY_PROPAGATION_ELEMENTS,
+   OPT_DEAD_CODE,
+   OPT_DEAD_CODE_LOCAL,
+   OPT_TREE_GRAFTING,
+   OPT_CONSTANT_PROPAGATION,
+   OPT_CONSTANT_VARIABLE,
+   OPT_CONSTANT_FOLDING,
+   OPT_CSE,
+   OPT_ALGEBRAIC,
+   OPT_LOWER_JUMPS,
+   OPT_VEC_INDEX_TO_SWIZZLE,
+   OPT_SWIZZLE_SWIZZLE,
+   OPT_NOOP_SWIZZLE,
+   OPT_SPLIT_ARRAYS,
+   OPT_REDUNDANT_JUMPS,
+   OPT_UNROLL_LOOPS,
+   OPT_COUNT
+};
+
+#define OPT_BIT(pass) (1u << OPT_##pass)
+
+/**
+ * Passes that any rewriting of expressions, assignments or control flow
+ * may give new work.  Subtraction lowering and function inlining only act
+ * on constructs that the other passes don't create, and dead functions
+ * only appear when calls go away.
+ */
+#define OPT_GENERAL (((1u << OPT_COUNT) - 1) & \
+                     ~(OPT_BIT(LOWER_SUB) | \
+                       OPT_BIT(FUNCTION_INLINING) | \
+                       OPT_BIT(DEAD_FUNCTIONS)))
+
+static const struct opt_pass common_optimization_passes[OPT_COUNT] = {
+   { "lower_sub_to_add_neg", opt_lower_sub, true,
+     OPT_GENERAL },
+   { "function_inlining", opt_function_inlining, false,
+     OPT_GENERAL | OPT_BIT(FUNCTION_INLINING) | OPT_BIT(DEAD_FUNCTIONS) },
+   { "dead_functions", opt_dead_functions, false,
+     OPT_BIT(DEAD_FUNCTIONS) | OPT_BIT(STRUCTURE_SPLITTING) |
+     OPT_BIT(DEAD_CODE) | OPT_BIT(TREE_GRAFTING) |
+     OPT_BIT(CONSTANT_VARIABLE) | OPT_BIT(SPLIT_ARRAYS) },
+   { "structure_splitting", opt_structure_splitting, false, OPT_GENERAL },
+   { "if_simplification", opt_if_simplification, true, OPT_GENERAL },
+   { "copy_propagation", opt_copy_propagation, true, OPT_GENERAL },
+   { "copy_propagation_elements", opt_copy_propagation_elements, true,
+     OPT_GENERAL },
+   { "dead_code", opt_dead_code, false, OPT_GENERAL },
+   { "dead_code_local", opt_dead_code_local, true, OPT_GENERAL },
+   { "tree_grafting", opt_tree_grafting, false, OPT_GENERAL },
+   { "constant_propagation", opt_constant_propagation, true, OPT_GENERAL },
+   { "constant_variable", opt_constant_variable, false, OPT_GENERAL },
+   { "constant_folding", opt_constant_folding, true, OPT_GENERAL },
+   { "cse", opt_cse, true, OPT_GENERAL },
+   { "algebraic", opt_algebraic, true, OPT_GENERAL },
+   /* lowering returns can make a function inlinable */
+   { "lower_jumps", opt_lower_jumps, true,
+     OPT_GENERAL | OPT_BIT(FUNCTION_INLINING) },
+   { "vec_index_to_swizzle", opt_vec_index_to_swizzle, true, OPT_GENERAL },
+   { "swizzle_swizzle", opt_swizzle_swizzle, true, OPT_GENERAL },
+   { "noop_swizzle", opt_noop_swizzle, true, OPT_GENERAL },
+   { "split_arrays", opt_split_arrays, false, OPT_GENERAL },
+   { "redundant_jumps", opt_redundant_jumps, true, OPT_GENERAL },
+   /* unrolled bodies are fresh copies of the loop's code */
+   { "unroll_loops", opt_unroll_loops, true,
+     OPT_GENERAL | OPT_BIT(LOWER_SUB) },
+};
+
 /**
  * Do the set of common optimizations passes
  *
+ * The passes are run until none of them makes progress, so callers don't
+ * need to loop.  Only passes which may have new work after another pass
+ * made progress are run again, and only on the functions that changed,
+ * see opt_pass_manager.
+ *
  * \param ir                          List of instructions to be optimized
  * \param linked                      Is the shader linked?  This enables
  *                                    optimizations passes that remove code at
@@ -1029,47 +1262,15 @@ do_common_optimization(exec_list *ir, bool linked,
 		       bool uniform_locations_assigned,
 		       unsigned max_unroll_iterations)
 {
-   GLboolean progress = GL_FALSE;
-
-   progress = lower_instructions(ir, SUB_TO_ADD_NEG) || progress;
-
-   if (linked) {
-      progress = do_function_inlining(ir) || progress;
-      progress = do_dead_functions(ir) || progress;
-      progress = do_structure_splitting(ir) || progress;
-   }
-   progress = do_if_simplification(ir) || progress;
-   progress = do_copy_propagation(ir) || progress;
-   progress = do_copy_propagation_elements(ir) || progress;
-   if (linked)
-      progress = do_dead_code(ir, uniform_locations_assigned) || progress;
-   else
-      progress = do_dead_code_unlinked(ir) || progress;
-   progress = do_dead_code_local(ir) || progress;
-   progress = do_tree_grafting(ir) || progress;
-   progress = do_constant_propagation(ir) || progress;
-   if (linked)
-      progress = do_constant_variable(ir) || progress;
-   else
-      progress = do_constant_variable_unlinked(ir) || progress;
-   progress = do_constant_folding(ir) || progress;
-   progress = do_algebraic(ir) || progress;
-   progress = do_lower_jumps(ir) || progress;
-   progress = do_vec_index_to_swizzle(ir) || progress;
-   progress = do_swizzle_swizzle(ir) || progress;
-   progress = do_noop_swizzle(ir) || progress;
+   struct opt_pass_params params;
 
-   progress = optimize_split_arrays(ir, linked) || progress;
-   progress = optimize_redundant_jumps(ir) || progress;
+   params.linked = linked;
+   params.uniform_locations_assigned = uniform_locations_assigned;
+   params.max_unroll_iterations = max_unroll_iterations;
 
-   loop_state *ls = analyze_loop_variables(ir);
-   if (ls->loop_found) {
-      progress = set_loop_controls(ir, ls) || progress;
-      progress = unroll_loops(ir, ls, max_unroll_iterations) || progress;
-   }
-   delete ls;
+   opt_pass_manager manager(common_optimization_passes, OPT_COUNT, &params);
 
-   return progress;
+   return manager.run(ir);
 }
 
 extern "C" {
@@ -77,7 +77,8 @@ struct _mesa_glsl_parse_state {
       ralloc_free(mem);
    }
 
-   struct gl_context *const ctx;
+   /** NULL while the bodies of built-in functions are read */
+   struct gl_context *ctx;
    void *scanner;
    exec_list translation_unit;
    glsl_symbol_table *symbols;
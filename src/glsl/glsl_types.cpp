@@ -450,6 +450,46 @@ glsl_type::get_instance(unsigned base_type, unsigned rows, unsigned columns)
 }
 
 
+const glsl_type *
+glsl_type::get_sampler_instance(enum glsl_sampler_dim dim, bool shadow,
+				bool array, unsigned type)
+{
+   static const struct {
+      const glsl_type *types;
+      unsigned count;
+   } tables[] = {
+      { builtin_core_types, Elements(builtin_core_types) },
+      { builtin_110_types, Elements(builtin_110_types) },
+      { builtin_130_types, Elements(builtin_130_types) },
+      { builtin_140_types, Elements(builtin_140_types) },
+      { builtin_ARB_texture_rectangle_types,
+	Elements(builtin_ARB_texture_rectangle_types) },
+      { builtin_EXT_texture_array_types,
+	Elements(builtin_EXT_texture_array_types) },
+      { builtin_EXT_texture_buffer_object_types,
+	Elements(builtin_EXT_texture_buffer_object_types) },
+      { builtin_OES_EGL_image_external_types,
+	Elements(builtin_OES_EGL_image_external_types) },
+      { &_sampler3D_type, 1 },
+   };
+
+   for (unsigned i = 0; i < Elements(tables); i++) {
+      for (unsigned j = 0; j < tables[i].count; j++) {
+	 const glsl_type *const t = &tables[i].types[j];
+
+	 if (t->base_type == GLSL_TYPE_SAMPLER
+	     && t->sampler_dimensionality == unsigned(dim)
+	     && t->sampler_shadow == unsigned(shadow)
+	     && t->sampler_array == unsigned(array)
+	     && t->sampler_type == type)
+	    return t;
+      }
+   }
+
+   return error_type;
+}
+
+
 const glsl_type *
 glsl_type::get_array_instance(const glsl_type *base, unsigned array_size)
 {
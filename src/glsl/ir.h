@@ -1863,6 +1863,14 @@ _mesa_glsl_initialize_variables(exec_list *instructions,
 extern void
 _mesa_glsl_initialize_functions(_mesa_glsl_parse_state *state);
 
+/**
+ * Built-in function bodies are only read on demand.  Make sure those of
+ * function \c name in the built-in shader \c sh, and of anything they
+ * call, have been read.
+ */
+extern void
+_mesa_glsl_load_builtin_function(struct gl_shader *sh, const char *name);
+
 extern void
 _mesa_glsl_release_functions(void);
 
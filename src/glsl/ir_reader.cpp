@@ -25,6 +25,7 @@
 #include "glsl_parser_extras.h"
 #include "glsl_types.h"
 #include "s_expression.h"
+#include "program/hash_table.h"
 
 const static bool debug = false;
 
@@ -33,8 +34,13 @@ public:
    ir_reader(_mesa_glsl_parse_state *);
 
    void read(exec_list *instructions, const char *src, bool scan_for_protos);
+   void read(exec_list *instructions, const unsigned char *src,
+	     const char *const *symbols, bool scan_for_protos);
 
 private:
+   void read(exec_list *instructions, s_expression *expr,
+	     bool scan_for_protos);
+
    void *mem_ctx;
    _mesa_glsl_parse_state *state;
 
@@ -45,6 +51,8 @@ private:
    void scan_for_prototypes(exec_list *, s_expression *);
    ir_function *read_function(s_expression *, bool skip_body);
    void read_function_sig(ir_function *, s_expression *, bool skip_body);
+   void read_function_body(ir_function_signature *, exec_list *hir_parameters,
+			   s_expression *);
 
    void read_instructions(exec_list *, s_expression *, ir_loop *);
    ir_instruction *read_instruction(s_expression *, ir_loop *);
@@ -77,6 +85,15 @@ _mesa_glsl_read_ir(_mesa_glsl_parse_state *state, exec_list *instructions,
    r.read(instructions, src, scan_for_protos);
 }
 
+void
+_mesa_glsl_read_ir(_mesa_glsl_parse_state *state, exec_list *instructions,
+		   const unsigned char *src, const char *const *symbols,
+		   bool scan_for_protos)
+{
+   ir_reader r(state);
+   r.read(instructions, src, symbols, scan_for_protos);
+}
+
 void
 ir_reader::read(exec_list *instructions, const char *src, bool scan_for_protos)
 {
@@ -86,7 +103,31 @@ ir_reader::read(exec_list *instructions, const char *src, bool scan_for_protos)
       ir_read_error(NULL, "couldn't parse S-Expression.");
       return;
    }
-   
+
+   read(instructions, expr, scan_for_protos);
+   ralloc_free(sx_mem_ctx);
+}
+
+void
+ir_reader::read(exec_list *instructions, const unsigned char *src,
+		const char *const *symbols, bool scan_for_protos)
+{
+   void *sx_mem_ctx = ralloc_context(NULL);
+   s_expression *expr =
+      s_expression::read_binary_expression(sx_mem_ctx, src, symbols);
+   if (expr == NULL) {
+      ir_read_error(NULL, "couldn't parse S-Expression.");
+      return;
+   }
+
+   read(instructions, expr, scan_for_protos);
+   ralloc_free(sx_mem_ctx);
+}
+
+void
+ir_reader::read(exec_list *instructions, s_expression *expr,
+		bool scan_for_protos)
+{
    if (scan_for_protos) {
       scan_for_prototypes(instructions, expr);
       if (state->error)
@@ -94,7 +135,6 @@ ir_reader::read(exec_list *instructions, const char *src, bool scan_for_protos)
    }
 
    read_instructions(instructions, expr, NULL);
-   ralloc_free(sx_mem_ctx);
 
    if (debug)
       validate_ir_tree(instructions);
@@ -251,6 +291,7 @@ ir_reader::read_function_sig(ir_function *f, s_expression *expr, bool skip_body)
       /* If scanning for prototypes, generate a new signature. */
       sig = new(mem_ctx) ir_function_signature(return_type);
       sig->is_builtin = true;
+      sig->replace_parameters(&hir_parameters);
       f->add_signature(sig);
    } else if (sig != NULL) {
       const char *badvar = sig->qualifiers_match(&hir_parameters);
@@ -272,22 +313,62 @@ ir_reader::read_function_sig(ir_function *f, s_expression *expr, bool skip_body)
    }
    assert(sig != NULL);
 
-   sig->replace_parameters(&hir_parameters);
-
    if (!skip_body && !body_list->subexpressions.is_empty()) {
       if (sig->is_defined) {
 	 ir_read_error(expr, "function %s redefined", f->name);
 	 return;
       }
-      state->current_function = sig;
-      read_instructions(&sig->body, body_list, NULL);
-      state->current_function = NULL;
-      sig->is_defined = true;
+      read_function_body(sig, &hir_parameters, body_list);
    }
 
    state->symbols->pop_scope();
 }
 
+/**
+ * Read the body of a signature which already exists.
+ *
+ * The signature's parameters are left alone, since other threads may be
+ * looking at a built-in prototype while its body is read, see
+ * _mesa_glsl_load_builtin_function().  The body is read against the
+ * parameters declared with it, then cloned into the signature with its
+ * references to them redirected to the signature's own parameters.
+ */
+void
+ir_reader::read_function_body(ir_function_signature *sig,
+			      exec_list *hir_parameters, s_expression *expr)
+{
+   void *const sig_mem_ctx = this->mem_ctx;
+   exec_list body;
+
+   this->mem_ctx = ralloc_context(NULL);
+   state->current_function = sig;
+   read_instructions(&body, expr, NULL);
+   state->current_function = NULL;
+
+   struct hash_table *ht = hash_table_ctor(0, hash_table_pointer_hash,
+					   hash_table_pointer_compare);
+
+   exec_list_iterator param_iter = sig->parameters.iterator();
+   foreach_list(node, hir_parameters) {
+      ir_variable *const hir_param = (ir_variable *) node;
+      ir_variable *const param = (ir_variable *) param_iter.get();
+
+      hash_table_insert(ht, param, hir_param);
+      param_iter.next();
+   }
+
+   foreach_list(node, &body) {
+      ir_instruction *ir = (ir_instruction *) node;
+      sig->body.push_tail(ir->clone(sig_mem_ctx, ht));
+   }
+
+   hash_table_dtor(ht);
+   ralloc_free(this->mem_ctx);
+   this->mem_ctx = sig_mem_ctx;
+
+   sig->is_defined = true;
+}
+
 void
 ir_reader::read_instructions(exec_list *instructions, s_expression *expr,
 			     ir_loop *loop_ctx)
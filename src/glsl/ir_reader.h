@@ -31,4 +31,11 @@
 void _mesa_glsl_read_ir(_mesa_glsl_parse_state *state, exec_list *instructions,
 			const char *src, bool scan_for_prototypes);
 
+/**
+ * Read IR from its pre-tokenized S-Expression form, see \c sx_binary_tag.
+ */
+void _mesa_glsl_read_ir(_mesa_glsl_parse_state *state, exec_list *instructions,
+			const unsigned char *src, const char *const *symbols,
+			bool scan_for_prototypes);
+
 #endif /* IR_READER_H */
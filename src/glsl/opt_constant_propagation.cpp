@@ -40,6 +40,7 @@
 #include "ir_basic_block.h"
 #include "ir_optimization.h"
 #include "glsl_types.h"
+#include "opt_var_chains.h"
 
 namespace {
 
@@ -54,6 +55,7 @@ public:
       this->write_mask = write_mask;
       this->constant = constant;
       this->initial_values = write_mask;
+      this->var_link.entry = this;
    }
 
    acp_entry(const acp_entry *src)
@@ -62,6 +64,7 @@ public:
       this->write_mask = src->write_mask;
       this->constant = src->constant;
       this->initial_values = src->initial_values;
+      this->var_link.entry = this;
    }
 
    ir_variable *var;
@@ -70,6 +73,58 @@ public:
 
    /** Mask of values initially available in the constant. */
    unsigned initial_values;
+
+   /** Link in the acp_table chain of the variable */
+   var_chain_link var_link;
+};
+
+
+/**
+ * The available constants of a block, which can be looked up by variable
+ * in constant time.
+ */
+class acp_table
+{
+public:
+   acp_table(void *mem_ctx, unsigned num_entries)
+      : chains(mem_ctx, var_chains_buckets(num_entries))
+   {
+      this->num_entries = 0;
+   }
+
+   void add(acp_entry *entry)
+   {
+      this->entries.push_tail(entry);
+      this->chains.add(entry->var, &entry->var_link);
+      this->num_entries++;
+   }
+
+   void remove(acp_entry *entry)
+   {
+      entry->remove();
+      entry->var_link.remove();
+      this->num_entries--;
+   }
+
+   /** Returns the list of var_chain_link of the constants of \c var */
+   exec_list *find(ir_variable *var)
+   {
+      return this->chains.find(var);
+   }
+
+   void make_empty()
+   {
+      this->entries.make_empty();
+      this->chains.clear();
+      this->num_entries = 0;
+   }
+
+   /** List of acp_entry */
+   exec_list entries;
+   unsigned num_entries;
+
+private:
+   var_chains chains;
 };
 
 
@@ -87,17 +142,60 @@ public:
    unsigned write_mask;
 };
 
+
+/**
+ * The kill_entry of a block, at most one per variable.
+ */
+class kill_table
+{
+public:
+   kill_table()
+   {
+      this->ht = hash_table_ctor(var_chains_buckets(0),
+                                 hash_table_pointer_hash,
+                                 hash_table_pointer_compare);
+   }
+
+   ~kill_table()
+   {
+      hash_table_dtor(this->ht);
+   }
+
+   /** Adds \c write_mask to the killed channels of \c var */
+   void add(void *mem_ctx, ir_variable *var, unsigned write_mask)
+   {
+      kill_entry *entry = (kill_entry *) hash_table_find(this->ht, var);
+
+      if (entry) {
+	 entry->write_mask |= write_mask;
+	 return;
+      }
+
+      entry = new(mem_ctx) kill_entry(var, write_mask);
+      hash_table_insert(this->ht, entry, var);
+      this->entries.push_tail(entry);
+   }
+
+   /** List of kill_entry */
+   exec_list entries;
+
+private:
+   hash_table *ht;
+};
+
 class ir_constant_propagation_visitor : public ir_rvalue_visitor {
 public:
    ir_constant_propagation_visitor()
    {
       progress = false;
       mem_ctx = ralloc_context(0);
-      this->acp = new(mem_ctx) exec_list;
-      this->kills = new(mem_ctx) exec_list;
+      this->acp = new acp_table(mem_ctx, 0);
+      this->kills = new kill_table;
    }
    ~ir_constant_propagation_visitor()
    {
+      delete this->acp;
+      delete this->kills;
       ralloc_free(mem_ctx);
    }
 
@@ -113,14 +211,11 @@ public:
    void handle_if_block(exec_list *instructions);
    void handle_rvalue(ir_rvalue **rvalue);
 
-   /** List of acp_entry: The available constants to propagate */
-   exec_list *acp;
+   /** The available constants to propagate */
+   acp_table *acp;
 
-   /**
-    * List of kill_entry: The masks of variables whose values were
-    * killed in this block.
-    */
-   exec_list *kills;
+   /** The masks of variables whose values were killed in this block. */
+   kill_table *kills;
 
    bool progress;
 
@@ -171,9 +266,13 @@ ir_constant_propagation_visitor::handle_rvalue(ir_rvalue **rvalue)
 	 channel = i;
       }
 
-      foreach_iter(exec_list_iterator, iter, *this->acp) {
-	 acp_entry *entry = (acp_entry *)iter.get();
-	 if (entry->var == deref->var && entry->write_mask & (1 << channel)) {
+      exec_list *chain = this->acp->find(deref->var);
+      if (!chain)
+	 return;
+
+      foreach_list(node, chain) {
+	 acp_entry *entry = (acp_entry *) ((var_chain_link *) node)->entry;
+	 if (entry->write_mask & (1 << channel)) {
 	    found = entry;
 	    break;
 	 }
@@ -220,12 +319,14 @@ ir_constant_propagation_visitor::visit_enter(ir_function_signature *ir)
     * block.  Any instructions at global scope will be shuffled into
     * main() at link time, so they're irrelevant to us.
     */
-   exec_list *orig_acp = this->acp;
-   exec_list *orig_kills = this->kills;
+   acp_table *orig_acp = this->acp;
+   kill_table *orig_kills = this->kills;
    bool orig_killed_all = this->killed_all;
 
-   this->acp = new(mem_ctx) exec_list;
-   this->kills = new(mem_ctx) exec_list;
+   acp_table acp(mem_ctx, 0);
+   kill_table kills;
+   this->acp = &acp;
+   this->kills = &kills;
    this->killed_all = false;
 
    visit_list_elements(this, &ir->body);
@@ -307,18 +408,20 @@ ir_constant_propagation_visitor::visit_enter(ir_call *ir)
 void
 ir_constant_propagation_visitor::handle_if_block(exec_list *instructions)
 {
-   exec_list *orig_acp = this->acp;
-   exec_list *orig_kills = this->kills;
+   acp_table *orig_acp = this->acp;
+   kill_table *orig_kills = this->kills;
    bool orig_killed_all = this->killed_all;
 
-   this->acp = new(mem_ctx) exec_list;
-   this->kills = new(mem_ctx) exec_list;
+   acp_table acp(mem_ctx, orig_acp->num_entries);
+   kill_table kills;
+   this->acp = &acp;
+   this->kills = &kills;
    this->killed_all = false;
 
    /* Populate the initial acp with a constant of the original */
-   foreach_iter(exec_list_iterator, iter, *orig_acp) {
+   foreach_iter(exec_list_iterator, iter, orig_acp->entries) {
       acp_entry *a = (acp_entry *)iter.get();
-      this->acp->push_tail(new(this->mem_ctx) acp_entry(a));
+      this->acp->add(new(this->mem_ctx) acp_entry(a));
    }
 
    visit_list_elements(this, instructions);
@@ -327,12 +430,12 @@ ir_constant_propagation_visitor::handle_if_block(exec_list *instructions)
       orig_acp->make_empty();
    }
 
-   exec_list *new_kills = this->kills;
+   kill_table *new_kills = this->kills;
    this->kills = orig_kills;
    this->acp = orig_acp;
    this->killed_all = this->killed_all || orig_killed_all;
 
-   foreach_iter(exec_list_iterator, iter, *new_kills) {
+   foreach_iter(exec_list_iterator, iter, new_kills->entries) {
       kill_entry *k = (kill_entry *)iter.get();
       kill(k->var, k->write_mask);
    }
@@ -354,16 +457,18 @@ ir_constant_propagation_visitor::visit_enter(ir_if *ir)
 ir_visitor_status
 ir_constant_propagation_visitor::visit_enter(ir_loop *ir)
 {
-   exec_list *orig_acp = this->acp;
-   exec_list *orig_kills = this->kills;
+   acp_table *orig_acp = this->acp;
+   kill_table *orig_kills = this->kills;
    bool orig_killed_all = this->killed_all;
 
    /* FINISHME: For now, the initial acp for loops is totally empty.
     * We could go through once, then go through again with the acp
     * cloned minus the killed entries after the first run through.
     */
-   this->acp = new(mem_ctx) exec_list;
-   this->kills = new(mem_ctx) exec_list;
+   acp_table acp(mem_ctx, 0);
+   kill_table kills;
+   this->acp = &acp;
+   this->kills = &kills;
    this->killed_all = false;
 
    visit_list_elements(this, &ir->body_instructions);
@@ -372,12 +477,12 @@ ir_constant_propagation_visitor::visit_enter(ir_loop *ir)
       orig_acp->make_empty();
    }
 
-   exec_list *new_kills = this->kills;
+   kill_table *new_kills = this->kills;
    this->kills = orig_kills;
    this->acp = orig_acp;
    this->killed_all = this->killed_all || orig_killed_all;
 
-   foreach_iter(exec_list_iterator, iter, *new_kills) {
+   foreach_iter(exec_list_iterator, iter, new_kills->entries) {
       kill_entry *k = (kill_entry *)iter.get();
       kill(k->var, k->write_mask);
    }
@@ -396,29 +501,21 @@ ir_constant_propagation_visitor::kill(ir_variable *var, unsigned write_mask)
       return;
 
    /* Remove any entries currently in the ACP for this kill. */
-   foreach_iter(exec_list_iterator, iter, *this->acp) {
-      acp_entry *entry = (acp_entry *)iter.get();
+   exec_list *chain = this->acp->find(var);
+   if (chain) {
+      foreach_list_safe(node, chain) {
+	 acp_entry *entry = (acp_entry *) ((var_chain_link *) node)->entry;
 
-      if (entry->var == var) {
 	 entry->write_mask &= ~write_mask;
 	 if (entry->write_mask == 0)
-	    entry->remove();
+	    this->acp->remove(entry);
       }
    }
 
    /* Add this writemask of the variable to the list of killed
     * variables in this block.
     */
-   foreach_iter(exec_list_iterator, iter, *this->kills) {
-      kill_entry *entry = (kill_entry *)iter.get();
-
-      if (entry->var == var) {
-	 entry->write_mask |= write_mask;
-	 return;
-      }
-   }
-   /* Not already in the list.  Make new entry. */
-   this->kills->push_tail(new(this->mem_ctx) kill_entry(var, write_mask));
+   this->kills->add(this->mem_ctx, var, write_mask);
 }
 
 /**
@@ -449,7 +546,7 @@ ir_constant_propagation_visitor::add_constant(ir_assignment *ir)
       return;
 
    entry = new(this->mem_ctx) acp_entry(deref->var, ir->write_mask, constant);
-   this->acp->push_tail(entry);
+   this->acp->add(entry);
 }
 
 } /* unnamed namespace */
@@ -37,6 +37,7 @@
 #include "ir_basic_block.h"
 #include "ir_optimization.h"
 #include "glsl_types.h"
+#include "opt_var_chains.h"
 
 namespace {
 
@@ -49,10 +50,93 @@ public:
       assert(rhs);
       this->lhs = lhs;
       this->rhs = rhs;
+      this->lhs_link.entry = this;
+      this->rhs_link.entry = this;
    }
 
    ir_variable *lhs;
    ir_variable *rhs;
+
+   /** Links in the acp_table chains of the lhs and rhs variables */
+   var_chain_link lhs_link;
+   var_chain_link rhs_link;
+};
+
+
+/**
+ * The available copies of a block, which can be looked up by either of
+ * their variables in constant time.
+ */
+class acp_table
+{
+public:
+   acp_table(void *mem_ctx, unsigned num_entries)
+      : lhs_chains(mem_ctx, var_chains_buckets(num_entries)),
+        rhs_chains(mem_ctx, var_chains_buckets(num_entries))
+   {
+      this->num_entries = 0;
+   }
+
+   void add(acp_entry *entry)
+   {
+      this->entries.push_tail(entry);
+      this->lhs_chains.add(entry->lhs, &entry->lhs_link);
+      this->rhs_chains.add(entry->rhs, &entry->rhs_link);
+      this->num_entries++;
+   }
+
+   void remove(acp_entry *entry)
+   {
+      entry->remove();
+      entry->lhs_link.remove();
+      entry->rhs_link.remove();
+      this->num_entries--;
+   }
+
+   /** Returns the copy whose lhs is \c var, if any */
+   acp_entry *find(ir_variable *var)
+   {
+      exec_list *chain = this->lhs_chains.find(var);
+
+      if (!chain || chain->is_empty())
+         return NULL;
+
+      return (acp_entry *) ((var_chain_link *) chain->get_head())->entry;
+   }
+
+   /** Removes the copies reading or writing \c var */
+   void kill(ir_variable *var)
+   {
+      exec_list *chain;
+
+      chain = this->lhs_chains.find(var);
+      if (chain) {
+         foreach_list_safe(node, chain)
+            remove((acp_entry *) ((var_chain_link *) node)->entry);
+      }
+
+      chain = this->rhs_chains.find(var);
+      if (chain) {
+         foreach_list_safe(node, chain)
+            remove((acp_entry *) ((var_chain_link *) node)->entry);
+      }
+   }
+
+   void make_empty()
+   {
+      this->entries.make_empty();
+      this->lhs_chains.clear();
+      this->rhs_chains.clear();
+      this->num_entries = 0;
+   }
+
+   /** List of acp_entry */
+   exec_list entries;
+   unsigned num_entries;
+
+private:
+   var_chains lhs_chains;
+   var_chains rhs_chains;
 };
 
 
@@ -74,11 +158,12 @@ public:
    {
       progress = false;
       mem_ctx = ralloc_context(0);
-      this->acp = new(mem_ctx) exec_list;
+      this->acp = new acp_table(mem_ctx, 0);
       this->kills = new(mem_ctx) exec_list;
    }
    ~ir_copy_propagation_visitor()
    {
+      delete this->acp;
       ralloc_free(mem_ctx);
    }
 
@@ -94,8 +179,8 @@ public:
    void kill(ir_variable *ir);
    void handle_if_block(exec_list *instructions);
 
-   /** List of acp_entry: The available copies to propagate */
-   exec_list *acp;
+   /** The available copies to propagate */
+   acp_table *acp;
    /**
     * List of kill_entry: The variables whose values were killed in this
     * block.
@@ -118,11 +203,12 @@ ir_copy_propagation_visitor::visit_enter(ir_function_signature *ir)
     * block.  Any instructions at global scope will be shuffled into
     * main() at link time, so they're irrelevant to us.
     */
-   exec_list *orig_acp = this->acp;
+   acp_table *orig_acp = this->acp;
    exec_list *orig_kills = this->kills;
    bool orig_killed_all = this->killed_all;
 
-   this->acp = new(mem_ctx) exec_list;
+   acp_table acp(mem_ctx, 0);
+   this->acp = &acp;
    this->kills = new(mem_ctx) exec_list;
    this->killed_all = false;
 
@@ -165,16 +251,10 @@ ir_copy_propagation_visitor::visit(ir_dereference_variable *ir)
    if (this->in_assignee)
       return visit_continue;
 
-   ir_variable *var = ir->var;
-
-   foreach_iter(exec_list_iterator, iter, *this->acp) {
-      acp_entry *entry = (acp_entry *)iter.get();
-
-      if (var == entry->lhs) {
-	 ir->var = entry->rhs;
-	 this->progress = true;
-	 break;
-      }
+   acp_entry *entry = this->acp->find(ir->var);
+   if (entry) {
+      ir->var = entry->rhs;
+      this->progress = true;
    }
 
    return visit_continue;
@@ -207,18 +287,19 @@ ir_copy_propagation_visitor::visit_enter(ir_call *ir)
 void
 ir_copy_propagation_visitor::handle_if_block(exec_list *instructions)
 {
-   exec_list *orig_acp = this->acp;
+   acp_table *orig_acp = this->acp;
    exec_list *orig_kills = this->kills;
    bool orig_killed_all = this->killed_all;
 
-   this->acp = new(mem_ctx) exec_list;
+   acp_table acp(mem_ctx, orig_acp->num_entries);
+   this->acp = &acp;
    this->kills = new(mem_ctx) exec_list;
    this->killed_all = false;
 
    /* Populate the initial acp with a copy of the original */
-   foreach_iter(exec_list_iterator, iter, *orig_acp) {
+   foreach_iter(exec_list_iterator, iter, orig_acp->entries) {
       acp_entry *a = (acp_entry *)iter.get();
-      this->acp->push_tail(new(this->mem_ctx) acp_entry(a->lhs, a->rhs));
+      this->acp->add(new(this->mem_ctx) acp_entry(a->lhs, a->rhs));
    }
 
    visit_list_elements(this, instructions);
@@ -253,7 +334,7 @@ ir_copy_propagation_visitor::visit_enter(ir_if *ir)
 ir_visitor_status
 ir_copy_propagation_visitor::visit_enter(ir_loop *ir)
 {
-   exec_list *orig_acp = this->acp;
+   acp_table *orig_acp = this->acp;
    exec_list *orig_kills = this->kills;
    bool orig_killed_all = this->killed_all;
 
@@ -261,7 +342,8 @@ ir_copy_propagation_visitor::visit_enter(ir_loop *ir)
     * We could go through once, then go through again with the acp
     * cloned minus the killed entries after the first run through.
     */
-   this->acp = new(mem_ctx) exec_list;
+   acp_table acp(mem_ctx, 0);
+   this->acp = &acp;
    this->kills = new(mem_ctx) exec_list;
    this->killed_all = false;
 
@@ -291,13 +373,7 @@ ir_copy_propagation_visitor::kill(ir_variable *var)
    assert(var != NULL);
 
    /* Remove any entries currently in the ACP for this kill. */
-   foreach_iter(exec_list_iterator, iter, *acp) {
-      acp_entry *entry = (acp_entry *)iter.get();
-
-      if (entry->lhs == var || entry->rhs == var) {
-	 entry->remove();
-      }
-   }
+   this->acp->kill(var);
 
    /* Add the LHS variable to the list of killed variables in this block.
     */
@@ -330,7 +406,7 @@ ir_copy_propagation_visitor::add_copy(ir_assignment *ir)
 	 this->progress = true;
       } else {
 	 entry = new(this->mem_ctx) acp_entry(lhs_var, rhs_var);
-	 this->acp->push_tail(entry);
+	 this->acp->add(entry);
       }
    }
 }
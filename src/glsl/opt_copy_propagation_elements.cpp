@@ -46,6 +46,7 @@
 #include "ir_basic_block.h"
 #include "ir_optimization.h"
 #include "glsl_types.h"
+#include "opt_var_chains.h"
 
 static bool debug = false;
 
@@ -60,6 +61,8 @@ public:
       this->rhs = rhs;
       this->write_mask = write_mask;
       memcpy(this->swizzle, swizzle, sizeof(this->swizzle));
+      this->lhs_link.entry = this;
+      this->rhs_link.entry = this;
    }
 
    acp_entry(acp_entry *a)
@@ -68,12 +71,78 @@ public:
       this->rhs = a->rhs;
       this->write_mask = a->write_mask;
       memcpy(this->swizzle, a->swizzle, sizeof(this->swizzle));
+      this->lhs_link.entry = this;
+      this->rhs_link.entry = this;
    }
 
    ir_variable *lhs;
    ir_variable *rhs;
    unsigned int write_mask;
    int swizzle[4];
+
+   /** Links in the acp_table chains of the lhs and rhs variables */
+   var_chain_link lhs_link;
+   var_chain_link rhs_link;
+};
+
+
+/**
+ * The available copies of a block.  A variable may be the lhs of several
+ * entries copying different channels, which are kept in the order they
+ * were added.
+ */
+class acp_table
+{
+public:
+   acp_table(void *mem_ctx, unsigned num_entries)
+      : lhs_chains(mem_ctx, var_chains_buckets(num_entries)),
+        rhs_chains(mem_ctx, var_chains_buckets(num_entries))
+   {
+      this->num_entries = 0;
+   }
+
+   void add(acp_entry *entry)
+   {
+      this->entries.push_tail(entry);
+      this->lhs_chains.add(entry->lhs, &entry->lhs_link);
+      this->rhs_chains.add(entry->rhs, &entry->rhs_link);
+      this->num_entries++;
+   }
+
+   void remove(acp_entry *entry)
+   {
+      entry->remove();
+      entry->lhs_link.remove();
+      entry->rhs_link.remove();
+      this->num_entries--;
+   }
+
+   /** Returns the list of var_chain_link of the copies to \c var, if any */
+   exec_list *find_lhs(ir_variable *var)
+   {
+      return this->lhs_chains.find(var);
+   }
+
+   exec_list *find_rhs(ir_variable *var)
+   {
+      return this->rhs_chains.find(var);
+   }
+
+   void make_empty()
+   {
+      this->entries.make_empty();
+      this->lhs_chains.clear();
+      this->rhs_chains.clear();
+      this->num_entries = 0;
+   }
+
+   /** List of acp_entry */
+   exec_list entries;
+   unsigned num_entries;
+
+private:
+   var_chains lhs_chains;
+   var_chains rhs_chains;
 };
 
 
@@ -98,11 +167,12 @@ public:
       this->killed_all = false;
       this->mem_ctx = ralloc_context(NULL);
       this->shader_mem_ctx = NULL;
-      this->acp = new(mem_ctx) exec_list;
+      this->acp = new acp_table(mem_ctx, 0);
       this->kills = new(mem_ctx) exec_list;
    }
    ~ir_copy_propagation_elements_visitor()
    {
+      delete this->acp;
       ralloc_free(mem_ctx);
    }
 
@@ -119,8 +189,8 @@ public:
    void kill(kill_entry *k);
    void handle_if_block(exec_list *instructions);
 
-   /** List of acp_entry: The available copies to propagate */
-   exec_list *acp;
+   /** The available copies to propagate */
+   acp_table *acp;
    /**
     * List of kill_entry: The variables whose values were killed in this
     * block.
@@ -146,11 +216,12 @@ ir_copy_propagation_elements_visitor::visit_enter(ir_function_signature *ir)
     * block.  Any instructions at global scope will be shuffled into
     * main() at link time, so they're irrelevant to us.
     */
-   exec_list *orig_acp = this->acp;
+   acp_table *orig_acp = this->acp;
    exec_list *orig_kills = this->kills;
    bool orig_killed_all = this->killed_all;
 
-   this->acp = new(mem_ctx) exec_list;
+   acp_table acp(mem_ctx, 0);
+   this->acp = &acp;
    this->kills = new(mem_ctx) exec_list;
    this->killed_all = false;
 
@@ -244,15 +315,17 @@ ir_copy_propagation_elements_visitor::handle_rvalue(ir_rvalue **ir)
    /* Try to find ACP entries covering swizzle_chan[], hoping they're
     * the same source variable.
     */
-   foreach_iter(exec_list_iterator, iter, *this->acp) {
-      acp_entry *entry = (acp_entry *)iter.get();
-
-      if (var == entry->lhs) {
-	 for (int c = 0; c < chans; c++) {
-	    if (entry->write_mask & (1 << swizzle_chan[c])) {
-	       source[c] = entry->rhs;
-	       source_chan[c] = entry->swizzle[swizzle_chan[c]];
-	    }
+   exec_list *chain = this->acp->find_lhs(var);
+   if (!chain)
+      return;
+
+   foreach_list(node, chain) {
+      acp_entry *entry = (acp_entry *) ((var_chain_link *) node)->entry;
+
+      for (int c = 0; c < chans; c++) {
+	 if (entry->write_mask & (1 << swizzle_chan[c])) {
+	    source[c] = entry->rhs;
+	    source_chan[c] = entry->swizzle[swizzle_chan[c]];
 	 }
       }
    }
@@ -315,18 +388,19 @@ ir_copy_propagation_elements_visitor::visit_enter(ir_call *ir)
 void
 ir_copy_propagation_elements_visitor::handle_if_block(exec_list *instructions)
 {
-   exec_list *orig_acp = this->acp;
+   acp_table *orig_acp = this->acp;
    exec_list *orig_kills = this->kills;
    bool orig_killed_all = this->killed_all;
 
-   this->acp = new(mem_ctx) exec_list;
+   acp_table acp(mem_ctx, orig_acp->num_entries);
+   this->acp = &acp;
    this->kills = new(mem_ctx) exec_list;
    this->killed_all = false;
 
    /* Populate the initial acp with a copy of the original */
-   foreach_iter(exec_list_iterator, iter, *orig_acp) {
+   foreach_iter(exec_list_iterator, iter, orig_acp->entries) {
       acp_entry *a = (acp_entry *)iter.get();
-      this->acp->push_tail(new(this->mem_ctx) acp_entry(a));
+      this->acp->add(new(this->mem_ctx) acp_entry(a));
    }
 
    visit_list_elements(this, instructions);
@@ -364,7 +438,7 @@ ir_copy_propagation_elements_visitor::visit_enter(ir_if *ir)
 ir_visitor_status
 ir_copy_propagation_elements_visitor::visit_enter(ir_loop *ir)
 {
-   exec_list *orig_acp = this->acp;
+   acp_table *orig_acp = this->acp;
    exec_list *orig_kills = this->kills;
    bool orig_killed_all = this->killed_all;
 
@@ -372,7 +446,8 @@ ir_copy_propagation_elements_visitor::visit_enter(ir_loop *ir)
     * We could go through once, then go through again with the acp
     * cloned minus the killed entries after the first run through.
     */
-   this->acp = new(mem_ctx) exec_list;
+   acp_table acp(mem_ctx, 0);
+   this->acp = &acp;
    this->kills = new(mem_ctx) exec_list;
    this->killed_all = false;
 
@@ -400,18 +475,25 @@ ir_copy_propagation_elements_visitor::visit_enter(ir_loop *ir)
 void
 ir_copy_propagation_elements_visitor::kill(kill_entry *k)
 {
-   foreach_list_safe(node, acp) {
-      acp_entry *entry = (acp_entry *)node;
+   exec_list *chain;
+
+   chain = acp->find_lhs(k->var);
+   if (chain) {
+      foreach_list_safe(node, chain) {
+	 acp_entry *entry = (acp_entry *) ((var_chain_link *) node)->entry;
 
-      if (entry->lhs == k->var) {
 	 entry->write_mask = entry->write_mask & ~k->write_mask;
-	 if (entry->write_mask == 0) {
-	    entry->remove();
-	    continue;
-	 }
+	 if (entry->write_mask == 0)
+	    acp->remove(entry);
       }
-      if (entry->rhs == k->var) {
-	 entry->remove();
+   }
+
+   chain = acp->find_rhs(k->var);
+   if (chain) {
+      foreach_list_safe(node, chain) {
+	 acp_entry *entry = (acp_entry *) ((var_chain_link *) node)->entry;
+
+	 acp->remove(entry);
       }
    }
 
@@ -481,7 +563,7 @@ ir_copy_propagation_elements_visitor::add_copy(ir_assignment *ir)
 
    entry = new(this->mem_ctx) acp_entry(lhs->var, rhs->var, write_mask,
 					swizzle);
-   this->acp->push_tail(entry);
+   this->acp->add(entry);
 }
 
 bool
@@ -0,0 +1,806 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \file opt_cse.cpp
+ *
+ * Common subexpression elimination by value numbering of expressions and
+ * texture lookups.
+ *
+ * Every expression seen is hashed on its operation, type and operands and
+ * recorded as an available expression, until one of the variables it
+ * reads is written.  When an expression computing the same value shows up
+ * again, the first one is moved to a new temporary just before the
+ * statement it was in, and both are replaced by reads of the temporary.
+ *
+ * The available expressions of a block are also available in the blocks
+ * nested in it, so the then and else blocks of an if start out with a
+ * copy of the enclosing block's table, which makes this a global rather
+ * than basic block local pass for structured control flow.  Expressions
+ * first seen in a nested block are dropped at its end.  Like copy
+ * propagation, loop bodies start out empty, and calls kill everything as
+ * we don't know what they write.
+ *
+ * Reads of the temporaries made by this pass hash and compare like the
+ * expression they hold, so that an expression whose operands got replaced
+ * by a temporary still matches its other occurrences.
+ */
+
+#include "ir.h"
+#include "ir_visitor.h"
+#include "ir_rvalue_visitor.h"
+#include "ir_optimization.h"
+#include "glsl_types.h"
+#include "opt_var_chains.h"
+
+static bool debug = false;
+
+namespace {
+
+/**
+ * A value computed by an expression, shared by the copies of its ae_entry
+ * in nested blocks.
+ */
+struct ae_value {
+   /** Expression computing the value */
+   ir_rvalue *expr;
+
+   /** Where \c expr is, until it's moved to \c var */
+   ir_rvalue **rvalue;
+
+   /** The statement containing \c expr when it was first seen */
+   ir_instruction *base_ir;
+
+   unsigned hash;
+
+   /** The variables the value depends on */
+   ir_variable **reads;
+   unsigned num_reads;
+
+   /** Temporary holding the value, once it's been reused */
+   ir_variable *var;
+};
+
+class ae_entry : public exec_node
+{
+public:
+   ae_entry(void *mem_ctx, ae_value *value)
+   {
+      this->value = value;
+      this->hash_link.entry = this;
+      this->read_links = ralloc_array(mem_ctx, var_chain_link *,
+                                      value->num_reads);
+      for (unsigned i = 0; i < value->num_reads; i++) {
+         this->read_links[i] = new(mem_ctx) var_chain_link;
+         this->read_links[i]->entry = this;
+      }
+   }
+
+   ae_value *value;
+
+   /** Link in the ae_table chain of the hash value */
+   var_chain_link hash_link;
+
+   /** Links in the ae_table chains of the variables read */
+   var_chain_link **read_links;
+};
+
+
+/**
+ * The available expressions of a block, found by hash value, or by the
+ * variables they read when one of those is written.
+ */
+class ae_table
+{
+public:
+   ae_table(void *mem_ctx, unsigned num_entries)
+      : hash_chains(mem_ctx, var_chains_buckets(num_entries)),
+        read_chains(mem_ctx, var_chains_buckets(num_entries))
+   {
+      this->mem_ctx = mem_ctx;
+      this->num_entries = 0;
+   }
+
+   void add(ae_value *value)
+   {
+      ae_entry *entry = new(this->mem_ctx) ae_entry(this->mem_ctx, value);
+
+      this->entries.push_tail(entry);
+      this->hash_chains.add((void *) (uintptr_t) value->hash,
+                            &entry->hash_link);
+      for (unsigned i = 0; i < value->num_reads; i++)
+         this->read_chains.add(value->reads[i], entry->read_links[i]);
+      this->num_entries++;
+   }
+
+   void remove(ae_entry *entry)
+   {
+      entry->remove();
+      entry->hash_link.remove();
+      for (unsigned i = 0; i < entry->value->num_reads; i++)
+         entry->read_links[i]->remove();
+      this->num_entries--;
+   }
+
+   /** Returns the list of var_chain_link of the values hashing to \c hash */
+   exec_list *find(unsigned hash)
+   {
+      return this->hash_chains.find((void *) (uintptr_t) hash);
+   }
+
+   /** Removes the values depending on \c var */
+   void kill(ir_variable *var)
+   {
+      exec_list *chain = this->read_chains.find(var);
+
+      if (!chain)
+         return;
+
+      foreach_list_safe(node, chain)
+         remove((ae_entry *) ((var_chain_link *) node)->entry);
+   }
+
+   void make_empty()
+   {
+      this->entries.make_empty();
+      this->hash_chains.clear();
+      this->read_chains.clear();
+      this->num_entries = 0;
+   }
+
+   /** List of ae_entry */
+   exec_list entries;
+   unsigned num_entries;
+
+private:
+   void *mem_ctx;
+   var_chains hash_chains;
+   var_chains read_chains;
+};
+
+
+class kill_entry : public exec_node
+{
+public:
+   kill_entry(ir_variable *var)
+   {
+      assert(var);
+      this->var = var;
+   }
+
+   ir_variable *var;
+};
+
+class ir_cse_visitor : public ir_rvalue_visitor {
+public:
+   ir_cse_visitor()
+   {
+      this->progress = false;
+      this->killed_all = false;
+      this->in_function_body = false;
+      this->mem_ctx = ralloc_context(NULL);
+      this->ae = new ae_table(mem_ctx, 0);
+      this->kills = new(mem_ctx) exec_list;
+      this->temps = hash_table_ctor(var_chains_buckets(0),
+                                    hash_table_pointer_hash,
+                                    hash_table_pointer_compare);
+   }
+   ~ir_cse_visitor()
+   {
+      hash_table_dtor(this->temps);
+      delete this->ae;
+      ralloc_free(mem_ctx);
+   }
+
+   virtual ir_visitor_status visit_enter(class ir_loop *);
+   virtual ir_visitor_status visit_enter(class ir_function_signature *);
+   virtual ir_visitor_status visit_leave(class ir_assignment *);
+   virtual ir_visitor_status visit_leave(class ir_call *);
+   virtual ir_visitor_status visit_enter(class ir_if *);
+
+   void handle_rvalue(ir_rvalue **rvalue);
+
+   bool hash_rvalue(ir_rvalue *ir, unsigned *hash);
+   bool equals(ir_rvalue *a, ir_rvalue *b);
+   ir_rvalue *resolve(ir_rvalue *ir);
+   void add_reads(ir_rvalue *ir, ae_value *value);
+   ae_value *find(ir_rvalue *ir, unsigned hash);
+   void reuse(ae_value *value);
+
+   void kill(ir_variable *var);
+   void handle_block(exec_list *instructions, bool copy_ae);
+
+   /** The available expressions */
+   ae_table *ae;
+
+   /**
+    * List of kill_entry: The variables whose values were killed in this
+    * block.
+    */
+   exec_list *kills;
+
+   /** Maps the temporaries made by the pass to their ae_value */
+   hash_table *temps;
+
+   bool progress;
+
+   bool killed_all;
+
+   /**
+    * Whether we're in a function body.  Expressions at global scope, i.e.
+    * the initializers of globals in unlinked shaders, are neither reused
+    * nor recorded: the linker moves them into main(), so a temporary
+    * placed before them might not be set yet where it's read.
+    */
+   bool in_function_body;
+
+   void *mem_ctx;
+};
+
+} /* unnamed namespace */
+
+/**
+ * Returns the expression held by a temporary of ours, or \c ir itself.
+ */
+ir_rvalue *
+ir_cse_visitor::resolve(ir_rvalue *ir)
+{
+   ir_dereference_variable *deref = ir->as_dereference_variable();
+
+   while (deref) {
+      ae_value *value = (ae_value *) hash_table_find(this->temps, deref->var);
+      if (!value)
+         break;
+
+      ir = value->expr;
+      deref = ir->as_dereference_variable();
+   }
+
+   return ir;
+}
+
+static inline unsigned
+hash_combine(unsigned hash, unsigned value)
+{
+   return hash * 31 + value;
+}
+
+/**
+ * Hashes an rvalue tree, returning false if it contains anything that
+ * isn't a plain function of its variables.
+ */
+bool
+ir_cse_visitor::hash_rvalue(ir_rvalue *ir, unsigned *hash)
+{
+   if (ir == NULL) {
+      *hash = 0;
+      return true;
+   }
+
+   ir_dereference_variable *temp = ir->as_dereference_variable();
+   if (temp) {
+      ae_value *value = (ae_value *) hash_table_find(this->temps, temp->var);
+      if (value) {
+         *hash = value->hash;
+         return true;
+      }
+   }
+
+   unsigned h = hash_combine(ir->ir_type, (unsigned) (uintptr_t) ir->type);
+   unsigned op;
+
+   switch (ir->ir_type) {
+   case ir_type_expression: {
+      ir_expression *expr = (ir_expression *) ir;
+
+      h = hash_combine(h, expr->operation);
+      for (unsigned i = 0; i < expr->get_num_operands(); i++) {
+         if (!hash_rvalue(expr->operands[i], &op))
+            return false;
+         h = hash_combine(h, op);
+      }
+      break;
+   }
+
+   case ir_type_texture: {
+      ir_texture *tex = (ir_texture *) ir;
+      ir_rvalue *operands[] = {
+         tex->sampler, tex->coordinate, tex->projector,
+         tex->shadow_comparitor, tex->offset, NULL, NULL
+      };
+
+      switch (tex->op) {
+      case ir_tex:
+         break;
+      case ir_txb:
+         operands[5] = tex->lod_info.bias;
+         break;
+      case ir_txf:
+      case ir_txl:
+      case ir_txs:
+         operands[5] = tex->lod_info.lod;
+         break;
+      case ir_txd:
+         operands[5] = tex->lod_info.grad.dPdx;
+         operands[6] = tex->lod_info.grad.dPdy;
+         break;
+      }
+
+      h = hash_combine(h, tex->op);
+      for (unsigned i = 0; i < sizeof(operands) / sizeof(operands[0]); i++) {
+         if (!hash_rvalue(operands[i], &op))
+            return false;
+         h = hash_combine(h, op);
+      }
+      break;
+   }
+
+   case ir_type_swizzle: {
+      ir_swizzle *swiz = (ir_swizzle *) ir;
+
+      if (!hash_rvalue(swiz->val, &op))
+         return false;
+      h = hash_combine(h, op);
+      h = hash_combine(h, swiz->mask.x | swiz->mask.y << 2 |
+                       swiz->mask.z << 4 | swiz->mask.w << 6);
+      break;
+   }
+
+   case ir_type_dereference_variable:
+      h = hash_combine(h, (unsigned) (uintptr_t)
+                       ((ir_dereference_variable *) ir)->var);
+      break;
+
+   case ir_type_dereference_array: {
+      ir_dereference_array *deref = (ir_dereference_array *) ir;
+
+      if (!hash_rvalue(deref->array, &op))
+         return false;
+      h = hash_combine(h, op);
+      if (!hash_rvalue(deref->array_index, &op))
+         return false;
+      h = hash_combine(h, op);
+      break;
+   }
+
+   case ir_type_dereference_record: {
+      ir_dereference_record *deref = (ir_dereference_record *) ir;
+
+      if (!hash_rvalue(deref->record, &op))
+         return false;
+      h = hash_combine(h, op);
+      for (const char *c = deref->field; *c; c++)
+         h = hash_combine(h, *c);
+      break;
+   }
+
+   case ir_type_constant: {
+      ir_constant *c = (ir_constant *) ir;
+
+      if (!c->type->is_scalar() && !c->type->is_vector() &&
+          !c->type->is_matrix())
+         return false;
+
+      for (unsigned i = 0; i < c->type->components(); i++) {
+         if (c->type->base_type == GLSL_TYPE_BOOL)
+            h = hash_combine(h, c->value.b[i]);
+         else
+            h = hash_combine(h, c->value.u[i]);
+      }
+      break;
+   }
+
+   default:
+      return false;
+   }
+
+   *hash = h;
+   return true;
+}
+
+/**
+ * Returns whether two rvalue trees accepted by hash_rvalue() compute the
+ * same value.
+ */
+bool
+ir_cse_visitor::equals(ir_rvalue *a, ir_rvalue *b)
+{
+   if (a == NULL || b == NULL)
+      return a == b;
+
+   a = resolve(a);
+   b = resolve(b);
+
+   if (a == b)
+      return true;
+
+   if (a->ir_type != b->ir_type || a->type != b->type)
+      return false;
+
+   switch (a->ir_type) {
+   case ir_type_expression: {
+      ir_expression *ea = (ir_expression *) a;
+      ir_expression *eb = (ir_expression *) b;
+
+      if (ea->operation != eb->operation)
+         return false;
+
+      for (unsigned i = 0; i < ea->get_num_operands(); i++) {
+         if (!equals(ea->operands[i], eb->operands[i]))
+            return false;
+      }
+      return true;
+   }
+
+   case ir_type_texture: {
+      ir_texture *ta = (ir_texture *) a;
+      ir_texture *tb = (ir_texture *) b;
+
+      if (ta->op != tb->op ||
+          !equals(ta->sampler, tb->sampler) ||
+          !equals(ta->coordinate, tb->coordinate) ||
+          !equals(ta->projector, tb->projector) ||
+          !equals(ta->shadow_comparitor, tb->shadow_comparitor) ||
+          !equals(ta->offset, tb->offset))
+         return false;
+
+      switch (ta->op) {
+      case ir_tex:
+         return true;
+      case ir_txb:
+         return equals(ta->lod_info.bias, tb->lod_info.bias);
+      case ir_txf:
+      case ir_txl:
+      case ir_txs:
+         return equals(ta->lod_info.lod, tb->lod_info.lod);
+      case ir_txd:
+         return equals(ta->lod_info.grad.dPdx, tb->lod_info.grad.dPdx) &&
+                equals(ta->lod_info.grad.dPdy, tb->lod_info.grad.dPdy);
+      }
+      return false;
+   }
+
+   case ir_type_swizzle: {
+      ir_swizzle *sa = (ir_swizzle *) a;
+      ir_swizzle *sb = (ir_swizzle *) b;
+
+      return sa->mask.x == sb->mask.x &&
+             sa->mask.y == sb->mask.y &&
+             sa->mask.z == sb->mask.z &&
+             sa->mask.w == sb->mask.w &&
+             sa->mask.num_components == sb->mask.num_components &&
+             equals(sa->val, sb->val);
+   }
+
+   case ir_type_dereference_variable:
+      return ((ir_dereference_variable *) a)->var ==
+             ((ir_dereference_variable *) b)->var;
+
+   case ir_type_dereference_array: {
+      ir_dereference_array *da = (ir_dereference_array *) a;
+      ir_dereference_array *db = (ir_dereference_array *) b;
+
+      return equals(da->array, db->array) &&
+             equals(da->array_index, db->array_index);
+   }
+
+   case ir_type_dereference_record: {
+      ir_dereference_record *da = (ir_dereference_record *) a;
+      ir_dereference_record *db = (ir_dereference_record *) b;
+
+      return strcmp(da->field, db->field) == 0 &&
+             equals(da->record, db->record);
+   }
+
+   case ir_type_constant: {
+      ir_constant *ca = (ir_constant *) a;
+      ir_constant *cb = (ir_constant *) b;
+
+      for (unsigned i = 0; i < ca->type->components(); i++) {
+         if (ca->type->base_type == GLSL_TYPE_BOOL) {
+            if (ca->value.b[i] != cb->value.b[i])
+               return false;
+         } else {
+            if (ca->value.u[i] != cb->value.u[i])
+               return false;
+         }
+      }
+      return true;
+   }
+
+   default:
+      return false;
+   }
+}
+
+namespace {
+
+class ir_cse_reads_visitor : public ir_hierarchical_visitor {
+public:
+   ir_cse_reads_visitor(ir_cse_visitor *cse, ae_value *value)
+   {
+      this->cse = cse;
+      this->value = value;
+   }
+
+   void add(ir_variable *var)
+   {
+      for (unsigned i = 0; i < value->num_reads; i++) {
+         if (value->reads[i] == var)
+            return;
+      }
+
+      value->reads = reralloc(value, value->reads, ir_variable *,
+                              value->num_reads + 1);
+      value->reads[value->num_reads++] = var;
+   }
+
+   virtual ir_visitor_status visit(ir_dereference_variable *ir)
+   {
+      ae_value *temp = (ae_value *) hash_table_find(cse->temps, ir->var);
+
+      if (temp) {
+         for (unsigned i = 0; i < temp->num_reads; i++)
+            add(temp->reads[i]);
+      } else {
+         add(ir->var);
+      }
+
+      return visit_continue;
+   }
+
+   ir_cse_visitor *cse;
+   ae_value *value;
+};
+
+} /* unnamed namespace */
+
+/**
+ * Records the variables \c ir depends on in \c value, looking through our
+ * temporaries.
+ */
+void
+ir_cse_visitor::add_reads(ir_rvalue *ir, ae_value *value)
+{
+   ir_cse_reads_visitor v(this, value);
+
+   ir->accept(&v);
+}
+
+ae_value *
+ir_cse_visitor::find(ir_rvalue *ir, unsigned hash)
+{
+   exec_list *chain = this->ae->find(hash);
+
+   if (!chain)
+      return NULL;
+
+   foreach_list(node, chain) {
+      ae_entry *entry = (ae_entry *) ((var_chain_link *) node)->entry;
+
+      if (entry->value->hash == hash && equals(entry->value->expr, ir))
+         return entry->value;
+   }
+
+   return NULL;
+}
+
+/**
+ * Moves the first occurrence of \c value to a temporary, if that hasn't
+ * been done yet.
+ */
+void
+ir_cse_visitor::reuse(ae_value *value)
+{
+   if (value->var)
+      return;
+
+   void *ctx = ralloc_parent(value->expr);
+   ir_variable *var = new(ctx) ir_variable(value->expr->type, "cse",
+                                           ir_var_temporary);
+
+   value->base_ir->insert_before(var);
+   value->base_ir->insert_before(
+      new(ctx) ir_assignment(new(ctx) ir_dereference_variable(var),
+                             value->expr, NULL));
+   *value->rvalue = new(ctx) ir_dereference_variable(var);
+   value->rvalue = NULL;
+   value->var = var;
+
+   hash_table_insert(this->temps, value, var);
+}
+
+void
+ir_cse_visitor::handle_rvalue(ir_rvalue **rvalue)
+{
+   if (!*rvalue || this->in_assignee || !this->in_function_body)
+      return;
+
+   ir_rvalue *ir = *rvalue;
+   if (ir->ir_type != ir_type_expression && ir->ir_type != ir_type_texture)
+      return;
+
+   unsigned hash;
+   if (!hash_rvalue(ir, &hash))
+      return;
+
+   ae_value *value = find(ir, hash);
+
+   if (!value) {
+      value = rzalloc(this->mem_ctx, ae_value);
+      value->expr = ir;
+      value->rvalue = rvalue;
+      value->base_ir = this->base_ir;
+      value->hash = hash;
+      add_reads(ir, value);
+
+      this->ae->add(value);
+      return;
+   }
+
+   if (debug) {
+      printf("CSE of:\n");
+      ir->print();
+      printf("\n");
+   }
+
+   reuse(value);
+   *rvalue = new(ralloc_parent(ir)) ir_dereference_variable(value->var);
+   this->progress = true;
+}
+
+ir_visitor_status
+ir_cse_visitor::visit_enter(ir_function_signature *ir)
+{
+   ae_table *orig_ae = this->ae;
+   exec_list *orig_kills = this->kills;
+   bool orig_killed_all = this->killed_all;
+
+   ae_table ae(mem_ctx, 0);
+   this->ae = &ae;
+   this->kills = new(mem_ctx) exec_list;
+   this->killed_all = false;
+   this->in_function_body = true;
+
+   visit_list_elements(this, &ir->body);
+
+   this->kills = orig_kills;
+   this->ae = orig_ae;
+   this->killed_all = orig_killed_all;
+   this->in_function_body = false;
+
+   return visit_continue_with_parent;
+}
+
+ir_visitor_status
+ir_cse_visitor::visit_leave(ir_assignment *ir)
+{
+   ir_rvalue_visitor::visit_leave(ir);
+
+   kill(ir->lhs->variable_referenced());
+
+   return visit_continue;
+}
+
+ir_visitor_status
+ir_cse_visitor::visit_leave(ir_call *ir)
+{
+   ir_rvalue_visitor::visit_leave(ir);
+
+   /* We don't know what the callee writes, so kill everything. */
+   this->ae->make_empty();
+   this->killed_all = true;
+
+   return visit_continue;
+}
+
+/**
+ * Visits a nested block, starting with a copy of the enclosing block's
+ * available expressions if \c copy_ae, then kills what it wrote in the
+ * enclosing block.
+ */
+void
+ir_cse_visitor::handle_block(exec_list *instructions, bool copy_ae)
+{
+   ae_table *orig_ae = this->ae;
+   exec_list *orig_kills = this->kills;
+   bool orig_killed_all = this->killed_all;
+
+   ae_table ae(mem_ctx, copy_ae ? orig_ae->num_entries : 0);
+   this->ae = &ae;
+   this->kills = new(mem_ctx) exec_list;
+   this->killed_all = false;
+
+   if (copy_ae) {
+      foreach_list(node, &orig_ae->entries) {
+         ae_entry *entry = (ae_entry *) node;
+         this->ae->add(entry->value);
+      }
+   }
+
+   visit_list_elements(this, instructions);
+
+   if (this->killed_all)
+      orig_ae->make_empty();
+
+   exec_list *new_kills = this->kills;
+   this->kills = orig_kills;
+   this->ae = orig_ae;
+   this->killed_all = this->killed_all || orig_killed_all;
+
+   foreach_list(node, new_kills) {
+      kill_entry *k = (kill_entry *) node;
+      kill(k->var);
+   }
+}
+
+ir_visitor_status
+ir_cse_visitor::visit_enter(ir_if *ir)
+{
+   ir->condition->accept(this);
+   handle_rvalue(&ir->condition);
+
+   handle_block(&ir->then_instructions, true);
+   handle_block(&ir->else_instructions, true);
+
+   /* handle_block() already descended into the children. */
+   return visit_continue_with_parent;
+}
+
+ir_visitor_status
+ir_cse_visitor::visit_enter(ir_loop *ir)
+{
+   /* FINISHME: The body could start out with the available expressions
+    * that don't depend on anything the body writes.
+    */
+   handle_block(&ir->body_instructions, false);
+
+   if (ir->counter)
+      kill(ir->counter);
+
+   /* already descended into the children. */
+   return visit_continue_with_parent;
+}
+
+void
+ir_cse_visitor::kill(ir_variable *var)
+{
+   assert(var != NULL);
+
+   this->ae->kill(var);
+
+   this->kills->push_tail(new(this->mem_ctx) kill_entry(var));
+}
+
+/**
+ * Does common subexpression elimination on the instruction stream.
+ */
+bool
+do_cse(exec_list *instructions)
+{
+   ir_cse_visitor v;
+
+   visit_list_elements(&v, instructions);
+
+   return v.progress;
+}
@@ -0,0 +1,266 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \file opt_pass_manager.cpp
+ *
+ * Worklist driven optimization pass runner.  See opt_pass_manager.h.
+ *
+ * Setting MESA_GLSL=optstats prints, for every run, how many sweeps over
+ * the pass list it took and how often and how long each pass ran.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include "ralloc.h"
+#include "opt_pass_manager.h"
+
+static bool
+opt_stats_enabled()
+{
+   static int enabled = -1;
+
+   if (enabled < 0) {
+      const char *env = getenv("MESA_GLSL");
+      enabled = env != NULL && strstr(env, "optstats") != NULL;
+   }
+
+   return enabled != 0;
+}
+
+opt_pass_manager::opt_pass_manager(const struct opt_pass *passes,
+                                   unsigned num_passes,
+                                   const struct opt_pass_params *params)
+   : passes(passes), num_passes(num_passes), params(params)
+{
+   assert(num_passes <= OPT_PASS_MAX);
+
+   this->local_passes = 0;
+   for (unsigned i = 0; i < num_passes; i++) {
+      if (passes[i].per_function)
+         this->local_passes |= 1u << i;
+   }
+
+   this->global_dirty = 0;
+   this->regions = NULL;
+   this->num_regions = 0;
+   this->mem_ctx = NULL;
+   this->sweeps = 0;
+   memset(this->stats, 0, sizeof(this->stats));
+}
+
+/**
+ * (Re)build the list of functions the per_function passes run on, giving
+ * each the given dirty mask.
+ */
+void
+opt_pass_manager::build_regions(exec_list *instructions, unsigned dirty)
+{
+   unsigned count = 0;
+   bool whole_list = false;
+
+   foreach_list(node, instructions) {
+      ir_instruction *ir = (ir_instruction *) node;
+
+      if (ir->as_function())
+         count++;
+      else if (!ir->as_variable())
+         whole_list = true;
+   }
+
+   ralloc_free(this->regions);
+
+   /* Unlinked shaders keep global initializers outside of any function,
+    * which the passes must see too, so give up on the finer granularity.
+    */
+   if (whole_list || count == 0) {
+      this->regions = ralloc_array(this->mem_ctx, struct region, 1);
+      this->regions[0].function = NULL;
+      this->regions[0].dirty = dirty;
+      this->num_regions = 1;
+      return;
+   }
+
+   this->regions = ralloc_array(this->mem_ctx, struct region, count);
+   this->num_regions = 0;
+
+   foreach_list(node, instructions) {
+      ir_function *f = ((ir_instruction *) node)->as_function();
+
+      if (f) {
+         this->regions[this->num_regions].function = f;
+         this->regions[this->num_regions].dirty = dirty;
+         this->num_regions++;
+      }
+   }
+}
+
+/**
+ * Mask of the passes which are dirty anywhere.
+ */
+unsigned
+opt_pass_manager::dirty_mask() const
+{
+   unsigned dirty = this->global_dirty;
+
+   for (unsigned r = 0; r < this->num_regions; r++)
+      dirty |= this->regions[r].dirty;
+
+   return dirty;
+}
+
+/**
+ * Run pass \c i wherever it is dirty.  Returns whether it made progress.
+ */
+bool
+opt_pass_manager::run_pass(unsigned i, exec_list *instructions)
+{
+   const struct opt_pass *pass = &this->passes[i];
+   const unsigned bit = 1u << i;
+   const unsigned local = pass->invalidates & this->local_passes;
+   const unsigned global = pass->invalidates & ~this->local_passes;
+   struct opt_pass_stats *stats = &this->stats[i];
+   bool progress = false;
+   clock_t start = 0;
+
+   if (opt_stats_enabled())
+      start = clock();
+
+   if (!pass->per_function) {
+      this->global_dirty &= ~bit;
+      stats->runs++;
+
+      progress = pass->run(instructions, this->params);
+
+      if (progress) {
+         /* A whole-program pass may have touched, added or removed any
+          * function.
+          */
+         unsigned dirty = (dirty_mask() & this->local_passes) | local;
+
+         this->global_dirty |= global;
+         build_regions(instructions, dirty);
+      }
+   } else {
+      for (unsigned r = 0; r < this->num_regions; r++) {
+         struct region *region = &this->regions[r];
+         bool region_progress;
+
+         if (!(region->dirty & bit))
+            continue;
+
+         region->dirty &= ~bit;
+         stats->runs++;
+
+         if (region->function == NULL) {
+            region_progress = pass->run(instructions, this->params);
+         } else {
+            /* Run the pass on a list holding just this function, keeping
+             * its place in the real list with a marker node.
+             */
+            exec_node marker;
+            exec_list single;
+
+            region->function->replace_with(&marker);
+            single.push_tail(region->function);
+
+            region_progress = pass->run(&single, this->params);
+
+            foreach_list_safe(node, &single) {
+               node->remove();
+               marker.insert_before(node);
+            }
+            marker.remove();
+         }
+
+         if (region_progress) {
+            region->dirty |= local;
+            this->global_dirty |= global;
+            progress = true;
+         }
+      }
+   }
+
+   if (progress)
+      stats->progress++;
+
+   if (opt_stats_enabled())
+      stats->seconds += (double) (clock() - start) / CLOCKS_PER_SEC;
+
+   return progress;
+}
+
+void
+opt_pass_manager::print_stats() const
+{
+   printf("GLSL optimization: %u sweep(s), %u function region(s)\n",
+          this->sweeps, this->num_regions);
+   printf("   %-28s %6s %9s %10s\n", "pass", "runs", "progress", "usecs");
+   for (unsigned i = 0; i < this->num_passes; i++) {
+      if (this->stats[i].runs == 0)
+         continue;
+
+      printf("   %-28s %6u %9u %10.0f\n",
+             this->passes[i].name,
+             this->stats[i].runs,
+             this->stats[i].progress,
+             this->stats[i].seconds * 1e6);
+   }
+}
+
+bool
+opt_pass_manager::run(exec_list *instructions)
+{
+   const unsigned all = num_passes < 32 ? (1u << num_passes) - 1 : ~0u;
+   bool progress = false;
+
+   this->mem_ctx = ralloc_context(NULL);
+   this->regions = NULL;
+   this->global_dirty = all & ~this->local_passes;
+   build_regions(instructions, all & this->local_passes);
+
+   while (dirty_mask() != 0) {
+      this->sweeps++;
+
+      for (unsigned i = 0; i < this->num_passes; i++) {
+         if (!(dirty_mask() & (1u << i)))
+            continue;
+
+         if (run_pass(i, instructions))
+            progress = true;
+      }
+   }
+
+   if (opt_stats_enabled())
+      print_stats();
+
+   ralloc_free(this->mem_ctx);
+   this->mem_ctx = NULL;
+   this->regions = NULL;
+   this->num_regions = 0;
+
+   return progress;
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \file opt_pass_manager.h
+ *
+ * Runs a set of optimization passes until none of them makes progress,
+ * without re-running the passes which can't have anything left to do.
+ */
+
+#pragma once
+#ifndef OPT_PASS_MANAGER_H
+#define OPT_PASS_MANAGER_H
+
+#include "ir.h"
+
+/**
+ * Parameters shared by all the passes of a pass manager run.
+ */
+struct opt_pass_params {
+   bool linked;
+   bool uniform_locations_assigned;
+   unsigned max_unroll_iterations;
+};
+
+/**
+ * Description of one optimization pass.
+ */
+struct opt_pass {
+   const char *name;
+
+   /** Runs the pass, returning whether it made progress. */
+   bool (*run)(exec_list *instructions, const struct opt_pass_params *params);
+
+   /**
+    * Whether the pass only looks at one function at a time, so that it
+    * can be run on the functions which changed, alone.  Passes that count
+    * variable references or otherwise look at the whole program must set
+    * this to false.
+    */
+   bool per_function;
+
+   /**
+    * Mask of the passes, by index, which may have new work to do after
+    * this pass made progress.  Include the pass itself unless it's known
+    * to leave nothing for a second run.
+    */
+   unsigned invalidates;
+};
+
+#define OPT_PASS_MAX 32
+
+/**
+ * Per pass counters reported by the MESA_GLSL=optstats option.
+ */
+struct opt_pass_stats {
+   unsigned runs;
+   unsigned progress;
+   double seconds;
+};
+
+/**
+ * Worklist driven replacement for a "run every pass until no progress"
+ * loop.
+ *
+ * Every pass starts out dirty.  Passes are run in order, skipping the
+ * clean ones, and whenever one makes progress the passes listed in its
+ * invalidates mask become dirty again.  Dirtiness is tracked per function
+ * for the per_function passes, so that a change in one function doesn't
+ * make them visit all the others again.  The run ends once nothing is
+ * dirty.
+ */
+class opt_pass_manager {
+public:
+   opt_pass_manager(const struct opt_pass *passes, unsigned num_passes,
+                    const struct opt_pass_params *params);
+
+   /** Returns whether any pass made progress. */
+   bool run(exec_list *instructions);
+
+private:
+   void build_regions(exec_list *instructions, unsigned dirty);
+   unsigned dirty_mask() const;
+   bool run_pass(unsigned i, exec_list *instructions);
+   void print_stats() const;
+
+   const struct opt_pass *passes;
+   unsigned num_passes;
+   const struct opt_pass_params *params;
+
+   /** Mask of the passes with per_function set */
+   unsigned local_passes;
+
+   /** Dirty mask of the whole-program passes */
+   unsigned global_dirty;
+
+   /**
+    * Functions the per_function passes are run on, along with their dirty
+    * masks.  A single region with a NULL function stands for the whole
+    * instruction list, for IR that has code outside of functions.
+    */
+   struct region {
+      ir_function *function;
+      unsigned dirty;
+   } *regions;
+   unsigned num_regions;
+   void *mem_ctx;
+
+   unsigned sweeps;
+   struct opt_pass_stats stats[OPT_PASS_MAX];
+};
+
+#endif /* OPT_PASS_MANAGER_H */
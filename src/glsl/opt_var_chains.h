@@ -0,0 +1,114 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \file opt_var_chains.h
+ *
+ * Hash table from ir_variable to a list of nodes, used by the copy and
+ * constant propagation passes to find the entries of their available copy
+ * tables that involve a variable without walking the whole table.  Any
+ * other pointer sized key works too.  Every
+ * entry embeds one exec_node per chain it is on, and is removed from a
+ * chain by removing that node.
+ */
+
+#pragma once
+#ifndef OPT_VAR_CHAINS_H
+#define OPT_VAR_CHAINS_H
+
+#include "ir.h"
+#include "program/hash_table.h"
+
+/**
+ * Node of a chain, pointing back at the entry which embeds it.
+ */
+class var_chain_link : public exec_node
+{
+public:
+   var_chain_link()
+   {
+      this->entry = NULL;
+   }
+
+   void *entry;
+};
+
+class var_chains {
+public:
+   /**
+    * \param mem_ctx      context the chain lists are allocated from
+    * \param num_buckets  expected number of variables, the hash table
+    *                     does not grow
+    */
+   var_chains(void *mem_ctx, unsigned num_buckets)
+   {
+      this->mem_ctx = mem_ctx;
+      this->ht = hash_table_ctor(num_buckets, hash_table_pointer_hash,
+                                 hash_table_pointer_compare);
+   }
+
+   ~var_chains()
+   {
+      hash_table_dtor(this->ht);
+   }
+
+   /** Returns the chain of \c key, or NULL if nothing was ever added. */
+   exec_list *find(const void *key)
+   {
+      return (exec_list *) hash_table_find(this->ht, key);
+   }
+
+   void add(const void *key, var_chain_link *link)
+   {
+      exec_list *chain = find(key);
+
+      if (!chain) {
+         chain = new(this->mem_ctx) exec_list;
+         hash_table_insert(this->ht, chain, key);
+      }
+
+      chain->push_tail(link);
+   }
+
+   /** Forgets all chains, without touching the nodes on them. */
+   void clear()
+   {
+      hash_table_clear(this->ht);
+   }
+
+private:
+   void *mem_ctx;
+   hash_table *ht;
+};
+
+/**
+ * Hash table size for a table which starts out with \c num_entries
+ * entries, typically copied from an enclosing block.
+ */
+static inline unsigned
+var_chains_buckets(unsigned num_entries)
+{
+   return num_entries * 2 > 256 ? num_entries * 2 : 256;
+}
+
+#endif /* OPT_VAR_CHAINS_H */
@@ -0,0 +1,1969 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \file program_binary.cpp
+ *
+ * Serialization of linked GLSL programs.
+ *
+ * A program binary holds the IR of each linked shader, as it is when
+ * \c link_shaders returns, along with the link results that can't be
+ * recomputed from that IR: the uniform blocks, transform feedback outputs,
+ * clip distance usage, etc.  Uniform storage is not serialized; it is
+ * rebuilt from the uniform variables by \c link_assign_uniform_locations
+ * when the binary is loaded, and the driver's LinkShader hook then runs on
+ * the restored IR exactly as it would after a real link.
+ *
+ * Layout, all values being 32-bit host endian words:
+ *
+ *    magic, format version, checksum of everything that follows
+ *    identity of the driver and Mesa version which produced the binary
+ *    program level link results
+ *    for each shader stage:
+ *       whether the stage is present, and if it is:
+ *       shader level link results
+ *       variable table
+ *       function table
+ *       instruction stream
+ *
+ * Variables and function signatures are written once, up front, and are
+ * referred to by index from the instruction stream, so that references to
+ * a variable may come before its declaration (loop counters, parameters)
+ * and calls may come before the callee's body.  Within the stream each
+ * instruction starts with its \c ir_node_type, and \c ir_type_unset stands
+ * for a NULL rvalue or for the end of an instruction list.
+ */
+
+#include <string.h>
+#include "main/core.h"
+#include "main/version.h"
+#include "ir.h"
+#include "glsl_types.h"
+#include "linker.h"
+#include "program/hash_table.h"
+#include "program_binary.h"
+
+extern "C" {
+#include "main/shaderobj.h"
+}
+
+/** "MGPB" */
+#define PROGRAM_BINARY_MAGIC 0x4250474d
+
+/** Bump whenever the encoding changes */
+#define PROGRAM_BINARY_VERSION 1
+
+/** Size of the magic, version and checksum words */
+#define PROGRAM_BINARY_HEADER_SIZE 12
+
+/** Index of a NULL variable, length of a NULL string */
+#define NULL_INDEX 0xffffffffu
+
+namespace {
+
+class blob_writer {
+public:
+   blob_writer(void *mem_ctx)
+      : mem_ctx(mem_ctx), data(NULL), size(0), capacity(0)
+   {
+   }
+
+   void write(const void *bytes, unsigned n)
+   {
+      if (this->size + n > this->capacity) {
+	 this->capacity = MAX2(MAX2(this->capacity * 2, this->size + n), 4096);
+	 this->data = reralloc(this->mem_ctx, this->data, uint8_t,
+			       this->capacity);
+      }
+
+      memcpy(this->data + this->size, bytes, n);
+      this->size += n;
+   }
+
+   void write_uint(unsigned value)
+   {
+      write(&value, sizeof(value));
+   }
+
+   void write_int(int value)
+   {
+      write(&value, sizeof(value));
+   }
+
+   void write_string(const char *str)
+   {
+      if (str == NULL) {
+	 write_uint(NULL_INDEX);
+	 return;
+      }
+
+      const unsigned len = strlen(str);
+      write_uint(len);
+      write(str, len);
+   }
+
+   void *mem_ctx;
+   uint8_t *data;
+   unsigned size;
+   unsigned capacity;
+};
+
+/**
+ * Reader for a blob.  Reading past the end sets \c overrun and returns
+ * zeros from then on, so that callers only need to check for it once in a
+ * while.
+ */
+class blob_reader {
+public:
+   blob_reader(const void *data, unsigned size)
+      : cur((const uint8_t *) data), end((const uint8_t *) data + size),
+	overrun(false)
+   {
+   }
+
+   unsigned remaining() const
+   {
+      return this->end - this->cur;
+   }
+
+   bool read(void *dst, unsigned n)
+   {
+      if (this->overrun || remaining() < n) {
+	 this->overrun = true;
+	 memset(dst, 0, n);
+	 return false;
+      }
+
+      memcpy(dst, this->cur, n);
+      this->cur += n;
+      return true;
+   }
+
+   unsigned read_uint()
+   {
+      unsigned value;
+      read(&value, sizeof(value));
+      return value;
+   }
+
+   int read_int()
+   {
+      int value;
+      read(&value, sizeof(value));
+      return value;
+   }
+
+   /**
+    * Read a string into a copy allocated off of \c mem_ctx.
+    *
+    * \return The copy, or \c NULL for a NULL string or on overrun.
+    */
+   char *read_string(void *mem_ctx)
+   {
+      const unsigned len = read_uint();
+
+      if (len == NULL_INDEX)
+	 return NULL;
+
+      if (this->overrun || remaining() < len) {
+	 this->overrun = true;
+	 return NULL;
+      }
+
+      char *str = ralloc_strndup(mem_ctx, (const char *) this->cur, len);
+      this->cur += len;
+      return str;
+   }
+
+   /** Skip \c n bytes if they match \c bytes, fail otherwise. */
+   bool read_match(const void *bytes, unsigned n)
+   {
+      if (this->overrun || remaining() < n
+	  || memcmp(this->cur, bytes, n) != 0) {
+	 this->overrun = true;
+	 return false;
+      }
+
+      this->cur += n;
+      return true;
+   }
+
+   const uint8_t *cur;
+   const uint8_t *end;
+   bool overrun;
+};
+
+} /* anonymous namespace */
+
+
+static uint32_t
+checksum(const uint8_t *data, unsigned size)
+{
+   uint32_t hash = 0x811c9dc5;  /* FNV-1a 32-bit offset basis */
+
+   for (unsigned i = 0; i < size; i++) {
+      hash ^= data[i];
+      hash *= 0x01000193;       /* FNV-1a 32-bit prime */
+   }
+
+   return hash;
+}
+
+
+/**
+ * Write what a binary is only valid for: the Mesa version, the driver, the
+ * API of the context and the encoding of the IR.
+ */
+static void
+write_identity(blob_writer &blob, struct gl_context *ctx)
+{
+   const GLubyte *renderer = NULL;
+
+   if (ctx->Driver.GetString)
+      renderer = ctx->Driver.GetString(ctx, GL_RENDERER);
+
+   blob.write_string(MESA_VERSION_STRING);
+   blob.write_string(renderer ? (const char *) renderer : "");
+   blob.write_uint(ctx->API);
+   blob.write_uint(sizeof(void *));
+   blob.write_uint(ir_last_opcode);
+   blob.write_uint(ir_type_max);
+}
+
+
+static void
+write_type(blob_writer &blob, const glsl_type *type)
+{
+   blob.write_uint(type->base_type);
+
+   switch (type->base_type) {
+   case GLSL_TYPE_UINT:
+   case GLSL_TYPE_INT:
+   case GLSL_TYPE_FLOAT:
+   case GLSL_TYPE_BOOL:
+      blob.write_uint(type->vector_elements);
+      blob.write_uint(type->matrix_columns);
+      break;
+   case GLSL_TYPE_SAMPLER:
+      blob.write_uint(type->sampler_dimensionality);
+      blob.write_uint(type->sampler_shadow);
+      blob.write_uint(type->sampler_array);
+      blob.write_uint(type->sampler_type);
+      break;
+   case GLSL_TYPE_STRUCT:
+      blob.write_string(type->name);
+      blob.write_uint(type->length);
+      for (unsigned i = 0; i < type->length; i++) {
+	 blob.write_string(type->fields.structure[i].name);
+	 write_type(blob, type->fields.structure[i].type);
+      }
+      break;
+   case GLSL_TYPE_ARRAY:
+      blob.write_uint(type->length);
+      write_type(blob, type->fields.array);
+      break;
+   default:
+      break;
+   }
+}
+
+
+/**
+ * \return The type, or \c glsl_type::error_type if the encoding is invalid.
+ */
+static const glsl_type *
+read_type(blob_reader &blob)
+{
+   const unsigned base_type = blob.read_uint();
+
+   switch (base_type) {
+   case GLSL_TYPE_UINT:
+   case GLSL_TYPE_INT:
+   case GLSL_TYPE_FLOAT:
+   case GLSL_TYPE_BOOL: {
+      const unsigned rows = blob.read_uint();
+      const unsigned columns = blob.read_uint();
+
+      return glsl_type::get_instance(base_type, rows, columns);
+   }
+   case GLSL_TYPE_SAMPLER: {
+      const unsigned dim = blob.read_uint();
+      const unsigned shadow = blob.read_uint();
+      const unsigned array = blob.read_uint();
+      const unsigned type = blob.read_uint();
+
+      return glsl_type::get_sampler_instance((glsl_sampler_dim) dim,
+					     shadow != 0, array != 0, type);
+   }
+   case GLSL_TYPE_STRUCT: {
+      void *mem_ctx = ralloc_context(NULL);
+      const char *name = blob.read_string(mem_ctx);
+      const unsigned length = blob.read_uint();
+      const glsl_type *type = glsl_type::error_type;
+
+      if (name != NULL && length != 0 && length <= blob.remaining() / 8) {
+	 glsl_struct_field *fields =
+	    ralloc_array(mem_ctx, glsl_struct_field, length);
+	 bool valid = true;
+
+	 for (unsigned i = 0; i < length && valid; i++) {
+	    fields[i].name = blob.read_string(mem_ctx);
+	    fields[i].type = read_type(blob);
+	    valid = fields[i].name != NULL && !fields[i].type->is_error();
+	 }
+
+	 if (valid && !blob.overrun)
+	    type = glsl_type::get_record_instance(fields, length, name);
+      }
+
+      ralloc_free(mem_ctx);
+      return type;
+   }
+   case GLSL_TYPE_ARRAY: {
+      const unsigned length = blob.read_uint();
+      const glsl_type *element = read_type(blob);
+
+      if (element->is_error() || element->is_void())
+	 return glsl_type::error_type;
+
+      return glsl_type::get_array_instance(element, length);
+   }
+   case GLSL_TYPE_VOID:
+      return glsl_type::void_type;
+   default:
+      return glsl_type::error_type;
+   }
+}
+
+
+static void
+write_constant(blob_writer &blob, const ir_constant *c)
+{
+   write_type(blob, c->type);
+
+   switch (c->type->base_type) {
+   case GLSL_TYPE_STRUCT:
+      foreach_list_const(node, &c->components)
+	 write_constant(blob, (const ir_constant *) node);
+      break;
+   case GLSL_TYPE_ARRAY:
+      for (unsigned i = 0; i < c->type->length; i++)
+	 write_constant(blob, c->array_elements[i]);
+      break;
+   case GLSL_TYPE_BOOL:
+      for (unsigned i = 0; i < c->type->components(); i++)
+	 blob.write_uint(c->value.b[i]);
+      break;
+   default:
+      for (unsigned i = 0; i < c->type->components(); i++)
+	 blob.write_uint(c->value.u[i]);
+      break;
+   }
+}
+
+
+/**
+ * \return The constant, or \c NULL if the encoding is invalid.
+ */
+static ir_constant *
+read_constant(blob_reader &blob, void *mem_ctx)
+{
+   const glsl_type *type = read_type(blob);
+
+   switch (type->base_type) {
+   case GLSL_TYPE_STRUCT:
+   case GLSL_TYPE_ARRAY: {
+      exec_list values;
+
+      if (type->length > blob.remaining() / 4)
+	 return NULL;
+
+      for (unsigned i = 0; i < type->length; i++) {
+	 ir_constant *value = read_constant(blob, mem_ctx);
+
+	 if (value == NULL)
+	    return NULL;
+
+	 values.push_tail(value);
+      }
+
+      return new(mem_ctx) ir_constant(type, &values);
+   }
+   case GLSL_TYPE_UINT:
+   case GLSL_TYPE_INT:
+   case GLSL_TYPE_FLOAT:
+   case GLSL_TYPE_BOOL: {
+      ir_constant_data data;
+
+      memset(&data, 0, sizeof(data));
+      for (unsigned i = 0; i < type->components(); i++) {
+	 const unsigned value = blob.read_uint();
+
+	 if (type->base_type == GLSL_TYPE_BOOL)
+	    data.b[i] = value != 0;
+	 else
+	    data.u[i] = value;
+      }
+
+      if (blob.overrun)
+	 return NULL;
+
+      return new(mem_ctx) ir_constant(type, &data);
+   }
+   default:
+      return NULL;
+   }
+}
+
+
+namespace {
+
+/**
+ * Writes the IR of one shader: the variable and function tables, then the
+ * instruction stream.
+ */
+class ir_serializer {
+public:
+   ir_serializer(void *mem_ctx)
+      : mem_ctx(mem_ctx), body(mem_ctx)
+   {
+      this->variable_ht = hash_table_ctor(1024, hash_table_pointer_hash,
+					  hash_table_pointer_compare);
+      this->signature_ht = hash_table_ctor(64, hash_table_pointer_hash,
+					   hash_table_pointer_compare);
+      this->function_ht = hash_table_ctor(64, hash_table_pointer_hash,
+					  hash_table_pointer_compare);
+      this->variables = NULL;
+      this->num_variables = 0;
+      this->functions = NULL;
+      this->num_functions = 0;
+      this->num_signatures = 0;
+   }
+
+   ~ir_serializer()
+   {
+      hash_table_dtor(this->variable_ht);
+      hash_table_dtor(this->signature_ht);
+      hash_table_dtor(this->function_ht);
+   }
+
+   void write_shader(blob_writer &out, const exec_list *instructions);
+
+private:
+   unsigned variable_index(const ir_variable *var);
+   unsigned function_index(const ir_function *f);
+   unsigned signature_index(const ir_function_signature *sig);
+
+   void write_variable(blob_writer &blob, const ir_variable *var);
+   void write_list(const exec_list *list);
+   void write_instruction(const ir_instruction *ir);
+
+   void *mem_ctx;
+   blob_writer body;
+
+   /** Maps of IR nodes to their index plus one */
+   hash_table *variable_ht;
+   hash_table *signature_ht;
+   hash_table *function_ht;
+
+   const ir_variable **variables;
+   unsigned num_variables;
+   const ir_function **functions;
+   unsigned num_functions;
+   unsigned num_signatures;
+};
+
+} /* anonymous namespace */
+
+
+unsigned
+ir_serializer::variable_index(const ir_variable *var)
+{
+   const uintptr_t index = (uintptr_t) hash_table_find(this->variable_ht, var);
+
+   if (index != 0)
+      return index - 1;
+
+   if ((this->num_variables & (this->num_variables - 1)) == 0) {
+      this->variables = reralloc(this->mem_ctx, this->variables,
+				 const ir_variable *,
+				 MAX2(this->num_variables * 2, 16));
+   }
+
+   this->variables[this->num_variables] = var;
+   this->num_variables++;
+   hash_table_insert(this->variable_ht, (void *) (uintptr_t) this->num_variables,
+		     var);
+   return this->num_variables - 1;
+}
+
+
+/**
+ * Signatures are numbered in the order of the function table, so this
+ * numbers all of the signatures of a function when it is first seen.
+ */
+unsigned
+ir_serializer::function_index(const ir_function *f)
+{
+   const uintptr_t index = (uintptr_t) hash_table_find(this->function_ht, f);
+
+   if (index != 0)
+      return index - 1;
+
+   if ((this->num_functions & (this->num_functions - 1)) == 0) {
+      this->functions = reralloc(this->mem_ctx, this->functions,
+				 const ir_function *,
+				 MAX2(this->num_functions * 2, 16));
+   }
+
+   this->functions[this->num_functions] = f;
+   this->num_functions++;
+   hash_table_insert(this->function_ht, (void *) (uintptr_t) this->num_functions,
+		     f);
+
+   foreach_list_const(node, &f->signatures) {
+      const ir_function_signature *sig = (const ir_function_signature *) node;
+
+      this->num_signatures++;
+      hash_table_insert(this->signature_ht,
+			(void *) (uintptr_t) this->num_signatures, sig);
+   }
+
+   return this->num_functions - 1;
+}
+
+
+unsigned
+ir_serializer::signature_index(const ir_function_signature *sig)
+{
+   function_index(sig->function());
+
+   const uintptr_t index = (uintptr_t) hash_table_find(this->signature_ht, sig);
+   assert(index != 0);
+
+   return index - 1;
+}
+
+
+void
+ir_serializer::write_variable(blob_writer &blob, const ir_variable *var)
+{
+   const unsigned flags = (var->read_only << 0)
+      | (var->centroid << 1)
+      | (var->invariant << 2)
+      | (var->used << 3)
+      | (var->assigned << 4)
+      | (var->origin_upper_left << 5)
+      | (var->pixel_center_integer << 6)
+      | (var->explicit_location << 7)
+      | (var->explicit_index << 8)
+      | (var->has_initializer << 9);
+
+   write_type(blob, var->type);
+   blob.write_string(var->name);
+   blob.write_uint(var->mode);
+   blob.write_uint(flags);
+   blob.write_uint(var->interpolation);
+   blob.write_uint(var->depth_layout);
+   blob.write_uint(var->max_array_access);
+   blob.write_int(var->location);
+   blob.write_int(var->index);
+   blob.write_int(var->uniform_block);
+
+   blob.write_uint(var->state_slots ? var->num_state_slots : 0);
+   if (var->state_slots) {
+      blob.write(var->state_slots,
+		 sizeof(var->state_slots[0]) * var->num_state_slots);
+   }
+
+   blob.write_uint(var->constant_value != NULL);
+   if (var->constant_value)
+      write_constant(blob, var->constant_value);
+
+   blob.write_uint(var->constant_initializer != NULL);
+   if (var->constant_initializer)
+      write_constant(blob, var->constant_initializer);
+}
+
+
+void
+ir_serializer::write_list(const exec_list *list)
+{
+   foreach_list_const(node, list)
+      write_instruction((const ir_instruction *) node);
+
+   this->body.write_uint(ir_type_unset);
+}
+
+
+void
+ir_serializer::write_instruction(const ir_instruction *ir)
+{
+   blob_writer &blob = this->body;
+
+   if (ir == NULL) {
+      blob.write_uint(ir_type_unset);
+      return;
+   }
+
+   blob.write_uint(ir->ir_type);
+
+   switch (ir->ir_type) {
+   case ir_type_variable:
+      blob.write_uint(variable_index((const ir_variable *) ir));
+      break;
+
+   case ir_type_function: {
+      const ir_function *f = (const ir_function *) ir;
+
+      blob.write_uint(function_index(f));
+      foreach_list_const(node, &f->signatures)
+	 write_list(&((const ir_function_signature *) node)->body);
+      break;
+   }
+
+   case ir_type_assignment: {
+      const ir_assignment *a = (const ir_assignment *) ir;
+
+      write_instruction(a->lhs);
+      write_instruction(a->rhs);
+      write_instruction(a->condition);
+      blob.write_uint(a->write_mask);
+      break;
+   }
+
+   case ir_type_expression: {
+      const ir_expression *expr = (const ir_expression *) ir;
+      const unsigned num_operands = expr->get_num_operands();
+
+      blob.write_uint(expr->operation);
+      write_type(blob, expr->type);
+      blob.write_uint(num_operands);
+      for (unsigned i = 0; i < num_operands; i++)
+	 write_instruction(expr->operands[i]);
+      break;
+   }
+
+   case ir_type_texture: {
+      const ir_texture *tex = (const ir_texture *) ir;
+
+      blob.write_uint(tex->op);
+      write_type(blob, tex->type);
+      write_instruction(tex->sampler);
+      write_instruction(tex->coordinate);
+      write_instruction(tex->projector);
+      write_instruction(tex->shadow_comparitor);
+      write_instruction(tex->offset);
+
+      switch (tex->op) {
+      case ir_tex:
+	 break;
+      case ir_txb:
+	 write_instruction(tex->lod_info.bias);
+	 break;
+      case ir_txl:
+      case ir_txf:
+      case ir_txs:
+	 write_instruction(tex->lod_info.lod);
+	 break;
+      case ir_txd:
+	 write_instruction(tex->lod_info.grad.dPdx);
+	 write_instruction(tex->lod_info.grad.dPdy);
+	 break;
+      }
+      break;
+   }
+
+   case ir_type_swizzle: {
+      const ir_swizzle *swiz = (const ir_swizzle *) ir;
+
+      write_instruction(swiz->val);
+      blob.write_uint(swiz->mask.x);
+      blob.write_uint(swiz->mask.y);
+      blob.write_uint(swiz->mask.z);
+      blob.write_uint(swiz->mask.w);
+      blob.write_uint(swiz->mask.num_components);
+      break;
+   }
+
+   case ir_type_dereference_variable:
+      blob.write_uint(variable_index(((const ir_dereference_variable *) ir)->var));
+      break;
+
+   case ir_type_dereference_array: {
+      const ir_dereference_array *deref = (const ir_dereference_array *) ir;
+
+      write_instruction(deref->array);
+      write_instruction(deref->array_index);
+      break;
+   }
+
+   case ir_type_dereference_record: {
+      const ir_dereference_record *deref = (const ir_dereference_record *) ir;
+
+      write_instruction(deref->record);
+      blob.write_string(deref->field);
+      break;
+   }
+
+   case ir_type_constant:
+      write_constant(blob, (const ir_constant *) ir);
+      break;
+
+   case ir_type_call: {
+      const ir_call *call = (const ir_call *) ir;
+
+      blob.write_uint(signature_index(call->callee));
+      write_instruction(call->return_deref);
+      write_list(&call->actual_parameters);
+      break;
+   }
+
+   case ir_type_return:
+      write_instruction(((const ir_return *) ir)->value);
+      break;
+
+   case ir_type_discard:
+      write_instruction(((const ir_discard *) ir)->condition);
+      break;
+
+   case ir_type_if: {
+      const ir_if *iff = (const ir_if *) ir;
+
+      write_instruction(iff->condition);
+      write_list(&iff->then_instructions);
+      write_list(&iff->else_instructions);
+      break;
+   }
+
+   case ir_type_loop: {
+      const ir_loop *loop = (const ir_loop *) ir;
+
+      write_instruction(loop->from);
+      write_instruction(loop->to);
+      write_instruction(loop->increment);
+      blob.write_uint(loop->counter ? variable_index(loop->counter)
+		      : NULL_INDEX);
+      blob.write_int(loop->cmp);
+      write_list(&loop->body_instructions);
+      break;
+   }
+
+   case ir_type_loop_jump:
+      blob.write_uint(((const ir_loop_jump *) ir)->mode);
+      break;
+
+   default:
+      assert(!"Unexpected IR node in a linked shader");
+      break;
+   }
+}
+
+
+void
+ir_serializer::write_shader(blob_writer &out, const exec_list *instructions)
+{
+   write_list(instructions);
+
+   /* Writing the function table can still add parameters to the variable
+    * table, so it has to be built first.
+    */
+   blob_writer function_table(this->mem_ctx);
+
+   function_table.write_uint(this->num_functions);
+   function_table.write_uint(this->num_signatures);
+   for (unsigned i = 0; i < this->num_functions; i++) {
+      const ir_function *f = this->functions[i];
+      unsigned num_signatures = 0;
+
+      foreach_list_const(node, &f->signatures)
+	 num_signatures++;
+
+      function_table.write_string(f->name);
+      function_table.write_uint(num_signatures);
+
+      foreach_list_const(node, &f->signatures) {
+	 const ir_function_signature *sig =
+	    (const ir_function_signature *) node;
+	 unsigned num_parameters = 0;
+
+	 foreach_list_const(param, &sig->parameters)
+	    num_parameters++;
+
+	 write_type(function_table, sig->return_type);
+	 function_table.write_uint(sig->is_defined);
+	 function_table.write_uint(sig->is_builtin);
+	 function_table.write_uint(num_parameters);
+	 foreach_list_const(param, &sig->parameters)
+	    function_table.write_uint(variable_index((const ir_variable *) param));
+      }
+   }
+
+   blob_writer variable_table(this->mem_ctx);
+
+   variable_table.write_uint(this->num_variables);
+   for (unsigned i = 0; i < this->num_variables; i++)
+      write_variable(variable_table, this->variables[i]);
+
+   out.write(variable_table.data, variable_table.size);
+   out.write(function_table.data, function_table.size);
+   out.write(this->body.data, this->body.size);
+}
+
+
+/**
+ * Check the operand and result types of an expression read from a blob.
+ *
+ * These are the rules \c ir_validate asserts on, which only runs in debug
+ * builds and aborts; a corrupt binary must be rejected in every build.
+ */
+static bool
+expression_types_valid(ir_expression_operation op, const glsl_type *type,
+		       ir_rvalue *const *operands, unsigned num_operands)
+{
+   for (unsigned i = 0; i < num_operands; i++) {
+      const glsl_type *t = operands[i]->type;
+
+      if (t->is_error() || t->is_void() || t->is_sampler())
+	 return false;
+
+      /* Only the aggregate comparisons take structures and arrays. */
+      if ((t->is_record() || t->is_array())
+	  && op != ir_binop_all_equal && op != ir_binop_any_nequal)
+	 return false;
+   }
+
+   if (op != ir_binop_all_equal && op != ir_binop_any_nequal
+       && !type->is_numeric() && !type->is_boolean())
+      return false;
+
+   const glsl_type *const t0 = operands[0]->type;
+   const glsl_type *const t1 = num_operands > 1 ? operands[1]->type : NULL;
+
+   switch (op) {
+   case ir_unop_bit_not:
+      return t0 == type && type->is_integer();
+
+   case ir_unop_logic_not:
+      return type->base_type == GLSL_TYPE_BOOL && t0 == type;
+
+   case ir_unop_neg:
+   case ir_unop_abs:
+   case ir_unop_sign:
+   case ir_unop_rcp:
+   case ir_unop_rsq:
+   case ir_unop_sqrt:
+      return t0 == type;
+
+   case ir_unop_exp:
+   case ir_unop_log:
+   case ir_unop_exp2:
+   case ir_unop_log2:
+   case ir_unop_trunc:
+   case ir_unop_round_even:
+   case ir_unop_ceil:
+   case ir_unop_floor:
+   case ir_unop_fract:
+   case ir_unop_sin:
+   case ir_unop_cos:
+   case ir_unop_sin_reduced:
+   case ir_unop_cos_reduced:
+   case ir_unop_dFdx:
+   case ir_unop_dFdy:
+      return t0->base_type == GLSL_TYPE_FLOAT && t0 == type;
+
+   case ir_unop_f2i:
+   case ir_unop_bitcast_f2i:
+      return t0->base_type == GLSL_TYPE_FLOAT
+	 && type->base_type == GLSL_TYPE_INT
+	 && t0->vector_elements == type->vector_elements;
+   case ir_unop_f2u:
+   case ir_unop_bitcast_f2u:
+      return t0->base_type == GLSL_TYPE_FLOAT
+	 && type->base_type == GLSL_TYPE_UINT
+	 && t0->vector_elements == type->vector_elements;
+   case ir_unop_i2f:
+   case ir_unop_bitcast_i2f:
+      return t0->base_type == GLSL_TYPE_INT
+	 && type->base_type == GLSL_TYPE_FLOAT
+	 && t0->vector_elements == type->vector_elements;
+   case ir_unop_f2b:
+      return t0->base_type == GLSL_TYPE_FLOAT
+	 && type->base_type == GLSL_TYPE_BOOL
+	 && t0->vector_elements == type->vector_elements;
+   case ir_unop_b2f:
+      return t0->base_type == GLSL_TYPE_BOOL
+	 && type->base_type == GLSL_TYPE_FLOAT
+	 && t0->vector_elements == type->vector_elements;
+   case ir_unop_i2b:
+      return t0->base_type == GLSL_TYPE_INT
+	 && type->base_type == GLSL_TYPE_BOOL
+	 && t0->vector_elements == type->vector_elements;
+   case ir_unop_b2i:
+      return t0->base_type == GLSL_TYPE_BOOL
+	 && type->base_type == GLSL_TYPE_INT
+	 && t0->vector_elements == type->vector_elements;
+   case ir_unop_u2f:
+   case ir_unop_bitcast_u2f:
+      return t0->base_type == GLSL_TYPE_UINT
+	 && type->base_type == GLSL_TYPE_FLOAT
+	 && t0->vector_elements == type->vector_elements;
+   case ir_unop_i2u:
+      return t0->base_type == GLSL_TYPE_INT
+	 && type->base_type == GLSL_TYPE_UINT
+	 && t0->vector_elements == type->vector_elements;
+   case ir_unop_u2i:
+      return t0->base_type == GLSL_TYPE_UINT
+	 && type->base_type == GLSL_TYPE_INT
+	 && t0->vector_elements == type->vector_elements;
+
+   case ir_unop_any:
+      return t0->base_type == GLSL_TYPE_BOOL && type == glsl_type::bool_type;
+
+   case ir_unop_noise:
+      return t0->is_float() && type == glsl_type::float_type;
+
+   case ir_binop_add:
+   case ir_binop_sub:
+   case ir_binop_mul:
+   case ir_binop_div:
+   case ir_binop_mod:
+   case ir_binop_min:
+   case ir_binop_max:
+   case ir_binop_pow:
+      if (t0->base_type != t1->base_type || t0->base_type != type->base_type)
+	 return false;
+      if (t0->is_scalar())
+	 return t1 == type;
+      if (t1->is_scalar())
+	 return t0 == type;
+      if (t0->is_vector() && t1->is_vector())
+	 return t0 == t1 && t0 == type;
+      /* Matrix multiplication; the result type depends on the operands. */
+      if (op == ir_binop_mul)
+	 return t0->is_matrix() || t1->is_matrix();
+      return t0 == t1 && t0 == type;
+
+   case ir_binop_less:
+   case ir_binop_greater:
+   case ir_binop_lequal:
+   case ir_binop_gequal:
+   case ir_binop_equal:
+   case ir_binop_nequal:
+      return type->base_type == GLSL_TYPE_BOOL
+	 && t0 == t1
+	 && (t0->is_scalar() || t0->is_vector())
+	 && t0->vector_elements == type->vector_elements;
+
+   case ir_binop_all_equal:
+   case ir_binop_any_nequal:
+      return type == glsl_type::bool_type && t0 == t1;
+
+   case ir_binop_lshift:
+   case ir_binop_rshift:
+      if (!t0->is_integer() || !t1->is_integer() || type != t0)
+	 return false;
+      if (t0->is_scalar())
+	 return t1->is_scalar();
+      return t1->is_scalar() || t0->components() == t1->components();
+
+   case ir_binop_bit_and:
+   case ir_binop_bit_xor:
+   case ir_binop_bit_or:
+      if (t0->base_type != t1->base_type || !type->is_integer())
+	 return false;
+      if (t0->is_vector() && t1->is_vector())
+	 return t0->vector_elements == t1->vector_elements;
+      return true;
+
+   case ir_binop_logic_and:
+   case ir_binop_logic_xor:
+   case ir_binop_logic_or:
+      return type == glsl_type::bool_type
+	 && t0 == glsl_type::bool_type
+	 && t1 == glsl_type::bool_type;
+
+   case ir_binop_dot:
+      return type == glsl_type::float_type
+	 && t0->base_type == GLSL_TYPE_FLOAT
+	 && t0->is_vector()
+	 && t0 == t1;
+
+   case ir_binop_ubo_load:
+      return operands[0]->as_constant() != NULL
+	 && t0 == glsl_type::uint_type
+	 && t1 == glsl_type::uint_type;
+
+   case ir_quadop_vector:
+      if (!type->is_vector())
+	 return false;
+      for (unsigned i = 0; i < num_operands; i++) {
+	 if (!operands[i]->type->is_scalar()
+	     || operands[i]->type->base_type != type->base_type)
+	    return false;
+      }
+      return true;
+   }
+
+   return false;
+}
+
+
+namespace {
+
+/**
+ * Reads the IR of one shader written by \c ir_serializer.
+ *
+ * Nothing in the blob is trusted: every index is range checked, and any
+ * inconsistency makes \c read_shader fail rather than build invalid IR.
+ */
+class ir_deserializer {
+public:
+   ir_deserializer(blob_reader &blob, void *mem_ctx)
+      : blob(blob), mem_ctx(mem_ctx), error(false)
+   {
+      this->tables_ctx = ralloc_context(NULL);
+      this->variables = NULL;
+      this->num_variables = 0;
+      this->functions = NULL;
+      this->num_functions = 0;
+      this->signatures = NULL;
+      this->num_signatures = 0;
+   }
+
+   ~ir_deserializer()
+   {
+      ralloc_free(this->tables_ctx);
+   }
+
+   bool read_shader(exec_list *instructions);
+
+private:
+   ir_variable *read_variable();
+   ir_variable *read_variable_index();
+   bool read_function_table();
+   bool read_list(exec_list *list);
+   ir_instruction *read_instruction(unsigned ir_type);
+   ir_rvalue *read_rvalue(bool optional);
+   ir_dereference *read_dereference();
+
+   ir_instruction *fail()
+   {
+      this->error = true;
+      return NULL;
+   }
+
+   blob_reader &blob;
+   void *mem_ctx;
+   void *tables_ctx;
+   bool error;
+
+   ir_variable **variables;
+   unsigned num_variables;
+   ir_function **functions;
+   unsigned num_functions;
+   ir_function_signature **signatures;
+   unsigned num_signatures;
+};
+
+} /* anonymous namespace */
+
+
+ir_variable *
+ir_deserializer::read_variable()
+{
+   const glsl_type *type = read_type(this->blob);
+   char *name = this->blob.read_string(this->tables_ctx);
+   const unsigned mode = this->blob.read_uint();
+   const unsigned flags = this->blob.read_uint();
+
+   if (type->is_error() || name == NULL || mode > ir_var_temporary)
+      return NULL;
+
+   ir_variable *var =
+      new(this->mem_ctx) ir_variable(type, name, (ir_variable_mode) mode);
+
+   var->read_only = (flags >> 0) & 1;
+   var->centroid = (flags >> 1) & 1;
+   var->invariant = (flags >> 2) & 1;
+   var->used = (flags >> 3) & 1;
+   var->assigned = (flags >> 4) & 1;
+   var->origin_upper_left = (flags >> 5) & 1;
+   var->pixel_center_integer = (flags >> 6) & 1;
+   var->explicit_location = (flags >> 7) & 1;
+   var->explicit_index = (flags >> 8) & 1;
+   var->has_initializer = (flags >> 9) & 1;
+   var->interpolation = this->blob.read_uint();
+   var->depth_layout = (ir_depth_layout) this->blob.read_uint();
+   var->max_array_access = this->blob.read_uint();
+   var->location = this->blob.read_int();
+   var->index = this->blob.read_int();
+   var->uniform_block = this->blob.read_int();
+
+   const unsigned num_state_slots = this->blob.read_uint();
+   if (num_state_slots != 0) {
+      if (num_state_slots > this->blob.remaining() / sizeof(ir_state_slot))
+	 return NULL;
+
+      var->num_state_slots = num_state_slots;
+      var->state_slots = ralloc_array(var, ir_state_slot, num_state_slots);
+      this->blob.read(var->state_slots,
+		      sizeof(var->state_slots[0]) * num_state_slots);
+   }
+
+   if (this->blob.read_uint()) {
+      var->constant_value = read_constant(this->blob, var);
+      if (var->constant_value == NULL)
+	 return NULL;
+   }
+
+   if (this->blob.read_uint()) {
+      var->constant_initializer = read_constant(this->blob, var);
+      if (var->constant_initializer == NULL)
+	 return NULL;
+   }
+
+   return this->blob.overrun ? NULL : var;
+}
+
+
+ir_variable *
+ir_deserializer::read_variable_index()
+{
+   const unsigned index = this->blob.read_uint();
+
+   if (index >= this->num_variables) {
+      fail();
+      return NULL;
+   }
+
+   return this->variables[index];
+}
+
+
+bool
+ir_deserializer::read_function_table()
+{
+   this->num_functions = this->blob.read_uint();
+   const unsigned num_signatures = this->blob.read_uint();
+
+   if (this->num_functions > this->blob.remaining() / 8
+       || num_signatures > this->blob.remaining() / 8)
+      return false;
+
+   this->functions = ralloc_array(this->tables_ctx, ir_function *,
+				  this->num_functions);
+   this->signatures = ralloc_array(this->tables_ctx, ir_function_signature *,
+				   num_signatures);
+
+   for (unsigned i = 0; i < this->num_functions; i++) {
+      const char *name = this->blob.read_string(this->tables_ctx);
+      const unsigned count = this->blob.read_uint();
+
+      if (name == NULL || this->blob.overrun)
+	 return false;
+
+      ir_function *f = new(this->mem_ctx) ir_function(name);
+      this->functions[i] = f;
+
+      for (unsigned j = 0; j < count; j++) {
+	 const glsl_type *return_type = read_type(this->blob);
+	 const unsigned is_defined = this->blob.read_uint();
+	 const unsigned is_builtin = this->blob.read_uint();
+	 const unsigned num_parameters = this->blob.read_uint();
+
+	 if (return_type->is_error()
+	     || this->num_signatures >= num_signatures
+	     || this->blob.overrun)
+	    return false;
+
+	 ir_function_signature *sig =
+	    new(this->mem_ctx) ir_function_signature(return_type);
+
+	 sig->is_defined = is_defined != 0;
+	 sig->is_builtin = is_builtin != 0;
+
+	 for (unsigned k = 0; k < num_parameters; k++) {
+	    ir_variable *param = read_variable_index();
+
+	    /* Each variable is declared in exactly one place. */
+	    if (param == NULL || param->next != NULL)
+	       return false;
+
+	    sig->parameters.push_tail(param);
+	 }
+
+	 f->add_signature(sig);
+	 this->signatures[this->num_signatures] = sig;
+	 this->num_signatures++;
+      }
+   }
+
+   return this->num_signatures == num_signatures && !this->blob.overrun;
+}
+
+
+bool
+ir_deserializer::read_list(exec_list *list)
+{
+   for (;;) {
+      const unsigned ir_type = this->blob.read_uint();
+
+      if (this->blob.overrun || this->error)
+	 return false;
+
+      if (ir_type == ir_type_unset)
+	 return true;
+
+      ir_instruction *ir = read_instruction(ir_type);
+      if (ir == NULL)
+	 return false;
+
+      list->push_tail(ir);
+   }
+}
+
+
+ir_rvalue *
+ir_deserializer::read_rvalue(bool optional)
+{
+   const unsigned ir_type = this->blob.read_uint();
+
+   if (ir_type == ir_type_unset) {
+      if (!optional)
+	 fail();
+      return NULL;
+   }
+
+   ir_instruction *ir = read_instruction(ir_type);
+   if (ir == NULL)
+      return NULL;
+
+   ir_rvalue *rvalue = ir->as_rvalue();
+   if (rvalue == NULL)
+      fail();
+
+   return rvalue;
+}
+
+
+ir_dereference *
+ir_deserializer::read_dereference()
+{
+   ir_rvalue *rvalue = read_rvalue(false);
+   ir_dereference *deref = rvalue ? rvalue->as_dereference() : NULL;
+
+   if (deref == NULL)
+      fail();
+
+   return deref;
+}
+
+
+ir_instruction *
+ir_deserializer::read_instruction(unsigned ir_type)
+{
+   void *const mem_ctx = this->mem_ctx;
+
+   switch (ir_type) {
+   case ir_type_variable: {
+      ir_variable *var = read_variable_index();
+
+      if (var == NULL || var->next != NULL)
+	 return fail();
+
+      return var;
+   }
+
+   case ir_type_function: {
+      const unsigned index = this->blob.read_uint();
+
+      if (index >= this->num_functions || this->functions[index]->next != NULL)
+	 return fail();
+
+      ir_function *f = this->functions[index];
+
+      foreach_list(node, &f->signatures) {
+	 ir_function_signature *sig = (ir_function_signature *) node;
+
+	 if (!read_list(&sig->body))
+	    return fail();
+      }
+
+      return f;
+   }
+
+   case ir_type_assignment: {
+      ir_dereference *lhs = read_dereference();
+      ir_rvalue *rhs = read_rvalue(false);
+      ir_rvalue *condition = read_rvalue(true);
+      const unsigned write_mask = this->blob.read_uint();
+
+      if (this->error || write_mask > 0xf)
+	 return fail();
+
+      if (lhs->type->is_scalar() || lhs->type->is_vector()) {
+	 unsigned lhs_components = 0;
+
+	 for (unsigned i = 0; i < 4; i++) {
+	    if (write_mask & (1 << i))
+	       lhs_components++;
+	 }
+
+	 if (lhs_components != rhs->type->vector_elements)
+	    return fail();
+      }
+
+      return new(mem_ctx) ir_assignment(lhs, rhs, condition, write_mask);
+   }
+
+   case ir_type_expression: {
+      const unsigned op = this->blob.read_uint();
+      const glsl_type *type = read_type(this->blob);
+      const unsigned num_operands = this->blob.read_uint();
+      ir_rvalue *operands[4] = { NULL, NULL, NULL, NULL };
+
+      if (op > ir_last_opcode || type->is_error())
+	 return fail();
+
+      const unsigned expected = (op == ir_quadop_vector)
+	 ? type->vector_elements
+	 : ir_expression::get_num_operands((ir_expression_operation) op);
+
+      if (num_operands != expected || num_operands > 4)
+	 return fail();
+
+      for (unsigned i = 0; i < num_operands; i++)
+	 operands[i] = read_rvalue(false);
+
+      if (this->error)
+	 return NULL;
+
+      if (!expression_types_valid((ir_expression_operation) op, type,
+				  operands, num_operands))
+	 return fail();
+
+      return new(mem_ctx) ir_expression(op, type, operands[0], operands[1],
+					operands[2], operands[3]);
+   }
+
+   case ir_type_texture: {
+      const unsigned op = this->blob.read_uint();
+
+      if (op > ir_txs)
+	 return fail();
+
+      ir_texture *tex = new(mem_ctx) ir_texture((ir_texture_opcode) op);
+
+      tex->type = read_type(this->blob);
+      tex->sampler = read_dereference();
+      tex->coordinate = read_rvalue(true);
+      tex->projector = read_rvalue(true);
+      tex->shadow_comparitor = read_rvalue(true);
+      tex->offset = read_rvalue(true);
+
+      switch (tex->op) {
+      case ir_tex:
+	 break;
+      case ir_txb:
+	 tex->lod_info.bias = read_rvalue(false);
+	 break;
+      case ir_txl:
+      case ir_txf:
+      case ir_txs:
+	 tex->lod_info.lod = read_rvalue(false);
+	 break;
+      case ir_txd:
+	 tex->lod_info.grad.dPdx = read_rvalue(false);
+	 tex->lod_info.grad.dPdy = read_rvalue(false);
+	 break;
+      }
+
+      if (this->error || tex->type->is_error())
+	 return fail();
+
+      return tex;
+   }
+
+   case ir_type_swizzle: {
+      ir_rvalue *val = read_rvalue(false);
+      const unsigned x = this->blob.read_uint();
+      const unsigned y = this->blob.read_uint();
+      const unsigned z = this->blob.read_uint();
+      const unsigned w = this->blob.read_uint();
+      const unsigned count = this->blob.read_uint();
+
+      if (this->error || x > 3 || y > 3 || z > 3 || w > 3
+	  || count < 1 || count > 4)
+	 return fail();
+
+      return new(mem_ctx) ir_swizzle(val, x, y, z, w, count);
+   }
+
+   case ir_type_dereference_variable: {
+      ir_variable *var = read_variable_index();
+
+      if (var == NULL)
+	 return NULL;
+
+      return new(mem_ctx) ir_dereference_variable(var);
+   }
+
+   case ir_type_dereference_array: {
+      ir_rvalue *array = read_rvalue(false);
+      ir_rvalue *array_index = read_rvalue(false);
+
+      if (this->error)
+	 return NULL;
+
+      if (!array_index->type->is_scalar()
+	  || !array_index->type->is_integer())
+	 return fail();
+
+      ir_dereference_array *deref =
+	 new(mem_ctx) ir_dereference_array(array, array_index);
+
+      if (deref->type->is_error())
+	 return fail();
+
+      return deref;
+   }
+
+   case ir_type_dereference_record: {
+      ir_rvalue *record = read_rvalue(false);
+      char *field = this->blob.read_string(NULL);
+
+      if (this->error || field == NULL) {
+	 ralloc_free(field);
+	 return fail();
+      }
+
+      ir_dereference_record *deref =
+	 new(mem_ctx) ir_dereference_record(record, field);
+      ralloc_free(field);
+
+      if (deref->type->is_error())
+	 return fail();
+
+      return deref;
+   }
+
+   case ir_type_constant: {
+      ir_constant *c = read_constant(this->blob, mem_ctx);
+
+      if (c == NULL)
+	 return fail();
+
+      return c;
+   }
+
+   case ir_type_call: {
+      const unsigned index = this->blob.read_uint();
+
+      if (index >= this->num_signatures)
+	 return fail();
+
+      ir_rvalue *return_value = read_rvalue(true);
+      ir_dereference_variable *return_deref = NULL;
+      exec_list parameters;
+
+      if (return_value != NULL) {
+	 return_deref = return_value->as_dereference_variable();
+	 if (return_deref == NULL)
+	    return fail();
+      }
+
+      if (this->error || !read_list(&parameters))
+	 return fail();
+
+      ir_function_signature *const callee = this->signatures[index];
+
+      /* Same rules as ir_validate: the return value and every argument
+       * must match the callee's signature exactly.
+       */
+      if (callee->return_type->is_void()) {
+	 if (return_deref != NULL)
+	    return fail();
+      } else if (return_deref == NULL
+		 || return_deref->type != callee->return_type) {
+	 return fail();
+      }
+
+      exec_list_iterator formal_iter = callee->parameters.iterator();
+      foreach_list(node, &parameters) {
+	 ir_rvalue *actual = ((ir_instruction *) node)->as_rvalue();
+
+	 if (actual == NULL || !formal_iter.has_next())
+	    return fail();
+
+	 ir_variable *formal = (ir_variable *) formal_iter.get();
+
+	 if (actual->type != formal->type)
+	    return fail();
+
+	 if ((formal->mode == ir_var_out || formal->mode == ir_var_inout)
+	     && !actual->is_lvalue())
+	    return fail();
+
+	 formal_iter.next();
+      }
+
+      if (formal_iter.has_next())
+	 return fail();
+
+      return new(mem_ctx) ir_call(callee, return_deref, &parameters);
+   }
+
+   case ir_type_return: {
+      ir_rvalue *value = read_rvalue(true);
+
+      if (this->error)
+	 return NULL;
+
+      return new(mem_ctx) ir_return(value);
+   }
+
+   case ir_type_discard: {
+      ir_rvalue *condition = read_rvalue(true);
+
+      if (this->error)
+	 return NULL;
+
+      return new(mem_ctx) ir_discard(condition);
+   }
+
+   case ir_type_if: {
+      ir_rvalue *condition = read_rvalue(false);
+
+      if (this->error)
+	 return NULL;
+
+      ir_if *iff = new(mem_ctx) ir_if(condition);
+
+      if (!read_list(&iff->then_instructions)
+	  || !read_list(&iff->else_instructions))
+	 return fail();
+
+      return iff;
+   }
+
+   case ir_type_loop: {
+      ir_loop *loop = new(mem_ctx) ir_loop;
+
+      loop->from = read_rvalue(true);
+      loop->to = read_rvalue(true);
+      loop->increment = read_rvalue(true);
+
+      const unsigned counter = this->blob.read_uint();
+      if (counter != NULL_INDEX) {
+	 if (counter >= this->num_variables)
+	    return fail();
+
+	 loop->counter = this->variables[counter];
+      }
+
+      loop->cmp = this->blob.read_int();
+
+      if (this->error || !read_list(&loop->body_instructions))
+	 return fail();
+
+      return loop;
+   }
+
+   case ir_type_loop_jump: {
+      const unsigned mode = this->blob.read_uint();
+
+      if (mode != ir_loop_jump::jump_break
+	  && mode != ir_loop_jump::jump_continue)
+	 return fail();
+
+      return new(mem_ctx) ir_loop_jump((ir_loop_jump::jump_mode) mode);
+   }
+
+   default:
+      return fail();
+   }
+}
+
+
+bool
+ir_deserializer::read_shader(exec_list *instructions)
+{
+   this->num_variables = this->blob.read_uint();
+
+   if (this->num_variables > this->blob.remaining() / 8)
+      return false;
+
+   this->variables = ralloc_array(this->tables_ctx, ir_variable *,
+				  this->num_variables);
+
+   for (unsigned i = 0; i < this->num_variables; i++) {
+      this->variables[i] = read_variable();
+
+      if (this->variables[i] == NULL)
+	 return false;
+   }
+
+   if (!read_function_table())
+      return false;
+
+   return read_list(instructions) && !this->error && !this->blob.overrun;
+}
+
+
+static void
+write_uniform_blocks(blob_writer &blob, const struct gl_uniform_block *blocks,
+		     unsigned num_blocks)
+{
+   blob.write_uint(num_blocks);
+
+   for (unsigned i = 0; i < num_blocks; i++) {
+      const struct gl_uniform_block *block = &blocks[i];
+
+      blob.write_string(block->Name);
+      blob.write_uint(block->Binding);
+      blob.write_uint(block->UniformBufferSize);
+      blob.write_uint(block->NumUniforms);
+
+      for (unsigned j = 0; j < block->NumUniforms; j++) {
+	 const struct gl_uniform_buffer_variable *var = &block->Uniforms[j];
+
+	 blob.write_string(var->Name);
+	 write_type(blob, var->Type);
+	 blob.write_uint(var->Buffer);
+	 blob.write_uint(var->Offset);
+	 blob.write_uint(var->RowMajor);
+      }
+   }
+}
+
+
+static bool
+read_uniform_blocks(blob_reader &blob, void *mem_ctx,
+		    struct gl_uniform_block **blocks, unsigned *num_blocks)
+{
+   const unsigned count = blob.read_uint();
+
+   *blocks = NULL;
+   *num_blocks = 0;
+
+   if (count == 0)
+      return !blob.overrun;
+
+   if (count > blob.remaining() / 16)
+      return false;
+
+   struct gl_uniform_block *b =
+      rzalloc_array(mem_ctx, struct gl_uniform_block, count);
+
+   for (unsigned i = 0; i < count; i++) {
+      b[i].Name = blob.read_string(b);
+      b[i].Binding = blob.read_uint();
+      b[i].UniformBufferSize = blob.read_uint();
+      b[i].NumUniforms = blob.read_uint();
+
+      if (b[i].Name == NULL || b[i].NumUniforms > blob.remaining() / 16) {
+	 ralloc_free(b);
+	 return false;
+      }
+
+      b[i].Uniforms = rzalloc_array(b, struct gl_uniform_buffer_variable,
+				    b[i].NumUniforms);
+
+      for (unsigned j = 0; j < b[i].NumUniforms; j++) {
+	 struct gl_uniform_buffer_variable *var = &b[i].Uniforms[j];
+
+	 var->Name = blob.read_string(b[i].Uniforms);
+	 var->Type = read_type(blob);
+	 var->Buffer = blob.read_uint();
+	 var->Offset = blob.read_uint();
+	 var->RowMajor = blob.read_uint() != 0;
+
+	 if (var->Name == NULL || var->Type->is_error()) {
+	    ralloc_free(b);
+	    return false;
+	 }
+      }
+   }
+
+   if (blob.overrun) {
+      ralloc_free(b);
+      return false;
+   }
+
+   *blocks = b;
+   *num_blocks = count;
+   return true;
+}
+
+
+static const GLenum stage_types[MESA_SHADER_TYPES] = {
+   GL_VERTEX_SHADER,
+   GL_FRAGMENT_SHADER,
+   GL_GEOMETRY_SHADER,
+};
+
+
+extern "C" void *
+_mesa_glsl_serialize_program(void *mem_ctx, struct gl_context *ctx,
+			     const struct gl_shader_program *prog,
+			     unsigned *size)
+{
+   const struct gl_transform_feedback_info *xfb = &prog->LinkedTransformFeedback;
+   void *tmp_ctx = ralloc_context(NULL);
+   blob_writer blob(mem_ctx);
+
+   *size = 0;
+   if (!prog->LinkStatus) {
+      ralloc_free(tmp_ctx);
+      return NULL;
+   }
+
+   blob.write_uint(PROGRAM_BINARY_MAGIC);
+   blob.write_uint(PROGRAM_BINARY_VERSION);
+   blob.write_uint(0); /* checksum, filled in at the end */
+
+   write_identity(blob, ctx);
+
+   blob.write_uint(prog->Version);
+   blob.write_string(prog->InfoLog);
+   blob.write_uint(prog->FragDepthLayout);
+   blob.write_uint(prog->Vert.UsesClipDistance);
+   blob.write_uint(prog->Vert.ClipDistanceArraySize);
+
+   write_uniform_blocks(blob, prog->UniformBlocks, prog->NumUniformBlocks);
+   for (unsigned i = 0; i < MESA_SHADER_TYPES; i++) {
+      blob.write_uint(prog->UniformBlockStageIndex[i] != NULL);
+      if (prog->UniformBlockStageIndex[i] != NULL) {
+	 for (unsigned j = 0; j < prog->NumUniformBlocks; j++)
+	    blob.write_int(prog->UniformBlockStageIndex[i][j]);
+      }
+   }
+
+   blob.write_uint(xfb->NumOutputs);
+   blob.write_uint(xfb->NumBuffers);
+   for (unsigned i = 0; i < xfb->NumOutputs; i++) {
+      blob.write_uint(xfb->Outputs[i].OutputRegister);
+      blob.write_uint(xfb->Outputs[i].OutputBuffer);
+      blob.write_uint(xfb->Outputs[i].NumComponents);
+      blob.write_uint(xfb->Outputs[i].DstOffset);
+      blob.write_uint(xfb->Outputs[i].ComponentOffset);
+   }
+   blob.write_int(xfb->NumVarying);
+   for (int i = 0; i < xfb->NumVarying; i++) {
+      blob.write_string(xfb->Varyings[i].Name);
+      blob.write_uint(xfb->Varyings[i].Type);
+      blob.write_int(xfb->Varyings[i].Size);
+   }
+   for (unsigned i = 0; i < MAX_FEEDBACK_BUFFERS; i++)
+      blob.write_uint(xfb->BufferStride[i]);
+
+   for (unsigned i = 0; i < MESA_SHADER_TYPES; i++) {
+      const struct gl_shader *sh = prog->_LinkedShaders[i];
+
+      blob.write_uint(sh != NULL);
+      if (sh == NULL)
+	 continue;
+
+      blob.write_uint(sh->Version);
+      write_uniform_blocks(blob, sh->UniformBlocks, sh->NumUniformBlocks);
+
+      ir_serializer serializer(tmp_ctx);
+      serializer.write_shader(blob, sh->ir);
+   }
+
+   ralloc_free(tmp_ctx);
+
+   const uint32_t sum = checksum(blob.data + PROGRAM_BINARY_HEADER_SIZE,
+				 blob.size - PROGRAM_BINARY_HEADER_SIZE);
+   memcpy(blob.data + 8, &sum, sizeof(sum));
+
+   *size = blob.size;
+   return blob.data;
+}
+
+
+/**
+ * Drop the results of a previous link, as \c link_shaders does before it
+ * starts.
+ */
+static void
+clear_link_results(struct gl_context *ctx, struct gl_shader_program *prog)
+{
+   prog->LinkStatus = false;
+   prog->Validated = false;
+   prog->_Used = false;
+
+   ralloc_free(prog->UniformBlocks);
+   prog->UniformBlocks = NULL;
+   prog->NumUniformBlocks = 0;
+   for (unsigned i = 0; i < MESA_SHADER_TYPES; i++) {
+      ralloc_free(prog->UniformBlockStageIndex[i]);
+      prog->UniformBlockStageIndex[i] = NULL;
+   }
+
+   ralloc_free(prog->LinkedTransformFeedback.Varyings);
+   ralloc_free(prog->LinkedTransformFeedback.Outputs);
+   memset(&prog->LinkedTransformFeedback, 0,
+	  sizeof(prog->LinkedTransformFeedback));
+
+   for (unsigned i = 0; i < MESA_SHADER_TYPES; i++) {
+      if (prog->_LinkedShaders[i] != NULL)
+	 ctx->Driver.DeleteShader(ctx, prog->_LinkedShaders[i]);
+
+      prog->_LinkedShaders[i] = NULL;
+   }
+}
+
+
+static bool
+read_program(struct gl_context *ctx, struct gl_shader_program *prog,
+	     blob_reader &blob)
+{
+   struct gl_transform_feedback_info *xfb = &prog->LinkedTransformFeedback;
+
+   prog->Version = blob.read_uint();
+
+   char *info_log = blob.read_string(prog);
+   if (info_log == NULL)
+      return false;
+
+   ralloc_free(prog->InfoLog);
+   prog->InfoLog = info_log;
+
+   prog->FragDepthLayout = (gl_frag_depth_layout) blob.read_uint();
+   prog->Vert.UsesClipDistance = blob.read_uint() != 0;
+   prog->Vert.ClipDistanceArraySize = blob.read_uint();
+
+   if (!read_uniform_blocks(blob, prog, &prog->UniformBlocks,
+			    &prog->NumUniformBlocks))
+      return false;
+
+   for (unsigned i = 0; i < MESA_SHADER_TYPES; i++) {
+      if (!blob.read_uint())
+	 continue;
+
+      prog->UniformBlockStageIndex[i] =
+	 ralloc_array(prog, int, MAX2(prog->NumUniformBlocks, 1));
+      for (unsigned j = 0; j < prog->NumUniformBlocks; j++)
+	 prog->UniformBlockStageIndex[i][j] = blob.read_int();
+   }
+
+   xfb->NumOutputs = blob.read_uint();
+   xfb->NumBuffers = blob.read_uint();
+   if (xfb->NumOutputs > blob.remaining() / 20
+       || xfb->NumBuffers > MAX_FEEDBACK_BUFFERS)
+      return false;
+
+   xfb->Outputs = rzalloc_array(prog, struct gl_transform_feedback_output,
+				xfb->NumOutputs);
+   for (unsigned i = 0; i < xfb->NumOutputs; i++) {
+      xfb->Outputs[i].OutputRegister = blob.read_uint();
+      xfb->Outputs[i].OutputBuffer = blob.read_uint();
+      xfb->Outputs[i].NumComponents = blob.read_uint();
+      xfb->Outputs[i].DstOffset = blob.read_uint();
+      xfb->Outputs[i].ComponentOffset = blob.read_uint();
+   }
+
+   const int num_varying = blob.read_int();
+   if (num_varying < 0 || unsigned(num_varying) > blob.remaining() / 12)
+      return false;
+
+   xfb->Varyings = rzalloc_array(prog, struct gl_transform_feedback_varying_info,
+				 num_varying);
+   xfb->NumVarying = num_varying;
+   for (int i = 0; i < num_varying; i++) {
+      xfb->Varyings[i].Name = blob.read_string(prog);
+      xfb->Varyings[i].Type = blob.read_uint();
+      xfb->Varyings[i].Size = blob.read_int();
+
+      if (xfb->Varyings[i].Name == NULL)
+	 return false;
+   }
+   for (unsigned i = 0; i < MAX_FEEDBACK_BUFFERS; i++)
+      xfb->BufferStride[i] = blob.read_uint();
+
+   for (unsigned i = 0; i < MESA_SHADER_TYPES; i++) {
+      if (!blob.read_uint())
+	 continue;
+
+      struct gl_shader *sh = ctx->Driver.NewShader(NULL, 0, stage_types[i]);
+      if (sh == NULL)
+	 return false;
+
+      _mesa_reference_shader(ctx, &prog->_LinkedShaders[i], sh);
+
+      sh->Version = blob.read_uint();
+      if (!read_uniform_blocks(blob, sh, &sh->UniformBlocks,
+			       &sh->NumUniformBlocks))
+	 return false;
+
+      sh->ir = new(sh) exec_list;
+
+      ir_deserializer deserializer(blob, sh->ir);
+      if (!deserializer.read_shader(sh->ir))
+	 return false;
+   }
+
+   return !blob.overrun && blob.remaining() == 0;
+}
+
+
+extern "C" GLboolean
+_mesa_glsl_deserialize_program(struct gl_context *ctx,
+			       struct gl_shader_program *prog,
+			       const void *data, unsigned size)
+{
+   blob_reader blob(data, size);
+
+   clear_link_results(ctx, prog);
+
+   if (data == NULL || size < PROGRAM_BINARY_HEADER_SIZE)
+      return GL_FALSE;
+
+   if (blob.read_uint() != PROGRAM_BINARY_MAGIC
+       || blob.read_uint() != PROGRAM_BINARY_VERSION
+       || blob.read_uint() != checksum(blob.cur, blob.remaining()))
+      return GL_FALSE;
+
+   /* Binaries from any other driver or version of Mesa are rejected. */
+   void *mem_ctx = ralloc_context(NULL);
+   blob_writer identity(mem_ctx);
+
+   write_identity(identity, ctx);
+   const bool same_identity = blob.read_match(identity.data, identity.size);
+   ralloc_free(mem_ctx);
+
+   if (!same_identity)
+      return GL_FALSE;
+
+   if (!read_program(ctx, prog, blob)) {
+      clear_link_results(ctx, prog);
+      return GL_FALSE;
+   }
+
+   link_assign_uniform_locations(prog);
+
+   prog->LinkStatus = true;
+   return GL_TRUE;
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \file program_binary.h
+ *
+ * Serialization of linked GLSL programs, for ARB_get_program_binary and the
+ * on-disk program cache.
+ */
+
+#pragma once
+#ifndef GLSL_PROGRAM_BINARY_H
+#define GLSL_PROGRAM_BINARY_H
+
+#include "main/glheader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct gl_context;
+struct gl_shader_program;
+
+/**
+ * Serialize the linked state of \c prog: the IR of the linked shaders and
+ * the link results that can't be recomputed from it.
+ *
+ * Must be called after \c link_shaders and before the driver's LinkShader
+ * hook, which is free to lower the linked IR in place.
+ *
+ * \return A blob allocated with ralloc off of \c mem_ctx, with its size in
+ *         \c size, or \c NULL if \c prog didn't link.
+ */
+extern void *
+_mesa_glsl_serialize_program(void *mem_ctx, struct gl_context *ctx,
+			     const struct gl_shader_program *prog,
+			     unsigned *size);
+
+/**
+ * Restore the linked state of \c prog from a blob produced by
+ * \c _mesa_glsl_serialize_program, as if \c link_shaders had been run.
+ *
+ * The blob is rejected if it was produced by a different driver, a
+ * different version of Mesa or is damaged.  In that case, \c prog is left
+ * with no linked shaders and \c GL_FALSE is returned.
+ */
+extern GLboolean
+_mesa_glsl_deserialize_program(struct gl_context *ctx,
+			       struct gl_shader_program *prog,
+			       const void *data, unsigned size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GLSL_PROGRAM_BINARY_H */
@@ -144,6 +144,73 @@ s_expression::read_expression(void *ctx, const char *&src)
    return __read_expression(ctx, src, symbol_buffer);
 }
 
+static unsigned
+read_varint(const unsigned char *&src)
+{
+   unsigned value = 0;
+   unsigned shift = 0;
+
+   do {
+      value |= (unsigned) (*src & 0x7f) << shift;
+      shift += 7;
+   } while (*src++ & 0x80);
+
+   return value;
+}
+
+static s_expression *
+__read_binary_expression(void *ctx, const unsigned char *&src,
+                         const char *const *symbols)
+{
+   unsigned tag = read_varint(src);
+
+   switch (tag) {
+   case SX_BINARY_OPEN: {
+      s_list *list = new(ctx) s_list;
+
+      while (*src != SX_BINARY_CLOSE) {
+         s_expression *expr = __read_binary_expression(ctx, src, symbols);
+         if (expr == NULL)
+            return NULL;
+         list->subexpressions.push_tail(expr);
+      }
+      ++src;
+      return list;
+   }
+   case SX_BINARY_CLOSE:
+      printf("Unbalanced binary S-Expression.\n");
+      return NULL;
+   case SX_BINARY_INT: {
+      unsigned zigzag = read_varint(src);
+      return new(ctx) s_int((int) (zigzag >> 1) ^ -(int) (zigzag & 1));
+   }
+   case SX_BINARY_FLOAT: {
+      union {
+         uint32_t u;
+         float f;
+      } bits;
+
+      bits.u = (uint32_t) src[0] | (uint32_t) src[1] << 8 |
+               (uint32_t) src[2] << 16 | (uint32_t) src[3] << 24;
+      src += 4;
+      return new(ctx) s_float(bits.f);
+   }
+   default: {
+      const char *str = symbols[tag - SX_BINARY_SYMBOL];
+      return new(ctx) s_symbol(str, strlen(str));
+   }
+   }
+}
+
+s_expression *
+s_expression::read_binary_expression(void *ctx, const unsigned char *&src,
+                                     const char *const *symbols)
+{
+   assert(src != NULL);
+
+   return __read_binary_expression(ctx, src, symbols);
+}
+
 void s_int::print()
 {
    printf("%d", this->val);
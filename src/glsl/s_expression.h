@@ -42,6 +42,25 @@
 #define MATCH(list, pat) s_match(list, Elements(pat), pat, false)
 #define PARTIAL_MATCH(list, pat) s_match(list, Elements(pat), pat, true)
 
+/**
+ * Tokens of the pre-tokenized S-Expression format, as produced by
+ * builtins/tools/generate_builtins.py.
+ *
+ * Every token is an unsigned LEB128 varint: one of the tags below, or
+ * SX_BINARY_SYMBOL + n for the n-th entry of a symbol table.  An int tag is
+ * followed by the value, zigzag encoded, as another varint; a float tag by
+ * the four bytes of the IEEE single precision value, least significant
+ * first.  Since all tags are below 128, a token starts with an
+ * SX_BINARY_CLOSE byte if and only if it is a closing parenthesis.
+ */
+enum sx_binary_tag {
+   SX_BINARY_OPEN = 0,
+   SX_BINARY_CLOSE = 1,
+   SX_BINARY_INT = 2,
+   SX_BINARY_FLOAT = 3,
+   SX_BINARY_SYMBOL = 4
+};
+
 /* For our purposes, S-Expressions are:
  * - <int>
  * - <float>
@@ -61,6 +80,16 @@ public:
     */
    static s_expression *read_expression(void *ctx, const char *&src);
 
+   /**
+    * Read an S-Expression from the pre-tokenized form described at
+    * \c sx_binary_tag.  Symbols are looked up by index in \p symbols, and
+    * are not copied, so the table must outlive the expression.
+    * Advances the supplied pointer to just after the expression read.
+    */
+   static s_expression *read_binary_expression(void *ctx,
+                                               const unsigned char *&src,
+                                               const char *const *symbols);
+
    /**
     * Print out an S-Expression.  Useful for debugging.
     */
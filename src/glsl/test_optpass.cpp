@@ -36,6 +36,7 @@
 #include <iostream>
 #include <sstream>
 #include <getopt.h>
+#include <time.h>
 
 #include "ast.h"
 #include "ir_optimization.h"
@@ -79,6 +80,8 @@ do_optimization(struct exec_list *ir, const char *optimization)
       return do_copy_propagation_elements(ir);
    } else if (strcmp(optimization, "do_constant_propagation") == 0) {
       return do_constant_propagation(ir);
+   } else if (strcmp(optimization, "do_cse") == 0) {
+      return do_cse(ir);
    } else if (strcmp(optimization, "do_dead_code") == 0) {
       return do_dead_code(ir, false);
    } else if (strcmp(optimization, "do_dead_code_local") == 0) {
@@ -141,7 +144,7 @@ do_optimization(struct exec_list *ir, const char *optimization)
 
 static GLboolean
 do_optimization_passes(struct exec_list *ir, char **optimizations,
-                       int num_optimizations, bool quiet)
+                       int num_optimizations, bool quiet, bool time_passes)
 {
    GLboolean overall_progress = false;
 
@@ -150,7 +153,12 @@ do_optimization_passes(struct exec_list *ir, char **optimizations,
       if (!quiet) {
          printf("*** Running optimization %s...", optimization);
       }
+      clock_t start = clock();
       GLboolean progress = do_optimization(ir, optimization);
+      if (time_passes) {
+         fprintf(stderr, "*** %s: %.0f usecs\n", optimization,
+                 (double) (clock() - start) * 1e6 / CLOCKS_PER_SEC);
+      }
       if (!quiet) {
          printf("%s\n", progress ? "progress" : "no progress");
       }
@@ -168,6 +176,7 @@ int test_optpass(int argc, char **argv)
    int loop = 0;
    int shader_type = GL_VERTEX_SHADER;
    int quiet = 0;
+   int time_passes = 0;
 
    const struct option optpass_opts[] = {
       { "input-ir", no_argument, &input_format_ir, 1 },
@@ -176,6 +185,7 @@ int test_optpass(int argc, char **argv)
       { "vertex-shader", no_argument, &shader_type, GL_VERTEX_SHADER },
       { "fragment-shader", no_argument, &shader_type, GL_FRAGMENT_SHADER },
       { "quiet", no_argument, &quiet, 1 },
+      { "time", no_argument, &time_passes, 1 },
       { NULL, 0, NULL, 0 }
    };
 
@@ -191,6 +201,7 @@ int test_optpass(int argc, char **argv)
          printf("  --loop: run optimizations repeatedly until no progress\n");
          printf("  --vertex-shader: test with a vertex shader (the default)\n");
          printf("  --fragment-shader: test with a fragment shader\n");
+         printf("  --time: print the time each optimization took to stderr\n");
          exit(EXIT_FAILURE);
       }
    }
@@ -242,7 +253,8 @@ int test_optpass(int argc, char **argv)
       GLboolean progress;
       do {
          progress = do_optimization_passes(shader->ir, &argv[optind],
-                                           argc - optind, quiet != 0);
+                                           argc - optind, quiet != 0,
+                                           time_passes != 0);
       } while (loop && progress);
    }
 
@@ -787,6 +787,11 @@ static const struct value_desc values[] = {
    { GL_READ_BUFFER,
      LOC_CUSTOM, TYPE_ENUM, NO_OFFSET, extra_NV_read_buffer_api_gl },
 
+   /* GL_ARB_get_program_binary / GLES 3.0 */
+   { GL_NUM_PROGRAM_BINARY_FORMATS, CONST(1), extra_ARB_shader_objects },
+   { GL_PROGRAM_BINARY_FORMATS,
+     CONST(GL_PROGRAM_BINARY_FORMAT_MESA), extra_ARB_shader_objects },
+
 #endif /* FEATURE_GL || FEATURE_ES2 */
 
 #if FEATURE_ES2
@@ -160,6 +160,16 @@ typedef void *GLeglImageOES;
  */
 #define MESA_GEOMETRY_PROGRAM 0x8c26
 
+
+/**
+ * Format of the binaries returned by glGetProgramBinary(): serialized
+ * linked GLSL IR, only accepted back by the same driver and Mesa version.
+ * Taken from the unused end of the MESA enum range.
+ */
+#ifndef GL_PROGRAM_BINARY_FORMAT_MESA
+#define GL_PROGRAM_BINARY_FORMAT_MESA 0x875F
+#endif
+
 /* Several fields of struct gl_config can take these as values.  Since
  * GLX header files may not be available everywhere they need to be used,
  * redefine them here.
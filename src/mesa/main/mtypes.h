@@ -2190,6 +2190,12 @@ struct gl_shader
    GLboolean CompileStatus;
    const GLchar *Source;  /**< Source code string */
    GLuint SourceChecksum;       /**< for debug/logging purposes */
+   /**
+    * Copy of the source this shader was last compiled from, for the program
+    * cache key, as \c Source may have been replaced since.  Only kept when
+    * the program cache is enabled.
+    */
+   GLchar *CompiledSource;
    struct gl_program *Program;  /**< Post-compile assembly code */
    GLchar *InfoLog;
    struct gl_sl_pragmas Pragmas;
@@ -2398,6 +2404,19 @@ struct gl_shader_program
 
    unsigned Version;       /**< GLSL version used for linking */
 
+   /** GL_PROGRAM_BINARY_RETRIEVABLE_HINT, set with glProgramParameteri() */
+   GLboolean BinaryRetrievableHint;
+
+   /**
+    * Serialized linked program, for glGetProgramBinary() and the on-disk
+    * program cache.
+    *
+    * Only kept when \c BinaryRetrievableHint was set or the program cache
+    * is enabled at link time, \c NULL otherwise.
+    */
+   void *Binary;
+   GLuint BinarySize;
+
    /**
     * Per-stage shaders resulting from the first stage of linking.
     *
@@ -0,0 +1,354 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \file shader_cache.c
+ *
+ * Persistent on-disk cache of linked GLSL programs.
+ *
+ * Each entry is a pair of files named after the 64-bit FNV-1a hash of the
+ * key: "<hash>.key" holds the full key bytes, and "<hash>.bin" the program
+ * binary.  A lookup only succeeds if the stored key matches exactly.
+ *
+ * The key always starts with the identity of the compiler: a format
+ * version, the Mesa version, the renderer and the context state that
+ * compilation and linking depend on.  The caller appends the program
+ * inputs (shader sources, bindings, etc).
+ *
+ * Only linking is skipped on a hit; the shaders are still compiled by
+ * glCompileShader(), and the driver still generates code for the loaded
+ * program.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "main/glheader.h"
+#include "main/imports.h"
+#include "main/macros.h"
+#include "main/mtypes.h"
+#include "main/shader_cache.h"
+#include "main/version.h"
+#include "ralloc.h"
+
+
+/** Bump whenever the cache file layout or key identity changes */
+#define PROGRAM_CACHE_VERSION 1
+
+/** Largest entry we are willing to load */
+#define PROGRAM_CACHE_MAX_SIZE (64 * 1024 * 1024)
+
+
+static const char *
+get_cache_dir(void)
+{
+   static GLboolean first = GL_TRUE;
+   static const char *dir = NULL;
+
+   if (first) {
+      first = GL_FALSE;
+      dir = _mesa_getenv("MESA_GLSL_CACHE_DIR");
+      if (dir && !dir[0])
+         dir = NULL;
+   }
+
+   return dir;
+}
+
+
+GLboolean
+_mesa_program_cache_enabled(void)
+{
+   return get_cache_dir() != NULL;
+}
+
+
+/**
+ * Initialize the key with the compiler identity.
+ */
+void
+_mesa_program_cache_key_init(struct gl_context *ctx,
+                             struct program_cache_key *key)
+{
+   const GLubyte *renderer = NULL;
+   unsigned identity[4];
+
+   memset(key, 0, sizeof *key);
+   key->hash = 0xcbf29ce484222325ULL;  /* FNV-1a 64-bit offset basis */
+
+   identity[0] = PROGRAM_CACHE_VERSION;
+   identity[1] = ctx->API;
+   identity[2] = sizeof(void *);
+   identity[3] = ctx->Shader.Flags & (GLSL_OPT | GLSL_NO_OPT |
+                                      GLSL_NOP_VERT | GLSL_NOP_FRAG);
+   _mesa_program_cache_key_add(key, identity, sizeof identity);
+
+   _mesa_program_cache_key_add_string(key, MESA_VERSION_STRING);
+   if (ctx->Driver.GetString)
+      renderer = ctx->Driver.GetString(ctx, GL_RENDERER);
+   _mesa_program_cache_key_add_string(key,
+                                      renderer ? (const char *) renderer : "");
+
+   /* Limits, enabled extensions and compiler options all affect the IR
+    * produced by the compiler and the linker.  The context is
+    * zero-allocated, so padding is stable.  Of the extensions only the
+    * flags are added, as the extension string is a heap pointer that
+    * differs in every process.
+    */
+   _mesa_program_cache_key_add(key, &ctx->Const, sizeof ctx->Const);
+   _mesa_program_cache_key_add(key, &ctx->Extensions,
+                               offsetof(struct gl_extensions, String));
+   _mesa_program_cache_key_add(key, ctx->ShaderCompilerOptions,
+                               sizeof ctx->ShaderCompilerOptions);
+}
+
+
+void
+_mesa_program_cache_key_add(struct program_cache_key *key,
+                            const void *data, unsigned size)
+{
+   const uint8_t *bytes = (const uint8_t *) data;
+   unsigned i;
+
+   if (key->size + size > key->max_size) {
+      unsigned new_size = MAX2(key->size + size, 2 * key->max_size);
+      new_size = MAX2(new_size, 1024);
+      key->data = _mesa_realloc(key->data, key->max_size, new_size);
+      key->max_size = new_size;
+      if (!key->data) {
+         key->size = key->max_size = 0;
+         return;
+      }
+   }
+
+   memcpy(key->data + key->size, bytes, size);
+   key->size += size;
+
+   for (i = 0; i < size; i++) {
+      key->hash ^= bytes[i];
+      key->hash *= 0x100000001b3ULL;  /* FNV-1a 64-bit prime */
+   }
+}
+
+
+/**
+ * Add a string, including its terminator so that consecutive strings
+ * can't run into each other.  \c NULL is added as an empty string.
+ */
+void
+_mesa_program_cache_key_add_string(struct program_cache_key *key,
+                                   const char *str)
+{
+   if (!str)
+      str = "";
+   _mesa_program_cache_key_add(key, str, strlen(str) + 1);
+}
+
+
+void
+_mesa_program_cache_key_cleanup(struct program_cache_key *key)
+{
+   free(key->data);
+   memset(key, 0, sizeof *key);
+}
+
+
+static void
+get_filename(char *filename, size_t size,
+             const struct program_cache_key *key,
+             const char *suffix)
+{
+   _mesa_snprintf(filename, size, "%s/%08x%08x%s",
+                  get_cache_dir(),
+                  (unsigned) (key->hash >> 32),
+                  (unsigned) (key->hash & 0xffffffff),
+                  suffix);
+}
+
+
+/**
+ * Check that the stored key matches exactly.
+ */
+static GLboolean
+key_matches(const struct program_cache_key *key)
+{
+   char filename[1024];
+   GLboolean match = GL_FALSE;
+   uint8_t *data;
+   FILE *f;
+
+   get_filename(filename, sizeof filename, key, ".key");
+
+   f = fopen(filename, "rb");
+   if (!f)
+      return GL_FALSE;
+
+   data = malloc(key->size + 1);
+   if (data) {
+      /* read one more byte than expected to detect longer keys */
+      if (fread(data, 1, key->size + 1, f) == key->size &&
+          memcmp(data, key->data, key->size) == 0) {
+         match = GL_TRUE;
+      }
+      free(data);
+   }
+
+   fclose(f);
+   return match;
+}
+
+
+/**
+ * Look up a program binary in the cache.
+ *
+ * \return The binary, allocated with ralloc off of \c mem_ctx, with its
+ *         size in \c size, or \c NULL on a miss.
+ */
+void *
+_mesa_program_cache_load(void *mem_ctx, const struct program_cache_key *key,
+                         unsigned *size)
+{
+   char filename[1024];
+   void *data = NULL;
+   long length;
+   FILE *f;
+
+   if (!_mesa_program_cache_enabled() || !key->data)
+      return NULL;
+
+   if (!key_matches(key))
+      return NULL;
+
+   get_filename(filename, sizeof filename, key, ".bin");
+
+   f = fopen(filename, "rb");
+   if (!f)
+      return NULL;
+
+   if (fseek(f, 0, SEEK_END) == 0 &&
+       (length = ftell(f)) > 0 && length <= PROGRAM_CACHE_MAX_SIZE &&
+       fseek(f, 0, SEEK_SET) == 0) {
+      data = ralloc_size(mem_ctx, length);
+      if (data && fread(data, 1, length, f) == (size_t) length) {
+         *size = length;
+      } else {
+         ralloc_free(data);
+         data = NULL;
+      }
+   }
+
+   fclose(f);
+   return data;
+}
+
+
+/**
+ * Create a temporary file next to \c filename, with a name no other
+ * process or thread is using.
+ */
+static FILE *
+open_temp_file(const char *filename, char *tmpname, size_t size)
+{
+#ifdef _WIN32
+   _mesa_snprintf(tmpname, size, "%s.%d.tmp", filename, _getpid());
+   return fopen(tmpname, "wb");
+#else
+   FILE *f;
+   int fd;
+
+   _mesa_snprintf(tmpname, size, "%s.XXXXXX", filename);
+
+   fd = mkstemp(tmpname);
+   if (fd < 0)
+      return NULL;
+
+   f = fdopen(fd, "wb");
+   if (!f) {
+      close(fd);
+      remove(tmpname);
+   }
+   return f;
+#endif
+}
+
+
+/**
+ * Write a file atomically, by writing a temporary file and renaming it.
+ * Concurrent processes may be storing the same entry; each writes its own
+ * temporary file, and the last rename wins.
+ */
+static GLboolean
+write_file(const char *filename, const void *data, unsigned size)
+{
+   char tmpname[1024];
+   GLboolean ok;
+   FILE *f;
+
+   f = open_temp_file(filename, tmpname, sizeof tmpname);
+   if (!f)
+      return GL_FALSE;
+
+   ok = fwrite(data, 1, size, f) == size;
+   ok = (fclose(f) == 0) && ok;
+
+   if (ok)
+      ok = rename(tmpname, filename) == 0;
+
+   if (!ok)
+      remove(tmpname);
+
+   return ok;
+}
+
+
+/**
+ * Store a program binary in the cache.
+ */
+GLboolean
+_mesa_program_cache_store(const struct program_cache_key *key,
+                          const void *data, unsigned size)
+{
+   char filename[1024];
+
+   if (!_mesa_program_cache_enabled() || !key->data)
+      return GL_FALSE;
+
+   /* Remove any key file first, as it may belong to a different key with
+    * the same hash, then write the binary, so that a key file always
+    * refers to a complete binary for that key.
+    */
+   get_filename(filename, sizeof filename, key, ".key");
+   remove(filename);
+
+   get_filename(filename, sizeof filename, key, ".bin");
+   if (!write_file(filename, data, size))
+      return GL_FALSE;
+
+   get_filename(filename, sizeof filename, key, ".key");
+   return write_file(filename, key->data, key->size);
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \file shader_cache.h
+ *
+ * Persistent on-disk cache of linked GLSL programs.
+ *
+ * Programs are stored in the format of glGetProgramBinary(), in the
+ * directory named by the MESA_GLSL_CACHE_DIR environment variable.  The
+ * cache is disabled when the variable is not set.
+ */
+
+#ifndef SHADER_CACHE_H
+#define SHADER_CACHE_H
+
+#include "main/compiler.h"
+#include "main/glheader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct gl_context;
+
+
+/**
+ * Cache lookup key.  Holds the raw bytes of everything the link result
+ * depends on, so that a hash collision can never return the wrong program.
+ */
+struct program_cache_key
+{
+   uint64_t hash;
+   unsigned size;
+   unsigned max_size;
+   uint8_t *data;
+};
+
+
+extern GLboolean
+_mesa_program_cache_enabled(void);
+
+extern void
+_mesa_program_cache_key_init(struct gl_context *ctx,
+                             struct program_cache_key *key);
+
+extern void
+_mesa_program_cache_key_add(struct program_cache_key *key,
+                            const void *data, unsigned size);
+
+extern void
+_mesa_program_cache_key_add_string(struct program_cache_key *key,
+                                   const char *str);
+
+extern void
+_mesa_program_cache_key_cleanup(struct program_cache_key *key);
+
+extern void *
+_mesa_program_cache_load(void *mem_ctx, const struct program_cache_key *key,
+                         unsigned *size);
+
+extern GLboolean
+_mesa_program_cache_store(const struct program_cache_key *key,
+                          const void *data, unsigned size);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SHADER_CACHE_H */
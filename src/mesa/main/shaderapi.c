@@ -496,6 +496,10 @@ get_programiv(struct gl_context *ctx, GLuint program, GLenum pname, GLint *param
       || ctx->API == API_OPENGL_CORE
       || _mesa_is_gles3(ctx);
 
+   /* Is ARB_get_program_binary available in this context?
+    */
+   const bool has_binary = _mesa_is_desktop_gl(ctx) || _mesa_is_gles3(ctx);
+
    if (!shProg) {
       _mesa_error(ctx, GL_INVALID_VALUE, "glGetProgramiv(program)");
       return;
@@ -601,6 +605,16 @@ get_programiv(struct gl_context *ctx, GLuint program, GLenum pname, GLint *param
 
       *params = shProg->NumUniformBlocks;
       return;
+   case GL_PROGRAM_BINARY_LENGTH:
+      if (!has_binary)
+         break;
+      *params = shProg->LinkStatus ? shProg->BinarySize : 0;
+      return;
+   case GL_PROGRAM_BINARY_RETRIEVABLE_HINT:
+      if (!has_binary)
+         break;
+      *params = shProg->BinaryRetrievableHint;
+      return;
    default:
       break;
    }
@@ -1533,8 +1547,10 @@ _mesa_ShaderBinary(GLint n, const GLuint* shaders, GLenum binaryformat,
 #endif /* FEATURE_ES2 */
 
 
-#if FEATURE_ARB_geometry_shader4
-
+/**
+ * glProgramParameteri() of ARB_get_program_binary and
+ * glProgramParameteriARB() of ARB_geometry_shader4.
+ */
 void GLAPIENTRY
 _mesa_ProgramParameteriARB(GLuint program, GLenum pname, GLint value)
 {
@@ -1549,6 +1565,17 @@ _mesa_ProgramParameteriARB(GLuint program, GLenum pname, GLint value)
       return;
 
    switch (pname) {
+   case GL_PROGRAM_BINARY_RETRIEVABLE_HINT:
+      if (value != GL_FALSE && value != GL_TRUE) {
+         _mesa_error(ctx, GL_INVALID_VALUE,
+                     "glProgramParameteri(GL_PROGRAM_BINARY_RETRIEVABLE_HINT"
+                     "=%d)", value);
+         return;
+      }
+      /* Takes effect on the next glLinkProgram() */
+      shProg->BinaryRetrievableHint = value;
+      break;
+#if FEATURE_ARB_geometry_shader4
    case GL_GEOMETRY_VERTICES_OUT_ARB:
       if (value < 1 ||
           (unsigned) value > ctx->Const.MaxGeometryOutputVertices) {
@@ -1589,6 +1616,7 @@ _mesa_ProgramParameteriARB(GLuint program, GLenum pname, GLint value)
          return;
       }
       break;
+#endif
    default:
       _mesa_error(ctx, GL_INVALID_ENUM, "glProgramParameteriARB(pname=%s)",
                   _mesa_lookup_enum_by_nr(pname));
@@ -1596,7 +1624,6 @@ _mesa_ProgramParameteriARB(GLuint program, GLenum pname, GLint value)
    }
 }
 
-#endif
 
 void
 _mesa_use_shader_program(struct gl_context *ctx, GLenum type,
@@ -1712,6 +1739,96 @@ _mesa_CreateShaderProgramEXT(GLenum type, const GLchar *string)
    return program;
 }
 
+/**
+ * glGetProgramBinary() - ARB_get_program_binary
+ */
+void GLAPIENTRY
+_mesa_GetProgramBinary(GLuint program, GLsizei bufSize, GLsizei *length,
+                       GLenum *binaryFormat, GLvoid *binary)
+{
+   struct gl_shader_program *shProg;
+   GET_CURRENT_CONTEXT(ctx);
+
+   ASSERT_OUTSIDE_BEGIN_END(ctx);
+
+   shProg = _mesa_lookup_shader_program_err(ctx, program,
+                                            "glGetProgramBinary");
+   if (!shProg)
+      return;
+
+   if (!shProg->LinkStatus) {
+      _mesa_error(ctx, GL_INVALID_OPERATION,
+                  "glGetProgramBinary(program not linked)");
+      return;
+   }
+
+   if (bufSize < 0 || (GLuint) bufSize < shProg->BinarySize) {
+      _mesa_error(ctx, GL_INVALID_OPERATION, "glGetProgramBinary(bufSize)");
+      return;
+   }
+
+   /* The binary is only kept when GL_PROGRAM_BINARY_RETRIEVABLE_HINT was set
+    * at link time, otherwise GL_PROGRAM_BINARY_LENGTH is 0 and so is the
+    * length returned here.
+    */
+   if (length)
+      *length = shProg->BinarySize;
+   *binaryFormat = GL_PROGRAM_BINARY_FORMAT_MESA;
+   if (shProg->BinarySize)
+      memcpy(binary, shProg->Binary, shProg->BinarySize);
+}
+
+
+/**
+ * glProgramBinary() - ARB_get_program_binary
+ *
+ * Loading a binary replaces the results of the last link, like
+ * glLinkProgram() does.  A binary we can't load is not an error: the
+ * program is just left unlinked, and the application is expected to fall
+ * back to linking from source.
+ */
+void GLAPIENTRY
+_mesa_ProgramBinary(GLuint program, GLenum binaryFormat,
+                    const GLvoid *binary, GLsizei length)
+{
+   struct gl_shader_program *shProg;
+   struct gl_transform_feedback_object *obj;
+   GET_CURRENT_CONTEXT(ctx);
+
+   ASSERT_OUTSIDE_BEGIN_END(ctx);
+
+   shProg = _mesa_lookup_shader_program_err(ctx, program, "glProgramBinary");
+   if (!shProg)
+      return;
+
+   if (binaryFormat != GL_PROGRAM_BINARY_FORMAT_MESA) {
+      _mesa_error(ctx, GL_INVALID_ENUM, "glProgramBinary(binaryFormat=%s)",
+                  _mesa_lookup_enum_by_nr(binaryFormat));
+      return;
+   }
+
+   obj = ctx->TransformFeedback.CurrentObject;
+   if (obj->Active
+       && (shProg == ctx->Shader.CurrentVertexProgram
+	   || shProg == ctx->Shader.CurrentGeometryProgram
+	   || shProg == ctx->Shader.CurrentFragmentProgram)) {
+      _mesa_error(ctx, GL_INVALID_OPERATION,
+                  "glProgramBinary(transform feedback active)");
+      return;
+   }
+
+   FLUSH_VERTICES(ctx, _NEW_PROGRAM);
+
+   _mesa_glsl_program_binary(ctx, shProg, binary, length > 0 ? length : 0);
+
+   if (shProg->LinkStatus == GL_FALSE &&
+       (ctx->Shader.Flags & GLSL_REPORT_ERRORS)) {
+      _mesa_debug(ctx, "Error loading binary of program %u:\n%s\n",
+                  shProg->Name, shProg->InfoLog);
+   }
+}
+
+
 /**
  * Plug in shader-related functions into API dispatch table.
  */
@@ -1762,6 +1879,11 @@ _mesa_init_shader_dispatch(struct _glapi_table *exec)
    SET_ProgramParameteriARB(exec, _mesa_ProgramParameteriARB);
 #endif
 
+   /* GL_ARB_get_program_binary */
+   SET_GetProgramBinary(exec, _mesa_GetProgramBinary);
+   SET_ProgramBinary(exec, _mesa_ProgramBinary);
+   SET_ProgramParameteri(exec, _mesa_ProgramParameteriARB);
+
    SET_UseShaderProgramEXT(exec, _mesa_UseShaderProgramEXT);
    SET_ActiveProgramEXT(exec, _mesa_ActiveProgramEXT);
    SET_CreateShaderProgramEXT(exec, _mesa_CreateShaderProgramEXT);
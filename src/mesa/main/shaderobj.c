@@ -290,6 +290,12 @@ _mesa_clear_shader_program_data(struct gl_context *ctx,
       shProg->UniformHash = NULL;
    }
 
+   if (shProg->Binary) {
+      ralloc_free(shProg->Binary);
+      shProg->Binary = NULL;
+      shProg->BinarySize = 0;
+   }
+
    assert(shProg->InfoLog != NULL);
    ralloc_free(shProg->InfoLog);
    shProg->InfoLog = ralloc_strdup(shProg, "");
@@ -272,7 +272,31 @@ public:
 	 free(dup_key);
    }
 
+   /**
+    * Call \c func on every mapping, in no particular order
+    */
+   void iterate(void (*func)(const char *, unsigned, void *), void *closure)
+   {
+      struct iterate_closure wrapper = { func, closure };
+
+      hash_table_call_foreach(this->ht, call_iterate_func, &wrapper);
+   }
+
 private:
+   struct iterate_closure {
+      void (*func)(const char *, unsigned, void *);
+      void *closure;
+   };
+
+   static void call_iterate_func(const void *key, void *data, void *closure)
+   {
+      struct iterate_closure *wrapper = (struct iterate_closure *) closure;
+
+      /* Undo the bias applied by ::put. */
+      wrapper->func((const char *) key, (unsigned) ((intptr_t) data - 1),
+                    wrapper->closure);
+   }
+
    static void delete_key(const void *key, void *data, void *closure)
    {
       (void) data;
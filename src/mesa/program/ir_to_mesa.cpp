@@ -42,9 +42,11 @@
 #include "ir_optimization.h"
 #include "ast.h"
 #include "linker.h"
+#include "program_binary.h"
 
 #include "main/mtypes.h"
 #include "main/shaderobj.h"
+#include "main/shader_cache.h"
 #include "program/hash_table.h"
 
 extern "C" {
@@ -3075,6 +3077,11 @@ _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader)
      _mesa_glsl_lexer_dtor(state);
    }
 
+   ralloc_free(shader->CompiledSource);
+   shader->CompiledSource = NULL;
+   if (_mesa_program_cache_enabled())
+      shader->CompiledSource = ralloc_strdup(shader, shader->Source);
+
    ralloc_free(shader->ir);
    shader->ir = new(shader) exec_list;
    if (!state->error && !state->translation_unit.is_empty())
@@ -3086,8 +3093,7 @@ _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader)
       /* Do some optimization at compile time to reduce shader IR size
        * and reduce later work if the same shader is linked multiple times
        */
-      while (do_common_optimization(shader->ir, false, false, 32))
-	 ;
+      do_common_optimization(shader->ir, false, false, 32);
 
       validate_ir_tree(shader->ir);
    }
@@ -3132,12 +3138,125 @@ _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader)
 }
 
 
+static void
+add_binding_to_cache_key(const char *name, unsigned value, void *closure)
+{
+   struct program_cache_key *key = (struct program_cache_key *) closure;
+
+   _mesa_program_cache_key_add_string(key, name);
+   _mesa_program_cache_key_add(key, &value, sizeof(value));
+}
+
+
+static void
+add_bindings_to_cache_key(struct program_cache_key *key,
+			  struct string_to_uint_map *map)
+{
+   if (map)
+      map->iterate(add_binding_to_cache_key, key);
+
+   /* No variable has an empty name, so this terminates the list. */
+   _mesa_program_cache_key_add_string(key, "");
+}
+
+
+/**
+ * Whether all shaders of \c prog were compiled from source.  Shaders built
+ * directly as IR, like those of fixed-function fragment programs, have no
+ * source to identify them in the program cache key.
+ */
+static bool
+program_has_compiled_source(const struct gl_shader_program *prog)
+{
+   for (unsigned i = 0; i < prog->NumShaders; i++) {
+      if (prog->Shaders[i]->CompiledSource == NULL)
+	 return false;
+   }
+
+   return true;
+}
+
+
+/**
+ * Build the program cache key of \c prog from everything \c link_shaders
+ * depends on, besides the context state in the key identity.
+ */
+static void
+get_program_cache_key(struct gl_context *ctx, struct gl_shader_program *prog,
+		      struct program_cache_key *key)
+{
+   unsigned header[7];
+
+   _mesa_program_cache_key_init(ctx, key);
+
+   header[0] = prog->NumShaders;
+   header[1] = prog->InternalSeparateShader;
+   header[2] = prog->Geom.VerticesOut;
+   header[3] = prog->Geom.InputType;
+   header[4] = prog->Geom.OutputType;
+   header[5] = prog->TransformFeedback.BufferMode;
+   header[6] = prog->TransformFeedback.NumVarying;
+   _mesa_program_cache_key_add(key, header, sizeof(header));
+
+   for (unsigned i = 0; i < prog->NumShaders; i++) {
+      _mesa_program_cache_key_add(key, &prog->Shaders[i]->Type,
+				  sizeof(prog->Shaders[i]->Type));
+      _mesa_program_cache_key_add_string(key,
+					 prog->Shaders[i]->CompiledSource);
+   }
+
+   for (unsigned i = 0; i < prog->TransformFeedback.NumVarying; i++) {
+      _mesa_program_cache_key_add_string(key,
+					 prog->TransformFeedback.VaryingNames[i]);
+   }
+
+   add_bindings_to_cache_key(key, prog->AttributeBindings);
+   add_bindings_to_cache_key(key, prog->FragDataBindings);
+   add_bindings_to_cache_key(key, prog->FragDataIndexBindings);
+}
+
+
+/**
+ * Try to restore the results of \c link_shaders from the program cache.
+ */
+static bool
+link_shaders_from_cache(struct gl_context *ctx,
+			struct gl_shader_program *prog,
+			const struct program_cache_key *key)
+{
+   unsigned size;
+   void *binary = _mesa_program_cache_load(prog, key, &size);
+
+   if (binary == NULL)
+      return false;
+
+   if (!_mesa_glsl_deserialize_program(ctx, prog, binary, size)) {
+      /* Most likely from an older build.  It gets replaced once the
+       * program is linked from source.
+       */
+      ralloc_free(binary);
+      _mesa_clear_shader_program_data(ctx, prog);
+      prog->LinkStatus = GL_TRUE;
+      return false;
+   }
+
+   prog->Binary = binary;
+   prog->BinarySize = size;
+   return true;
+}
+
+
 /**
  * Link a GLSL shader program.  Called via glLinkProgram().
+ *
+ * If the program cache is enabled, \c link_shaders is skipped when the same
+ * program was linked before.
  */
 void
 _mesa_glsl_link_shader(struct gl_context *ctx, struct gl_shader_program *prog)
 {
+   struct program_cache_key key;
+   bool use_cache = false;
    unsigned int i;
 
    _mesa_clear_shader_program_data(ctx, prog);
@@ -3151,10 +3270,30 @@ _mesa_glsl_link_shader(struct gl_context *ctx, struct gl_shader_program *prog)
       }
    }
 
-   if (prog->LinkStatus) {
+   if (prog->LinkStatus && _mesa_program_cache_enabled() &&
+       program_has_compiled_source(prog)) {
+      get_program_cache_key(ctx, prog, &key);
+      use_cache = true;
+   }
+
+   if (prog->LinkStatus &&
+       !(use_cache && link_shaders_from_cache(ctx, prog, &key))) {
       link_shaders(ctx, prog);
+
+      /* The driver is free to lower the linked IR in place, so this is the
+       * last chance to serialize it.
+       */
+      if (prog->LinkStatus && (prog->BinaryRetrievableHint || use_cache)) {
+	 prog->Binary = _mesa_glsl_serialize_program(prog, ctx, prog,
+						     &prog->BinarySize);
+	 if (prog->Binary && use_cache)
+	    _mesa_program_cache_store(&key, prog->Binary, prog->BinarySize);
+      }
    }
 
+   if (use_cache)
+      _mesa_program_cache_key_cleanup(&key);
+
    if (prog->LinkStatus) {
       if (!ctx->Driver.LinkShader(ctx, prog)) {
 	 prog->LinkStatus = GL_FALSE;
@@ -3173,4 +3312,30 @@ _mesa_glsl_link_shader(struct gl_context *ctx, struct gl_shader_program *prog)
    }
 }
 
+
+
+/**
+ * Load a program binary.  Called via glProgramBinary().
+ */
+void
+_mesa_glsl_program_binary(struct gl_context *ctx,
+			  struct gl_shader_program *prog,
+			  const void *binary, unsigned size)
+{
+   _mesa_clear_shader_program_data(ctx, prog);
+
+   if (!_mesa_glsl_deserialize_program(ctx, prog, binary, size)) {
+      linker_error(prog, "program binary was not created by this driver "
+		   "and version of Mesa\n");
+   } else if (!ctx->Driver.LinkShader(ctx, prog)) {
+      prog->LinkStatus = GL_FALSE;
+   }
+
+   if (prog->LinkStatus && prog->BinaryRetrievableHint) {
+      prog->Binary = ralloc_size(prog, size);
+      memcpy(prog->Binary, binary, size);
+      prog->BinarySize = size;
+   }
+}
+
 } /* extern "C" */
@@ -78,6 +78,7 @@ MAIN_FILES = \
 	$(SRCDIR)main/scissor.c \
 	$(SRCDIR)main/shaderapi.c \
 	$(SRCDIR)main/shaderobj.c \
+	$(SRCDIR)main/shader_cache.c \
 	$(SRCDIR)main/shared.c \
 	$(SRCDIR)main/state.c \
 	$(SRCDIR)main/stencil.c \